@@ -0,0 +1,286 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "base.h"
+#include "bitmap.h"
+
+// Adds a container for the records set in words (a bitmap of BITMAP_CHUNK bits). Empty chunks are not stored.
+void bitmaps_add(struct bitmaps *restrict bitmaps, uint32_t chunk, const uint64_t *restrict words)
+{
+	struct bitmap_container *container;
+	size_t cardinality = 0, size;
+	size_t word;
+
+	for(word = 0; word < BITMAP_WORDS; ++word)
+		cardinality += __builtin_popcountll(words[word]);
+	if (!cardinality)
+		return;
+
+	if (cardinality <= BITMAP_ARRAY_LIMIT)
+		size = (cardinality * sizeof(uint16_t) + sizeof(uint64_t) - 1) / sizeof(uint64_t) * sizeof(uint64_t);
+	else
+		size = BITMAP_WORDS * sizeof(uint64_t);
+
+	if (bitmaps->count == bitmaps->capacity)
+	{
+		bitmaps->capacity = (bitmaps->capacity ? bitmaps->capacity * 2 : 64);
+		bitmaps->containers = realloc(bitmaps->containers, bitmaps->capacity * sizeof(*bitmaps->containers));
+		if (!bitmaps->containers)
+			abort();
+	}
+	if (bitmaps->size + size > bitmaps->data_capacity)
+	{
+		size_t capacity = (bitmaps->data_capacity ? bitmaps->data_capacity * 2 : 65536);
+		while (capacity < bitmaps->size + size)
+			capacity *= 2;
+		bitmaps->data = realloc(bitmaps->data, capacity);
+		if (!bitmaps->data)
+			abort();
+		bitmaps->data_capacity = capacity;
+	}
+
+	container = bitmaps->containers + bitmaps->count++;
+	container->chunk = chunk;
+	container->cardinality = cardinality;
+	container->offset = bitmaps->size;
+
+	if (cardinality <= BITMAP_ARRAY_LIMIT)
+	{
+		uint16_t *values = (uint16_t *)(bitmaps->data + bitmaps->size);
+		size_t index = 0;
+
+		memset(values, 0, size);
+		for(word = 0; word < BITMAP_WORDS; ++word)
+		{
+			uint64_t bits = words[word];
+			while (bits)
+			{
+				values[index++] = word * 64 + __builtin_ctzll(bits);
+				bits &= bits - 1;
+			}
+		}
+	}
+	else
+		memcpy(bitmaps->data + bitmaps->size, words, size);
+	bitmaps->size += size;
+}
+
+void bitmaps_term(struct bitmaps *restrict bitmaps)
+{
+	free(bitmaps->data);
+	free(bitmaps->containers);
+}
+
+// Returns the container of the bitmap for the given chunk or NULL if the bitmap has no records in it.
+static const struct bitmap_container *container_find(const struct bitmap_index *restrict index, uint32_t bitmap, uint32_t chunk)
+{
+	size_t low, high;
+
+	if (bitmap >= index->count)
+		return 0;
+
+	low = index->starts[bitmap];
+	high = index->starts[bitmap + 1];
+	while (low < high)
+	{
+		size_t middle = (high - low) / 2 + low;
+		if (index->containers[middle].chunk < chunk)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	if ((low < index->starts[bitmap + 1]) && (index->containers[low].chunk == chunk))
+		return index->containers + low;
+	return 0;
+}
+
+// Sets the bits of the records in the container. Returns error code if the container is not inside the data.
+static int container_or(const struct bitmap_index *restrict index, const struct bitmap_container *restrict container, uint64_t *restrict words)
+{
+	size_t word;
+
+	if (container->cardinality <= BITMAP_ARRAY_LIMIT)
+	{
+		const uint16_t *values = (const uint16_t *)(index->data + container->offset);
+		size_t i;
+
+		if ((container->offset > index->data_size) || (container->cardinality > (index->data_size - container->offset) / sizeof(*values)))
+			return ERROR_INPUT;
+		for(i = 0; i < container->cardinality; ++i)
+			words[values[i] / 64] |= (uint64_t)1 << (values[i] % 64);
+	}
+	else
+	{
+		const uint64_t *bits = (const uint64_t *)(index->data + container->offset);
+
+		if ((container->offset > index->data_size) || (BITMAP_WORDS > (index->data_size - container->offset) / sizeof(*bits)))
+			return ERROR_INPUT;
+		for(word = 0; word < BITMAP_WORDS; ++word)
+			words[word] |= bits[word];
+	}
+
+	return 0;
+}
+
+// Computes the union of the group of bitmaps in the chunk.
+// Returns whether any of the bitmaps has records in the chunk or error code.
+static int group_chunk(const struct bitmap_index *restrict index, const uint32_t *restrict bitmaps, size_t count, uint32_t chunk, uint64_t *restrict words)
+{
+	int found = 0;
+	size_t i;
+	int status;
+
+	memset(words, 0, BITMAP_WORDS * sizeof(*words));
+	for(i = 0; i < count; ++i)
+	{
+		const struct bitmap_container *container = container_find(index, bitmaps[i], chunk);
+		if (!container)
+			continue;
+		if (status = container_or(index, container, words))
+			return status;
+		found = 1;
+	}
+
+	return found;
+}
+
+// Returns the total number of records in the bitmaps (records in more than one bitmap are counted more than once).
+uint64_t bitmap_cardinality(const struct bitmap_index *restrict index, const uint32_t *restrict bitmaps, size_t count)
+{
+	uint64_t cardinality = 0;
+	size_t i, container;
+
+	for(i = 0; i < count; ++i)
+	{
+		if (bitmaps[i] >= index->count)
+			continue;
+		for(container = index->starts[bitmaps[i]]; container < index->starts[bitmaps[i] + 1]; ++container)
+			cardinality += index->containers[container].cardinality;
+	}
+
+	return cardinality;
+}
+
+// Finds the records that are in at least one bitmap of each group.
+// bitmaps lists the bitmaps of the first group, followed by the bitmaps of the second group, etc.; groups holds the number of bitmaps in each group.
+// On success, stores the records in ascending order in an allocated array and returns their number.
+// The time is proportional to the number of records in the bitmaps of the smallest group.
+ssize_t bitmap_search(const struct bitmap_index *restrict index, const uint32_t *restrict bitmaps, const size_t *restrict groups, size_t groups_count, uint64_t **restrict records)
+{
+	const uint32_t *driver = 0;
+	size_t driver_count = 0;
+	uint64_t smallest = UINT64_MAX;
+	size_t *positions;
+	uint64_t *words, *group;
+	ssize_t count = 0;
+	size_t g, i, word, offset;
+	int status = 0;
+
+	// Start with the group with the fewest records.
+	for(g = 0, offset = 0; g < groups_count; offset += groups[g++])
+	{
+		uint64_t cardinality = bitmap_cardinality(index, bitmaps + offset, groups[g]);
+		if (cardinality < smallest)
+		{
+			smallest = cardinality;
+			driver = bitmaps + offset;
+			driver_count = groups[g];
+		}
+	}
+	if (!smallest || !driver)
+	{
+		*records = 0;
+		return 0;
+	}
+
+	positions = alloc(driver_count * sizeof(*positions));
+	for(i = 0; i < driver_count; ++i)
+		positions[i] = ((driver[i] < index->count) ? index->starts[driver[i]] : 0);
+	words = alloc(2 * BITMAP_WORDS * sizeof(*words));
+	group = words + BITMAP_WORDS;
+	*records = alloc(smallest * sizeof(**records));
+
+	while (1)
+	{
+		uint32_t chunk = UINT32_MAX;
+		int found = 0;
+
+		// Find the next chunk with records from the driving group.
+		for(i = 0; i < driver_count; ++i)
+			if ((driver[i] < index->count) && (positions[i] < index->starts[driver[i] + 1]) && (index->containers[positions[i]].chunk <= chunk))
+			{
+				chunk = index->containers[positions[i]].chunk;
+				found = 1;
+			}
+		if (!found)
+			break;
+
+		memset(words, 0, BITMAP_WORDS * sizeof(*words));
+		for(i = 0; i < driver_count; ++i)
+			if ((driver[i] < index->count) && (positions[i] < index->starts[driver[i] + 1]) && (index->containers[positions[i]].chunk == chunk))
+			{
+				if (status = container_or(index, index->containers + positions[i], words))
+					goto finally;
+				positions[i] += 1;
+			}
+
+		// Keep only the records that are also in the other groups.
+		for(g = 0, offset = 0; g < groups_count; offset += groups[g++])
+		{
+			if (bitmaps + offset == driver)
+				continue;
+			status = group_chunk(index, bitmaps + offset, groups[g], chunk, group);
+			if (status < 0)
+				goto finally;
+			if (!status)
+				break;
+			for(word = 0; word < BITMAP_WORDS; ++word)
+				words[word] &= group[word];
+		}
+		status = 0;
+		if (g < groups_count)
+			continue; // some group has no records in the chunk
+
+		for(word = 0; word < BITMAP_WORDS; ++word)
+		{
+			uint64_t bits = words[word];
+			while (bits && ((uint64_t)count < smallest))
+			{
+				(*records)[count++] = (uint64_t)chunk * BITMAP_CHUNK + word * 64 + __builtin_ctzll(bits);
+				bits &= bits - 1;
+			}
+		}
+	}
+
+finally:
+	free(words);
+	free(positions);
+	if (status)
+	{
+		free(*records);
+		return status;
+	}
+	return count;
+}
@@ -0,0 +1,58 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Compressed bitmaps of records (similar to Roaring bitmaps).
+// The records are split in chunks of BITMAP_CHUNK. The records of a bitmap in each non-empty chunk are stored in a container:
+// a sorted array of 16-bit values if there are at most BITMAP_ARRAY_LIMIT of them or a bitmap of BITMAP_CHUNK bits otherwise.
+// Arrays are padded to a multiple of 8 bytes.
+
+#define BITMAP_CHUNK 65536
+#define BITMAP_WORDS (BITMAP_CHUNK / 64)
+#define BITMAP_ARRAY_LIMIT 4096
+
+struct bitmap_container
+{
+	uint32_t chunk;
+	uint32_t cardinality;
+	uint64_t offset; // offset of the values in data
+};
+
+struct bitmap_index
+{
+	uint64_t count; // number of bitmaps
+	const uint64_t *starts; // first container of each bitmap; followed by the number of containers
+	const struct bitmap_container *containers;
+	const unsigned char *data;
+	size_t data_size;
+};
+
+// Builder for a list of containers and their data.
+struct bitmaps
+{
+	size_t count, capacity;
+	struct bitmap_container *containers;
+	size_t size, data_capacity;
+	unsigned char *data;
+};
+
+void bitmaps_add(struct bitmaps *restrict bitmaps, uint32_t chunk, const uint64_t *restrict words);
+void bitmaps_term(struct bitmaps *restrict bitmaps);
+
+uint64_t bitmap_cardinality(const struct bitmap_index *restrict index, const uint32_t *restrict bitmaps, size_t count);
+ssize_t bitmap_search(const struct bitmap_index *restrict index, const uint32_t *restrict bitmaps, const size_t *restrict groups, size_t groups_count, uint64_t **restrict records);
@@ -0,0 +1,85 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "base.h"
+#include "bloom.h"
+
+#define HASHES_MAX 16
+
+// Chooses the size of the filter so that the false positive rate is about 1/rate.
+// Allocates the filter (initially empty).
+void bloom_init(struct bloom *restrict bloom, size_t count, unsigned rate)
+{
+	size_t bits, bits_per_key;
+
+	// Bloom filters need about 1.44 * log2(rate) bits per key (a bit more when blocked).
+	for(bits = 0; rate >> bits; ++bits)
+		;
+	bits_per_key = (bits * 3 + 1) / 2 + 1;
+
+	bloom->hashes = bits_per_key * 69 / 100; // ln(2) * bits_per_key
+	if (bloom->hashes < 1)
+		bloom->hashes = 1;
+	if (bloom->hashes > HASHES_MAX)
+		bloom->hashes = HASHES_MAX;
+
+	bloom->blocks = (count * bits_per_key + BLOOM_BLOCK_WORDS * 64 - 1) / (BLOOM_BLOCK_WORDS * 64);
+	if (!bloom->blocks)
+		bloom->blocks = 1;
+
+	bloom->data = alloc(bloom->blocks * BLOOM_BLOCK_WORDS * sizeof(*bloom->data));
+	memset(bloom->data, 0, bloom->blocks * BLOOM_BLOCK_WORDS * sizeof(*bloom->data));
+}
+
+// The high bits of the hash select the block. Each multiplication gives another bit in the block.
+static inline uint64_t *block(const struct bloom *restrict bloom, uint64_t hash)
+{
+	return bloom->data + (((hash >> 32) * bloom->blocks) >> 32) * BLOOM_BLOCK_WORDS;
+}
+
+void bloom_add(struct bloom *restrict bloom, uint64_t hash)
+{
+	uint64_t *words = block(bloom, hash);
+	unsigned i;
+
+	for(i = 0; i < bloom->hashes; ++i)
+	{
+		hash *= 0x9e3779b97f4a7c15ULL;
+		words[hash >> 61] |= (uint64_t)1 << ((hash >> 55) & 63);
+	}
+}
+
+// Returns 0 if the key is certainly not in the set.
+int bloom_check(const struct bloom *restrict bloom, uint64_t hash)
+{
+	const uint64_t *words = block(bloom, hash);
+	unsigned i;
+
+	for(i = 0; i < bloom->hashes; ++i)
+	{
+		hash *= 0x9e3779b97f4a7c15ULL;
+		if (!(words[hash >> 61] & ((uint64_t)1 << ((hash >> 55) & 63))))
+			return 0;
+	}
+	return 1;
+}
@@ -0,0 +1,35 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Blocked Bloom filter. All the bits for a key are in a single block the size of a cache line.
+
+#define BLOOM_BLOCK_WORDS 8 /* 512 bits */
+
+#define BLOOM_RATE_DEFAULT 100 /* false positive rate 1/100 */
+
+struct bloom
+{
+	uint64_t blocks;
+	uint64_t hashes; // number of bits set for each key
+	uint64_t *data;
+};
+
+void bloom_init(struct bloom *restrict bloom, size_t count, unsigned rate);
+void bloom_add(struct bloom *restrict bloom, uint64_t hash);
+int bloom_check(const struct bloom *restrict bloom, uint64_t hash);
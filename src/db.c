@@ -18,11 +18,13 @@
  */
 
 #include <assert.h>
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/file.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -32,12 +34,24 @@
 #include "fs.h"
 #include "hash.h"
 #include "magic.h"
+#include "lz.h"
+#include "map.h"
+#include "digest.h"
+#include "pattern.h"
+#include "query.h"
 #include "db.h"
 
 struct index_entry
 {
-	uint32_t hash;
-	uint32_t start; // limits index database size to 4GiB
+	uint64_t hash;
+	uint64_t record;
+};
+
+// Describes the records added for one of the indexed directories. Followed by the path of the directory.
+struct root
+{
+	uint64_t start, end;
+	uint16_t path_length;
 } __attribute__((packed));
 
 #define HEAP_NAME heap_index
@@ -46,15 +60,230 @@ struct index_entry
 #include "generic/heap.g"
 
 #define DB_ACCESS 0600
-#define DB_HEADER "\x00\x03\x00\00\x00\x00\x00\x00"
+#define DB_ACCESS_SYSTEM 0640 /* readable by the group of the reader */
+#define DB_HEADER "\x00\x06\x00\00\x00\x00\x00\x00" /* the second byte is the version of the format */
+#define INDEX_HEADER "\x00\x05\x00\00\x00\x00\x00\x00"
+#define DB_HEADER_BASELINE "\x00\x03\x00\00\x00\x00\x00\x00" /* databases converted by findex -upgrade */
 
+#define DB_RECORDS_TEMPNAME "records_temp"
 #define DB_DATA_TEMPNAME "data_temp"
 #define DB_INDEX_TEMPNAME "index_temp"
+#define DB_COLUMNS_TEMPNAME "columns_temp"
+#define DB_ROOTS_TEMPNAME "roots_temp"
+#define DB_PERFECT_TEMPNAME "perfect_temp"
+#define DB_BLOOM_TEMPNAME "bloom_temp"
+#define DB_TRIGRAM_TEMPNAME "trigram_temp"
+#define DB_NAMES_TEMPNAME "names_temp"
+#define DB_SORTED_TEMPNAME "sorted_temp"
+#define DB_BITMAP_TEMPNAME "bitmap_temp"
+#define DB_INODE_TEMPNAME "inode_temp"
+#define DB_DIGEST_TEMPNAME "digest_temp"
+#define DB_MEDIA_TEMPNAME "media_temp"
+#define DB_AGGREGATE_TEMPNAME "aggregate_temp"
+#define DB_SEARCHES_TEMPNAME "searches_temp"
+#define DB_SAVED_TEMPNAME "saved_temp"
 
+#define DB_CONTAINER_NAME "database" /* all the files below from data to aggregate, as sections */
 #define DB_DATA_NAME "data"
 #define DB_INDEX_NAME "index"
+#define DB_COLUMNS_NAME "columns"
+#define DB_ROOTS_NAME "roots"
+#define DB_PERFECT_NAME "perfect"
+#define DB_BLOOM_NAME "bloom"
+#define DB_TRIGRAM_NAME "trigram"
+#define DB_NAMES_NAME "names"
+#define DB_SORTED_NAME "sorted"
+#define DB_BITMAP_NAME "bitmap"
+#define DB_INODE_NAME "inode"
+#define DB_DIGEST_NAME "digest"
+#define DB_MEDIA_NAME "media"
+#define DB_AGGREGATE_NAME "aggregate"
+#define DB_SEARCHES_NAME "searches" /* definitions of the saved searches */
+#define DB_SAVED_NAME "saved" /* records matching each saved search */
+#define DB_DELTA_NAME "delta." /* followed by the number of the segment */
+#define DB_DELTA_TEMPNAME "delta_temp." /* followed by the process id */
+#define DB_LOCK_NAME "lock"
+#define DB_REPLICA_NAME "replica" /* generation reached by the changes applied by findex -apply */
+#define DB_REPLICA_TEMPNAME "replica_temp"
+#define DB_SHARDS_NAME "shards"
+#define DB_SHARDS_TEMPNAME "shards_temp"
+#define DB_SHARDS_LOCK_NAME "shards_lock"
+#define DB_SHARD_NAME "shard." /* followed by the number of the shard */
+
+// The container is the data file with the other files of the database appended as sections, followed by a table of the sections and a trailer.
+// The sections start at page boundaries so that each one can be given its own paging hints.
+#define CONTAINER_ALIGNMENT 4096
+#define CONTAINER_MAGIC "fsection"
+#define CONTAINER_NAME_SIZE 16
+#define CONTAINER_COPY (1024 * 1024)
+
+struct container_entry
+{
+	char name[CONTAINER_NAME_SIZE]; // terminated by 0
+	uint64_t offset, size;
+};
+
+// The trailer stores the offset of the table, the number of sections and then the magic.
+#define CONTAINER_TRAILER_SIZE (2 * sizeof(uint64_t) + sizeof(CONTAINER_MAGIC) - 1)
+
+// Files appended to data as sections. The optional ones are only appended if they were created.
+static const struct
+{
+	const char *name, *tempname;
+} sections[] = {
+	{DB_INDEX_NAME, DB_INDEX_TEMPNAME},
+	{DB_COLUMNS_NAME, DB_COLUMNS_TEMPNAME},
+	{DB_ROOTS_NAME, DB_ROOTS_TEMPNAME},
+	{DB_PERFECT_NAME, DB_PERFECT_TEMPNAME},
+	{DB_BLOOM_NAME, DB_BLOOM_TEMPNAME},
+	{DB_TRIGRAM_NAME, DB_TRIGRAM_TEMPNAME},
+	{DB_NAMES_NAME, DB_NAMES_TEMPNAME},
+	{DB_SORTED_NAME, DB_SORTED_TEMPNAME},
+	{DB_BITMAP_NAME, DB_BITMAP_TEMPNAME},
+	{DB_INODE_NAME, DB_INODE_TEMPNAME},
+	{DB_DIGEST_NAME, DB_DIGEST_TEMPNAME},
+	{DB_MEDIA_NAME, DB_MEDIA_TEMPNAME},
+	{DB_AGGREGATE_NAME, DB_AGGREGATE_TEMPNAME},
+};
+#define SECTIONS_COUNT (sizeof(sections) / sizeof(*sections))
+
+// The bloom filter starts with the database header, followed by the number of blocks and the number of hashes.
+#define BLOOM_HEADER_SIZE 64
+
+// Each column starts at an offset that is a multiple of the cache line size.
+// The columns file starts with the database header, followed by the number of records and the generation of the database.
+// The last column stores the offset of each block in data.
+#define COLUMNS_ALIGNMENT 64
+
+#define BLOCKS_COUNT(count) (((count) + DB_BLOCK_RECORDS - 1) / DB_BLOCK_RECORDS)
+
+struct columns_layout
+{
+	size_t size, mtime, offset, end, mime_type, content, path_length, depth;
+	size_t block;
+	size_t generation;
+	size_t total;
+};
+
+static inline size_t align(size_t offset)
+{
+	return (offset + COLUMNS_ALIGNMENT - 1) & ~(size_t)(COLUMNS_ALIGNMENT - 1);
+}
+
+// Databases created before generations were introduced have no generation column.
+static void columns_layout(struct columns_layout *restrict layout, size_t count, int generations)
+{
+	layout->size = COLUMNS_ALIGNMENT;
+	layout->mtime = align(layout->size + count * sizeof(uint64_t));
+	layout->offset = align(layout->mtime + count * sizeof(uint64_t));
+	layout->end = align(layout->offset + count * sizeof(uint64_t));
+	layout->mime_type = align(layout->end + count * sizeof(uint64_t));
+	layout->content = align(layout->mime_type + count * sizeof(uint32_t));
+	layout->path_length = align(layout->content + count * sizeof(uint16_t));
+	layout->depth = align(layout->path_length + count * sizeof(uint16_t));
+	layout->block = align(layout->depth + count * sizeof(uint16_t));
+	layout->generation = align(layout->block + BLOCKS_COUNT(count) * sizeof(uint64_t));
+	layout->total = (generations ? align(layout->generation + count * sizeof(uint64_t)) : layout->generation);
+}
+
+// Maximum size of a delta segment file name (including the terminating NUL).
+#define DELTA_NAME_SIZE (sizeof(DB_DELTA_TEMPNAME) + 20)
+
+// Generates the file name of the delta segment with the given number. Returns the length of the name.
+static size_t delta_name(char name[static restrict DELTA_NAME_SIZE], const char *restrict prefix, size_t prefix_length, uint64_t number)
+{
+	memcpy(name, prefix, prefix_length);
+	return prefix_length + snprintf(name + prefix_length, DELTA_NAME_SIZE - prefix_length, "%" PRIu64, number);
+}
+
+// Lists the numbers of the delta segments in descending order.
+// Returns the number of segments or error code. The caller must free the list.
+static ssize_t deltas_list(struct path_buffer *restrict path_buffer, uint64_t **restrict numbers)
+{
+	DIR *dir;
+	struct dirent *entry;
+	size_t count = 0, capacity = 0;
+	size_t i, j;
+
+	*numbers = 0;
+
+	path_set(path_buffer, "", 0);
+	dir = opendir(path_buffer->data);
+	if (!dir)
+		return ((errno == ENOENT) ? 0 : ERROR);
+
+	while (entry = readdir(dir))
+	{
+		const char *digits = entry->d_name + sizeof(DB_DELTA_NAME) - 1;
+
+		if (strncmp(entry->d_name, DB_DELTA_NAME, sizeof(DB_DELTA_NAME) - 1))
+			continue;
+		if (!*digits || (strspn(digits, "0123456789") != strlen(digits)))
+			continue;
+
+		if (count == capacity)
+		{
+			capacity = (capacity ? capacity * 2 : 16);
+			*numbers = realloc(*numbers, capacity * sizeof(**numbers));
+			if (!*numbers)
+			{
+				closedir(dir);
+				return ERROR_MEMORY;
+			}
+		}
+		(*numbers)[count++] = strtoull(digits, 0, 10);
+	}
+	closedir(dir);
+
+	for(i = 1; i < count; ++i)
+	{
+		uint64_t number = (*numbers)[i];
+		for(j = i; j && ((*numbers)[j - 1] < number); --j)
+			(*numbers)[j] = (*numbers)[j - 1];
+		(*numbers)[j] = number;
+	}
+
+	return count;
+}
+
+// Finds the number of the newest delta segment (0 if there are no segments).
+static int deltas_last(struct path_buffer *restrict path_buffer, uint64_t *restrict last)
+{
+	uint64_t *numbers;
+	ssize_t count = deltas_list(path_buffer, &numbers);
+	if (count < 0)
+		return count;
+	*last = (count ? numbers[0] : 0);
+	free(numbers);
+	return 0;
+}
+
+// Removes the delta segments with number up to last.
+static void deltas_remove(struct path_buffer *restrict path_buffer, uint64_t last)
+{
+	uint64_t *numbers;
+	ssize_t count = deltas_list(path_buffer, &numbers);
+	ssize_t i;
 
-#define INDEX_SIZE_LIMIT (64 * 1024 * 1024)
+	for(i = 0; i < count; ++i)
+		if (numbers[i] <= last)
+		{
+			char name[DELTA_NAME_SIZE];
+			path_set(path_buffer, name, delta_name(name, DB_DELTA_NAME, sizeof(DB_DELTA_NAME) - 1, numbers[i]));
+			unlink(path_buffer->data);
+		}
+	free(numbers);
+}
+
+static int db_access = DB_ACCESS; // permissions of the database files
+
+// Makes all following operations use the system-wide database.
+// Its files are readable by their group so that a reader with that group can open them.
+void db_system(void)
+{
+	path_system();
+	db_access = DB_ACCESS_SYSTEM;
+}
 
 int db_new(struct db *restrict db)
 {
@@ -64,63 +293,118 @@ int db_new(struct db *restrict db)
 	struct path_buffer path_buffer;
 	size_t length;
 
+	temp.inodes = 0;
+	temp.inodes_capacity = 0;
+
 	// Initialize path for database files.
 	status = path_init(&path_buffer);
 	if (status < 0)
 		return status;
 
-	// Open data database and write header.
-	length = path_set(&path_buffer, DB_DATA_TEMPNAME, sizeof(DB_DATA_TEMPNAME) - 1);
-	temp.data = fs_load(path_buffer.data, length, DB_ACCESS, 1);
+	// Only one database can be created at a time. The delta segments existing now are replaced by the new database.
+	length = path_set(&path_buffer, DB_LOCK_NAME, sizeof(DB_LOCK_NAME) - 1);
+	temp.lock = fs_load(path_buffer.data, length, db_access, 0);
+	if (temp.lock < 0)
+		return temp.lock;
+	if (flock(temp.lock, LOCK_EX) < 0)
+	{
+		close(temp.lock);
+		return ERROR;
+	}
+	if (status = deltas_last(&path_buffer, &temp.deltas))
+	{
+		close(temp.lock);
+		return status;
+	}
+
+	// Open file for the records and write header.
+	length = path_set(&path_buffer, DB_RECORDS_TEMPNAME, sizeof(DB_RECORDS_TEMPNAME) - 1);
+	temp.data = fs_load(path_buffer.data, length, db_access, 1);
 	if (temp.data < 0)
+	{
+		close(temp.lock);
 		return temp.data;
+	}
 	if (write(temp.data, DB_HEADER, sizeof(DB_HEADER) - 1) < 0)
 	{
 		unlink(path_buffer.data);
 		close(temp.data);
+		close(temp.lock);
 		return ERROR;
 	}
 	temp.data_offset = sizeof(DB_HEADER) - 1;
 
 	// Open index database and write header.
 	length = path_set(&path_buffer, DB_INDEX_TEMPNAME, sizeof(DB_INDEX_TEMPNAME) - 1);
-	temp.index = fs_load(path_buffer.data, length, DB_ACCESS, 1);
+	temp.index = fs_load(path_buffer.data, length, db_access, 1);
 	if (temp.index < 0)
 	{
-		path_set(&path_buffer, DB_DATA_TEMPNAME, sizeof(DB_DATA_TEMPNAME) - 1);
+		path_set(&path_buffer, DB_RECORDS_TEMPNAME, sizeof(DB_RECORDS_TEMPNAME) - 1);
 		unlink(path_buffer.data);
 		close(temp.data);
+		close(temp.lock);
 
 		return temp.index;
 	}
-	if (write(temp.index, DB_HEADER, sizeof(DB_HEADER) - 1) < 0)
+	temp.roots = -1;
+	if (write(temp.index, INDEX_HEADER, sizeof(INDEX_HEADER) - 1) < 0)
+	{
+		db_delete(&temp);
+		return ERROR;
+	}
+	temp.index_offset = sizeof(INDEX_HEADER) - 1;
+
+	// Open file for the indexed directories and write header.
+	length = path_set(&path_buffer, DB_ROOTS_TEMPNAME, sizeof(DB_ROOTS_TEMPNAME) - 1);
+	temp.roots = fs_load(path_buffer.data, length, db_access, 1);
+	if (temp.roots < 0)
+	{
+		status = temp.roots;
+		temp.roots = -1;
+		db_delete(&temp);
+		return status;
+	}
+	if (write(temp.roots, DB_HEADER, sizeof(DB_HEADER) - 1) < 0)
 	{
 		db_delete(&temp);
 		return ERROR;
 	}
-	temp.index_offset = sizeof(DB_HEADER) - 1;
+
+	temp.count = 0;
+	temp.flags = 0;
+	temp.bloom = BLOOM_RATE_DEFAULT;
 
 	*db = temp;
 	return 0;
 }
 
-int db_add(struct db *restrict db, const char *restrict path, size_t path_length, const struct file *restrict file)
+// inode is used only if the database has an inode index.
+int db_add(struct db *restrict db, const char *restrict path, size_t path_length, const struct file *restrict file, const struct inode *restrict inode)
 {
 	struct index_entry entry;
 
+	if (db->flags & DB_INODE)
+	{
+		if (db->count == db->inodes_capacity)
+		{
+			db->inodes_capacity = (db->inodes_capacity ? db->inodes_capacity * 2 : 1024);
+			db->inodes = realloc(db->inodes, db->inodes_capacity * sizeof(*db->inodes));
+			if (!db->inodes)
+				abort();
+		}
+		db->inodes[db->count] = *inode;
+	}
+
 	if (write(db->data, file, sizeof(*file)) < 0)
 		return ERROR; // TODO
 	if (write(db->data, path, path_length) < 0)
 		return ERROR; // TODO
 
-	entry.hash = hash((const unsigned char *)path, path_length);
-	entry.start = db->data_offset;
+	entry.hash = hash64((const unsigned char *)path, path_length);
+	entry.record = db->count;
 
 	db->data_offset += sizeof(*file) + path_length;
-
-	// TODO support larger chunks by using merge sort on disk
-	if (db->index_offset + sizeof(entry) > INDEX_SIZE_LIMIT)
-		return ERROR; // TODO
+	db->count += 1;
 
 	if (write(db->index, &entry, sizeof(entry)) < 0)
 		return ERROR; // TODO
@@ -130,318 +414,4289 @@ int db_add(struct db *restrict db, const char *restrict path, size_t path_length
 	return 0;
 }
 
-int db_persist(struct db *restrict db)
+// Records that the records from start to the last one added are the contents of the directory path.
+int db_root(struct db *restrict db, const char *restrict path, size_t path_length, size_t start)
 {
-	void *buffer;
-	struct heap_index heap;
-
-	struct path_buffer path_origin;
-	struct path_buffer path_target;
-	int status;
-
-	close(db->data);
+	struct root root;
 
-	// Map index file in memory.
-	buffer = mmap(0, db->index_offset, PROT_WRITE, MAP_SHARED, db->index, 0);
-	close(db->index);
-	if (buffer == MAP_FAILED)
-	{
-		fprintf(stderr, "ERROR: mmap failed for index\n");
-		return ERROR;
-	}
+	root.start = start;
+	root.end = db->count;
+	root.path_length = path_length;
 
-	// Sort index with heap sort.
-	heap.data = (void *)((char *)buffer + sizeof(DB_HEADER) - 1); // TODO ugly casting hack; think how to fix
-	heap.count = (db->index_offset - sizeof(DB_HEADER) + 1) / sizeof(struct index_entry);
-	heap_index_heapify(&heap);
-	while (heap.count)
-	{
-		struct index_entry entry = heap.data[0];
-		heap_index_pop(&heap);
-		heap.data[heap.count] = entry;
-	}
+	if (write(db->roots, &root, sizeof(root)) < 0)
+		return ERROR; // TODO
+	if (write(db->roots, path, path_length) < 0)
+		return ERROR; // TODO
 
-	munmap(buffer, db->index_offset);
+	return 0;
+}
 
-	status = path_init(&path_origin);
-	assert(status == 0);
-	memcpy(path_target.data, path_origin.data, path_origin.prefix_length);
-	path_target.prefix_length = path_origin.prefix_length;
+static int columns_write(int fd, size_t offset, const void *buffer, size_t size)
+{
+	return ((pwrite(fd, buffer, size, offset) == size) ? 0 : ERROR_WRITE);
+}
 
-	// Replace old data database with the new one.
-	path_set(&path_origin, DB_DATA_TEMPNAME, sizeof(DB_DATA_TEMPNAME) - 1);
-	path_set(&path_target, DB_DATA_NAME, sizeof(DB_DATA_NAME) - 1);
-	if (rename(path_origin.data, path_target.data) < 0)
-	{
-		unlink(path_origin.data);
-		path_set(&path_origin, DB_INDEX_TEMPNAME, sizeof(DB_INDEX_TEMPNAME) - 1);
-		unlink(path_origin.data);
+static int data_write(int fd, const void *buffer, size_t size)
+{
+	return ((write(fd, buffer, size) == size) ? 0 : ERROR_WRITE);
+}
 
-		return ERROR; // TODO error code
-	}
+// Writes the paths of a block of records in data. Fills the block header with information about the records.
+static int block_write(int fd, struct block *restrict header, const unsigned char *restrict paths, unsigned char *restrict compressed)
+{
+	static const unsigned char padding[sizeof(uint64_t)] = {0};
+	size_t size;
+	int status;
 
-	// Replace old index database with the new one.
-	path_set(&path_origin, DB_INDEX_TEMPNAME, sizeof(DB_INDEX_TEMPNAME) - 1);
-	path_set(&path_target, DB_INDEX_NAME, sizeof(DB_INDEX_NAME) - 1);
-	if (rename(path_origin.data, path_target.data) < 0)
-	{
-		unlink(path_target.data); // cleanup outdated index
-		// TODO issue warning that index wasn't created
+	header->compressed = lz_compress(compressed, paths, header->raw);
 
-		unlink(path_origin.data);
-		path_set(&path_origin, DB_DATA_TEMPNAME, sizeof(DB_DATA_TEMPNAME) - 1);
-		unlink(path_origin.data);
+	if (status = data_write(fd, header, sizeof(*header)))
+		return status;
+	if (status = data_write(fd, paths, header->prefix_length))
+		return status;
+	if (status = data_write(fd, compressed, header->compressed))
+		return status;
 
-		return ERROR; // TODO error code
-	}
+	// Make sure each block header is aligned.
+	size = header->prefix_length + header->compressed;
+	if (size % sizeof(uint64_t))
+		status = data_write(fd, padding, sizeof(uint64_t) - size % sizeof(uint64_t));
 
-	return 0;
+	return status;
 }
 
-void db_delete(struct db *restrict db)
+// Record whose subtree has not ended yet.
+struct subtree
 {
-	struct path_buffer buffer;
-	int status;
+	uint64_t record;
+	const unsigned char *path;
+	size_t path_length;
+};
 
-	status = path_init(&buffer);
-	assert(status == 0);
+// Generates data and columns from the records added to the database.
+// Data stores the paths in compressed blocks. Columns stores the other fields of each record in separate arrays.
+// If keys is not NULL, fills it with the 64-bit hash of the path of each record.
+// If trigrams is not NULL, adds to it the trigrams of the path of each record.
+// If names is not NULL, adds to it the name of each record.
+// If digests is not NULL, fills it with the digest of each record taken from the previous database (0 if there is none).
+static uint64_t file_generation(struct search *restrict previous, const unsigned char *restrict path, const struct file *restrict file, uint64_t generation, uint64_t *restrict digest);
 
-	path_set(&buffer, DB_DATA_TEMPNAME, sizeof(DB_DATA_TEMPNAME) - 1);
-	unlink(buffer.data);
-	close(db->data);
+static int db_build(const struct db *restrict db, struct path_buffer *restrict path_buffer, struct perfect_key *restrict keys, struct trigrams *restrict trigrams, struct names *restrict names, uint64_t *restrict digests, struct search *restrict previous, uint64_t generation)
+{
+	int fd, data, columns;
+	size_t length;
+	const unsigned char *records;
 
-	path_set(&buffer, DB_INDEX_TEMPNAME, sizeof(DB_INDEX_TEMPNAME) - 1);
-	unlink(buffer.data);
-	close(db->index);
-}
+	struct columns_layout layout;
+	unsigned char header[COLUMNS_ALIGNMENT] = {0};
+	uint64_t count = db->count;
 
-// TODO indicate error conditions
-int db_open(struct search *restrict search)
-{
-	struct search temp;
-	int status;
-	int fd;
+	struct file *files;
+	uint64_t *offsets, *ends, *blocks, *generations;
+	uint16_t *depths;
+	struct subtree *subtrees;
+	size_t subtrees_count = 0;
+	unsigned char *paths, *compressed;
 	void *buffer;
 
-	struct path_buffer path_buffer;
-
-	// Initialize path for database files.
-	status = path_init(&path_buffer);
-	if (status < 0)
-		return status;
+	size_t offset, data_offset;
+	size_t block, start, i;
+	int status;
 
-	path_set(&path_buffer, DB_DATA_NAME, sizeof(DB_DATA_NAME) - 1);
-	fd = open(path_buffer.data, O_RDONLY);
+	length = path_set(path_buffer, DB_RECORDS_TEMPNAME, sizeof(DB_RECORDS_TEMPNAME) - 1);
+	fd = open(path_buffer->data, O_RDONLY);
 	if (fd < 0)
 		return ERROR;
-	if (fstat(fd, &temp.info) < 0)
-	{
-		close(fd);
-		return ERROR;
-	}
-
-	buffer = mmap(0, temp.info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	records = mmap(0, db->data_offset, PROT_READ, MAP_PRIVATE, fd, 0);
 	close(fd);
-	if (buffer == MAP_FAILED)
-		return ERROR;
-	temp.data_buffer = buffer;
-
-	// Check file header.
-	if (temp.info.st_size < (sizeof(DB_HEADER) - 1))
-		goto error; // unexpected EOF
-	if (memcmp(temp.data_buffer, DB_HEADER, sizeof(DB_HEADER) - 1))
-		goto error; // invalid database format
+	if (records == MAP_FAILED)
+		return ERROR_MEMORY;
 
-	*search = temp;
-	return 0;
+	length = path_set(path_buffer, DB_DATA_TEMPNAME, sizeof(DB_DATA_TEMPNAME) - 1);
+	data = fs_load(path_buffer->data, length, db_access, 1);
+	if (data < 0)
+	{
+		munmap((void *)records, db->data_offset);
+		return data;
+	}
 
-error:
-	db_close(&temp);
-	return ERROR_INPUT;
-}
+	length = path_set(path_buffer, DB_COLUMNS_TEMPNAME, sizeof(DB_COLUMNS_TEMPNAME) - 1);
+	columns = fs_load(path_buffer->data, length, db_access, 1);
+	if (columns < 0)
+	{
+		close(data);
+		path_set(path_buffer, DB_DATA_TEMPNAME, sizeof(DB_DATA_TEMPNAME) - 1);
+		unlink(path_buffer->data);
+		munmap((void *)records, db->data_offset);
+		return columns;
+	}
 
-void db_close(const struct search *restrict search)
-{
-	munmap(search->data_buffer, search->info.st_size);
-}
+	columns_layout(&layout, count, 1);
+	memcpy(header, DB_HEADER, sizeof(DB_HEADER) - 1);
+	memcpy(header + sizeof(DB_HEADER) - 1, &count, sizeof(count));
+	memcpy(header + sizeof(DB_HEADER) - 1 + sizeof(count), &generation, sizeof(generation));
 
-static int update_match(struct file *restrict file, const unsigned char *buffer, const char *restrict path, size_t length)
-{
-	struct file temp;
+	files = alloc(DB_BLOCK_RECORDS * sizeof(*files));
+	generations = alloc(DB_BLOCK_RECORDS * sizeof(*generations));
+	offsets = alloc(DB_BLOCK_RECORDS * sizeof(*offsets));
+	ends = alloc(DB_BLOCK_RECORDS * sizeof(*ends));
+	depths = alloc(DB_BLOCK_RECORDS * sizeof(*depths));
+	subtrees = alloc((PATH_SIZE_LIMIT / 2 + 1) * sizeof(*subtrees));
+	blocks = alloc((BLOCKS_COUNT(count) + 1) * sizeof(*blocks));
+	paths = alloc(DB_BLOCK_RECORDS * PATH_SIZE_LIMIT);
+	compressed = alloc(LZ_BOUND(DB_BLOCK_RECORDS * PATH_SIZE_LIMIT));
+	buffer = alloc(DB_BLOCK_RECORDS * sizeof(uint64_t));
 
-	memcpy(&temp, buffer, sizeof(temp));
+	if ((status = columns_write(columns, 0, header, sizeof(header))) || (status = data_write(data, DB_HEADER, sizeof(DB_HEADER) - 1)))
+		goto finally;
+	if (ftruncate(columns, layout.total) < 0)
+	{
+		status = ERROR_WRITE;
+		goto finally;
+	}
 
-	if (temp.path_length != length)
-		return ERROR_MISSING;
+	offset = sizeof(DB_HEADER) - 1;
+	data_offset = sizeof(DB_HEADER) - 1;
+	for(block = 0, start = 0; start < count; block += 1, start += DB_BLOCK_RECORDS)
+	{
+		size_t chunk = ((count - start) < DB_BLOCK_RECORDS) ? (count - start) : DB_BLOCK_RECORDS;
+		struct block info;
 
-	if (memcmp(buffer + sizeof(temp), path, length))
-		return ERROR_MISSING;
+		memset(&info, 0, sizeof(info));
+		info.size_min = UINT64_MAX;
+		info.mtime_min = UINT64_MAX;
 
-	memcpy(file, &temp, sizeof(temp));
+		for(i = 0; i < chunk; ++i)
+		{
+			const unsigned char *path;
+			size_t index;
 
-	return 0;
-}
+			memcpy(files + i, records + offset, sizeof(*files));
+			path = records + offset + sizeof(*files);
+			offset += sizeof(*files) + files[i].path_length;
 
-int db_find_fileinfo(struct file *restrict file, const char *restrict path, size_t length, const struct search *restrict search)
-{
-	int fd;
-	struct stat info;
-	void *buffer;
-	size_t index_size;
+			// Records are added in depth-first order so each subtree occupies a contiguous range of records.
+			// Find where the subtrees that don't contain this record end.
+			while (subtrees_count)
+			{
+				const struct subtree *subtree = subtrees + subtrees_count - 1;
+				if ((files[i].path_length > subtree->path_length) && (path[subtree->path_length] == '/') && !memcmp(path, subtree->path, subtree->path_length))
+					break;
 
-	uint32_t hashsum;
-	struct index_entry *entries;
+				if (subtree->record >= start)
+					ends[subtree->record - start] = start + i;
+				else // the subtree started in a block whose columns are already written
+				{
+					uint64_t end = start + i;
+					if (status = columns_write(columns, layout.end + subtree->record * sizeof(end), &end, sizeof(end)))
+						goto finally;
+				}
+				subtrees_count -= 1;
+			}
+			subtrees[subtrees_count++] = (struct subtree){start + i, path, files[i].path_length};
+			ends[i] = start + i + 1;
 
-	int status;
+			if (keys)
+			{
+				keys[start + i].hash = hash64(path, files[i].path_length);
+				keys[start + i].record = start + i;
+			}
+			if (trigrams)
+				trigrams_add(trigrams, path, files[i].path_length, start + i);
+			if (names)
+			{
+				size_t name = files[i].path_length;
+				while (name && (path[name - 1] != '/'))
+					name -= 1;
+				names_add(names, path + name, files[i].path_length - name, start + i);
+			}
 
-	struct path_buffer path_buffer;
+			depths[i] = 0;
+			for(index = 0; index < files[i].path_length; ++index)
+				depths[i] += (path[index] == '/');
 
-	status = path_init(&path_buffer);
-	if (status < 0)
-		return status;
-	path_set(&path_buffer, DB_INDEX_NAME, sizeof(DB_INDEX_NAME) - 1);
+			generations[i] = file_generation(previous, path, files + i, generation, (digests ? digests + start + i : 0));
 
-	fd = open(path_buffer.data, O_RDONLY);
-	if (fd < 0)
-		return ERROR;
-	if (fstat(fd, &info) < 0)
-	{
-		close(fd);
-		return ERROR;
-	}
+			offsets[i] = info.raw;
+			memcpy(paths + info.raw, path, files[i].path_length);
+			info.raw += files[i].path_length;
 
-	buffer = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-	close(fd);
-	if (buffer == MAP_FAILED)
-		return ERROR;
+			if (files[i].size < info.size_min)
+				info.size_min = files[i].size;
+			if (files[i].size > info.size_max)
+				info.size_max = files[i].size;
+			if (files[i].mtime < info.mtime_min)
+				info.mtime_min = files[i].mtime;
+			if (files[i].mtime > info.mtime_max)
+				info.mtime_max = files[i].mtime;
+			info.content |= files[i].content;
 
-	index_size = info.st_size - sizeof(DB_HEADER) + 1;
-	entries = (void *)((char *)buffer + sizeof(DB_HEADER) - 1); // TODO ugly casting hack; think how to fix
-	hashsum = hash((const unsigned char *)path, length);
+			// Find the prefix of the first path that is common for all paths.
+			if (!i)
+				info.prefix_length = files[i].path_length;
+			else
+			{
+				size_t common = 0;
+				while ((common < info.prefix_length) && (common < files[i].path_length) && (paths[common] == path[common]))
+					common += 1;
+				info.prefix_length = common;
+			}
+		}
 
-	// Use binary search to look for the path hash in the index.
-	// Search the entries with the given hash until the actual path matches.
-	{
-		size_t low = 0, high = index_size / sizeof(*entries);
-		size_t i;
-		ssize_t i_offset;
+		blocks[block] = data_offset;
+		if (status = block_write(data, &info, paths, compressed))
+			goto finally;
+		data_offset += sizeof(info) + info.prefix_length + info.compressed;
+		data_offset = (data_offset + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
 
-		while (low < high)
+		// Write the chunk of each column.
 		{
-			i = (high - low) / 2 + low;
-
-			if (entries[i].hash == hashsum)
-				break;
-			else if (entries[i].hash > hashsum)
-				high = i;
-			else // entries[i].hash < hashsum
-				low = i + 1;
+			uint64_t *values = buffer;
+			for(i = 0; i < chunk; ++i)
+				values[i] = files[i].size;
+			if (status = columns_write(columns, layout.size + start * sizeof(*values), values, chunk * sizeof(*values)))
+				goto finally;
+			for(i = 0; i < chunk; ++i)
+				values[i] = files[i].mtime;
+			if (status = columns_write(columns, layout.mtime + start * sizeof(*values), values, chunk * sizeof(*values)))
+				goto finally;
+			if (status = columns_write(columns, layout.offset + start * sizeof(*offsets), offsets, chunk * sizeof(*offsets)))
+				goto finally;
+			if (status = columns_write(columns, layout.end + start * sizeof(*ends), ends, chunk * sizeof(*ends)))
+				goto finally;
+			if (status = columns_write(columns, layout.generation + start * sizeof(*generations), generations, chunk * sizeof(*generations)))
+				goto finally;
 		}
-
-		status = ERROR_MISSING;
-
-		i_offset = 0;
-		do
 		{
-			status = update_match(file, search->data_buffer + entries[i + i_offset].start, path, length);
-			if (!status)
+			uint32_t *values = buffer;
+			for(i = 0; i < chunk; ++i)
+				values[i] = files[i].mime_type;
+			if (status = columns_write(columns, layout.mime_type + start * sizeof(*values), values, chunk * sizeof(*values)))
 				goto finally;
-
-			i_offset += 1;
-		} while (entries[i + i_offset].hash == hashsum);
-
-		i_offset = -1;
-		while (entries[i + i_offset].hash == hashsum)
+		}
 		{
-			status = update_match(file, search->data_buffer + entries[i + i_offset].start, path, length);
-			if (!status)
+			uint16_t *values = buffer;
+			for(i = 0; i < chunk; ++i)
+				values[i] = files[i].content;
+			if (status = columns_write(columns, layout.content + start * sizeof(*values), values, chunk * sizeof(*values)))
+				goto finally;
+			for(i = 0; i < chunk; ++i)
+				values[i] = files[i].path_length;
+			if (status = columns_write(columns, layout.path_length + start * sizeof(*values), values, chunk * sizeof(*values)))
+				goto finally;
+			if (status = columns_write(columns, layout.depth + start * sizeof(*depths), depths, chunk * sizeof(*depths)))
 				goto finally;
-
-			i_offset -= 1;
 		}
 	}
 
+	// The remaining subtrees end with the last record.
+	while (subtrees_count--)
+		if (status = columns_write(columns, layout.end + subtrees[subtrees_count].record * sizeof(count), &count, sizeof(count)))
+			goto finally;
+
+	status = columns_write(columns, layout.block, blocks, block * sizeof(*blocks));
+
 finally:
-	munmap(buffer, info.st_size);
+	free(buffer);
+	free(compressed);
+	free(paths);
+	free(blocks);
+	free(subtrees);
+	free(depths);
+	free(ends);
+	free(offsets);
+	free(generations);
+	free(files);
+	close(columns);
+	close(data);
+	munmap((void *)records, db->data_offset);
+
+	if (status)
+	{
+		unlink(path_buffer->data);
+		path_set(path_buffer, DB_DATA_TEMPNAME, sizeof(DB_DATA_TEMPNAME) - 1);
+		unlink(path_buffer->data);
+	}
 	return status;
 }
 
-int db_set_fileinfo(struct file *restrict file, const char *restrict path, size_t path_length, const struct stat *restrict info)
+// Sort index with heap sort.
+static void index_sort(struct index_entry *entries, size_t count)
+{
+	struct heap_index heap;
+
+	heap.data = entries;
+	heap.count = count;
+	heap_index_heapify(&heap);
+	while (heap.count)
+	{
+		struct index_entry entry = heap.data[0];
+		heap_index_pop(&heap);
+		heap.data[heap.count] = entry;
+	}
+}
+
+// Writes the perfect hash function: a header with its parameters, followed by the pilots, the free slots and the slots.
+static int perfect_data_write(int fd, const struct perfect *restrict perfect)
+{
+	uint64_t header[4];
+	int status;
+
+	header[0] = perfect->count;
+	header[1] = perfect->size;
+	header[2] = perfect->buckets;
+	header[3] = perfect->seed;
+	if ((status = data_write(fd, header, sizeof(header))) ||
+		(status = data_write(fd, perfect->pilots, perfect->buckets * sizeof(*perfect->pilots))))
+		return status;
+	if (perfect->buckets % 2)
+	{
+		uint32_t padding = 0;
+		if (status = data_write(fd, &padding, sizeof(padding)))
+			return status;
+	}
+	if (status = data_write(fd, perfect->free, (perfect->size - perfect->count) * sizeof(*perfect->free)))
+		return status;
+	return data_write(fd, perfect->slots, perfect->count * sizeof(*perfect->slots));
+}
+
+// Reads a perfect hash function written by perfect_data_write. It must take all of the size bytes.
+static int perfect_data_read(struct perfect *restrict perfect, const unsigned char *restrict buffer, size_t size)
+{
+	uint64_t header[4];
+	size_t offset = sizeof(header);
+
+	if (size < offset)
+		return ERROR_INPUT;
+	memcpy(header, buffer, sizeof(header));
+	perfect->count = header[0];
+	perfect->size = header[1];
+	perfect->buckets = header[2];
+	perfect->seed = header[3];
+	if ((perfect->size <= perfect->count) || (perfect->size - perfect->count > size / sizeof(uint64_t)))
+		return ERROR_INPUT;
+	if (!perfect->buckets || (perfect->buckets > size / sizeof(uint32_t)) || (perfect->count > size / sizeof(*perfect->slots)))
+		return ERROR_INPUT;
+
+	perfect->pilots = (uint32_t *)(buffer + offset);
+	offset += (perfect->buckets + perfect->buckets % 2) * sizeof(*perfect->pilots);
+	perfect->free = (uint64_t *)(buffer + offset);
+	offset += (perfect->size - perfect->count) * sizeof(*perfect->free);
+	perfect->slots = (struct perfect_slot *)(buffer + offset);
+	offset += perfect->count * sizeof(*perfect->slots);
+	if (size != offset)
+		return ERROR_INPUT;
+
+	return 0;
+}
+
+// Writes a perfect hash index for the paths in the database.
+static int perfect_write(struct path_buffer *restrict path_buffer, const struct perfect_key *restrict keys, size_t count)
+{
+	struct perfect perfect;
+	size_t length;
+	int fd;
+	int status;
+
+	status = perfect_build(&perfect, keys, count);
+	if (status)
+		return status;
+
+	length = path_set(path_buffer, DB_PERFECT_TEMPNAME, sizeof(DB_PERFECT_TEMPNAME) - 1);
+	fd = fs_load(path_buffer->data, length, db_access, 1);
+	if (fd < 0)
+	{
+		perfect_term(&perfect);
+		return fd;
+	}
+
+	if (!(status = data_write(fd, DB_HEADER, sizeof(DB_HEADER) - 1)))
+		status = perfect_data_write(fd, &perfect);
+
+	close(fd);
+	perfect_term(&perfect);
+	if (status)
+		unlink(path_buffer->data);
+	return status;
+}
+
+// Writes the device and inode number of each record, the links between the records of each file and a perfect hash index for the files.
+// Stores in links the next record of the same file for each record (db->count for the last one).
+static int inode_write(struct path_buffer *restrict path_buffer, const struct db *restrict db, uint64_t *restrict links)
+{
+	struct perfect_key *keys;
+	struct perfect perfect;
+	uint64_t *values;
+	uint64_t count = db->count;
+	size_t keys_count, length, i;
+	int fd;
+	int status;
+
+	keys = alloc(count * sizeof(*keys) + 1);
+	keys_count = inodes_link(db->inodes, count, links, keys);
+	status = perfect_build(&perfect, keys, keys_count);
+	free(keys);
+	if (status)
+		return status;
+
+	length = path_set(path_buffer, DB_INODE_TEMPNAME, sizeof(DB_INODE_TEMPNAME) - 1);
+	fd = fs_load(path_buffer->data, length, db_access, 1);
+	if (fd < 0)
+	{
+		perfect_term(&perfect);
+		return fd;
+	}
+
+	values = alloc(count * sizeof(*values) + 1);
+	if ((status = data_write(fd, DB_HEADER, sizeof(DB_HEADER) - 1)) || (status = data_write(fd, &count, sizeof(count))))
+		goto finally;
+	for(i = 0; i < count; ++i)
+		values[i] = db->inodes[i].device;
+	if (status = data_write(fd, values, count * sizeof(*values)))
+		goto finally;
+	for(i = 0; i < count; ++i)
+		values[i] = db->inodes[i].number;
+	if ((status = data_write(fd, values, count * sizeof(*values))) || (status = data_write(fd, links, count * sizeof(*links))))
+		goto finally;
+	status = perfect_data_write(fd, &perfect);
+
+finally:
+	free(values);
+	close(fd);
+	perfect_term(&perfect);
+	if (status)
+		unlink(path_buffer->data);
+	return status;
+}
+
+// Regular file whose content may be the same as the content of another file of the same size.
+struct digest_candidate
+{
+	uint64_t size;
+	uint64_t partial; // digest of the first and the last block
+	uint64_t record;
+	const unsigned char *path;
+};
+
+#define HEAP_NAME heap_candidate
+#define HEAP_TYPE struct digest_candidate
+#define HEAP_ABOVE(a, b) (((a).size > (b).size) || (((a).size == (b).size) && ((a).partial >= (b).partial)))
+#include "generic/heap.g"
+
+#define DIGEST_BLOCK 4096 /* bytes read from each end of a file to tell apart files of the same size */
+#define DIGEST_READ 65536
+
+static void candidates_sort(struct digest_candidate *candidates, size_t count)
+{
+	struct heap_candidate heap;
+
+	heap.data = candidates;
+	heap.count = count;
+	heap_candidate_heapify(&heap);
+	while (heap.count)
+	{
+		struct digest_candidate candidate = heap.data[0];
+		heap_candidate_pop(&heap);
+		heap.data[heap.count] = candidate;
+	}
+}
+
+// Adds size bytes of the file starting at offset to the digest. Returns whether the bytes could be read.
+static int digest_range(int fd, unsigned char *restrict buffer, uint64_t offset, uint64_t size, struct digest *restrict digest)
+{
+	while (size)
+	{
+		ssize_t chunk = pread(fd, buffer, ((size < DIGEST_READ) ? size : DIGEST_READ), offset);
+		if (chunk <= 0)
+			return 0; // the file changed or can not be read
+		digest_update(digest, buffer, chunk);
+		offset += chunk;
+		size -= chunk;
+	}
+	return 1;
+}
+
+// Calculates the digest of the content of the file (or only of its ends if partial is set). Returns 0 if the file can not be read.
+static uint64_t digest_file(const struct digest_candidate *restrict candidate, unsigned char *restrict buffer, int partial)
+{
+	char path[PATH_SIZE_LIMIT];
+	struct file file;
+	struct digest digest;
+	uint64_t result;
+	int success;
+	int fd;
+
+	memcpy(&file, candidate->path - sizeof(file), sizeof(file));
+	memcpy(path, candidate->path, file.path_length);
+	path[file.path_length] = 0;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return 0;
+	digest_init(&digest);
+	if (partial && (candidate->size > 2 * DIGEST_BLOCK))
+		success = digest_range(fd, buffer, 0, DIGEST_BLOCK, &digest) && digest_range(fd, buffer, candidate->size - DIGEST_BLOCK, DIGEST_BLOCK, &digest);
+	else
+		success = digest_range(fd, buffer, 0, candidate->size, &digest);
+	close(fd);
+	if (!success)
+		return 0;
+
+	result = digest_final(&digest);
+	return (result ? result : 1); // 0 means no digest
+}
+
+// Writes the digest of the content of each file that has the same size as another file.
+// The files are first grouped by size, then by the digest of their first and last blocks. Only the files still in a group with other files are read entirely.
+// Digests from the previous database are passed in digests and are kept. Records without a digest have 0.
+static int digest_write(struct path_buffer *restrict path_buffer, const struct db *restrict db, uint64_t *restrict digests)
+{
+	struct digest_candidate *candidates;
+	const unsigned char *records;
+	unsigned char *buffer;
+	uint64_t count = db->count;
+	size_t candidates_count = 0;
+	size_t offset, record, start, end, i;
+	size_t length;
+	int fd;
+	int status;
+
+	path_set(path_buffer, DB_RECORDS_TEMPNAME, sizeof(DB_RECORDS_TEMPNAME) - 1);
+	fd = open(path_buffer->data, O_RDONLY);
+	if (fd < 0)
+		return ERROR;
+	records = mmap(0, db->data_offset, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (records == MAP_FAILED)
+		return ERROR_MEMORY;
+
+	// Empty files are not considered duplicates.
+	candidates = alloc(count * sizeof(*candidates) + 1);
+	for(offset = sizeof(DB_HEADER) - 1, record = 0; record < count; ++record)
+	{
+		struct file file;
+
+		memcpy(&file, records + offset, sizeof(file));
+		if (file.size && !(file.content & (CONTENT_DIRECTORY | CONTENT_LINK | CONTENT_SPECIAL)))
+			candidates[candidates_count++] = (struct digest_candidate){file.size, 0, record, records + offset + sizeof(file)};
+		offset += sizeof(file) + file.path_length;
+	}
+	candidates_sort(candidates, candidates_count);
+
+	buffer = alloc(DIGEST_READ);
+
+	// Digest the ends of the files with the same size as another file unless all of them already have a digest.
+	for(start = 0; start < candidates_count; start = end)
+	{
+		int missing = 0;
+
+		for(end = start; (end < candidates_count) && (candidates[end].size == candidates[start].size); ++end)
+			missing |= !digests[candidates[end].record];
+		if ((end - start < 2) || !missing)
+			continue;
+
+		for(i = start; i < end; ++i)
+		{
+			uint64_t *digest = digests + candidates[i].record;
+			if (candidates[i].size <= 2 * DIGEST_BLOCK) // the ends of the file are its whole content
+			{
+				if (!*digest)
+					*digest = digest_file(candidates + i, buffer, 0);
+				candidates[i].partial = *digest;
+			}
+			else candidates[i].partial = digest_file(candidates + i, buffer, 1);
+		}
+	}
+	candidates_sort(candidates, candidates_count);
+
+	// Digest the whole content of the files that still can't be told apart.
+	for(start = 0; start < candidates_count; start = end)
+	{
+		for(end = start; (end < candidates_count) && (candidates[end].size == candidates[start].size) && (candidates[end].partial == candidates[start].partial); ++end)
+			;
+		if ((end - start < 2) || !candidates[start].partial)
+			continue;
+
+		for(i = start; i < end; ++i)
+			if (!digests[candidates[i].record])
+				digests[candidates[i].record] = digest_file(candidates + i, buffer, 0);
+	}
+
+	free(buffer);
+	free(candidates);
+	munmap((void *)records, db->data_offset);
+
+	length = path_set(path_buffer, DB_DIGEST_TEMPNAME, sizeof(DB_DIGEST_TEMPNAME) - 1);
+	fd = fs_load(path_buffer->data, length, db_access, 1);
+	if (fd < 0)
+		return fd;
+	if (!(status = data_write(fd, DB_HEADER, sizeof(DB_HEADER) - 1)) && !(status = data_write(fd, &count, sizeof(count))))
+		status = data_write(fd, digests, count * sizeof(*digests));
+	close(fd);
+	if (status)
+		unlink(path_buffer->data);
+	return status;
+}
+
+// Media properties found in the previous database.
+struct media_found
+{
+	const struct file *file;
+	const struct media *media;
+	size_t record;
+};
+
+static int index_find(struct search *restrict search, const char *restrict path, size_t length, int (*found)(struct search *restrict, size_t, void *), void *argument);
+static int found_media(struct search *restrict search, size_t record, void *argument);
+
+// Writes the media properties of the images, audio and video files. They are stored sorted by record.
+// Files that are unchanged since the previous database keep their properties; the headers of the others are parsed.
+static int media_write(struct path_buffer *restrict path_buffer, const struct db *restrict db, struct search *restrict previous)
+{
+	const unsigned char *records;
+	uint64_t *entries = 0;
+	struct media *media = 0;
+	uint64_t header[2] = {db->count, 0};
+	size_t capacity = 0;
+	size_t offset, record, length;
+	int fd;
+	int status;
+
+	path_set(path_buffer, DB_RECORDS_TEMPNAME, sizeof(DB_RECORDS_TEMPNAME) - 1);
+	fd = open(path_buffer->data, O_RDONLY);
+	if (fd < 0)
+		return ERROR;
+	records = mmap(0, db->data_offset, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (records == MAP_FAILED)
+		return ERROR_MEMORY;
+
+	for(offset = sizeof(DB_HEADER) - 1, record = 0; record < db->count; offset += sizeof(struct file) + length, ++record)
+	{
+		struct file file;
+		const unsigned char *path = records + offset + sizeof(file);
+		struct media_found found;
+		char buffer[PATH_SIZE_LIMIT];
+
+		memcpy(&file, records + offset, sizeof(file));
+		length = file.path_length;
+		if ((file.content & CONTENT_DIRECTORY) || !(file.content & (CONTENT_IMAGE | CONTENT_AUDIO | CONTENT_VIDEO)))
+			continue;
+
+		if (header[1] == capacity)
+		{
+			capacity = (capacity ? capacity * 2 : 256);
+			entries = realloc(entries, capacity * sizeof(*entries));
+			media = realloc(media, capacity * sizeof(*media));
+			if (!entries || !media)
+				abort();
+		}
+
+		found.file = &file;
+		found.media = 0;
+		if (previous && previous->media_buffer)
+			index_find(previous, (const char *)path, length, found_media, &found);
+		if (found.media)
+			media[header[1]] = *found.media;
+		else
+		{
+			memcpy(buffer, path, length);
+			buffer[length] = 0;
+			fd = open(buffer, O_RDONLY);
+			if (fd < 0)
+				continue;
+			status = media_parse(media + header[1], fd, file.mime_type);
+			close(fd);
+			if (status)
+				continue;
+		}
+		entries[header[1]++] = record;
+	}
+
+	munmap((void *)records, db->data_offset);
+
+	length = path_set(path_buffer, DB_MEDIA_TEMPNAME, sizeof(DB_MEDIA_TEMPNAME) - 1);
+	fd = fs_load(path_buffer->data, length, db_access, 1);
+	if (fd >= 0)
+	{
+		if (!(status = data_write(fd, DB_HEADER, sizeof(DB_HEADER) - 1)) && !(status = data_write(fd, header, sizeof(header))) && !(status = data_write(fd, entries, header[1] * sizeof(*entries))))
+			status = data_write(fd, media, header[1] * sizeof(*media));
+		close(fd);
+		if (status)
+			unlink(path_buffer->data);
+	}
+	else status = fd;
+
+	free(media);
+	free(entries);
+	return status;
+}
+
+// Writes a bloom filter for the paths in the database.
+static int bloom_write(struct path_buffer *restrict path_buffer, const struct index_entry *restrict entries, size_t count, unsigned rate)
+{
+	struct bloom bloom;
+	unsigned char header[BLOOM_HEADER_SIZE] = {0};
+	size_t length;
+	size_t i;
+	int fd;
+	int status;
+
+	bloom_init(&bloom, count, rate);
+	for(i = 0; i < count; ++i)
+		bloom_add(&bloom, entries[i].hash);
+
+	length = path_set(path_buffer, DB_BLOOM_TEMPNAME, sizeof(DB_BLOOM_TEMPNAME) - 1);
+	fd = fs_load(path_buffer->data, length, db_access, 1);
+	if (fd < 0)
+	{
+		free(bloom.data);
+		return fd;
+	}
+
+	memcpy(header, DB_HEADER, sizeof(DB_HEADER) - 1);
+	memcpy(header + sizeof(DB_HEADER) - 1, &bloom.blocks, sizeof(bloom.blocks));
+	memcpy(header + sizeof(DB_HEADER) - 1 + sizeof(bloom.blocks), &bloom.hashes, sizeof(bloom.hashes));
+	if (!(status = data_write(fd, header, sizeof(header))))
+		status = data_write(fd, bloom.data, bloom.blocks * BLOOM_BLOCK_WORDS * sizeof(*bloom.data));
+
+	close(fd);
+	free(bloom.data);
+	if (status)
+		unlink(path_buffer->data);
+	return status;
+}
+
+// Writes a trigram index for the paths in the database.
+static int trigram_write(struct path_buffer *restrict path_buffer, struct trigrams *restrict trigrams)
+{
+	struct trigram_entry *entries;
+	unsigned char *postings;
+	size_t entries_count, postings_size;
+	uint64_t count;
+	size_t length;
+	int fd;
+	int status;
+
+	status = trigrams_build(trigrams, &entries, &entries_count, &postings, &postings_size);
+	if (status)
+		return status;
+
+	length = path_set(path_buffer, DB_TRIGRAM_TEMPNAME, sizeof(DB_TRIGRAM_TEMPNAME) - 1);
+	fd = fs_load(path_buffer->data, length, db_access, 1);
+	if (fd < 0)
+	{
+		free(postings);
+		free(entries);
+		return fd;
+	}
+
+	count = entries_count;
+	if (!(status = data_write(fd, DB_HEADER, sizeof(DB_HEADER) - 1)) &&
+		!(status = data_write(fd, &count, sizeof(count))) &&
+		!(status = data_write(fd, entries, (entries_count + 1) * sizeof(*entries))))
+		status = data_write(fd, postings, postings_size);
+
+	close(fd);
+	free(postings);
+	free(entries);
+	if (status)
+		unlink(path_buffer->data);
+	return status;
+}
+
+// Writes a sorted index of the names of the records in the database.
+static int names_write(struct path_buffer *restrict path_buffer, struct names *restrict names)
+{
+	uint64_t *offsets;
+	unsigned char *data;
+	size_t blocks, size;
+	uint64_t header[2];
+	size_t length;
+	int fd;
+	int status;
+
+	status = names_build(names, header, &offsets, &blocks, &data, &size);
+	if (status)
+		return status;
+	header[1] = blocks;
+
+	length = path_set(path_buffer, DB_NAMES_TEMPNAME, sizeof(DB_NAMES_TEMPNAME) - 1);
+	fd = fs_load(path_buffer->data, length, db_access, 1);
+	if (fd < 0)
+	{
+		free(data);
+		free(offsets);
+		return fd;
+	}
+
+	if (!(status = data_write(fd, DB_HEADER, sizeof(DB_HEADER) - 1)) &&
+		!(status = data_write(fd, header, sizeof(header))) &&
+		!(status = data_write(fd, offsets, (blocks + 1) * sizeof(*offsets))))
+		status = data_write(fd, data, size);
+
+	close(fd);
+	free(data);
+	free(offsets);
+	if (status)
+		unlink(path_buffer->data);
+	return status;
+}
+
+// Writes the records sorted by size and by mtime. The values are taken from the generated columns.
+static int sorted_write(struct path_buffer *restrict path_buffer, size_t count)
+{
+	struct columns_layout layout;
+	struct sorted_entry *entries;
+	const unsigned char *columns;
+	uint64_t header = count;
+	size_t length;
+	int fd;
+	int status;
+
+	columns_layout(&layout, count, 1);
+
+	path_set(path_buffer, DB_COLUMNS_TEMPNAME, sizeof(DB_COLUMNS_TEMPNAME) - 1);
+	fd = open(path_buffer->data, O_RDONLY);
+	if (fd < 0)
+		return ERROR;
+	columns = mmap(0, layout.total, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (columns == MAP_FAILED)
+		return ERROR_MEMORY;
+
+	length = path_set(path_buffer, DB_SORTED_TEMPNAME, sizeof(DB_SORTED_TEMPNAME) - 1);
+	fd = fs_load(path_buffer->data, length, db_access, 1);
+	if (fd < 0)
+	{
+		munmap((void *)columns, layout.total);
+		return fd;
+	}
+
+	entries = alloc((count + 1) * sizeof(*entries));
+	if (!(status = data_write(fd, DB_HEADER, sizeof(DB_HEADER) - 1)) && !(status = data_write(fd, &header, sizeof(header))))
+	{
+		sorted_init(entries, (const uint64_t *)(columns + layout.size), count);
+		if (!(status = data_write(fd, entries, count * sizeof(*entries))))
+		{
+			sorted_init(entries, (const uint64_t *)(columns + layout.mtime), count);
+			status = data_write(fd, entries, count * sizeof(*entries));
+		}
+	}
+
+	close(fd);
+	free(entries);
+	munmap((void *)columns, layout.total);
+	if (status)
+		unlink(path_buffer->data);
+	return status;
+}
+
+// Writes a bitmap of the records for each content bit and for each mime type. The values are taken from the generated columns.
+// The bitmaps are built in one pass over the records of each chunk: each record sets a bit for each of its content bits and for its mime type.
+static int bitmap_write(struct path_buffer *restrict path_buffer, size_t count)
+{
+	struct columns_layout layout;
+	struct bitmaps *bitmaps;
+	const unsigned char *columns;
+	const uint16_t *content;
+	const uint32_t *mime_type;
+	uint64_t *starts, *words;
+	uint64_t header[2];
+	uint64_t offset;
+	size_t types = 0;
+	size_t bitmap, chunk, i, j;
+	size_t length;
+	int fd;
+	int status;
+
+	columns_layout(&layout, count, 1);
+
+	path_set(path_buffer, DB_COLUMNS_TEMPNAME, sizeof(DB_COLUMNS_TEMPNAME) - 1);
+	fd = open(path_buffer->data, O_RDONLY);
+	if (fd < 0)
+		return ERROR;
+	columns = mmap(0, layout.total, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (columns == MAP_FAILED)
+		return ERROR_MEMORY;
+	content = (const uint16_t *)(columns + layout.content);
+	mime_type = (const uint32_t *)(columns + layout.mime_type);
+
+	for(i = 0; i < count; ++i)
+		if (mime_type[i] >= types)
+			types = mime_type[i] + 1;
+	header[0] = count;
+	header[1] = DB_BITMAP_TYPES + types;
+
+	// Each bitmap has its own list of containers so that the containers of a bitmap are stored together.
+	bitmaps = alloc(header[1] * sizeof(*bitmaps));
+	for(bitmap = 0; bitmap < header[1]; ++bitmap)
+		bitmaps[bitmap] = (struct bitmaps){0};
+	words = alloc(header[1] * BITMAP_WORDS * sizeof(*words));
+	for(chunk = 0; chunk * BITMAP_CHUNK < count; ++chunk)
+	{
+		size_t end = (((count - chunk * BITMAP_CHUNK) < BITMAP_CHUNK) ? count : (chunk + 1) * BITMAP_CHUNK);
+
+		memset(words, 0, header[1] * BITMAP_WORDS * sizeof(*words));
+		for(i = chunk * BITMAP_CHUNK; i < end; ++i)
+		{
+			size_t word = (i % BITMAP_CHUNK) / 64;
+			uint64_t bit = (uint64_t)1 << (i % 64);
+			unsigned bits = content[i];
+
+			while (bits)
+			{
+				words[__builtin_ctz(bits) * BITMAP_WORDS + word] |= bit;
+				bits &= bits - 1;
+			}
+			words[(DB_BITMAP_TYPES + mime_type[i]) * BITMAP_WORDS + word] |= bit;
+		}
+		for(bitmap = 0; bitmap < header[1]; ++bitmap)
+			bitmaps_add(bitmaps + bitmap, chunk, words + bitmap * BITMAP_WORDS);
+	}
+	free(words);
+	munmap((void *)columns, layout.total);
+
+	// Make the offsets of the containers relative to the data of all the bitmaps.
+	starts = alloc((header[1] + 1) * sizeof(*starts));
+	starts[0] = 0;
+	offset = 0;
+	for(bitmap = 0; bitmap < header[1]; ++bitmap)
+	{
+		starts[bitmap + 1] = starts[bitmap] + bitmaps[bitmap].count;
+		for(j = 0; j < bitmaps[bitmap].count; ++j)
+			bitmaps[bitmap].containers[j].offset += offset;
+		offset += bitmaps[bitmap].size;
+	}
+
+	length = path_set(path_buffer, DB_BITMAP_TEMPNAME, sizeof(DB_BITMAP_TEMPNAME) - 1);
+	fd = fs_load(path_buffer->data, length, db_access, 1);
+	if (fd < 0)
+	{
+		status = fd;
+		goto finally;
+	}
+
+	if (!(status = data_write(fd, DB_HEADER, sizeof(DB_HEADER) - 1)) && !(status = data_write(fd, header, sizeof(header))))
+		status = data_write(fd, starts, (header[1] + 1) * sizeof(*starts));
+	for(bitmap = 0; !status && (bitmap < header[1]); ++bitmap)
+		status = data_write(fd, bitmaps[bitmap].containers, bitmaps[bitmap].count * sizeof(*bitmaps[bitmap].containers));
+	for(bitmap = 0; !status && (bitmap < header[1]); ++bitmap)
+		status = data_write(fd, bitmaps[bitmap].data, bitmaps[bitmap].size);
+
+	close(fd);
+	if (status)
+		unlink(path_buffer->data);
+
+finally:
+	for(bitmap = 0; bitmap < header[1]; ++bitmap)
+		bitmaps_term(bitmaps + bitmap);
+	free(bitmaps);
+	free(starts);
+	return status;
+}
+
+// Subtree being summed by aggregate_write().
+struct aggregate_subtree
+{
+	uint64_t end;
+	size_t directory;
+	struct aggregate total;
+};
+
+// Writes the totals for the subtree of each directory. The values are taken from the generated columns.
+// Records are in depth-first order so the subtrees are summed bottom-up in one pass: each record is added to
+// the innermost directory containing it and the totals of a directory are added to its parent when its subtree ends.
+// If links is not NULL (the database has an inode index), a file with several hard links is counted only for its first record.
+// Symbolic links are not followed: a link is counted as a file with the size of the link itself (the records store the stat
+// information of the target) and a link to a directory gets totals of its own instead of a subtree.
+static int aggregate_write(struct path_buffer *restrict path_buffer, const struct db *restrict db, const uint64_t *restrict links)
+{
+	struct columns_layout layout;
+	const unsigned char *columns, *paths;
+	const uint64_t *size, *end;
+	const uint16_t *content;
+	struct aggregate_subtree *subtrees;
+	size_t subtrees_count = 0;
+	unsigned char *linked = 0; // whether the record is a hard link to a file counted for an earlier record
+	uint64_t *records = 0;
+	struct aggregate *aggregates = 0;
+	uint64_t header[2];
+	size_t capacity = 0;
+	size_t count = db->count;
+	size_t record, bit, offset;
+	size_t length;
+	int fd;
+	int status;
+
+	path_set(path_buffer, DB_RECORDS_TEMPNAME, sizeof(DB_RECORDS_TEMPNAME) - 1);
+	fd = open(path_buffer->data, O_RDONLY);
+	if (fd < 0)
+		return ERROR;
+	paths = mmap(0, db->data_offset, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (paths == MAP_FAILED)
+		return ERROR_MEMORY;
+
+	columns_layout(&layout, count, 1);
+
+	path_set(path_buffer, DB_COLUMNS_TEMPNAME, sizeof(DB_COLUMNS_TEMPNAME) - 1);
+	fd = open(path_buffer->data, O_RDONLY);
+	if (fd < 0)
+	{
+		munmap((void *)paths, db->data_offset);
+		return ERROR;
+	}
+	columns = mmap(0, layout.total, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (columns == MAP_FAILED)
+	{
+		munmap((void *)paths, db->data_offset);
+		return ERROR_MEMORY;
+	}
+	size = (const uint64_t *)(columns + layout.size);
+	end = (const uint64_t *)(columns + layout.end);
+	content = (const uint16_t *)(columns + layout.content);
+
+	subtrees = alloc((PATH_SIZE_LIMIT / 2 + 1) * sizeof(*subtrees));
+	if (links)
+	{
+		linked = alloc(count + 1);
+		memset(linked, 0, count + 1);
+	}
+	header[0] = count;
+	header[1] = 0;
+	for(offset = sizeof(DB_HEADER) - 1, record = 0; record <= count; offset += sizeof(struct file) + length, ++record)
+	{
+		struct file file;
+		int directory;
+		uint16_t flags;
+		uint64_t link_size = 0;
+
+		// Close the subtrees that end before this record.
+		while (subtrees_count && ((record == count) || (subtrees[subtrees_count - 1].end <= record)))
+		{
+			const struct aggregate *total = &subtrees[subtrees_count - 1].total;
+			aggregates[subtrees[subtrees_count - 1].directory] = *total;
+			if (--subtrees_count)
+			{
+				struct aggregate *parent = &subtrees[subtrees_count - 1].total;
+				parent->size += total->size;
+				parent->files += total->files;
+				for(bit = 0; bit < DB_BITMAP_TYPES; ++bit)
+					parent->content[bit] += total->content[bit];
+			}
+		}
+		if (record == count)
+			break;
+
+		memcpy(&file, paths + offset, sizeof(file));
+		length = file.path_length;
+		flags = content[record];
+		directory = ((flags & CONTENT_DIRECTORY) && !(flags & CONTENT_LINK));
+		if (flags & CONTENT_LINK)
+		{
+			char buffer[PATH_SIZE_LIMIT];
+			struct stat info;
+
+			memcpy(buffer, paths + offset + sizeof(struct file), length);
+			buffer[length] = 0;
+			if (!lstat(buffer, &info))
+				link_size = info.st_size;
+			flags &= ~CONTENT_DIRECTORY;
+		}
+
+		if (links && (links[record] > record))
+			linked[links[record]] = 1;
+
+		if (subtrees_count && !(linked && linked[record]))
+		{
+			struct aggregate *parent = &subtrees[subtrees_count - 1].total;
+			if (!directory)
+			{
+				parent->size += ((flags & CONTENT_LINK) ? link_size : size[record]);
+				parent->files += 1;
+			}
+			for(bit = 0; bit < DB_BITMAP_TYPES; ++bit)
+				parent->content[bit] += (flags >> bit) & 1;
+		}
+
+		if (directory || (flags & CONTENT_LINK))
+		{
+			if (header[1] == capacity)
+			{
+				capacity = (capacity ? capacity * 2 : 256);
+				records = realloc(records, capacity * sizeof(*records));
+				aggregates = realloc(aggregates, capacity * sizeof(*aggregates));
+				if (!records || !aggregates)
+					abort();
+			}
+			records[header[1]] = record;
+			if (directory)
+			{
+				subtrees[subtrees_count].end = end[record];
+				subtrees[subtrees_count].directory = header[1]++;
+				memset(&subtrees[subtrees_count].total, 0, sizeof(subtrees[subtrees_count].total));
+				subtrees[subtrees_count].total.size = size[record];
+				subtrees_count += 1;
+			}
+			else
+			{
+				// Like for a directory, the totals hold the size of the link itself and no files.
+				memset(aggregates + header[1], 0, sizeof(*aggregates));
+				aggregates[header[1]++].size = link_size;
+			}
+		}
+	}
+	free(linked);
+	free(subtrees);
+	munmap((void *)columns, layout.total);
+	munmap((void *)paths, db->data_offset);
+
+	length = path_set(path_buffer, DB_AGGREGATE_TEMPNAME, sizeof(DB_AGGREGATE_TEMPNAME) - 1);
+	fd = fs_load(path_buffer->data, length, db_access, 1);
+	if (fd >= 0)
+	{
+		if (!(status = data_write(fd, DB_HEADER, sizeof(DB_HEADER) - 1)) && !(status = data_write(fd, header, sizeof(header))) && !(status = data_write(fd, records, header[1] * sizeof(*records))))
+			status = data_write(fd, aggregates, header[1] * sizeof(*aggregates));
+		close(fd);
+		if (status)
+			unlink(path_buffer->data);
+	}
+	else status = fd;
+
+	free(aggregates);
+	free(records);
+	return status;
+}
+
+static void *file_map(struct path_buffer *restrict path_buffer, const char *restrict name, size_t name_length, size_t *restrict size);
+static int db_load(struct search *restrict search, struct path_buffer *restrict path_buffer);
+
+// Saved search being evaluated.
+struct saved_search
+{
+	const char *definition;
+	size_t definition_size;
+	struct query query;
+	uint64_t *records;
+	size_t count, capacity;
+};
+
+// Parses the definitions of the saved searches. Each is stored as its size, followed by the name and the arguments of the search (each terminated by 0).
+static int searches_parse(const unsigned char *restrict buffer, size_t size, struct saved_search **restrict result, size_t *restrict result_count)
+{
+	struct saved_search *searches = 0;
+	size_t count = 0, capacity = 0;
+	size_t offset = 0;
+
+	while (offset < size)
+	{
+		struct saved_search *search;
+		uint64_t length;
+		size_t start;
+
+		if (size - offset < sizeof(length))
+			goto error;
+		memcpy(&length, buffer + offset, sizeof(length));
+		offset += sizeof(length);
+		if (!length || (length > size - offset) || buffer[offset + length - 1])
+			goto error;
+
+		if (count == capacity)
+		{
+			capacity = (capacity ? capacity * 2 : 8);
+			searches = realloc(searches, capacity * sizeof(*searches));
+			if (!searches)
+				abort();
+		}
+		search = searches + count;
+		search->definition = (const char *)buffer + offset;
+		search->definition_size = length;
+		search->records = 0;
+		search->count = 0;
+		search->capacity = 0;
+
+		// The name is followed by the arguments.
+		start = strlen(search->definition) + 1;
+		if (query_load(&search->query, search->definition + start, length - start))
+			goto error;
+
+		count += 1;
+		offset += length;
+	}
+
+	*result = searches;
+	*result_count = count;
+	return 0;
+
+error:
+	free(searches);
+	return ERROR_INPUT;
+}
+
+static void searches_term(struct saved_search *restrict searches, size_t count)
+{
+	size_t i;
+	for(i = 0; i < count; ++i)
+		free(searches[i].records);
+	free(searches);
+}
+
+// Adds the record to each saved search that it matches.
+static void searches_add(struct saved_search *restrict searches, size_t count, const unsigned char *restrict path, const struct file *restrict file, uint64_t record)
+{
+	size_t i;
+
+	for(i = 0; i < count; ++i)
+	{
+		struct saved_search *search = searches + i;
+
+		if (!query_match(&search->query, path, file))
+			continue;
+
+		if (search->count == search->capacity)
+		{
+			search->capacity = (search->capacity ? search->capacity * 2 : 256);
+			search->records = realloc(search->records, search->capacity * sizeof(*search->records));
+			if (!search->records)
+				abort();
+		}
+		search->records[search->count++] = record;
+	}
+}
+
+// The saved searches file starts with the database header, followed by the number of records and the generation of the database and the number of searches.
+// Each search has an entry with the offset and size of its definition and the offset and count of its records.
+// The records of each search follow the entries and the definitions are at the end.
+static int searches_store(struct path_buffer *restrict path_buffer, uint64_t records, uint64_t generation, const struct saved_search *restrict searches, size_t count)
+{
+	uint64_t header[3] = {records, generation, count};
+	uint64_t *entries;
+	size_t offset, length, i;
+	int fd;
+	int status;
+
+	entries = alloc(count * 4 * sizeof(*entries));
+	offset = sizeof(DB_HEADER) - 1 + sizeof(header) + count * 4 * sizeof(*entries);
+	for(i = 0; i < count; ++i)
+	{
+		entries[i * 4 + 2] = offset;
+		entries[i * 4 + 3] = searches[i].count;
+		offset += searches[i].count * sizeof(*searches[i].records);
+	}
+	for(i = 0; i < count; ++i)
+	{
+		entries[i * 4] = offset;
+		entries[i * 4 + 1] = searches[i].definition_size;
+		offset += searches[i].definition_size;
+	}
+
+	length = path_set(path_buffer, DB_SAVED_TEMPNAME, sizeof(DB_SAVED_TEMPNAME) - 1);
+	fd = fs_load(path_buffer->data, length, db_access, 1);
+	if (fd < 0)
+	{
+		free(entries);
+		return fd;
+	}
+
+	if (!(status = data_write(fd, DB_HEADER, sizeof(DB_HEADER) - 1)) && !(status = data_write(fd, header, sizeof(header))))
+		status = data_write(fd, entries, count * 4 * sizeof(*entries));
+	for(i = 0; !status && (i < count); ++i)
+		status = data_write(fd, searches[i].records, searches[i].count * sizeof(*searches[i].records));
+	for(i = 0; !status && (i < count); ++i)
+		status = data_write(fd, searches[i].definition, searches[i].definition_size);
+	close(fd);
+	if (status)
+		unlink(path_buffer->data);
+
+	free(entries);
+	return status;
+}
+
+// Evaluates the saved searches on the records of the new database.
+static int saved_write(struct path_buffer *restrict path_buffer, const struct db *restrict db, uint64_t generation)
+{
+	void *buffer;
+	size_t size;
+	struct saved_search *searches;
+	size_t count;
+	const unsigned char *records;
+	size_t offset, record, length;
+	int fd;
+	int status;
+
+	buffer = file_map(path_buffer, DB_SEARCHES_NAME, sizeof(DB_SEARCHES_NAME) - 1, &size);
+	if (!buffer)
+		return 0; // no saved searches
+	if (searches_parse(buffer, size, &searches, &count))
+	{
+		munmap(buffer, size);
+		fprintf(stderr, "WARNING: Invalid saved searches; saved searches not evaluated\n");
+		return 0;
+	}
+
+	path_set(path_buffer, DB_RECORDS_TEMPNAME, sizeof(DB_RECORDS_TEMPNAME) - 1);
+	fd = open(path_buffer->data, O_RDONLY);
+	if (fd < 0)
+	{
+		status = ERROR;
+		goto finally;
+	}
+	records = mmap(0, db->data_offset, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (records == MAP_FAILED)
+	{
+		status = ERROR_MEMORY;
+		goto finally;
+	}
+
+	for(offset = sizeof(DB_HEADER) - 1, record = 0; record < db->count; offset += sizeof(struct file) + length, ++record)
+	{
+		struct file file;
+
+		memcpy(&file, records + offset, sizeof(file));
+		length = file.path_length;
+		searches_add(searches, count, records + offset + sizeof(file), &file, record);
+	}
+
+	munmap((void *)records, db->data_offset);
+
+	status = searches_store(path_buffer, db->count, generation, searches, count);
+
+finally:
+	searches_term(searches, count);
+	munmap(buffer, size);
+	return status;
+}
+
+// Appends the other files of the new database to data as sections and replaces the database with a single rename.
+// Readers see either the old database or the new one, never a mix of the two.
+static int container_write(struct path_buffer *restrict path_origin, struct path_buffer *restrict path_target)
+{
+	struct container_entry toc[1 + SECTIONS_COUNT] = {0};
+	uint64_t trailer[2];
+	unsigned char *buffer;
+	struct stat info;
+	uint64_t offset;
+	size_t count, i;
+	int fd;
+	int status = 0;
+
+	path_set(path_origin, DB_DATA_TEMPNAME, sizeof(DB_DATA_TEMPNAME) - 1);
+	fd = open(path_origin->data, O_WRONLY);
+	if (fd < 0)
+	{
+		status = ERROR_ACCESS;
+		goto finally;
+	}
+	if (fstat(fd, &info) < 0)
+	{
+		close(fd);
+		status = ERROR;
+		goto finally;
+	}
+
+	// data stays at the beginning so it is not copied.
+	memcpy(toc[0].name, DB_DATA_NAME, sizeof(DB_DATA_NAME));
+	toc[0].offset = 0;
+	toc[0].size = info.st_size;
+	count = 1;
+	offset = info.st_size;
+
+	buffer = alloc(CONTAINER_COPY);
+	for(i = 0; !status && (i < SECTIONS_COUNT); ++i)
+	{
+		ssize_t size;
+		int section;
+
+		path_set(path_origin, sections[i].tempname, strlen(sections[i].tempname));
+		section = open(path_origin->data, O_RDONLY);
+		if (section < 0)
+			continue; // optional section not created
+
+		offset = (offset + CONTAINER_ALIGNMENT - 1) & ~(uint64_t)(CONTAINER_ALIGNMENT - 1);
+		memcpy(toc[count].name, sections[i].name, strlen(sections[i].name) + 1);
+		toc[count].offset = offset;
+		if (lseek(fd, offset, SEEK_SET) < 0)
+			status = ERROR_WRITE;
+		while (!status && ((size = read(section, buffer, CONTAINER_COPY)) > 0))
+		{
+			status = data_write(fd, buffer, size);
+			offset += size;
+		}
+		if (!status && (size < 0))
+			status = ERROR_READ;
+		close(section);
+		toc[count].size = offset - toc[count].offset;
+		count += 1;
+	}
+	free(buffer);
+
+	offset = (offset + sizeof(uint64_t) - 1) & ~(uint64_t)(sizeof(uint64_t) - 1);
+	trailer[0] = offset;
+	trailer[1] = count;
+	if (!status && (lseek(fd, offset, SEEK_SET) < 0))
+		status = ERROR_WRITE;
+	if (!status && !(status = data_write(fd, toc, count * sizeof(*toc))) && !(status = data_write(fd, trailer, sizeof(trailer))))
+		status = data_write(fd, CONTAINER_MAGIC, sizeof(CONTAINER_MAGIC) - 1);
+	if (!status && (fsync(fd) < 0))
+		status = ERROR_WRITE; // the new database must be on disk before it replaces the old one
+	close(fd);
+
+	memcpy(path_target->data, path_origin->data, path_origin->prefix_length);
+	path_target->prefix_length = path_origin->prefix_length;
+
+	path_set(path_origin, DB_DATA_TEMPNAME, sizeof(DB_DATA_TEMPNAME) - 1);
+	path_set(path_target, DB_CONTAINER_NAME, sizeof(DB_CONTAINER_NAME) - 1);
+	if (!status && (rename(path_origin->data, path_target->data) < 0))
+		status = ERROR_WRITE;
+
+	// Remove the separate files of databases created by older versions.
+	if (!status)
+	{
+		path_set(path_target, DB_DATA_NAME, sizeof(DB_DATA_NAME) - 1);
+		unlink(path_target->data);
+		for(i = 0; i < SECTIONS_COUNT; ++i)
+		{
+			path_set(path_target, sections[i].name, strlen(sections[i].name));
+			unlink(path_target->data);
+		}
+	}
+
+finally:
+	if (status)
+	{
+		path_set(path_origin, DB_DATA_TEMPNAME, sizeof(DB_DATA_TEMPNAME) - 1);
+		unlink(path_origin->data);
+	}
+	for(i = 0; i < SECTIONS_COUNT; ++i)
+	{
+		path_set(path_origin, sections[i].tempname, strlen(sections[i].tempname));
+		unlink(path_origin->data);
+	}
+	return status;
+}
+
+static int db_write(struct db *restrict db)
+{
+	struct perfect_key *keys = 0;
+	struct trigrams trigrams = {0};
+	struct names names = {0};
+	uint64_t *digests = 0;
+	uint64_t *links = 0; // next record of the same file (only with DB_INODE)
+	void *buffer;
+
+	struct search previous;
+	int previous_status;
+	uint64_t generation;
+
+	struct path_buffer path_origin;
+	struct path_buffer path_target;
+	size_t i;
+	int status;
+
+	close(db->data);
+	close(db->roots);
+
+	status = path_init(&path_origin);
+	assert(status == 0);
+
+	if (db->flags & DB_PERFECT)
+		keys = alloc((db->count + 1) * sizeof(*keys));
+	if (db->flags & DB_DIGEST)
+		digests = alloc((db->count + 1) * sizeof(*digests));
+
+	// The files that are unchanged since the current database keep their generation and their digest.
+	// A database created by another version of findex is replaced without a message.
+	previous_status = db_load(&previous, &path_origin);
+	if (!previous_status)
+		db_advise(&previous, DB_USE_LOOKUP);
+	generation = (previous_status ? 1 : previous.generation + 1);
+	status = db_build(db, &path_origin, keys, ((db->flags & DB_TRIGRAM) ? &trigrams : 0), ((db->flags & DB_NAMES) ? &names : 0), digests, (previous_status ? 0 : &previous), generation);
+	if (!status && digests)
+		status = digest_write(&path_origin, db, digests);
+	free(digests);
+	if (!status && (db->flags & DB_MEDIA))
+		status = media_write(&path_origin, db, (previous_status ? 0 : &previous));
+	if (!status)
+		status = saved_write(&path_origin, db, generation);
+	if (!previous_status)
+		db_close(&previous);
+	if (!status && keys)
+	{
+		status = perfect_write(&path_origin, keys, db->count);
+		if (status == ERROR_EXIST)
+		{
+			fprintf(stderr, "WARNING: Some paths are indexed more than once; perfect hash index not created\n");
+			status = 0;
+		}
+	}
+	free(keys);
+	if (!status && (db->flags & DB_TRIGRAM))
+		status = trigram_write(&path_origin, &trigrams);
+	trigrams_term(&trigrams);
+	if (!status && (db->flags & DB_NAMES))
+		status = names_write(&path_origin, &names);
+	names_term(&names);
+	if (!status && (db->flags & DB_SORTED))
+		status = sorted_write(&path_origin, db->count);
+	if (!status && (db->flags & DB_BITMAP))
+		status = bitmap_write(&path_origin, db->count);
+	if (!status && (db->flags & DB_INODE))
+	{
+		links = alloc(db->count * sizeof(*links) + 1);
+		status = inode_write(&path_origin, db, links);
+		if (status == ERROR_EXIST)
+		{
+			fprintf(stderr, "WARNING: Some files have the same inode hash; inode index not created\n");
+			status = 0;
+		}
+	}
+	free(db->inodes);
+	db->inodes = 0;
+	if (!status)
+		status = aggregate_write(&path_origin, db, links);
+	free(links);
+	path_set(&path_origin, DB_RECORDS_TEMPNAME, sizeof(DB_RECORDS_TEMPNAME) - 1);
+	unlink(path_origin.data);
+	if (status)
+	{
+		close(db->index);
+		path_set(&path_origin, DB_DATA_TEMPNAME, sizeof(DB_DATA_TEMPNAME) - 1);
+		unlink(path_origin.data);
+		for(i = 0; i < SECTIONS_COUNT; ++i)
+		{
+			path_set(&path_origin, sections[i].tempname, strlen(sections[i].tempname));
+			unlink(path_origin.data);
+		}
+		path_set(&path_origin, DB_SAVED_TEMPNAME, sizeof(DB_SAVED_TEMPNAME) - 1);
+		unlink(path_origin.data);
+
+		return status;
+	}
+
+	// Map index file in memory.
+	buffer = mmap(0, db->index_offset, PROT_WRITE, MAP_SHARED, db->index, 0);
+	close(db->index);
+	if (buffer == MAP_FAILED)
+	{
+		fprintf(stderr, "ERROR: mmap failed for index\n");
+		return ERROR;
+	}
+
+	{
+		struct index_entry *entries = (void *)((char *)buffer + sizeof(INDEX_HEADER) - 1); // TODO ugly casting hack; think how to fix
+		size_t count = (db->index_offset - sizeof(INDEX_HEADER) + 1) / sizeof(*entries);
+
+		index_sort(entries, count);
+
+		// The bloom filter is not required for searching so just skip it on error.
+		if (db->bloom && bloom_write(&path_origin, entries, count, db->bloom))
+			fprintf(stderr, "WARNING: Unable to create bloom filter\n");
+	}
+	munmap(buffer, db->index_offset);
+
+	// Replace the old database with the new one at once.
+	if (status = container_write(&path_origin, &path_target))
+	{
+		path_set(&path_origin, DB_SAVED_TEMPNAME, sizeof(DB_SAVED_TEMPNAME) - 1);
+		unlink(path_origin.data);
+		return status;
+	}
+
+	// Replace old results of the saved searches with the new ones (if there are saved searches).
+	path_set(&path_origin, DB_SAVED_TEMPNAME, sizeof(DB_SAVED_TEMPNAME) - 1);
+	path_set(&path_target, DB_SAVED_NAME, sizeof(DB_SAVED_NAME) - 1);
+	if (rename(path_origin.data, path_target.data) < 0)
+		unlink(path_target.data); // cleanup outdated results
+
+	return 0;
+}
+
+int db_persist(struct db *restrict db)
+{
+	struct path_buffer path_buffer;
+	int status;
+
+	status = db_write(db);
+	if (!status && !path_init(&path_buffer))
+	{
+		deltas_remove(&path_buffer, db->deltas); // the changes in the segments are included in the new database
+
+		// A database created from the file system is no longer a replica of another database.
+		if (!db->deltas)
+		{
+			path_set(&path_buffer, DB_REPLICA_NAME, sizeof(DB_REPLICA_NAME) - 1);
+			unlink(path_buffer.data);
+		}
+	}
+	close(db->lock);
+
+	return status;
+}
+
+void db_delete(struct db *restrict db)
+{
+	struct path_buffer buffer;
+	int status;
+
+	status = path_init(&buffer);
+	assert(status == 0);
+
+	path_set(&buffer, DB_RECORDS_TEMPNAME, sizeof(DB_RECORDS_TEMPNAME) - 1);
+	unlink(buffer.data);
+	close(db->data);
+
+	path_set(&buffer, DB_INDEX_TEMPNAME, sizeof(DB_INDEX_TEMPNAME) - 1);
+	unlink(buffer.data);
+	close(db->index);
+
+	if (db->roots >= 0)
+	{
+		path_set(&buffer, DB_ROOTS_TEMPNAME, sizeof(DB_ROOTS_TEMPNAME) - 1);
+		unlink(buffer.data);
+		close(db->roots);
+	}
+
+	free(db->inodes);
+	close(db->lock);
+}
+
+// Maps the whole database file with the given name in memory.
+static void *file_map(struct path_buffer *restrict path_buffer, const char *restrict name, size_t name_length, size_t *restrict size)
+{
+	int fd;
+	struct stat info;
+	void *buffer;
+
+	path_set(path_buffer, name, name_length);
+	fd = open(path_buffer->data, O_RDONLY);
+	if (fd < 0)
+		return 0;
+	if (fstat(fd, &info) < 0)
+	{
+		close(fd);
+		return 0;
+	}
+
+	buffer = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (buffer == MAP_FAILED)
+		return 0;
+
+	*size = info.st_size;
+	return buffer;
+}
+
+// Reads the change of the given entry of a delta segment.
+static int delta_change(const struct delta_segment *restrict segment, size_t entry, uint32_t *restrict flags, struct file *restrict file, const unsigned char **restrict path)
+{
+	uint64_t offset = segment->entries[entry].offset;
+
+	if ((offset > segment->changes_size) || (segment->changes_size - offset < sizeof(*flags) + sizeof(*file)))
+		return ERROR_INPUT;
+	memcpy(flags, segment->changes + offset, sizeof(*flags));
+	memcpy(file, segment->changes + offset + sizeof(*flags), sizeof(*file));
+	offset += sizeof(*flags) + sizeof(*file);
+	if (file->path_length > segment->changes_size - offset)
+		return ERROR_INPUT;
+	*path = segment->changes + offset;
+
+	return 0;
+}
+
+// Finds the entry for the given path in a delta segment. Returns the index of the entry or error code.
+static ssize_t delta_find(const struct delta_segment *restrict segment, uint64_t hashsum, const char *restrict path, size_t length)
+{
+	size_t low = 0, high = segment->count;
+	size_t i;
+
+	while (low < high)
+	{
+		i = (high - low) / 2 + low;
+		if (segment->entries[i].hash < hashsum)
+			low = i + 1;
+		else
+			high = i;
+	}
+
+	for(i = low; (i < segment->count) && (segment->entries[i].hash == hashsum); ++i)
+	{
+		uint32_t flags;
+		struct file file;
+		const unsigned char *change;
+		int status = delta_change(segment, i, &flags, &file, &change);
+		if (status)
+			return status;
+		if ((file.path_length == length) && !memcmp(change, path, length))
+			return i;
+	}
+
+	return ERROR_MISSING;
+}
+
+// Maps the delta segments in memory (newest first).
+static int deltas_open(struct search *restrict search, struct path_buffer *restrict path_buffer)
+{
+	uint64_t *numbers;
+	ssize_t count = deltas_list(path_buffer, &numbers);
+	ssize_t i;
+
+	if (count <= 0)
+		return count;
+
+	search->deltas = alloc(count * sizeof(*search->deltas));
+
+	for(i = 0; i < count; ++i)
+	{
+		struct delta_segment *segment = search->deltas + search->deltas_count;
+		char name[DELTA_NAME_SIZE];
+		size_t offset = sizeof(DB_HEADER) - 1 + sizeof(segment->count);
+
+		segment->buffer = file_map(path_buffer, name, delta_name(name, DB_DELTA_NAME, sizeof(DB_DELTA_NAME) - 1, numbers[i]), &segment->size);
+		if (!segment->buffer)
+			continue; // the segment was compacted in the meantime
+		segment->number = numbers[i];
+		segment->hidden = 0;
+		search->deltas_count += 1;
+
+		if ((segment->size < offset) || memcmp(segment->buffer, DB_HEADER, sizeof(DB_HEADER) - 1))
+			break; // invalid database format
+		memcpy(&segment->count, (const unsigned char *)segment->buffer + sizeof(DB_HEADER) - 1, sizeof(segment->count));
+		if (segment->count > (segment->size - offset) / sizeof(*segment->entries))
+			break; // invalid database format
+		segment->entries = (const struct delta_entry *)((const unsigned char *)segment->buffer + offset);
+		offset += segment->count * sizeof(*segment->entries);
+		segment->changes = (const unsigned char *)segment->buffer + offset;
+		segment->changes_size = segment->size - offset;
+
+		segment->hidden = alloc((segment->count / 64 + 1) * sizeof(*segment->hidden));
+		memset(segment->hidden, 0, (segment->count / 64 + 1) * sizeof(*segment->hidden));
+		search->deltas_entries += segment->count;
+	}
+	free(numbers);
+
+	return ((i < count) ? ERROR_INPUT : 0);
+}
+
+static int deltas_mask(struct search *restrict search);
+
+// Checks the table of sections at the end of the container.
+// Returns ERROR_READ if the trailer is missing or doesn't describe a table inside the container (e.g. the file is truncated)
+// and ERROR_INPUT if an entry of the table is invalid.
+static int container_read(struct search *restrict search)
+{
+	const unsigned char *container = search->container_buffer;
+	size_t size = search->container_size;
+	uint64_t trailer[2];
+	size_t i;
+
+	if ((size < sizeof(DB_HEADER) - 1 + CONTAINER_TRAILER_SIZE) || memcmp(container + size - (sizeof(CONTAINER_MAGIC) - 1), CONTAINER_MAGIC, sizeof(CONTAINER_MAGIC) - 1))
+		return ERROR_READ;
+	memcpy(trailer, container + size - CONTAINER_TRAILER_SIZE, sizeof(trailer));
+	size -= CONTAINER_TRAILER_SIZE;
+	if ((trailer[0] > size) || (trailer[1] != (size - trailer[0]) / sizeof(struct container_entry)) || ((size - trailer[0]) % sizeof(struct container_entry)))
+		return ERROR_READ;
+	search->container_toc = container + trailer[0];
+	search->container_count = trailer[1];
+
+	// Make sure the sections are inside the container.
+	for(i = 0; i < search->container_count; ++i)
+	{
+		struct container_entry entry;
+
+		memcpy(&entry, search->container_toc + i * sizeof(entry), sizeof(entry));
+		if (entry.name[CONTAINER_NAME_SIZE - 1] || (entry.offset % CONTAINER_ALIGNMENT) || (entry.offset > trailer[0]) || (entry.size > trailer[0] - entry.offset))
+			return ERROR_INPUT;
+	}
+
+	return 0;
+}
+
+// Locates a file of the database: as a section of the container or as a separate file in databases created by older versions.
+static void *section_map(const struct search *restrict search, struct path_buffer *restrict path_buffer, const char *restrict name, size_t name_length, size_t *restrict size)
+{
+	size_t i;
+
+	if (!search->container_buffer)
+		return file_map(path_buffer, name, name_length, size);
+
+	for(i = 0; i < search->container_count; ++i)
+	{
+		struct container_entry entry;
+
+		memcpy(&entry, search->container_toc + i * sizeof(entry), sizeof(entry));
+		if (!memcmp(entry.name, name, name_length + 1))
+		{
+			*size = entry.size;
+			return (unsigned char *)search->container_buffer + entry.offset;
+		}
+	}
+	return 0; // optional section not created
+}
+
+// Checks the results of the saved searches.
+static int saved_read(struct search *restrict search)
+{
+	const unsigned char *saved = search->saved_buffer;
+	uint64_t header[3];
+	size_t offset = sizeof(DB_HEADER) - 1 + sizeof(header);
+	size_t i;
+
+	if ((search->saved_size < offset) || memcmp(saved, DB_HEADER, sizeof(DB_HEADER) - 1))
+		return ERROR_INPUT;
+	memcpy(header, saved + sizeof(DB_HEADER) - 1, sizeof(header));
+	if ((header[0] != search->columns.count) || (header[1] != search->generation) || (header[2] > (search->saved_size - offset) / (4 * sizeof(uint64_t))))
+		return ERROR_INPUT;
+	search->saved_count = header[2];
+	search->saved_entries = (const uint64_t *)(saved + offset);
+	for(i = 0; i < search->saved_count; ++i)
+	{
+		const uint64_t *entry = search->saved_entries + i * 4;
+		if ((entry[0] > search->saved_size) || !entry[1] || (entry[1] > search->saved_size - entry[0]) || saved[entry[0] + entry[1] - 1])
+			return ERROR_INPUT;
+		if ((entry[2] > search->saved_size) || (entry[2] % sizeof(uint64_t)) || (entry[3] > (search->saved_size - entry[2]) / sizeof(uint64_t)))
+			return ERROR_INPUT;
+	}
+
+	return 0;
+}
+
+static int db_load(struct search *restrict search, struct path_buffer *restrict path_buffer)
+{
+	struct search temp;
+	int fd;
+	void *buffer;
+
+	// The whole database is mapped at once when it is in a container.
+	temp.container_buffer = file_map(path_buffer, DB_CONTAINER_NAME, sizeof(DB_CONTAINER_NAME) - 1, &temp.container_size);
+	if (temp.container_buffer)
+	{
+		size_t size;
+		int status;
+
+		if (!(status = container_read(&temp)) && !(buffer = section_map(&temp, path_buffer, DB_DATA_NAME, sizeof(DB_DATA_NAME) - 1, &size)))
+			status = ERROR_INPUT;
+		if (status)
+		{
+			munmap(temp.container_buffer, temp.container_size);
+			return status;
+		}
+		temp.info.st_size = size; // only the size of data is used
+	}
+	else
+	{
+		path_set(path_buffer, DB_DATA_NAME, sizeof(DB_DATA_NAME) - 1);
+		fd = open(path_buffer->data, O_RDONLY);
+		if (fd < 0)
+			return ((errno == ENOENT) ? ERROR_MISSING : ERROR);
+		if (fstat(fd, &temp.info) < 0)
+		{
+			close(fd);
+			return ERROR;
+		}
+
+		buffer = mmap(0, temp.info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (buffer == MAP_FAILED)
+			return ERROR;
+	}
+	temp.data_buffer = buffer;
+
+	temp.columns_buffer = 0;
+	temp.index_buffer = 0;
+	temp.roots_buffer = 0;
+	temp.perfect_buffer = 0;
+	temp.bloom_buffer = 0;
+	temp.trigram_buffer = 0;
+	temp.names_buffer = 0;
+	temp.sorted_buffer = 0;
+	temp.bitmap_buffer = 0;
+	temp.inode_buffer = 0;
+	temp.digest_buffer = 0;
+	temp.digests = 0;
+	temp.media_buffer = 0;
+	temp.aggregate_buffer = 0;
+	temp.aggregates_count = 0;
+	temp.saved_buffer = 0;
+	temp.saved_count = 0;
+	temp.bloom_stats = (struct bloom_stats){0};
+	temp.paths = 0;
+	temp.paths_capacity = 0;
+	temp.paths_size = 0;
+	temp.deltas = 0;
+	temp.deltas_count = 0;
+	temp.deltas_entries = 0;
+	temp.masked = 0;
+
+	// Check file header.
+	if (temp.info.st_size < (sizeof(DB_HEADER) - 1))
+		goto error; // unexpected EOF
+	if (memcmp(temp.data_buffer, DB_HEADER, sizeof(DB_HEADER) - 1))
+	{
+		// A header that differs only in the version is from another version of findex.
+		const unsigned char *header = temp.data_buffer;
+		if ((header[0] == DB_HEADER[0]) && !memcmp(header + 2, DB_HEADER + 2, sizeof(DB_HEADER) - 3))
+		{
+			db_close(&temp);
+			return ERROR_UNSUPPORTED;
+		}
+		goto error; // invalid database format
+	}
+
+	temp.columns_buffer = section_map(&temp, path_buffer, DB_COLUMNS_NAME, sizeof(DB_COLUMNS_NAME) - 1, &temp.columns_size);
+	if (!temp.columns_buffer)
+		goto error;
+
+	// Check columns header and locate each column.
+	{
+		struct columns_layout layout;
+		uint64_t count;
+		const unsigned char *columns = temp.columns_buffer;
+
+		if (temp.columns_size < COLUMNS_ALIGNMENT)
+			goto error; // unexpected EOF
+		if (memcmp(columns, DB_HEADER, sizeof(DB_HEADER) - 1))
+			goto error; // invalid database format
+		memcpy(&count, columns + sizeof(DB_HEADER) - 1, sizeof(count));
+		memcpy(&temp.generation, columns + sizeof(DB_HEADER) - 1 + sizeof(count), sizeof(temp.generation));
+
+		columns_layout(&layout, count, (temp.generation != 0));
+		if (temp.columns_size != layout.total)
+			goto error; // columns don't match the number of records
+
+		temp.columns.count = count;
+		temp.columns.size = (const uint64_t *)(columns + layout.size);
+		temp.columns.mtime = (const uint64_t *)(columns + layout.mtime);
+		temp.columns.offset = (const uint64_t *)(columns + layout.offset);
+		temp.columns.end = (const uint64_t *)(columns + layout.end);
+		temp.columns.mime_type = (const uint32_t *)(columns + layout.mime_type);
+		temp.columns.content = (const uint16_t *)(columns + layout.content);
+		temp.columns.path_length = (const uint16_t *)(columns + layout.path_length);
+		temp.columns.depth = (const uint16_t *)(columns + layout.depth);
+
+		temp.columns.blocks_count = BLOCKS_COUNT(count);
+		temp.columns.block = (const uint64_t *)(columns + layout.block);
+		temp.columns.generation = (temp.generation ? (const uint64_t *)(columns + layout.generation) : 0);
+	}
+
+	temp.index_buffer = section_map(&temp, path_buffer, DB_INDEX_NAME, sizeof(DB_INDEX_NAME) - 1, &temp.index_size);
+	if (!temp.index_buffer)
+		goto error;
+	if (temp.index_size < sizeof(INDEX_HEADER) - 1)
+		goto error; // unexpected EOF
+	if (memcmp(temp.index_buffer, INDEX_HEADER, sizeof(INDEX_HEADER) - 1))
+		goto error; // invalid database format
+
+	temp.roots_buffer = section_map(&temp, path_buffer, DB_ROOTS_NAME, sizeof(DB_ROOTS_NAME) - 1, &temp.roots_size);
+	if (!temp.roots_buffer)
+		goto error;
+	if ((temp.roots_size < sizeof(DB_HEADER) - 1) || memcmp(temp.roots_buffer, DB_HEADER, sizeof(DB_HEADER) - 1))
+		goto error; // invalid database format
+
+	// The perfect hash index is optional.
+	temp.perfect_buffer = section_map(&temp, path_buffer, DB_PERFECT_NAME, sizeof(DB_PERFECT_NAME) - 1, &temp.perfect_size);
+	if (temp.perfect_buffer)
+	{
+		const unsigned char *perfect = temp.perfect_buffer;
+		size_t offset = sizeof(DB_HEADER) - 1;
+
+		if ((temp.perfect_size < offset) || memcmp(perfect, DB_HEADER, sizeof(DB_HEADER) - 1))
+			goto error; // invalid database format
+		if (perfect_data_read(&temp.perfect, perfect + offset, temp.perfect_size - offset) || (temp.perfect.count != temp.columns.count))
+			goto error; // invalid database format
+	}
+
+	// The bloom filter is optional.
+	temp.bloom_buffer = section_map(&temp, path_buffer, DB_BLOOM_NAME, sizeof(DB_BLOOM_NAME) - 1, &temp.bloom_size);
+	if (temp.bloom_buffer)
+	{
+		const unsigned char *bloom = temp.bloom_buffer;
+
+		if ((temp.bloom_size < BLOOM_HEADER_SIZE) || memcmp(bloom, DB_HEADER, sizeof(DB_HEADER) - 1))
+			goto error; // invalid database format
+		memcpy(&temp.bloom.blocks, bloom + sizeof(DB_HEADER) - 1, sizeof(temp.bloom.blocks));
+		memcpy(&temp.bloom.hashes, bloom + sizeof(DB_HEADER) - 1 + sizeof(temp.bloom.blocks), sizeof(temp.bloom.hashes));
+		if (!temp.bloom.blocks || (temp.bloom.blocks != (temp.bloom_size - BLOOM_HEADER_SIZE) / (BLOOM_BLOCK_WORDS * sizeof(uint64_t))) || ((temp.bloom_size - BLOOM_HEADER_SIZE) % (BLOOM_BLOCK_WORDS * sizeof(uint64_t))))
+			goto error; // invalid database format
+		temp.bloom.data = (uint64_t *)(bloom + BLOOM_HEADER_SIZE);
+	}
+
+	// The trigram index is optional.
+	temp.trigram_buffer = section_map(&temp, path_buffer, DB_TRIGRAM_NAME, sizeof(DB_TRIGRAM_NAME) - 1, &temp.trigram_size);
+	if (temp.trigram_buffer)
+	{
+		const unsigned char *trigram = temp.trigram_buffer;
+		size_t offset = sizeof(DB_HEADER) - 1 + sizeof(uint64_t);
+		size_t i;
+
+		if ((temp.trigram_size < offset) || memcmp(trigram, DB_HEADER, sizeof(DB_HEADER) - 1))
+			goto error; // invalid database format
+		memcpy(&temp.trigram.count, trigram + sizeof(DB_HEADER) - 1, sizeof(temp.trigram.count));
+		if (temp.trigram.count >= (temp.trigram_size - offset) / sizeof(*temp.trigram.entries))
+			goto error; // invalid database format
+		temp.trigram.entries = (const struct trigram_entry *)(trigram + offset);
+		offset += (temp.trigram.count + 1) * sizeof(*temp.trigram.entries);
+		temp.trigram.postings = trigram + offset;
+
+		// Make sure the lists of records are inside the file.
+		for(i = 0; i <= temp.trigram.count; ++i)
+			if (temp.trigram.entries[i].offset > temp.trigram_size - offset)
+				goto error; // invalid database format
+	}
+
+	// The names index is optional.
+	temp.names_buffer = section_map(&temp, path_buffer, DB_NAMES_NAME, sizeof(DB_NAMES_NAME) - 1, &temp.names_size);
+	if (temp.names_buffer)
+	{
+		const unsigned char *names = temp.names_buffer;
+		uint64_t header[2];
+		size_t offset = sizeof(DB_HEADER) - 1 + sizeof(header);
+		size_t i;
+
+		if ((temp.names_size < offset) || memcmp(names, DB_HEADER, sizeof(DB_HEADER) - 1))
+			goto error; // invalid database format
+		memcpy(header, names + sizeof(DB_HEADER) - 1, sizeof(header));
+		temp.names.count = header[0];
+		temp.names.blocks = header[1];
+		if ((temp.names.blocks >= (temp.names_size - offset) / sizeof(*temp.names.offsets)) || (temp.names.blocks != (temp.names.count + NAMES_BLOCK - 1) / NAMES_BLOCK))
+			goto error; // invalid database format
+		temp.names.offsets = (const uint64_t *)(names + offset);
+		offset += (temp.names.blocks + 1) * sizeof(*temp.names.offsets);
+		temp.names.data = names + offset;
+
+		// Make sure the blocks are inside the file.
+		for(i = 0; i < temp.names.blocks; ++i)
+			if (temp.names.offsets[i] >= temp.names.offsets[i + 1])
+				goto error; // invalid database format
+		if (temp.names.offsets[temp.names.blocks] != temp.names_size - offset)
+			goto error; // invalid database format
+	}
+
+	// The sorted indexes are optional.
+	temp.sorted_buffer = section_map(&temp, path_buffer, DB_SORTED_NAME, sizeof(DB_SORTED_NAME) - 1, &temp.sorted_size);
+	if (temp.sorted_buffer)
+	{
+		const unsigned char *sorted = temp.sorted_buffer;
+		size_t offset = sizeof(DB_HEADER) - 1 + sizeof(uint64_t);
+
+		if ((temp.sorted_size < offset) || memcmp(sorted, DB_HEADER, sizeof(DB_HEADER) - 1))
+			goto error; // invalid database format
+		memcpy(&temp.sorted.count, sorted + sizeof(DB_HEADER) - 1, sizeof(temp.sorted.count));
+		if ((temp.sorted.count != temp.columns.count) || (temp.sorted_size != offset + 2 * temp.sorted.count * sizeof(struct sorted_entry)))
+			goto error; // invalid database format
+		temp.sorted.size = (const struct sorted_entry *)(sorted + offset);
+		temp.sorted.mtime = temp.sorted.size + temp.sorted.count;
+	}
+
+	// The bitmap indexes are optional.
+	temp.bitmap_buffer = section_map(&temp, path_buffer, DB_BITMAP_NAME, sizeof(DB_BITMAP_NAME) - 1, &temp.bitmap_size);
+	if (temp.bitmap_buffer)
+	{
+		const unsigned char *bitmap = temp.bitmap_buffer;
+		uint64_t header[2];
+		size_t offset = sizeof(DB_HEADER) - 1 + sizeof(header);
+		size_t i;
+
+		if ((temp.bitmap_size < offset) || memcmp(bitmap, DB_HEADER, sizeof(DB_HEADER) - 1))
+			goto error; // invalid database format
+		memcpy(header, bitmap + sizeof(DB_HEADER) - 1, sizeof(header));
+		if ((header[0] != temp.columns.count) || (header[1] >= (temp.bitmap_size - offset) / sizeof(*temp.bitmap.starts)))
+			goto error; // invalid database format
+		temp.bitmap.count = header[1];
+		temp.bitmap.starts = (const uint64_t *)(bitmap + offset);
+		offset += (temp.bitmap.count + 1) * sizeof(*temp.bitmap.starts);
+
+		// Make sure the containers are inside the file.
+		for(i = 0; i < temp.bitmap.count; ++i)
+			if (temp.bitmap.starts[i] > temp.bitmap.starts[i + 1])
+				goto error; // invalid database format
+		if (temp.bitmap.starts[temp.bitmap.count] > (temp.bitmap_size - offset) / sizeof(*temp.bitmap.containers))
+			goto error; // invalid database format
+		temp.bitmap.containers = (const struct bitmap_container *)(bitmap + offset);
+		offset += temp.bitmap.starts[temp.bitmap.count] * sizeof(*temp.bitmap.containers);
+		temp.bitmap.data = bitmap + offset;
+		temp.bitmap.data_size = temp.bitmap_size - offset;
+	}
+
+	// The inode index is optional.
+	temp.inode_buffer = section_map(&temp, path_buffer, DB_INODE_NAME, sizeof(DB_INODE_NAME) - 1, &temp.inode_size);
+	if (temp.inode_buffer)
+	{
+		const unsigned char *inode = temp.inode_buffer;
+		size_t offset = sizeof(DB_HEADER) - 1 + sizeof(temp.inodes.count);
+
+		if ((temp.inode_size < offset) || memcmp(inode, DB_HEADER, sizeof(DB_HEADER) - 1))
+			goto error; // invalid database format
+		memcpy(&temp.inodes.count, inode + sizeof(DB_HEADER) - 1, sizeof(temp.inodes.count));
+		if ((temp.inodes.count != temp.columns.count) || (temp.inodes.count > (temp.inode_size - offset) / (3 * sizeof(uint64_t))))
+			goto error; // invalid database format
+		temp.inodes.device = (const uint64_t *)(inode + offset);
+		offset += temp.inodes.count * sizeof(uint64_t);
+		temp.inodes.number = (const uint64_t *)(inode + offset);
+		offset += temp.inodes.count * sizeof(uint64_t);
+		temp.inodes.link = (const uint64_t *)(inode + offset);
+		offset += temp.inodes.count * sizeof(uint64_t);
+		if (perfect_data_read(&temp.inodes.perfect, inode + offset, temp.inode_size - offset))
+			goto error; // invalid database format
+	}
+
+	// The digests are optional.
+	temp.digest_buffer = section_map(&temp, path_buffer, DB_DIGEST_NAME, sizeof(DB_DIGEST_NAME) - 1, &temp.digest_size);
+	if (temp.digest_buffer)
+	{
+		const unsigned char *digest = temp.digest_buffer;
+		size_t offset = sizeof(DB_HEADER) - 1 + sizeof(uint64_t);
+		uint64_t count;
+
+		if ((temp.digest_size < offset) || memcmp(digest, DB_HEADER, sizeof(DB_HEADER) - 1))
+			goto error; // invalid database format
+		memcpy(&count, digest + sizeof(DB_HEADER) - 1, sizeof(count));
+		if ((count != temp.columns.count) || (temp.digest_size != offset + count * sizeof(uint64_t)))
+			goto error; // invalid database format
+		temp.digests = (const uint64_t *)(digest + offset);
+	}
+
+	// The media properties are optional.
+	temp.media_buffer = section_map(&temp, path_buffer, DB_MEDIA_NAME, sizeof(DB_MEDIA_NAME) - 1, &temp.media_size);
+	if (temp.media_buffer)
+	{
+		const unsigned char *media = temp.media_buffer;
+		uint64_t header[2];
+		size_t offset = sizeof(DB_HEADER) - 1 + sizeof(header);
+		size_t i;
+
+		if ((temp.media_size < offset) || memcmp(media, DB_HEADER, sizeof(DB_HEADER) - 1))
+			goto error; // invalid database format
+		memcpy(header, media + sizeof(DB_HEADER) - 1, sizeof(header));
+		if ((header[0] != temp.columns.count) || (header[1] > temp.columns.count) || (temp.media_size != offset + header[1] * (sizeof(uint64_t) + sizeof(struct media))))
+			goto error; // invalid database format
+		temp.media.count = header[1];
+		temp.media.records = (const uint64_t *)(media + offset);
+		temp.media.media = (const struct media *)(media + offset + header[1] * sizeof(uint64_t));
+		for(i = 1; i < temp.media.count; ++i)
+			if (temp.media.records[i - 1] >= temp.media.records[i])
+				goto error; // invalid database format
+	}
+
+	// The directory totals are missing in databases created by older versions.
+	temp.aggregate_buffer = section_map(&temp, path_buffer, DB_AGGREGATE_NAME, sizeof(DB_AGGREGATE_NAME) - 1, &temp.aggregate_size);
+	if (temp.aggregate_buffer)
+	{
+		const unsigned char *aggregate = temp.aggregate_buffer;
+		uint64_t header[2];
+		size_t offset = sizeof(DB_HEADER) - 1 + sizeof(header);
+		size_t i;
+
+		if ((temp.aggregate_size < offset) || memcmp(aggregate, DB_HEADER, sizeof(DB_HEADER) - 1))
+			goto error; // invalid database format
+		memcpy(header, aggregate + sizeof(DB_HEADER) - 1, sizeof(header));
+		if ((header[0] != temp.columns.count) || (header[1] > temp.columns.count) || (temp.aggregate_size != offset + header[1] * (sizeof(uint64_t) + sizeof(struct aggregate))))
+			goto error; // invalid database format
+		temp.aggregates_count = header[1];
+		temp.aggregate_records = (const uint64_t *)(aggregate + offset);
+		temp.aggregates = (const struct aggregate *)(aggregate + offset + header[1] * sizeof(uint64_t));
+		for(i = 1; i < temp.aggregates_count; ++i)
+			if (temp.aggregate_records[i - 1] >= temp.aggregate_records[i])
+				goto error; // invalid database format
+	}
+
+	// The results of the saved searches are replaced separately from the database so they may be from another generation.
+	// Such results and results in the format of older versions are ignored.
+	temp.saved_buffer = file_map(path_buffer, DB_SAVED_NAME, sizeof(DB_SAVED_NAME) - 1, &temp.saved_size);
+	if (temp.saved_buffer && saved_read(&temp))
+	{
+		munmap(temp.saved_buffer, temp.saved_size);
+		temp.saved_buffer = 0;
+		temp.saved_count = 0;
+	}
+
+	// Changes made after the database was created are stored in delta segments.
+	if (deltas_open(&temp, path_buffer) || deltas_mask(&temp))
+		goto error;
+
+	*search = temp;
+	return 0;
+
+error:
+	db_close(&temp);
+	return ERROR_INPUT;
+}
+
+// Tells the user what to do with a database that can't be used (created by another version of findex or damaged).
+static int db_loaded(int status, const struct path_buffer *restrict path_buffer)
+{
+	if (status == ERROR_UNSUPPORTED)
+		fprintf(stderr, "ERROR: The database in %.*s was created by another version of findex. Run findex -upgrade to convert it or run findex to create it again.\n", (int)path_buffer->prefix_length, path_buffer->data);
+	else if (status == ERROR_READ)
+		fprintf(stderr, "ERROR: The database in %.*s has no valid table of sections (it may be truncated). Run findex to create it again.\n", (int)path_buffer->prefix_length, path_buffer->data);
+	else if (status == ERROR_INPUT)
+		fprintf(stderr, "ERROR: The database in %.*s is corrupted. Run findex to create it again.\n", (int)path_buffer->prefix_length, path_buffer->data);
+	return status;
+}
+
+int db_open(struct search *restrict search)
+{
+	struct path_buffer path_buffer;
+
+	// Initialize path for database files.
+	int status = path_init(&path_buffer);
+	if (status < 0)
+		return status;
+
+	return db_loaded(db_load(search, &path_buffer), &path_buffer);
+}
+
+// Opens a database stored in the given directory (e.g. a copy of the database made earlier).
+int db_open_directory(struct search *restrict search, const char *restrict directory)
+{
+	struct path_buffer path_buffer;
+
+	int status = path_init_directory(&path_buffer, directory, strlen(directory));
+	if (status < 0)
+		return status;
+
+	return db_loaded(db_load(search, &path_buffer), &path_buffer);
+}
+
+void db_close(const struct search *restrict search)
+{
+	size_t i;
+
+	if (search->container_buffer)
+		munmap(search->container_buffer, search->container_size);
+	else
+	{
+		munmap(search->data_buffer, search->info.st_size);
+		if (search->columns_buffer)
+			munmap(search->columns_buffer, search->columns_size);
+		if (search->index_buffer)
+			munmap(search->index_buffer, search->index_size);
+		if (search->roots_buffer)
+			munmap(search->roots_buffer, search->roots_size);
+		if (search->perfect_buffer)
+			munmap(search->perfect_buffer, search->perfect_size);
+		if (search->bloom_buffer)
+			munmap(search->bloom_buffer, search->bloom_size);
+		if (search->trigram_buffer)
+			munmap(search->trigram_buffer, search->trigram_size);
+		if (search->names_buffer)
+			munmap(search->names_buffer, search->names_size);
+		if (search->sorted_buffer)
+			munmap(search->sorted_buffer, search->sorted_size);
+		if (search->bitmap_buffer)
+			munmap(search->bitmap_buffer, search->bitmap_size);
+		if (search->inode_buffer)
+			munmap(search->inode_buffer, search->inode_size);
+		if (search->digest_buffer)
+			munmap(search->digest_buffer, search->digest_size);
+		if (search->media_buffer)
+			munmap(search->media_buffer, search->media_size);
+		if (search->aggregate_buffer)
+			munmap(search->aggregate_buffer, search->aggregate_size);
+	}
+	if (search->saved_buffer)
+		munmap(search->saved_buffer, search->saved_size);
+	for(i = 0; i < search->deltas_count; ++i)
+	{
+		munmap(search->deltas[i].buffer, search->deltas[i].size);
+		free(search->deltas[i].hidden);
+	}
+	free(search->deltas);
+	free(search->masked);
+	free(search->paths);
+}
+
+// Gives the kernel paging hints for each file of the database, depending on how it will be used.
+// Scans read data and columns in order while the path lookups probe the index at random positions.
+void db_advise(const struct search *restrict search, unsigned use)
+{
+	enum access records, lookup, other;
+	size_t i;
+
+	switch (use)
+	{
+	case DB_USE_SCAN:
+		records = ACCESS_SEQUENTIAL;
+		lookup = ACCESS_RANDOM;
+		other = ACCESS_DEFAULT;
+		break;
+
+	case DB_USE_LOOKUP:
+		records = lookup = other = ACCESS_RANDOM;
+		break;
+
+	case DB_USE_RESIDENT:
+		records = lookup = other = ACCESS_RESIDENT;
+		break;
+
+	default:
+		records = lookup = other = ACCESS_DEFAULT;
+		break;
+	}
+
+	map_advise(search->data_buffer, search->info.st_size, records);
+	map_advise(search->columns_buffer, search->columns_size, records);
+	map_advise(search->index_buffer, search->index_size, lookup);
+	map_advise(search->perfect_buffer, search->perfect_size, lookup);
+	map_advise(search->bloom_buffer, search->bloom_size, lookup);
+	map_advise(search->inode_buffer, search->inode_size, lookup);
+	map_advise(search->media_buffer, search->media_size, lookup);
+	map_advise(search->trigram_buffer, search->trigram_size, other);
+	map_advise(search->names_buffer, search->names_size, other);
+	map_advise(search->sorted_buffer, search->sorted_size, other);
+	map_advise(search->bitmap_buffer, search->bitmap_size, other);
+	map_advise(search->digest_buffer, search->digest_size, other);
+	map_advise(search->aggregate_buffer, search->aggregate_size, other);
+	map_advise(search->saved_buffer, search->saved_size, other);
+	for(i = 0; i < search->deltas_count; ++i)
+		map_advise(search->deltas[i].buffer, search->deltas[i].size, other);
+}
+
+static void column_prefetch(const struct search *restrict search, const void *column, size_t item_size, size_t first, size_t last)
+{
+	size_t offset = (const unsigned char *)column - (const unsigned char *)search->columns_buffer;
+	map_prefetch(search->columns_buffer, search->columns_size, offset + first * item_size, (last - first) * item_size);
+}
+
+// Starts reading the paths and the columns of the records in [first, last) in the background.
+// Without this the first scan of a cold database waits for each page fault in turn.
+void db_prefetch(const struct search *restrict search, size_t first, size_t last)
+{
+	const struct columns *columns = &search->columns;
+	size_t start, end;
+
+	if (!search->columns_buffer || (first >= last))
+		return;
+
+	start = columns->block[first / DB_BLOCK_RECORDS];
+	end = (((last - 1) / DB_BLOCK_RECORDS + 1 < columns->blocks_count) ? columns->block[(last - 1) / DB_BLOCK_RECORDS + 1] : (uint64_t)search->info.st_size);
+	if (start < end)
+		map_prefetch(search->data_buffer, search->info.st_size, start, end - start);
+
+	column_prefetch(search, columns->size, sizeof(*columns->size), first, last);
+	column_prefetch(search, columns->mtime, sizeof(*columns->mtime), first, last);
+	column_prefetch(search, columns->offset, sizeof(*columns->offset), first, last);
+	column_prefetch(search, columns->mime_type, sizeof(*columns->mime_type), first, last);
+	column_prefetch(search, columns->content, sizeof(*columns->content), first, last);
+	column_prefetch(search, columns->path_length, sizeof(*columns->path_length), first, last);
+	column_prefetch(search, columns->depth, sizeof(*columns->depth), first, last);
+}
+
+void db_record(struct file *restrict file, const struct search *restrict search, size_t record)
+{
+	const struct columns *columns = &search->columns;
+
+	file->path_length = columns->path_length[record];
+	file->content = columns->content[record];
+	file->mime_type = columns->mime_type[record];
+	file->mtime = columns->mtime[record];
+	file->size = columns->size[record];
+}
+
+// Returns the header of the block or NULL if the block is invalid.
+const struct block *db_block(const struct search *restrict search, size_t block)
+{
+	const struct block *header;
+	size_t offset = search->columns.block[block];
+	size_t size = search->info.st_size;
+
+	if ((offset % sizeof(uint64_t)) || (offset > size) || (size - offset < sizeof(*header)))
+		return 0;
+	header = (const struct block *)(search->data_buffer + offset);
+	if (size - offset - sizeof(*header) < (size_t)header->prefix_length + header->compressed)
+		return 0;
+
+	return header;
+}
+
+// Returns the decompressed paths of a block. Only the first size bytes are guaranteed to be decompressed.
+// Returns NULL if the block is invalid.
+const unsigned char *db_paths(struct search *restrict search, size_t block, size_t size)
+{
+	const struct block *header;
+	const unsigned char *compressed;
+	ssize_t decompressed;
+
+	if (search->paths && (search->paths_block == block) && (search->paths_size >= size))
+		return search->paths;
+
+	header = db_block(search, block);
+	if (!header || (size > header->raw))
+		return 0;
+
+	if (search->paths_capacity < header->raw)
+	{
+		free(search->paths);
+		search->paths = alloc(header->raw);
+		search->paths_capacity = header->raw;
+	}
+
+	compressed = (const unsigned char *)(header + 1) + header->prefix_length;
+	decompressed = lz_decompress(search->paths, size, compressed, header->compressed);
+	if (decompressed != size)
+	{
+		search->paths_size = 0;
+		return 0;
+	}
+
+	search->paths_block = block;
+	search->paths_size = size;
+	return search->paths;
+}
+
+// Returns the path of a record or NULL if the record is invalid.
+const unsigned char *db_path(struct search *restrict search, size_t record)
+{
+	const struct columns *columns = &search->columns;
+	size_t block = record / DB_BLOCK_RECORDS;
+	const struct block *header;
+	const unsigned char *paths;
+
+	header = db_block(search, block);
+	if (!header || (columns->offset[record] + columns->path_length[record] > header->raw))
+		return 0;
+
+	paths = db_paths(search, block, header->raw);
+	if (!paths)
+		return 0;
+	return paths + columns->offset[record];
+}
+
+// Checks whether the record has the given path.
+static int record_match(struct search *restrict search, size_t record, const char *restrict path, size_t length)
+{
+	const struct columns *columns = &search->columns;
+	const unsigned char *paths;
+
+	if (record >= columns->count)
+		return ERROR_INPUT;
+	if (columns->path_length[record] != length)
+		return ERROR_MISSING;
+
+	paths = db_paths(search, record / DB_BLOCK_RECORDS, columns->offset[record] + length);
+	if (!paths)
+		return ERROR_INPUT;
+	if (memcmp(paths + columns->offset[record], path, length))
+		return ERROR_MISSING;
+
+	return 0;
+}
+
+// Finds the records with the given path.
+// Calls found for each of them until it returns something other than ERROR_MISSING.
+static int index_find(struct search *restrict search, const char *restrict path, size_t length, int (*found)(struct search *restrict, size_t, void *), void *argument)
+{
+	const struct index_entry *entries = (const void *)((const char *)search->index_buffer + sizeof(INDEX_HEADER) - 1);
+	size_t count = (search->index_size - sizeof(INDEX_HEADER) + 1) / sizeof(*entries);
+	uint64_t hashsum = hash64((const unsigned char *)path, length);
+
+	size_t low, high;
+	size_t i;
+	int status;
+
+	// Use binary search to find the first entry with the path hash in the index.
+	// Search the entries with the given hash until the actual path matches.
+	status = ERROR_MISSING;
+	low = 0;
+	high = count;
+	while (low < high)
+	{
+		i = (high - low) / 2 + low;
+		if (entries[i].hash < hashsum)
+			low = i + 1;
+		else /* entries[i].hash >= hashsum */
+			high = i;
+	}
+	for(i = low; (i < count) && (entries[i].hash == hashsum); ++i)
+	{
+		status = record_match(search, entries[i].record, path, length);
+		if (!status)
+			status = (*found)(search, entries[i].record, argument);
+		if (status != ERROR_MISSING)
+			break;
+	}
+
+	return status;
+}
+
+// Checks whether the size, the modification time or the content of a file is different.
+static inline int file_changed(const struct file *restrict a, const struct file *restrict b)
+{
+	return ((a->size != b->size) || (a->mtime != b->mtime) || (a->content != b->content));
+}
+
+struct generation
+{
+	const struct file *file;
+	uint64_t generation;
+	uint64_t digest;
+};
+
+static int found_generation(struct search *restrict search, size_t record, void *argument)
+{
+	struct generation *generation = argument;
+	struct file file;
+
+	db_record(&file, search, record);
+	if (!file_changed(&file, generation->file))
+	{
+		generation->generation = db_generation(search, record);
+		if (search->digests)
+			generation->digest = search->digests[record];
+	}
+	return 0;
+}
+
+// Finds the generation of a file from the previous database.
+// Files that are not in the previous database or that changed since it get the new generation.
+// If digest is not NULL, sets it to the digest of the file in the previous database (0 if the file changed).
+static uint64_t file_generation(struct search *restrict previous, const unsigned char *restrict path, const struct file *restrict file, uint64_t generation, uint64_t *restrict digest)
+{
+	struct generation found = {file, generation, 0};
+	if (previous)
+		index_find(previous, (const char *)path, file->path_length, found_generation, &found);
+	if (digest)
+		*digest = found.digest;
+	return found.generation;
+}
+
+static int found_mask(struct search *restrict search, size_t record, void *argument)
+{
+	search->masked[record / 64] |= (uint64_t)1 << (record % 64);
+	return ERROR_MISSING; // the same path can be indexed more than once
+}
+
+// Finds the entries superseded by a newer delta segment and the records replaced or deleted by the delta segments.
+static int deltas_mask(struct search *restrict search)
+{
+	size_t i, j, entry;
+	int status;
+
+	if (!search->deltas_count)
+		return 0;
+
+	search->masked = alloc((search->columns.count / 64 + 1) * sizeof(*search->masked));
+	memset(search->masked, 0, (search->columns.count / 64 + 1) * sizeof(*search->masked));
+
+	for(i = 0; i < search->deltas_count; ++i)
+	{
+		struct delta_segment *segment = search->deltas + i;
+		for(entry = 0; entry < segment->count; ++entry)
+		{
+			uint32_t flags;
+			struct file file;
+			const unsigned char *path;
+
+			if (status = delta_change(segment, entry, &flags, &file, &path))
+				return status;
+
+			for(j = 0; j < i; ++j)
+			{
+				status = delta_find(search->deltas + j, segment->entries[entry].hash, (const char *)path, file.path_length);
+				if (status >= 0)
+					break;
+				if (status != ERROR_MISSING)
+					return status;
+			}
+			if (j < i)
+			{
+				segment->hidden[entry / 64] |= (uint64_t)1 << (entry % 64);
+				continue;
+			}
+
+			status = index_find(search, (const char *)path, file.path_length, found_mask, 0);
+			if (status != ERROR_MISSING)
+				return status;
+		}
+	}
+
+	return 0;
+}
+
+static int found_fileinfo(struct search *restrict search, size_t record, void *argument)
+{
+	db_record(argument, search, record);
+	return 0;
+}
+
+int db_find_fileinfo(struct file *restrict file, const char *restrict path, size_t length, struct search *restrict search)
+{
+	uint64_t hashsum = hash64((const unsigned char *)path, length);
+	size_t i;
+	int status;
+
+	// The newest change of the path takes precedence over the database.
+	for(i = 0; i < search->deltas_count; ++i)
+	{
+		uint32_t flags;
+		const unsigned char *change;
+		ssize_t entry = delta_find(search->deltas + i, hashsum, path, length);
+		if (entry == ERROR_MISSING)
+			continue;
+		if (entry < 0)
+			return entry;
+		if (status = delta_change(search->deltas + i, entry, &flags, file, &change))
+			return status;
+		return ((flags & DELTA_DELETE) ? ERROR_MISSING : 0);
+	}
+
+	// Most paths not in the database are rejected by the bloom filter.
+	if (search->bloom_buffer)
+	{
+		if (!bloom_check(&search->bloom, hashsum))
+		{
+			search->bloom_stats.negative += 1;
+			return ERROR_MISSING;
+		}
+		search->bloom_stats.positive += 1;
+	}
+
+	if (search->perfect_buffer)
+	{
+		// Each path can only be in the slot given by the perfect hash function.
+		const struct perfect_slot *slot = perfect_find(&search->perfect, hashsum);
+		if (!slot)
+			status = ERROR_MISSING;
+		else if (!(status = record_match(search, slot->record, path, length)))
+			db_record(file, search, slot->record);
+	}
+	else status = index_find(search, path, length, found_fileinfo, file);
+
+	if (search->bloom_buffer && (status == ERROR_MISSING))
+		search->bloom_stats.false_positive += 1;
+
+	return status;
+}
+
+static int found_media(struct search *restrict search, size_t record, void *argument)
+{
+	struct media_found *found = argument;
+	struct file file;
+
+	db_record(&file, search, record);
+	if (!file_changed(&file, found->file))
+		found->media = media_find(&search->media, record);
+	return 0;
+}
+
+static int found_record(struct search *restrict search, size_t record, void *argument)
+{
+	((struct media_found *)argument)->record = record;
+	return 0;
+}
+
+// Finds the media properties of a file (image, audio or video). The headers of files changed since the database was created are parsed directly.
+int db_find_media(struct media *restrict media, const char *restrict path, size_t length, struct search *restrict search)
+{
+	struct media_found found;
+	struct file file;
+	const struct media *result;
+	char buffer[PATH_SIZE_LIMIT];
+	int fd;
+	int status;
+
+	if (!search->media_buffer)
+		return ERROR_UNSUPPORTED;
+
+	status = index_find(search, path, length, found_record, &found);
+	if (!status && !db_masked(search, found.record))
+	{
+		result = media_find(&search->media, found.record);
+		if (!result)
+			return ERROR_MISSING;
+		*media = *result;
+		return 0;
+	}
+	if ((status != ERROR_MISSING) && status)
+		return status;
+
+	if (status = db_find_fileinfo(&file, path, length, search))
+		return status;
+	if ((file.content & CONTENT_DIRECTORY) || !(file.content & (CONTENT_IMAGE | CONTENT_AUDIO | CONTENT_VIDEO)))
+		return ERROR_MISSING;
+	memcpy(buffer, path, length);
+	buffer[length] = 0;
+	fd = open(buffer, O_RDONLY);
+	if (fd < 0)
+		return ERROR_MISSING;
+	status = media_parse(media, fd, file.mime_type);
+	close(fd);
+	return (status ? ERROR_MISSING : 0);
+}
+
+// Returns the index of the first directory total for a record not before the given one.
+size_t db_aggregate_first(const struct search *restrict search, size_t record)
+{
+	size_t low = 0, high = search->aggregates_count;
+	while (low < high)
+	{
+		size_t middle = low + (high - low) / 2;
+		if (search->aggregate_records[middle] < record)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low;
+}
+
+// Finds the records of the saved search with the given name.
+int db_saved(const struct search *restrict search, const char *restrict name, struct saved *restrict saved)
+{
+	const unsigned char *buffer = search->saved_buffer;
+	size_t length = strlen(name) + 1;
+	size_t i;
+
+	for(i = 0; i < search->saved_count; ++i)
+	{
+		const uint64_t *entry = search->saved_entries + i * 4;
+		if ((entry[1] < length) || memcmp(buffer + entry[0], name, length))
+			continue;
+
+		saved->definition = (const char *)buffer + entry[0];
+		saved->definition_size = entry[1];
+		saved->records = (const uint64_t *)(buffer + entry[2]);
+		saved->count = entry[3];
+		return 0;
+	}
+
+	return ERROR_MISSING;
+}
+
+// Finds the records of the file with the given device and inode number (e.g. from fstat()). Calls callback for each name of the file.
+// The files changed after the database was created are found by the name they had then.
+int db_find_inode(struct search *restrict search, const struct inode *restrict inode, int (*callback)(const unsigned char *restrict, const struct file *restrict, void *), void *argument)
+{
+	size_t record;
+	int found = 0;
+	int status;
+
+	if (!search->inode_buffer)
+		return ERROR_UNSUPPORTED;
+
+	for(record = inodes_find(&search->inodes, inode); record < search->inodes.count; record = inodes_next(&search->inodes, record))
+	{
+		struct file file;
+		const unsigned char *path = db_path(search, record);
+		if (!path)
+			return ERROR_INPUT;
+
+		if (db_masked(search, record))
+		{
+			status = db_find_fileinfo(&file, (const char *)path, search->columns.path_length[record], search);
+			if (status == ERROR_MISSING)
+				continue; // the file is deleted
+			if (status)
+				return status;
+		}
+		else db_record(&file, search, record);
+
+		found = 1;
+		if (status = (*callback)(path, &file, argument))
+			return status;
+	}
+
+	return (found ? 0 : ERROR_MISSING);
+}
+
+// Gets the change with the given index (counting the entries of all delta segments, newest first).
+// Returns ERROR_MISSING if the change is a deletion or is superseded by a newer delta segment.
+int db_delta(struct search *restrict search, size_t index, struct file *restrict file, const unsigned char **restrict path)
+{
+	size_t i;
+
+	for(i = 0; i < search->deltas_count; ++i)
+	{
+		const struct delta_segment *segment = search->deltas + i;
+		uint32_t flags;
+		int status;
+
+		if (index >= segment->count)
+		{
+			index -= segment->count;
+			continue;
+		}
+
+		if ((segment->hidden[index / 64] >> (index % 64)) & 1)
+			return ERROR_MISSING;
+		if (status = delta_change(segment, index, &flags, file, path))
+			return status;
+		return ((flags & DELTA_DELETE) ? ERROR_MISSING : 0);
+	}
+
+	return ERROR_INPUT;
+}
+
+// Checks whether path is one of the indexed directories (returns 0) or is located in one of them (returns 1).
+// Returns ERROR_MISSING if the path is not in an indexed directory.
+int db_root_find(struct search *restrict search, const char *restrict path, size_t length)
+{
+	const unsigned char *position = (const unsigned char *)search->roots_buffer + sizeof(DB_HEADER) - 1;
+	const unsigned char *roots_end = (const unsigned char *)search->roots_buffer + search->roots_size;
+	int status = ERROR_MISSING;
+
+	while (position < roots_end)
+	{
+		struct root root;
+
+		if ((size_t)(roots_end - position) < sizeof(root))
+			return ERROR_INPUT;
+		memcpy(&root, position, sizeof(root));
+		position += sizeof(root);
+		if ((size_t)(roots_end - position) < root.path_length)
+			return ERROR_INPUT;
+
+		if ((root.path_length == length) && !memcmp(position, path, length))
+			return 0;
+		if ((root.path_length < length) && (path[root.path_length] == '/') && !memcmp(position, path, root.path_length))
+			status = 1;
+
+		position += root.path_length;
+	}
+
+	return status;
+}
+
+struct range
+{
+	size_t start, end;
+};
+
+static void range_extend(struct range *restrict range, size_t start, size_t end)
+{
+	if (range->start == range->end)
+	{
+		range->start = start;
+		range->end = end;
+		return;
+	}
+	if (start < range->start)
+		range->start = start;
+	if (end > range->end)
+		range->end = end;
+}
+
+static int found_range(struct search *restrict search, size_t record, void *argument)
+{
+	size_t end = search->columns.end[record];
+	if ((end <= record) || (end > search->columns.count))
+		return ERROR_INPUT;
+	range_extend(argument, record, end);
+	return ERROR_MISSING; // the same path can be indexed more than once
+}
+
+// Finds the range of records located in the directory path.
+// Records outside the directory may be included in the range when path contains more than one indexed directory.
+int db_range(struct search *restrict search, const char *restrict path, size_t length, size_t *restrict start, size_t *restrict end)
+{
+	struct range range = {0, 0};
+	const unsigned char *position = (const unsigned char *)search->roots_buffer + sizeof(DB_HEADER) - 1;
+	const unsigned char *roots_end = (const unsigned char *)search->roots_buffer + search->roots_size;
+	int status;
+
+	// The directories specified for indexing are not stored as records.
+	while (position < roots_end)
+	{
+		struct root root;
+
+		if ((size_t)(roots_end - position) < sizeof(root))
+			return ERROR_INPUT;
+		memcpy(&root, position, sizeof(root));
+		position += sizeof(root);
+		if (((size_t)(roots_end - position) < root.path_length) || (root.start > root.end) || (root.end > search->columns.count))
+			return ERROR_INPUT;
+
+		if ((root.start < root.end) && (root.path_length >= length) && (root.path_length == length || position[length] == '/') && !memcmp(position, path, length))
+			range_extend(&range, root.start, root.end);
+
+		position += root.path_length;
+	}
+
+	status = index_find(search, path, length, found_range, &range);
+	if (status != ERROR_MISSING)
+		return status;
+
+	*start = range.start;
+	*end = range.end;
+	return 0;
+}
+
+struct complete
+{
+	size_t limit;
+	int (*callback)(const char *restrict, size_t, size_t, void *);
+	void *argument;
+};
+
+static int complete_name(const unsigned char *restrict name, size_t name_length, const unsigned char *restrict position, const unsigned char *restrict end, void *argument)
+{
+	struct complete *complete = argument;
+	size_t count = 0;
+	int status;
+
+	// The last byte of each varint has the high bit cleared.
+	for(; position < end; ++position)
+		count += !(*position & 0x80);
+
+	if (status = (*complete->callback)((const char *)name, name_length, count, complete->argument))
+		return status;
+	return !--complete->limit;
+}
+
+// Calls callback for the names starting with prefix (in ascending order) until callback returns non-zero or limit names are reported.
+// The callback receives each name and the number of records with that name.
+// Returns ERROR_MISSING if the database has no names index.
+int db_complete(struct search *restrict search, const char *restrict prefix, size_t length, size_t limit, int (*callback)(const char *restrict, size_t, size_t, void *), void *argument)
+{
+	struct complete complete = {limit, callback, argument};
+	int status;
+
+	if (!search->names_buffer)
+		return ERROR_MISSING;
+	if (!limit)
+		return 0;
+
+	status = names_walk(&search->names, (const unsigned char *)prefix, length, &complete_name, &complete);
+	return ((status < 0) ? status : 0);
+}
+
+int db_set_fileinfo(struct file *restrict file, const char *restrict path, size_t path_length, const struct stat *restrict info)
 {
 	struct stat hardlink_info;
 	uint16_t length = path_length;
 
-	*file = (struct file){0};
+	*file = (struct file){0};
+
+	// If the file is a soft link, stat information about what it points to.
+	if (S_ISLNK(info->st_mode))
+	{
+		if (stat(path, &hardlink_info) < 0)
+		{
+			switch (errno)
+			{
+			case EACCES:
+				fprintf(stderr, "WARNING: Cannot stat link target (permission denied) for %s\n", path);
+				return ERROR_CANCEL;
+
+			case ENAMETOOLONG:
+				fprintf(stderr, "WARNING: Cannot stat link target (unsupported) for %s\n", path);
+				return ERROR_CANCEL;
+
+			case ENOENT:
+			case ENOTDIR:
+			case ELOOP:
+				fprintf(stderr, "WARNING: Cannot stat link target (broken link) for %s\n", path);
+				return ERROR_CANCEL;
+
+			default:
+				fprintf(stderr, "ERROR: Cannot stat link target for %s\n", path);
+				return ERROR;
+
+			case ENOMEM:
+				return ERROR_MEMORY;
+			}
+		}
+		info = &hardlink_info;
+
+		file->content |= CONTENT_LINK;
+	}
+
+	switch (info->st_mode & S_IFMT)
+	{
+	case S_IFDIR:
+		file->content |= CONTENT_DIRECTORY;
+		break;
+
+	case S_IFREG:
+		{
+			// TODO report open and read errors
+			int entry = open(path, O_RDONLY);
+			if (entry < 0)
+				break;
+
+			unsigned char buffer[MAGIC_SIZE];
+			ssize_t size = read(entry, &buffer, MAGIC_SIZE);
+
+			close(entry);
+
+			if (size < 0)
+				break;
+
+			uint32_t type = (uint32_t)content(buffer, size);
+			file->content |= typeinfo[type].content;
+			file->mime_type = type;
+		}
+		break;
+
+	default:
+		file->content |= CONTENT_SPECIAL;
+		break;
+	}
+
+	file->path_length = length;
+	file->mtime = info->st_mtime;
+	file->size = info->st_size;
+
+	return 0;
+}
+
+// Converts a database created by findex before version 4 of the format (a data file with the records and an index of 32-bit hashes).
+// Those databases don't store the indexed directories so the directory containing the first record of each indexed directory is used.
+int db_upgrade(void)
+{
+	struct search search;
+	struct db db;
+	struct path_buffer path_buffer;
+	const unsigned char *data;
+	struct file file;
+	size_t size, offset;
+	const char *root = 0;
+	size_t root_length = 0, start = 0;
+	int status;
+
+	status = path_init(&path_buffer);
+	if (status < 0)
+		return status;
+
+	status = db_load(&search, &path_buffer);
+	if (!status)
+	{
+		db_close(&search);
+		return 0; // already in the current format
+	}
+	if (status != ERROR_UNSUPPORTED)
+		return status;
+
+	data = file_map(&path_buffer, DB_DATA_NAME, sizeof(DB_DATA_NAME) - 1, &size);
+	if (!data || (size < sizeof(DB_HEADER_BASELINE) - 1) || memcmp(data, DB_HEADER_BASELINE, sizeof(DB_HEADER_BASELINE) - 1))
+	{
+		if (data)
+			munmap((void *)data, size);
+		fprintf(stderr, "ERROR: The database in %.*s can't be converted. Run findex to create it again.\n", (int)path_buffer.prefix_length, path_buffer.data);
+		return ERROR_UNSUPPORTED;
+	}
+
+	status = db_new(&db);
+	if (status)
+	{
+		munmap((void *)data, size);
+		return status;
+	}
+
+	for(offset = sizeof(DB_HEADER_BASELINE) - 1; offset < size; offset += sizeof(struct file) + file.path_length)
+	{
+		const char *path;
+
+		if (size - offset < sizeof(file))
+			goto invalid;
+		memcpy(&file, data + offset, sizeof(file));
+		path = (const char *)data + offset + sizeof(file);
+		if (!file.path_length || (file.path_length > size - offset - sizeof(file)) || (path[0] != '/'))
+			goto invalid;
+
+		// Each record of an indexed directory is inside the directory of its first record.
+		if (!root || (file.path_length <= root_length) || memcmp(path, root, root_length) || ((root_length > 1) && (path[root_length] != '/')))
+		{
+			if (root && (status = db_root(&db, root, root_length, start)))
+				goto error;
+			root = path;
+			for(root_length = file.path_length - 1; path[root_length] != '/'; --root_length)
+				;
+			if (!root_length)
+				root_length = 1; // the root directory
+			start = db.count;
+		}
+
+		if (status = db_add(&db, path, file.path_length, &file, 0))
+			goto error;
+	}
+	if (root && (status = db_root(&db, root, root_length, start)))
+		goto error;
+
+	// The data file and the index are removed when the new database is in place.
+	status = db_persist(&db);
+	munmap((void *)data, size);
+	return status;
+
+invalid:
+	status = ERROR_INPUT;
+error:
+	db_delete(&db);
+	munmap((void *)data, size);
+	return status;
+}
+
+#define HEAP_NAME heap_delta
+#define HEAP_TYPE struct delta_entry
+#define HEAP_ABOVE(a, b) (((a).hash > (b).hash) || (((a).hash == (b).hash) && ((a).offset >= (b).offset)))
+#include "generic/heap.g"
+
+void db_delta_new(struct delta *restrict delta)
+{
+	*delta = (struct delta){0};
+}
+
+// Appends a change to the delta segment being created.
+static void delta_append(struct delta *restrict delta, uint32_t flags, const char *restrict path, const struct file *restrict file)
+{
+	size_t size = sizeof(flags) + sizeof(*file) + file->path_length;
+
+	if (delta->count == delta->capacity)
+	{
+		delta->capacity = (delta->capacity ? delta->capacity * 2 : 256);
+		delta->entries = realloc(delta->entries, delta->capacity * sizeof(*delta->entries));
+		if (!delta->entries)
+			abort();
+	}
+	if (delta->size + size > delta->changes_capacity)
+	{
+		size_t capacity = (delta->changes_capacity ? delta->changes_capacity * 2 : 65536);
+		while (capacity < delta->size + size)
+			capacity *= 2;
+		delta->changes = realloc(delta->changes, capacity);
+		if (!delta->changes)
+			abort();
+		delta->changes_capacity = capacity;
+	}
+
+	delta->entries[delta->count].hash = hash64((const unsigned char *)path, file->path_length);
+	delta->entries[delta->count].offset = delta->size;
+	delta->count += 1;
+
+	memcpy(delta->changes + delta->size, &flags, sizeof(flags));
+	memcpy(delta->changes + delta->size + sizeof(flags), file, sizeof(*file));
+	memcpy(delta->changes + delta->size + sizeof(flags) + sizeof(*file), path, file->path_length);
+	delta->size += size;
+}
+
+// Records that path was added or modified.
+int db_delta_add(struct delta *restrict delta, const char *restrict path, size_t path_length, const struct file *restrict file)
+{
+	struct file change = *file;
+	change.path_length = path_length;
+	delta_append(delta, 0, path, &change);
+	return 0;
+}
+
+// Records that path was deleted.
+int db_delta_remove(struct delta *restrict delta, const char *restrict path, size_t path_length)
+{
+	struct file change = {0};
+	change.path_length = path_length;
+	delta_append(delta, DELTA_DELETE, path, &change);
+	return 0;
+}
+
+static int delta_same(const struct delta *restrict delta, const struct delta_entry *restrict a, const struct delta_entry *restrict b)
+{
+	struct file file_a, file_b;
+	memcpy(&file_a, delta->changes + a->offset + sizeof(uint32_t), sizeof(file_a));
+	memcpy(&file_b, delta->changes + b->offset + sizeof(uint32_t), sizeof(file_b));
+	return ((file_a.path_length == file_b.path_length) && !memcmp(delta->changes + a->offset + sizeof(uint32_t) + sizeof(file_a), delta->changes + b->offset + sizeof(uint32_t) + sizeof(file_b), file_a.path_length));
+}
+
+// Writes the changes as a new delta segment. Only the last change of each path is kept.
+int db_delta_persist(struct delta *restrict delta)
+{
+	struct path_buffer path_origin, path_target;
+	struct heap_delta heap;
+	char name[DELTA_NAME_SIZE];
+	size_t length;
+	size_t i, j, count;
+	uint64_t number;
+	uint64_t header;
+	int fd;
+	int status;
+
+	if (!delta->count)
+		return 0;
+
+	// Sort the entries by hash. Entries with the same hash are in the order the changes were made.
+	heap.data = delta->entries;
+	heap.count = delta->count;
+	heap_delta_heapify(&heap);
+	while (heap.count)
+	{
+		struct delta_entry entry = heap.data[0];
+		heap_delta_pop(&heap);
+		heap.data[heap.count] = entry;
+	}
+
+	count = 0;
+	for(i = 0; i < delta->count; ++i)
+	{
+		for(j = i + 1; (j < delta->count) && (delta->entries[j].hash == delta->entries[i].hash); ++j)
+			if (delta_same(delta, delta->entries + i, delta->entries + j))
+				break;
+		if ((j < delta->count) && (delta->entries[j].hash == delta->entries[i].hash))
+			continue; // the path is changed again later
+		delta->entries[count++] = delta->entries[i];
+	}
+
+	status = path_init(&path_origin);
+	if (status < 0)
+		return status;
+	memcpy(path_target.data, path_origin.data, path_origin.prefix_length);
+	path_target.prefix_length = path_origin.prefix_length;
+
+	length = path_set(&path_origin, name, delta_name(name, DB_DELTA_TEMPNAME, sizeof(DB_DELTA_TEMPNAME) - 1, getpid()));
+	unlink(path_origin.data);
+	fd = fs_load(path_origin.data, length, db_access, 1);
+	if (fd < 0)
+		return fd;
+
+	header = count;
+	if ((write(fd, DB_HEADER, sizeof(DB_HEADER) - 1) < 0) || (write(fd, &header, sizeof(header)) < 0) || data_write(fd, delta->entries, count * sizeof(*delta->entries)) || data_write(fd, delta->changes, delta->size))
+	{
+		close(fd);
+		unlink(path_origin.data);
+		return ERROR_WRITE;
+	}
+	close(fd);
+
+	// The segment becomes visible atomically. Another process may have added a segment with the same number.
+	if (status = deltas_last(&path_target, &number))
+	{
+		unlink(path_origin.data);
+		return status;
+	}
+	do
+	{
+		number += 1;
+		path_set(&path_target, name, delta_name(name, DB_DELTA_NAME, sizeof(DB_DELTA_NAME) - 1, number));
+		if (!link(path_origin.data, path_target.data))
+			break;
+		if (errno != EEXIST)
+		{
+			unlink(path_origin.data);
+			return ERROR_WRITE;
+		}
+	} while (1);
+	unlink(path_origin.data);
+
+	return 0;
+}
+
+// Finds the generation of the database that the database is a replica of: the generation reached by the last changes applied
+// by findex -apply or, if none were applied, the generation of the database itself.
+int db_replica(const struct search *restrict search, uint64_t *restrict generation)
+{
+	struct path_buffer path_buffer;
+	unsigned char buffer[sizeof(DB_HEADER) - 1 + sizeof(*generation)];
+	ssize_t size;
+	int fd;
+	int status;
+
+	status = path_init(&path_buffer);
+	if (status < 0)
+		return status;
+	path_set(&path_buffer, DB_REPLICA_NAME, sizeof(DB_REPLICA_NAME) - 1);
+	fd = open(path_buffer.data, O_RDONLY);
+	if (fd < 0)
+	{
+		if (errno != ENOENT)
+			return ERROR_ACCESS;
+		*generation = search->generation;
+		return 0;
+	}
+	size = read(fd, buffer, sizeof(buffer));
+	close(fd);
+	if ((size != sizeof(buffer)) || memcmp(buffer, DB_HEADER, sizeof(DB_HEADER) - 1))
+		return ERROR_INPUT;
+	memcpy(generation, buffer + sizeof(DB_HEADER) - 1, sizeof(*generation));
+	return 0;
+}
+
+// Records the generation reached by the changes applied by findex -apply.
+int db_replica_set(uint64_t generation)
+{
+	struct path_buffer path_origin, path_target;
+	size_t length;
+	int fd;
+	int status;
+
+	status = path_init(&path_origin);
+	if (status < 0)
+		return status;
+	memcpy(path_target.data, path_origin.data, path_origin.prefix_length);
+	path_target.prefix_length = path_origin.prefix_length;
+
+	length = path_set(&path_origin, DB_REPLICA_TEMPNAME, sizeof(DB_REPLICA_TEMPNAME) - 1);
+	fd = fs_load(path_origin.data, length, db_access, 1);
+	if (fd < 0)
+		return fd;
+	if (!(status = data_write(fd, DB_HEADER, sizeof(DB_HEADER) - 1)))
+		status = data_write(fd, &generation, sizeof(generation));
+	close(fd);
+
+	path_set(&path_target, DB_REPLICA_NAME, sizeof(DB_REPLICA_NAME) - 1);
+	if (!status && (rename(path_origin.data, path_target.data) < 0))
+		status = ERROR_WRITE;
+	if (status)
+		unlink(path_origin.data);
+	return status;
+}
+
+void db_delta_delete(struct delta *restrict delta)
+{
+	free(delta->entries);
+	free(delta->changes);
+}
+
+ssize_t db_deltas_count(void)
+{
+	struct path_buffer path_buffer;
+	uint64_t *numbers;
+	ssize_t count;
+	int status;
+
+	status = path_init(&path_buffer);
+	if (status < 0)
+		return status;
+	count = deltas_list(&path_buffer, &numbers);
+	free(numbers);
+	return count;
+}
+
+// Path added by the delta segments and the position where it is inserted during compaction.
+struct compact_entry
+{
+	size_t position; // record before which the path is inserted
+	size_t depth; // depth of the database record after whose subtree the path is inserted
+	const unsigned char *path;
+	struct file file;
+};
+
+// Orders the entries so that each directory is immediately followed by its contents.
+static int compact_compare(const struct compact_entry *restrict a, const struct compact_entry *restrict b)
+{
+	size_t length = ((a->file.path_length < b->file.path_length) ? a->file.path_length : b->file.path_length);
+	size_t i;
+
+	if (a->position != b->position)
+		return ((a->position < b->position) ? -1 : 1);
+	if (a->depth != b->depth)
+		return ((a->depth > b->depth) ? -1 : 1); // the subtree of the deeper record ends first
+
+	// Slash is ordered before any other byte.
+	for(i = 0; i < length; ++i)
+		if (a->path[i] != b->path[i])
+		{
+			unsigned char byte_a = ((a->path[i] == '/') ? 0 : a->path[i]);
+			unsigned char byte_b = ((b->path[i] == '/') ? 0 : b->path[i]);
+			return ((byte_a < byte_b) ? -1 : 1);
+		}
+	return ((a->file.path_length < b->file.path_length) ? -1 : (a->file.path_length > b->file.path_length));
+}
+
+#define HEAP_NAME heap_compact
+#define HEAP_TYPE struct compact_entry
+#define HEAP_ABOVE(a, b) (compact_compare(&(a), &(b)) >= 0)
+#include "generic/heap.g"
+
+struct anchor
+{
+	size_t start, end;
+	size_t record;
+};
+
+static int found_anchor(struct search *restrict search, size_t record, void *argument)
+{
+	struct anchor *anchor = argument;
+	if ((record < anchor->start) || (record >= anchor->end))
+		return ERROR_MISSING;
+	anchor->record = record;
+	return 0;
+}
+
+// Finds the paths the delta segments add to an indexed directory and where to insert them.
+// Returns the number of paths (stored sorted in entries) or error code.
+static ssize_t compact_insertions(struct search *restrict search, const struct root *restrict root, const unsigned char *restrict root_path, struct compact_entry *restrict entries)
+{
+	struct heap_compact heap;
+	size_t index, count = 0;
+	size_t root_depth = 0;
+	size_t i;
+	int status;
+
+	for(i = 0; i < root->path_length; ++i)
+		root_depth += (root_path[i] == '/');
+
+	for(index = 0; index < search->deltas_entries; ++index)
+	{
+		struct compact_entry *entry = entries + count;
+		struct anchor anchor = {root->start, root->end, 0};
+		size_t length;
+
+		status = db_delta(search, index, &entry->file, &entry->path);
+		if (status == ERROR_MISSING)
+			continue;
+		if (status)
+			return status;
+
+		length = entry->file.path_length;
+		if ((length <= root->path_length) || (entry->path[root->path_length] != '/') || memcmp(entry->path, root_path, root->path_length))
+			continue;
+
+		// Paths already in the database are replaced in place.
+		status = index_find(search, (const char *)entry->path, length, found_anchor, &anchor);
+		if (!status)
+			continue;
+		if (status != ERROR_MISSING)
+			return status;
+
+		// Insert the path at the end of the subtree of its nearest ancestor in the database.
+		entry->position = root->end;
+		entry->depth = root_depth;
+		while (1)
+		{
+			while (entry->path[length - 1] != '/')
+				length -= 1;
+			length -= 1;
+			if (length <= root->path_length)
+				break;
+
+			status = index_find(search, (const char *)entry->path, length, found_anchor, &anchor);
+			if (!status)
+			{
+				if ((search->columns.end[anchor.record] <= anchor.record) || (search->columns.end[anchor.record] > root->end))
+					return ERROR_INPUT;
+				entry->position = search->columns.end[anchor.record];
+				entry->depth = search->columns.depth[anchor.record];
+				break;
+			}
+			if (status != ERROR_MISSING)
+				return status;
+		}
+
+		count += 1;
+	}
+
+	heap.data = entries;
+	heap.count = count;
+	heap_compact_heapify(&heap);
+	while (heap.count)
+	{
+		struct compact_entry entry = heap.data[0];
+		heap_compact_pop(&heap);
+		heap.data[heap.count] = entry;
+	}
+
+	return count;
+}
+
+// Finds the device and inode number of a file changed by a delta segment. The segments don't store them.
+static void compact_inode(struct inode *restrict inode, const unsigned char *restrict path, size_t length)
+{
+	char buffer[PATH_SIZE_LIMIT];
+	struct stat info;
+
+	memcpy(buffer, path, length);
+	buffer[length] = 0;
+	if (lstat(buffer, &info) < 0)
+	{
+		inode->device = 0;
+		inode->number = 0;
+		return;
+	}
+	inode->device = info.st_dev;
+	inode->number = info.st_ino;
+}
+
+// Adds the records of an indexed directory with the changes from the delta segments applied.
+static int compact_root(struct db *restrict db, struct search *restrict search, const struct root *restrict root, const struct compact_entry *restrict entries, size_t count)
+{
+	size_t record, next = 0;
+	struct inode inode = {0};
+	int status;
+
+	for(record = root->start; record <= root->end; ++record)
+	{
+		struct file file;
+		const unsigned char *path;
+		size_t length;
+
+		for(; (next < count) && (entries[next].position == record); ++next)
+		{
+			if (db->flags & DB_INODE)
+				compact_inode(&inode, entries[next].path, entries[next].file.path_length);
+			if (status = db_add(db, (const char *)entries[next].path, entries[next].file.path_length, &entries[next].file, &inode))
+				return status;
+		}
+		if (record == root->end)
+			break;
+
+		path = db_path(search, record);
+		if (!path)
+			return ERROR_INPUT;
+		length = search->columns.path_length[record];
+
+		if (db_masked(search, record))
+		{
+			status = db_find_fileinfo(&file, (const char *)path, length, search);
+			if (status == ERROR_MISSING)
+				continue; // the file is deleted
+			if (status)
+				return status;
+			if (db->flags & DB_INODE)
+				compact_inode(&inode, path, length);
+		}
+		else
+		{
+			db_record(&file, search, record);
+			if (db->flags & DB_INODE)
+			{
+				inode.device = search->inodes.device[record];
+				inode.number = search->inodes.number[record];
+			}
+		}
+
+		if (status = db_add(db, (const char *)path, length, &file, &inode))
+			return status;
+	}
+
+	return 0;
+}
+
+// Replaces the saved search with the given name with definition (or removes it if definition is 0).
+// The results of the saved searches are evaluated again on the current database.
+static int searches_change(const char *restrict name, const unsigned char *restrict definition, uint64_t definition_size)
+{
+	struct path_buffer path_buffer, path_target;
+	unsigned char *buffer;
+	size_t size = 0;
+	void *previous;
+	size_t previous_size = 0;
+	size_t offset, length;
+	struct saved_search *searches;
+	size_t count;
+	struct search search;
+	size_t record;
+	int found = 0;
+	int lock, fd;
+	int status;
+
+	status = path_init(&path_buffer);
+	if (status < 0)
+		return status;
+	memcpy(path_target.data, path_buffer.data, path_buffer.prefix_length);
+	path_target.prefix_length = path_buffer.prefix_length;
+
+	// The saved searches must not change while a database is created.
+	length = path_set(&path_buffer, DB_LOCK_NAME, sizeof(DB_LOCK_NAME) - 1);
+	lock = fs_load(path_buffer.data, length, db_access, 0);
+	if (lock < 0)
+		return lock;
+	if (flock(lock, LOCK_EX) < 0)
+	{
+		close(lock);
+		return ERROR;
+	}
+
+	// Copy the definitions of the other saved searches.
+	previous = file_map(&path_buffer, DB_SEARCHES_NAME, sizeof(DB_SEARCHES_NAME) - 1, &previous_size);
+	buffer = alloc(previous_size + sizeof(definition_size) + definition_size);
+	for(offset = 0; offset + sizeof(uint64_t) <= previous_size; offset += sizeof(uint64_t) + length)
+	{
+		const unsigned char *entry = (const unsigned char *)previous + offset;
+		uint64_t entry_size;
+
+		memcpy(&entry_size, entry, sizeof(entry_size));
+		if (entry_size > previous_size - offset - sizeof(entry_size))
+			break; // invalid entry
+		length = entry_size;
+		if ((length > strlen(name)) && !memcmp(entry + sizeof(entry_size), name, strlen(name) + 1))
+		{
+			found = 1;
+			continue;
+		}
+		memcpy(buffer + size, entry, sizeof(entry_size) + length);
+		size += sizeof(entry_size) + length;
+	}
+	if (previous)
+		munmap(previous, previous_size);
+	if (!definition && !found)
+	{
+		status = ERROR_MISSING;
+		goto finally;
+	}
+	if (definition)
+	{
+		memcpy(buffer + size, &definition_size, sizeof(definition_size));
+		memcpy(buffer + size + sizeof(definition_size), definition, definition_size);
+		size += sizeof(definition_size) + definition_size;
+	}
+
+	path_set(&path_target, DB_SEARCHES_NAME, sizeof(DB_SEARCHES_NAME) - 1);
+	if (!size)
+	{
+		unlink(path_target.data);
+		path_set(&path_target, DB_SAVED_NAME, sizeof(DB_SAVED_NAME) - 1);
+		unlink(path_target.data);
+		status = 0;
+		goto finally;
+	}
+	length = path_set(&path_buffer, DB_SEARCHES_TEMPNAME, sizeof(DB_SEARCHES_TEMPNAME) - 1);
+	fd = fs_load(path_buffer.data, length, db_access, 1);
+	if (fd < 0)
+	{
+		status = fd;
+		goto finally;
+	}
+	status = data_write(fd, buffer, size);
+	close(fd);
+	if (!status && (rename(path_buffer.data, path_target.data) < 0))
+		status = ERROR_WRITE;
+	if (status)
+	{
+		unlink(path_buffer.data);
+		goto finally;
+	}
+
+	// Without a database, the searches are evaluated when it is created.
+	status = db_open(&search);
+	if (status)
+	{
+		if (status == ERROR_MISSING)
+			status = 0;
+		goto finally;
+	}
+	db_advise(&search, DB_USE_SCAN);
+
+	status = searches_parse(buffer, size, &searches, &count);
+	if (!status)
+	{
+		for(record = 0; record < search.columns.count; ++record)
+		{
+			const unsigned char *path = db_path(&search, record);
+			struct file file;
+
+			if (!path)
+			{
+				status = ERROR_INPUT;
+				break;
+			}
+			db_record(&file, &search, record);
+			searches_add(searches, count, path, &file, record);
+		}
+		if (!status)
+			status = searches_store(&path_buffer, search.columns.count, search.generation, searches, count);
+		searches_term(searches, count);
+	}
+	db_close(&search);
+	if (!status)
+	{
+		path_set(&path_target, DB_SAVED_NAME, sizeof(DB_SAVED_NAME) - 1);
+		if (rename(path_buffer.data, path_target.data) < 0)
+		{
+			unlink(path_buffer.data);
+			status = ERROR_WRITE;
+		}
+	}
+
+finally:
+	free(buffer);
+	close(lock);
+	return status;
+}
 
-	// If the file is a soft link, stat information about what it points to.
-	if (S_ISLNK(info->st_mode))
+// Saves a search with the given name. arguments are the location, followed by filters as accepted by ffind (see query_parse()).
+int db_save(const char *restrict name, char *const arguments[], size_t count)
+{
+	struct query query;
+	unsigned char *definition;
+	size_t size, i;
+	int status;
+
+	if (!*name || query_parse(&query, arguments, count))
+		return ERROR_INPUT;
+
+	// The definition consists of the name and the arguments, each terminated by 0.
+	size = strlen(name) + 1;
+	for(i = 0; i < count; ++i)
+		size += strlen(arguments[i]) + 1;
+	definition = alloc(size);
+	size = strlen(name) + 1;
+	memcpy(definition, name, size);
+	for(i = 0; i < count; ++i)
 	{
-		if (stat(path, &hardlink_info) < 0)
-		{
-			switch (errno)
-			{
-			case EACCES:
-				fprintf(stderr, "WARNING: Cannot stat link target (permission denied) for %s\n", path);
-				return ERROR_CANCEL;
+		size_t length = strlen(arguments[i]) + 1;
+		memcpy(definition + size, arguments[i], length);
+		size += length;
+	}
 
-			case ENAMETOOLONG:
-				fprintf(stderr, "WARNING: Cannot stat link target (unsupported) for %s\n", path);
-				return ERROR_CANCEL;
+	status = searches_change(name, definition, size);
+	free(definition);
+	return status;
+}
 
-			case ENOENT:
-			case ENOTDIR:
-			case ELOOP:
-				fprintf(stderr, "WARNING: Cannot stat link target (broken link) for %s\n", path);
-				return ERROR_CANCEL;
+// Removes the saved search with the given name.
+int db_forget(const char *restrict name)
+{
+	return searches_change(name, 0, 0);
+}
 
-			default:
-				fprintf(stderr, "ERROR: Cannot stat link target for %s\n", path);
-				return ERROR;
+// Creates a new database with the changes from the delta segments applied and removes the segments.
+int db_compact(void)
+{
+	struct db db;
+	struct search search;
+	struct compact_entry *entries;
+	const unsigned char *position, *roots_end;
+	int status;
 
-			case ENOMEM:
-				return ERROR_MEMORY;
-			}
+	// Take the database lock before reading the segments so that no other process replaces them.
+	status = db_new(&db);
+	if (status)
+		return status;
+	status = db_open(&search);
+	if (status)
+	{
+		db_delete(&db);
+		return status;
+	}
+	db_advise(&search, DB_USE_SCAN);
+	if (!search.deltas_count)
+	{
+		db_close(&search);
+		db_delete(&db);
+		return 0;
+	}
+
+	// Build the same indexes as the current database.
+	db.deltas = search.deltas[0].number;
+	db.flags = (search.perfect_buffer ? DB_PERFECT : 0) | (search.trigram_buffer ? DB_TRIGRAM : 0) | (search.names_buffer ? DB_NAMES : 0) | (search.sorted_buffer ? DB_SORTED : 0) | (search.bitmap_buffer ? DB_BITMAP : 0) | (search.inode_buffer ? DB_INODE : 0) | (search.digest_buffer ? DB_DIGEST : 0) | (search.media_buffer ? DB_MEDIA : 0);
+	db.bloom = (search.bloom_buffer ? BLOOM_RATE_DEFAULT : 0);
+
+	entries = alloc(search.deltas_entries * sizeof(*entries));
+
+	position = (const unsigned char *)search.roots_buffer + sizeof(DB_HEADER) - 1;
+	roots_end = (const unsigned char *)search.roots_buffer + search.roots_size;
+	while (position < roots_end)
+	{
+		struct root root;
+		size_t start = db.count;
+		ssize_t count;
+
+		status = ERROR_INPUT;
+		if ((size_t)(roots_end - position) < sizeof(root))
+			goto error;
+		memcpy(&root, position, sizeof(root));
+		position += sizeof(root);
+		if (((size_t)(roots_end - position) < root.path_length) || (root.start > root.end) || (root.end > search.columns.count))
+			goto error;
+
+		count = compact_insertions(&search, &root, position, entries);
+		if (count < 0)
+		{
+			status = count;
+			goto error;
 		}
-		info = &hardlink_info;
+		if (status = compact_root(&db, &search, &root, entries, count))
+			goto error;
+		if (status = db_root(&db, (const char *)position, root.path_length, start))
+			goto error;
 
-		file->content |= CONTENT_LINK;
+		position += root.path_length;
 	}
 
-	switch (info->st_mode & S_IFMT)
+	free(entries);
+	db_close(&search);
+	return db_persist(&db);
+
+error:
+	free(entries);
+	db_close(&search);
+	db_delete(&db);
+	return status;
+}
+
+// File from one of the databases compared by db_diff.
+struct diff_entry
+{
+	uint64_t hash;
+	size_t offset; // offset of the path in the paths of the database
+	struct file file;
+};
+
+#define HEAP_NAME heap_diff
+#define HEAP_TYPE struct diff_entry
+#define HEAP_ABOVE(a, b) ((a).hash >= (b).hash)
+#include "generic/heap.g"
+
+// Collects the files in the database (with the changes from the delta segments applied), sorted by path hash.
+// Returns the number of files or error code.
+static ssize_t diff_entries(struct search *restrict search, struct diff_entry **restrict entries, unsigned char **restrict paths)
+{
+	struct heap_diff heap;
+	size_t count = 0, size = 0, index;
+	struct file file;
+	const unsigned char *path;
+	int status;
+
+	*entries = alloc((search->columns.count + search->deltas_entries + 1) * sizeof(**entries));
+	for(index = 0; index < search->columns.count; ++index)
+		size += search->columns.path_length[index];
+	for(index = 0; index < search->deltas_count; ++index)
+		size += search->deltas[index].changes_size;
+	*paths = alloc(size + 1);
+
+	size = 0;
+	for(index = 0; index < search->columns.count; ++index)
 	{
-	case S_IFDIR:
-		file->content |= CONTENT_DIRECTORY;
-		break;
+		if (db_masked(search, index))
+			continue;
+		path = db_path(search, index);
+		if (!path)
+			return ERROR_INPUT;
+		db_record(&file, search, index);
 
-	case S_IFREG:
+		memcpy(*paths + size, path, file.path_length);
+		(*entries)[count++] = (struct diff_entry){hash64(path, file.path_length), size, file};
+		size += file.path_length;
+	}
+	for(index = 0; index < search->deltas_entries; ++index)
+	{
+		status = db_delta(search, index, &file, &path);
+		if (status == ERROR_MISSING)
+			continue;
+		if (status)
+			return status;
+
+		memcpy(*paths + size, path, file.path_length);
+		(*entries)[count++] = (struct diff_entry){hash64(path, file.path_length), size, file};
+		size += file.path_length;
+	}
+
+	heap.data = *entries;
+	heap.count = count;
+	heap_diff_heapify(&heap);
+	while (heap.count)
+	{
+		struct diff_entry entry = heap.data[0];
+		heap_diff_pop(&heap);
+		heap.data[heap.count] = entry;
+	}
+
+	return count;
+}
+
+static inline int diff_same(const struct diff_entry *restrict a, const unsigned char *restrict a_paths, const struct diff_entry *restrict b, const unsigned char *restrict b_paths)
+{
+	return ((a->file.path_length == b->file.path_length) && !memcmp(a_paths + a->offset, b_paths + b->offset, a->file.path_length));
+}
+
+// Compares two databases by merging their files sorted by path hash.
+// Calls callback for each file added, removed or changed (in size, modification time or content) in new until it returns non-zero.
+int db_diff(struct search *restrict old, struct search *restrict new, int (*callback)(unsigned, const unsigned char *restrict, const struct file *restrict, void *), void *argument)
+{
+	struct diff_entry *old_entries = 0, *new_entries = 0;
+	unsigned char *old_paths = 0, *new_paths = 0;
+	ssize_t old_count, new_count;
+	size_t i = 0, j = 0;
+	int status = 0;
+
+	old_count = diff_entries(old, &old_entries, &old_paths);
+	if (old_count < 0)
+	{
+		status = old_count;
+		goto finally;
+	}
+	new_count = diff_entries(new, &new_entries, &new_paths);
+	if (new_count < 0)
+	{
+		status = new_count;
+		goto finally;
+	}
+
+	while (!status && ((i < old_count) || (j < new_count)))
+	{
+		uint64_t hashsum;
+		size_t old_end, new_end;
+		size_t a, b;
+
+		// Find the files with the lowest hash in each database.
+		if ((j == new_count) || ((i < old_count) && (old_entries[i].hash < new_entries[j].hash)))
+			hashsum = old_entries[i].hash;
+		else
+			hashsum = new_entries[j].hash;
+		for(old_end = i; (old_end < old_count) && (old_entries[old_end].hash == hashsum); ++old_end)
+			;
+		for(new_end = j; (new_end < new_count) && (new_entries[new_end].hash == hashsum); ++new_end)
+			;
+
+		for(a = i; !status && (a < old_end); ++a)
 		{
-			// TODO report open and read errors
-			int entry = open(path, O_RDONLY);
-			if (entry < 0)
-				break;
+			for(b = j; b < new_end; ++b)
+				if (diff_same(old_entries + a, old_paths, new_entries + b, new_paths))
+					break;
+			if (b == new_end)
+				status = (*callback)(DB_DIFF_REMOVED, old_paths + old_entries[a].offset, &old_entries[a].file, argument);
+			else if (file_changed(&old_entries[a].file, &new_entries[b].file))
+				status = (*callback)(DB_DIFF_CHANGED, new_paths + new_entries[b].offset, &new_entries[b].file, argument);
+		}
+		for(b = j; !status && (b < new_end); ++b)
+		{
+			for(a = i; a < old_end; ++a)
+				if (diff_same(old_entries + a, old_paths, new_entries + b, new_paths))
+					break;
+			if (a == old_end)
+				status = (*callback)(DB_DIFF_ADDED, new_paths + new_entries[b].offset, &new_entries[b].file, argument);
+		}
 
-			unsigned char buffer[MAGIC_SIZE];
-			ssize_t size = read(entry, &buffer, MAGIC_SIZE);
+		i = old_end;
+		j = new_end;
+	}
 
-			close(entry);
+finally:
+	free(new_paths);
+	free(new_entries);
+	free(old_paths);
+	free(old_entries);
+	return status;
+}
 
-			if (size < 0)
-				break;
+// The manifest of the shards starts with the database header, followed by an entry for each shard.
+// Each entry is followed by the indexed directory of the shard and the directory storing its database.
+struct shard_entry
+{
+	uint16_t root_length, directory_length;
+} __attribute__((packed));
 
-			uint32_t type = (uint32_t)content(buffer, size);
-			file->content |= typeinfo[type].content;
-			file->mime_type = type;
+// Parses the manifest. Fills shard (unless it is NULL) and returns the number of shards or error code.
+static ssize_t shards_parse(const struct shards *restrict shards, struct shard *restrict shard)
+{
+	const unsigned char *position = (const unsigned char *)shards->buffer + sizeof(DB_HEADER) - 1;
+	const unsigned char *end = (const unsigned char *)shards->buffer + shards->size;
+	size_t count = 0;
+
+	while (position < end)
+	{
+		struct shard_entry entry;
+
+		if ((size_t)(end - position) < sizeof(entry))
+			return ERROR_INPUT;
+		memcpy(&entry, position, sizeof(entry));
+		position += sizeof(entry);
+		if (((size_t)(end - position) < (size_t)entry.root_length + entry.directory_length) || !entry.directory_length || (entry.directory_length >= PATH_SIZE_LIMIT))
+			return ERROR_INPUT;
+
+		if (shard)
+		{
+			shard[count].root = (const char *)position;
+			shard[count].root_length = entry.root_length;
+			shard[count].directory = (const char *)position + entry.root_length;
+			shard[count].directory_length = entry.directory_length;
 		}
-		break;
+		position += entry.root_length + entry.directory_length;
+		count += 1;
+	}
 
-	default:
-		file->content |= CONTENT_SPECIAL;
-		break;
+	return count;
+}
+
+// Reads the manifest of the shards. Returns ERROR_MISSING if the database is not sharded.
+int db_shards_open(struct shards *restrict shards)
+{
+	struct path_buffer path_buffer;
+	ssize_t count;
+	int status;
+
+	shards->buffer = 0;
+	shards->count = 0;
+	shards->shard = 0;
+
+	status = path_init(&path_buffer);
+	if (status < 0)
+		return status;
+
+	shards->buffer = file_map(&path_buffer, DB_SHARDS_NAME, sizeof(DB_SHARDS_NAME) - 1, &shards->size);
+	if (!shards->buffer)
+		return ((errno == ENOENT) ? ERROR_MISSING : ERROR);
+	if ((shards->size < sizeof(DB_HEADER) - 1) || memcmp(shards->buffer, DB_HEADER, sizeof(DB_HEADER) - 1))
+	{
+		db_shards_close(shards);
+		return ERROR_INPUT;
 	}
 
-	file->path_length = length;
-	file->mtime = info->st_mtime;
-	file->size = info->st_size;
+	count = shards_parse(shards, 0);
+	if (count < 0)
+	{
+		db_shards_close(shards);
+		return count;
+	}
+	shards->shard = alloc(count * sizeof(*shards->shard) + 1);
+	shards->count = shards_parse(shards, shards->shard);
+
+	return 0;
+}
+
+void db_shards_close(const struct shards *restrict shards)
+{
+	if (shards->buffer)
+		munmap(shards->buffer, shards->size);
+	free(shards->shard);
+}
+
+static int shard_write(int fd, const char *restrict root, size_t root_length, const char *restrict directory, size_t directory_length)
+{
+	struct shard_entry entry;
+	int status;
+
+	entry.root_length = root_length;
+	entry.directory_length = directory_length;
+	if (!(status = data_write(fd, &entry, sizeof(entry))) && !(status = data_write(fd, root, root_length)))
+		status = data_write(fd, directory, directory_length);
+	return status;
+}
+
+// Tells whether one of the paths is the other or a directory containing it.
+static int path_overlap(const char *restrict a, size_t a_length, const char *restrict b, size_t b_length)
+{
+	if (a_length > b_length)
+		return path_overlap(b, b_length, a, a_length);
+	if (!a_length || memcmp(a, b, a_length))
+		return 0;
+	return ((a_length == b_length) || (a[a_length - 1] == '/') || (b[a_length] == '/'));
+}
+
+// Tells whether the paths are of the same directory. The same directory may be reached through different paths (e.g. symbolic links).
+static int directory_same(const char *restrict a, size_t a_length, const char *restrict b, size_t b_length)
+{
+	char path[PATH_SIZE_LIMIT];
+	struct stat a_info, b_info;
+
+	if ((a_length == b_length) && !memcmp(a, b, a_length))
+		return 1;
+
+	memcpy(path, a, a_length);
+	path[a_length] = 0;
+	if (stat(path, &a_info) < 0)
+		return 0;
+	memcpy(path, b, b_length);
+	path[b_length] = 0;
+	if (stat(path, &b_info) < 0)
+		return 0;
+	return ((a_info.st_dev == b_info.st_dev) && (a_info.st_ino == b_info.st_ino));
+}
+
+// Tells whether one of the indexed directories of the database overlaps path.
+static int roots_overlap(const struct search *restrict search, const char *restrict path, size_t length)
+{
+	const unsigned char *position = (const unsigned char *)search->roots_buffer + sizeof(DB_HEADER) - 1;
+	const unsigned char *roots_end = (const unsigned char *)search->roots_buffer + search->roots_size;
+
+	while (position < roots_end)
+	{
+		struct root root;
+
+		if ((size_t)(roots_end - position) < sizeof(root))
+			return ERROR_INPUT;
+		memcpy(&root, position, sizeof(root));
+		position += sizeof(root);
+		if ((size_t)(roots_end - position) < root.path_length)
+			return ERROR_INPUT;
+
+		if (path_overlap((const char *)position, root.path_length, path, length))
+			return 1;
+
+		position += root.path_length;
+	}
 
 	return 0;
 }
+
+// Checks that root can be indexed in the database: it must not overlap the root of a shard.
+int db_shards_check(const char *restrict root, size_t root_length)
+{
+	struct shards shards;
+	size_t i;
+	int status;
+
+	status = db_shards_open(&shards);
+	if (status)
+		return ((status == ERROR_MISSING) ? 0 : status);
+
+	for(i = 0; i < shards.count; ++i)
+		if (path_overlap(shards.shard[i].root, shards.shard[i].root_length, root, root_length))
+		{
+			status = ERROR_EXIST;
+			break;
+		}
+
+	db_shards_close(&shards);
+	return status;
+}
+
+// Finds the directory storing the database of the shard for root. If directory is not NULL, the database of the shard is stored there. The directory is stored in result (PATH_SIZE_LIMIT bytes).
+// The root of the shard must not overlap the roots of the database and of the other shards, and its database must be in a directory of its own.
+// Returns a lock on the manifest, held while the shard is indexed. It must be passed to db_shard_add() once the database of the shard is created or closed on failure.
+int db_shard(const char *restrict root, size_t root_length, const char *restrict directory, size_t directory_length, char *restrict result, size_t *restrict result_length)
+{
+	struct path_buffer path_buffer;
+	struct shards shards;
+	struct search search;
+	size_t length, i, j;
+	unsigned number;
+	int lock;
+	int status;
+
+	if (directory_length + 1 + sizeof(DB_SHARDS_TEMPNAME) > PATH_SIZE_LIMIT)
+		return ERROR_UNSUPPORTED;
+
+	status = path_init(&path_buffer);
+	if (status < 0)
+		return status;
+
+	// Only one process at a time can change the manifest.
+	length = path_set(&path_buffer, DB_SHARDS_LOCK_NAME, sizeof(DB_SHARDS_LOCK_NAME) - 1);
+	lock = fs_load(path_buffer.data, length, db_access, 0);
+	if (lock < 0)
+		return lock;
+	if (flock(lock, LOCK_EX) < 0)
+	{
+		close(lock);
+		return ERROR;
+	}
+
+	status = db_shards_open(&shards);
+	if (status && (status != ERROR_MISSING))
+	{
+		close(lock);
+		return status;
+	}
+
+	// The files of a directory must be in only one database.
+	status = db_open(&search);
+	if (!status)
+	{
+		status = roots_overlap(&search, root, root_length);
+		db_close(&search);
+		if (status > 0)
+			status = ERROR_EXIST;
+	}
+	else if (status == ERROR_MISSING)
+		status = 0;
+	if (status)
+		goto error;
+
+	for(i = 0; i < shards.count; ++i)
+		if ((shards.shard[i].root_length == root_length) && !memcmp(shards.shard[i].root, root, root_length))
+			break;
+	for(j = 0; j < shards.count; ++j)
+		if ((j != i) && path_overlap(shards.shard[j].root, shards.shard[j].root_length, root, root_length))
+		{
+			status = ERROR_EXIST;
+			goto error;
+		}
+
+	if (directory)
+	{
+		// Storing the shard in the directory of another database would replace that database.
+		if (directory_same(directory, directory_length, path_buffer.data, path_buffer.prefix_length - 1))
+		{
+			status = ERROR_EXIST;
+			goto error;
+		}
+		for(j = 0; j < shards.count; ++j)
+			if ((j != i) && directory_same(shards.shard[j].directory, shards.shard[j].directory_length, directory, directory_length))
+			{
+				status = ERROR_EXIST;
+				goto error;
+			}
+
+		memcpy(result, directory, directory_length);
+		*result_length = directory_length;
+	}
+	else if (i < shards.count)
+	{
+		memcpy(result, shards.shard[i].directory, shards.shard[i].directory_length);
+		*result_length = shards.shard[i].directory_length;
+	}
+	else
+	{
+		// Store the database next to the manifest, in a directory not used by another shard.
+		memcpy(result, path_buffer.data, path_buffer.prefix_length);
+		memcpy(result + path_buffer.prefix_length, DB_SHARD_NAME, sizeof(DB_SHARD_NAME) - 1);
+		for(number = 0; ; ++number)
+		{
+			length = path_buffer.prefix_length + sizeof(DB_SHARD_NAME) - 1;
+			length += snprintf(result + length, PATH_SIZE_LIMIT - length, "%u", number);
+			for(j = 0; j < shards.count; ++j)
+				if (directory_same(shards.shard[j].directory, shards.shard[j].directory_length, result, length))
+					break;
+			if (j == shards.count)
+				break;
+		}
+		*result_length = length;
+	}
+
+	db_shards_close(&shards);
+	return lock;
+
+error:
+	db_shards_close(&shards);
+	close(lock);
+	return status;
+}
+
+// Adds the shard to the manifest (or changes the directory of the shard) after its database is created. Releases the lock returned by db_shard().
+int db_shard_add(int lock, const char *restrict root, size_t root_length, const char *restrict directory, size_t directory_length)
+{
+	struct path_buffer path_buffer, path_target;
+	struct shards shards;
+	size_t length, i, j;
+	int fd;
+	int status;
+
+	status = path_init(&path_buffer);
+	if (status < 0)
+		goto finally;
+	memcpy(path_target.data, path_buffer.data, path_buffer.prefix_length);
+	path_target.prefix_length = path_buffer.prefix_length;
+
+	status = db_shards_open(&shards);
+	if (status && (status != ERROR_MISSING))
+		goto finally;
+
+	for(i = 0; i < shards.count; ++i)
+		if ((shards.shard[i].root_length == root_length) && !memcmp(shards.shard[i].root, root, root_length))
+			break;
+	if ((i < shards.count) && (shards.shard[i].directory_length == directory_length) && !memcmp(shards.shard[i].directory, directory, directory_length))
+	{
+		status = 0;
+		goto release; // the manifest doesn't change
+	}
+
+	length = path_set(&path_buffer, DB_SHARDS_TEMPNAME, sizeof(DB_SHARDS_TEMPNAME) - 1);
+	unlink(path_buffer.data);
+	fd = fs_load(path_buffer.data, length, db_access, 1);
+	if (fd < 0)
+	{
+		status = fd;
+		goto release;
+	}
+	status = data_write(fd, DB_HEADER, sizeof(DB_HEADER) - 1);
+	for(j = 0; !status && (j < shards.count); ++j)
+		if (j != i)
+			status = shard_write(fd, shards.shard[j].root, shards.shard[j].root_length, shards.shard[j].directory, shards.shard[j].directory_length);
+	if (!status)
+		status = shard_write(fd, root, root_length, directory, directory_length);
+	close(fd);
+
+	path_set(&path_target, DB_SHARDS_NAME, sizeof(DB_SHARDS_NAME) - 1);
+	if (status || (rename(path_buffer.data, path_target.data) < 0))
+	{
+		unlink(path_buffer.data);
+		if (!status)
+			status = ERROR_WRITE;
+	}
+
+release:
+	db_shards_close(&shards);
+finally:
+	close(lock);
+	return status;
+}
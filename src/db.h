@@ -17,18 +17,200 @@
  * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "perfect.h"
+#include "bloom.h"
+#include "trigram.h"
+#include "names.h"
+#include "sorted.h"
+#include "bitmap.h"
+#include "inode.h"
+#include "media.h"
+
 struct db
 {
 	off_t data_offset;
 	off_t index_offset;
+	size_t count;
 	int data;
 	int index;
+	int roots;
+	unsigned flags;
+	unsigned bloom; // false positive rate of the bloom filter is 1/bloom; 0 means no bloom filter
+	int lock;
+	uint64_t deltas; // delta segments up to this number are removed when the database is persisted
+	struct inode *inodes; // device and inode number of each record (only with DB_INODE)
+	size_t inodes_capacity;
+};
+
+#define DB_PERFECT 0x1 /* build perfect hash index for the paths */
+#define DB_TRIGRAM 0x2 /* build trigram index for the paths */
+#define DB_NAMES 0x4 /* build sorted index of the names */
+#define DB_SORTED 0x8 /* build indexes of the records sorted by size and by mtime */
+#define DB_BITMAP 0x10 /* build bitmap indexes for content and mime type */
+#define DB_INODE 0x20 /* build index of the records by device and inode number */
+#define DB_DIGEST 0x40 /* store digest of the content of files that may have duplicates */
+#define DB_MEDIA 0x80 /* store properties of images, audio and video read from their headers */
+
+// Bitmap i is for content bit i (for i less than DB_BITMAP_TYPES). Bitmap DB_BITMAP_TYPES + t is for mime type t.
+#define DB_BITMAP_TYPES 16
+
+// Record fields stored as separate aligned arrays (one item per record).
+struct columns
+{
+	size_t count;
+	const uint64_t *size;
+	const uint64_t *mtime;
+	const uint64_t *offset; // offset of the path in the decompressed paths of the block
+	const uint64_t *end; // record after the last record in the subtree
+	const uint32_t *mime_type;
+	const uint16_t *content;
+	const uint16_t *path_length;
+	const uint16_t *depth; // number of path components
+
+	size_t blocks_count;
+	const uint64_t *block; // offset of each block in data
+
+	const uint64_t *generation; // generation in which the file last changed; NULL for databases without generations
+};
+
+// Data stores the paths in blocks of DB_BLOCK_RECORDS records, compressed independently.
+#define DB_BLOCK_RECORDS 2048
+
+// Block header. Describes the values of all records in the block so that blocks can be skipped without decompression.
+// The header is followed by the path prefix common for all records in the block and then by the compressed paths.
+struct block
+{
+	uint64_t size_min, size_max;
+	uint64_t mtime_min, mtime_max;
+	uint32_t compressed; // size of the compressed paths
+	uint32_t raw; // size of the paths after decompression
+	uint16_t content; // bitwise OR of the content of the records
+	uint16_t prefix_length;
+};
+
+// Totals for the subtree of a directory, computed when the database is created.
+struct aggregate
+{
+	uint64_t size; // total size of the directory and of each record in it
+	uint64_t files; // number of records in the subtree that are not directories
+	uint32_t content[DB_BITMAP_TYPES]; // number of records in the subtree with content bit i
 };
 
+// Changes to the database are stored in immutable delta segments. Each change is an upsert or a deletion of a path.
+// A segment consists of entries sorted by path hash, followed by the changes.
+// Each change is stored as flags, followed by the file information and the path.
+struct delta_entry
+{
+	uint64_t hash;
+	uint64_t offset; // offset of the change in the changes of the segment
+};
+
+#define DELTA_DELETE 0x1
+
+struct delta_segment
+{
+	void *buffer;
+	size_t size;
+	uint64_t number; // segments with higher numbers are newer
+	uint64_t count;
+	const struct delta_entry *entries;
+	const unsigned char *changes;
+	size_t changes_size;
+	uint64_t *hidden; // entries superseded by a newer segment
+};
+
+// Delta segment being created.
+struct delta
+{
+	size_t count, capacity;
+	struct delta_entry *entries;
+	unsigned char *changes;
+	size_t size, changes_capacity;
+};
+
+// Compact the delta segments in the background when there are at least this many of them.
+#define DELTA_COMPACT_LIMIT 8
+
 struct search
 {
+	void *container_buffer; // 0 for databases created by older versions (stored in separate files)
+	size_t container_size;
+	const unsigned char *container_toc;
+	size_t container_count;
 	struct stat info;
 	unsigned char *data_buffer;
+	void *columns_buffer;
+	size_t columns_size;
+	struct columns columns;
+	uint64_t generation; // incremented each time the database is created
+	void *index_buffer;
+	size_t index_size;
+	void *roots_buffer;
+	size_t roots_size;
+	void *perfect_buffer;
+	size_t perfect_size;
+	struct perfect perfect;
+	void *bloom_buffer;
+	size_t bloom_size;
+	struct bloom bloom;
+	void *trigram_buffer;
+	size_t trigram_size;
+	struct trigram_index trigram;
+	void *names_buffer;
+	size_t names_size;
+	struct names_index names;
+	void *sorted_buffer;
+	size_t sorted_size;
+	struct sorted sorted;
+	void *bitmap_buffer;
+	size_t bitmap_size;
+	struct bitmap_index bitmap;
+	void *inode_buffer;
+	size_t inode_size;
+	struct inodes inodes;
+	void *digest_buffer;
+	size_t digest_size;
+	const uint64_t *digests; // XXH64 of the content of each record; 0 for records that can't have the same content as another file
+	void *media_buffer;
+	size_t media_size;
+	struct media_index media;
+	void *aggregate_buffer;
+	size_t aggregate_size;
+	size_t aggregates_count;
+	const uint64_t *aggregate_records; // record of each directory and symbolic link, ascending
+	const struct aggregate *aggregates;
+	void *saved_buffer;
+	size_t saved_size;
+	size_t saved_count;
+	const uint64_t *saved_entries; // offset and size of the definition, offset and count of the records of each saved search
+
+	// Delta segments (newest first) and the records they replace or delete.
+	struct delta_segment *deltas;
+	size_t deltas_count;
+	size_t deltas_entries;
+	uint64_t *masked;
+
+	// Lookups by path checked against the bloom filter.
+	struct bloom_stats
+	{
+		uint64_t negative; // rejected by the bloom filter
+		uint64_t positive; // passed the bloom filter
+		uint64_t false_positive; // passed the bloom filter but not found
+	} bloom_stats;
+
+	// Decompressed paths of the last used block.
+	unsigned char *paths;
+	size_t paths_capacity, paths_size;
+	size_t paths_block;
+};
+
+// Saved search with its results on the database (see db_save()).
+struct saved
+{
+	const char *definition; // name followed by the arguments of the search, each terminated by 0
+	size_t definition_size;
+	const uint64_t *records; // matching records, ascending
+	size_t count;
 };
 
 struct file
@@ -40,14 +222,95 @@ struct file
     uint64_t size;
 } __attribute__((packed));
 
+void db_system(void);
+
 int db_new(struct db *restrict db);
 int db_persist(struct db *restrict db);
+int db_upgrade(void);
 void db_delete(struct db *restrict db);
 
-int db_add(struct db *restrict db, const char *restrict path, size_t path_length, const struct file *restrict file);
+int db_add(struct db *restrict db, const char *restrict path, size_t path_length, const struct file *restrict file, const struct inode *restrict inode);
+int db_root(struct db *restrict db, const char *restrict path, size_t path_length, size_t start);
 
 int db_open(struct search *restrict search);
+int db_open_directory(struct search *restrict search, const char *restrict directory);
 void db_close(const struct search *restrict search);
 
-int db_find_fileinfo(struct file *restrict file, const char *restrict path, size_t length, const struct search *restrict search);
+// Expected use of an open database. Selects the paging hints for each of its files.
+#define DB_USE_SCAN 1 /* the records in a range are read in order (e.g. ffind) */
+#define DB_USE_LOOKUP 2 /* a few records are found through the indexes (e.g. ffile) */
+#define DB_USE_RESIDENT 3 /* a long-lived process searches the database repeatedly */
+
+void db_advise(const struct search *restrict search, unsigned use);
+void db_prefetch(const struct search *restrict search, size_t first, size_t last);
+
+void db_record(struct file *restrict file, const struct search *restrict search, size_t record);
+const struct block *db_block(const struct search *restrict search, size_t block);
+const unsigned char *db_paths(struct search *restrict search, size_t block, size_t size);
+const unsigned char *db_path(struct search *restrict search, size_t record);
+int db_range(struct search *restrict search, const char *restrict path, size_t length, size_t *restrict start, size_t *restrict end);
+int db_complete(struct search *restrict search, const char *restrict prefix, size_t length, size_t limit, int (*callback)(const char *restrict, size_t, size_t, void *), void *argument);
+
+int db_find_fileinfo(struct file *restrict file, const char *restrict path, size_t length, struct search *restrict search);
+int db_find_media(struct media *restrict media, const char *restrict path, size_t length, struct search *restrict search);
+size_t db_aggregate_first(const struct search *restrict search, size_t record);
+int db_find_inode(struct search *restrict search, const struct inode *restrict inode, int (*callback)(const unsigned char *restrict, const struct file *restrict, void *), void *argument);
+int db_saved(const struct search *restrict search, const char *restrict name, struct saved *restrict saved);
+
+int db_root_find(struct search *restrict search, const char *restrict path, size_t length);
+
+void db_delta_new(struct delta *restrict delta);
+int db_delta_add(struct delta *restrict delta, const char *restrict path, size_t path_length, const struct file *restrict file);
+int db_delta_remove(struct delta *restrict delta, const char *restrict path, size_t path_length);
+int db_delta_persist(struct delta *restrict delta);
+void db_delta_delete(struct delta *restrict delta);
+int db_delta(struct search *restrict search, size_t index, struct file *restrict file, const unsigned char **restrict path);
+ssize_t db_deltas_count(void);
+int db_replica(const struct search *restrict search, uint64_t *restrict generation);
+int db_replica_set(uint64_t generation);
+int db_compact(void);
+int db_save(const char *restrict name, char *const arguments[], size_t count);
+int db_forget(const char *restrict name);
+
+// Checks whether the record is replaced or deleted by a delta segment.
+static inline int db_masked(const struct search *restrict search, size_t record)
+{
+	return (search->masked && ((search->masked[record / 64] >> (record % 64)) & 1));
+}
+
+// Generation in which the record last changed (size, mtime or content).
+static inline uint64_t db_generation(const struct search *restrict search, size_t record)
+{
+	return (search->columns.generation ? search->columns.generation[record] : 0);
+}
+
+// A shard is a separate database storing the files in one indexed directory. The manifest lists the shards.
+struct shard
+{
+	const char *root;
+	size_t root_length;
+	const char *directory; // stores the database of the shard
+	size_t directory_length;
+};
+
+struct shards
+{
+	void *buffer;
+	size_t size;
+	size_t count;
+	struct shard *shard;
+};
+
+int db_shards_open(struct shards *restrict shards);
+void db_shards_close(const struct shards *restrict shards);
+int db_shard(const char *restrict root, size_t root_length, const char *restrict directory, size_t directory_length, char *restrict result, size_t *restrict result_length);
+int db_shard_add(int lock, const char *restrict root, size_t root_length, const char *restrict directory, size_t directory_length);
+int db_shards_check(const char *restrict root, size_t root_length);
+
+#define DB_DIFF_ADDED 1
+#define DB_DIFF_REMOVED 2
+#define DB_DIFF_CHANGED 3
+
+int db_diff(struct search *restrict old, struct search *restrict new, int (*callback)(unsigned, const unsigned char *restrict, const struct file *restrict, void *), void *argument);
+
 int db_set_fileinfo(struct file *restrict file, const char *restrict path, size_t path_length, const struct stat *restrict info);
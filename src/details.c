@@ -1,3 +1,4 @@
+#include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -60,3 +61,26 @@ void details(const char *name, size_t name_length, const struct file *restrict f
 
 	printf("File: %.*s\nSize: %u\nModify: %sContent: %.*s\n", name_length, name, file->size, modified, (int)content.count, content.data);
 }
+
+void details_media(const struct media *restrict media)
+{
+	if (media->width || media->height)
+		printf("Dimensions: %" PRIu32 "x%" PRIu32 "\n", media->width, media->height);
+	if (media->duration)
+		printf("Duration: %" PRIu32 ".%03" PRIu32 "s\n", media->duration / 1000, media->duration % 1000);
+	if (media->rate)
+		printf("Sample rate: %" PRIu32 "Hz\n", media->rate);
+	if (media->codec[0])
+		printf("Codec: %.*s\n", (int)sizeof(media->codec), media->codec);
+}
+
+void details_aggregate(const char *name, size_t name_length, const struct aggregate *restrict aggregate)
+{
+	static const char *const classes[] = {"Directories", "Symbolic links", "Special files", "Executable", "Text", "Archive", "Document", "Image", "Audio", "Video", "Database"};
+	size_t i;
+
+	printf("Directory: %.*s\nSize: %" PRIu64 "\nFiles: %" PRIu64 "\n", (int)name_length, name, aggregate->size, aggregate->files);
+	for(i = 0; i < sizeof(classes) / sizeof(*classes); ++i)
+		if (aggregate->content[i])
+			printf("%s: %" PRIu32 "\n", classes[i], aggregate->content[i]);
+}
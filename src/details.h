@@ -1,3 +1,7 @@
 struct file;
+struct media;
+struct aggregate;
 
 void details(const char *name, size_t name_length, const struct file *restrict file);
+void details_media(const struct media *restrict media);
+void details_aggregate(const char *name, size_t name_length, const struct aggregate *restrict aggregate);
@@ -0,0 +1,144 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "digest.h"
+
+// XXH64 by Yann Collet (https://github.com/Cyan4973/xxHash) with seed 0.
+// Input is processed in stripes of 32 bytes, each of the 4 lanes of the state consuming 8 bytes.
+
+#define PRIME1 11400714785074694791ULL
+#define PRIME2 14029467366897019727ULL
+#define PRIME3 1609587929392839161ULL
+#define PRIME4 9650029242287828579ULL
+#define PRIME5 2870177450012600261ULL
+
+static inline uint64_t rotate(uint64_t value, unsigned bits)
+{
+	return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint64_t read64(const unsigned char *data)
+{
+	uint64_t value;
+	memcpy(&value, data, sizeof(value));
+	return value;
+}
+
+static inline uint32_t read32(const unsigned char *data)
+{
+	uint32_t value;
+	memcpy(&value, data, sizeof(value));
+	return value;
+}
+
+static inline uint64_t lane_round(uint64_t lane, uint64_t input)
+{
+	return rotate(lane + input * PRIME2, 31) * PRIME1;
+}
+
+static inline uint64_t lane_merge(uint64_t hash, uint64_t lane)
+{
+	return (hash ^ lane_round(0, lane)) * PRIME1 + PRIME4;
+}
+
+static void stripe(uint64_t state[static restrict 4], const unsigned char *restrict data)
+{
+	state[0] = lane_round(state[0], read64(data));
+	state[1] = lane_round(state[1], read64(data + 8));
+	state[2] = lane_round(state[2], read64(data + 16));
+	state[3] = lane_round(state[3], read64(data + 24));
+}
+
+void digest_init(struct digest *restrict digest)
+{
+	digest->state[0] = PRIME1 + PRIME2;
+	digest->state[1] = PRIME2;
+	digest->state[2] = 0;
+	digest->state[3] = -PRIME1;
+	digest->total = 0;
+	digest->buffered = 0;
+}
+
+void digest_update(struct digest *restrict digest, const unsigned char *restrict data, size_t size)
+{
+	const unsigned char *end = data + size;
+
+	digest->total += size;
+
+	// Complete the stripe started by the previous data.
+	if (digest->buffered)
+	{
+		size_t missing = sizeof(digest->buffer) - digest->buffered;
+		if (size < missing)
+		{
+			memcpy(digest->buffer + digest->buffered, data, size);
+			digest->buffered += size;
+			return;
+		}
+		memcpy(digest->buffer + digest->buffered, data, missing);
+		stripe(digest->state, digest->buffer);
+		data += missing;
+		digest->buffered = 0;
+	}
+
+	for(; (size_t)(end - data) >= sizeof(digest->buffer); data += sizeof(digest->buffer))
+		stripe(digest->state, data);
+
+	memcpy(digest->buffer, data, end - data);
+	digest->buffered = end - data;
+}
+
+uint64_t digest_final(const struct digest *restrict digest)
+{
+	const unsigned char *data = digest->buffer, *end = digest->buffer + digest->buffered;
+	uint64_t hash;
+
+	if (digest->total >= sizeof(digest->buffer))
+	{
+		hash = rotate(digest->state[0], 1) + rotate(digest->state[1], 7) + rotate(digest->state[2], 12) + rotate(digest->state[3], 18);
+		hash = lane_merge(hash, digest->state[0]);
+		hash = lane_merge(hash, digest->state[1]);
+		hash = lane_merge(hash, digest->state[2]);
+		hash = lane_merge(hash, digest->state[3]);
+	}
+	else hash = PRIME5;
+	hash += digest->total;
+
+	for(; end - data >= 8; data += 8)
+		hash = rotate(hash ^ lane_round(0, read64(data)), 27) * PRIME1 + PRIME4;
+	if (end - data >= 4)
+	{
+		hash = rotate(hash ^ (read32(data) * PRIME1), 23) * PRIME2 + PRIME3;
+		data += 4;
+	}
+	for(; data < end; ++data)
+		hash = rotate(hash ^ (*data * PRIME5), 11) * PRIME1;
+
+	hash ^= hash >> 33;
+	hash *= PRIME2;
+	hash ^= hash >> 29;
+	hash *= PRIME3;
+	hash ^= hash >> 32;
+
+	return hash;
+}
@@ -0,0 +1,31 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// XXH64 of data fed in pieces.
+struct digest
+{
+	uint64_t state[4];
+	uint64_t total;
+	unsigned char buffer[32];
+	size_t buffered;
+};
+
+void digest_init(struct digest *restrict digest);
+void digest_update(struct digest *restrict digest, const unsigned char *restrict data, size_t size);
+uint64_t digest_final(const struct digest *restrict digest);
@@ -0,0 +1,575 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "base.h"
+#include "magic.h"
+#include "db.h"
+#include "export.h"
+
+// The metadata of the file is stored as flatbuffers (https://flatbuffers.dev/internals/).
+// They are built front to back: each table is preceded by its vtable and followed by the objects it refers to.
+struct builder
+{
+	unsigned char *data;
+	size_t size, capacity;
+};
+
+#define TABLE_FIELDS_LIMIT 8
+
+#define ARROW_MAGIC "ARROW1"
+#define ARROW_ALIGNMENT 8
+#define ARROW_CONTINUATION 0xffffffff
+#define ARROW_VERSION 4 /* MetadataVersion V5 */
+
+// Values of the unions used in the metadata.
+#define HEADER_SCHEMA 1
+#define HEADER_DICTIONARY 2
+#define HEADER_BATCH 3
+#define TYPE_INT 2
+#define TYPE_UTF8 5
+#define TYPE_TIMESTAMP 10
+#define TYPE_LARGE_UTF8 20
+
+#define MIME_DICTIONARY 0 /* id of the dictionary of mime types */
+
+#define FIELDS_COUNT 5
+
+static const unsigned char padding[ARROW_ALIGNMENT] = {0};
+
+static inline size_t pad(size_t size)
+{
+	return (ARROW_ALIGNMENT - size % ARROW_ALIGNMENT) % ARROW_ALIGNMENT;
+}
+
+// Appends zeros until size + shift is a multiple of alignment. Then appends size zeros and returns their position.
+static size_t builder_reserve(struct builder *restrict builder, size_t size, size_t alignment, size_t shift)
+{
+	size_t position = builder->size;
+	while ((position + shift) % alignment)
+		position += 1;
+
+	if (position + size > builder->capacity)
+	{
+		builder->capacity = (position + size) * 2;
+		builder->data = realloc(builder->data, builder->capacity);
+		if (!builder->data)
+			abort();
+	}
+	memset(builder->data + builder->size, 0, position + size - builder->size);
+	builder->size = position + size;
+
+	return position;
+}
+
+// Appends a table with fields of the given sizes (0 for fields that are not set) and stores the position of each field.
+// The fields are placed by decreasing size so that each one is aligned.
+static size_t builder_table(struct builder *restrict builder, size_t count, const unsigned char sizes[], size_t fields[])
+{
+	uint16_t vtable[2 + TABLE_FIELDS_LIMIT] = {0};
+	size_t offset = sizeof(int32_t);
+	size_t start, table, size, i;
+	int32_t vtable_offset;
+
+	for(size = 8; size; size /= 2)
+		for(i = 0; i < count; ++i)
+			if (sizes[i] == size)
+			{
+				offset = (offset + size - 1) / size * size;
+				vtable[2 + i] = offset;
+				offset += size;
+			}
+	vtable[0] = (2 + count) * sizeof(*vtable);
+	vtable[1] = offset;
+
+	start = builder_reserve(builder, vtable[0], sizeof(*vtable), 0);
+	memcpy(builder->data + start, vtable, vtable[0]);
+
+	table = builder_reserve(builder, offset, 8, 0);
+	vtable_offset = table - start;
+	memcpy(builder->data + table, &vtable_offset, sizeof(vtable_offset));
+	for(i = 0; i < count; ++i)
+		fields[i] = (vtable[2 + i] ? table + vtable[2 + i] : 0);
+
+	return table;
+}
+
+// Appends a vector with count elements of the given size and alignment. The elements follow the length of the vector.
+static size_t builder_vector(struct builder *restrict builder, size_t count, size_t size, size_t alignment)
+{
+	uint32_t length = count;
+	size_t position = builder_reserve(builder, sizeof(length) + count * size, ((alignment > sizeof(length)) ? alignment : sizeof(length)), sizeof(length));
+	memcpy(builder->data + position, &length, sizeof(length));
+	return position;
+}
+
+static size_t builder_string(struct builder *restrict builder, const char *restrict string)
+{
+	uint32_t length = strlen(string);
+	size_t position = builder_reserve(builder, sizeof(length) + length + 1, sizeof(length), 0);
+	memcpy(builder->data + position, &length, sizeof(length));
+	memcpy(builder->data + position + sizeof(length), string, length);
+	return position;
+}
+
+// Makes the offset at position refer to target.
+static void builder_offset(struct builder *restrict builder, size_t position, size_t target)
+{
+	uint32_t offset = target - position;
+	memcpy(builder->data + position, &offset, sizeof(offset));
+}
+
+static void builder_set(struct builder *restrict builder, size_t position, const void *restrict value, size_t size)
+{
+	memcpy(builder->data + position, value, size);
+}
+
+// Int {bitWidth: int; is_signed: bool;}
+static size_t build_int(struct builder *restrict builder, int32_t width)
+{
+	static const unsigned char sizes[] = {4, 0};
+	size_t fields[2];
+	size_t table = builder_table(builder, 2, sizes, fields);
+	builder_set(builder, fields[0], &width, sizeof(width));
+	return table;
+}
+
+// Field {name: string; nullable: bool; type: Type; dictionary: DictionaryEncoding; children: [Field];}
+static size_t build_field(struct builder *restrict builder, const char *restrict name, uint8_t type, int32_t width, int dictionary)
+{
+	const unsigned char sizes[] = {4, 0, 1, 4, (dictionary ? 4 : 0), 4};
+	size_t fields[6];
+	size_t table = builder_table(builder, 6, sizes, fields);
+	size_t position;
+
+	builder_offset(builder, fields[0], builder_string(builder, name));
+	builder_set(builder, fields[2], &type, sizeof(type));
+	if (type == TYPE_INT)
+		position = build_int(builder, width);
+	else if (type == TYPE_TIMESTAMP)
+	{
+		// Timestamp {unit: TimeUnit; timezone: string;}
+		static const unsigned char timestamp_sizes[] = {0, 4};
+		size_t timestamp[2];
+		position = builder_table(builder, 2, timestamp_sizes, timestamp); // the unit is SECOND (0)
+		builder_offset(builder, timestamp[1], builder_string(builder, "UTC"));
+	}
+	else position = builder_table(builder, 0, 0, 0); // Utf8 and LargeUtf8 have no fields
+	builder_offset(builder, fields[3], position);
+
+	if (dictionary)
+	{
+		// DictionaryEncoding {id: long; indexType: Int;}
+		static const unsigned char encoding_sizes[] = {8, 4};
+		size_t encoding[2];
+		int64_t id = MIME_DICTIONARY;
+		builder_offset(builder, fields[4], builder_table(builder, 2, encoding_sizes, encoding));
+		builder_set(builder, encoding[0], &id, sizeof(id));
+		builder_offset(builder, encoding[1], build_int(builder, 32));
+	}
+
+	builder_offset(builder, fields[5], builder_vector(builder, 0, sizeof(uint32_t), sizeof(uint32_t)));
+
+	return table;
+}
+
+// Schema {endianness: Endianness; fields: [Field];}
+static size_t build_schema(struct builder *restrict builder)
+{
+	static const unsigned char sizes[] = {0, 4};
+	static const struct
+	{
+		const char *name;
+		uint8_t type;
+		int32_t width;
+		int dictionary;
+	} columns[FIELDS_COUNT] = {
+		{"path", TYPE_LARGE_UTF8, 0, 0},
+		{"size", TYPE_INT, 64, 0},
+		{"mtime", TYPE_TIMESTAMP, 0, 0},
+		{"content", TYPE_INT, 16, 0},
+		{"mime", TYPE_UTF8, 0, 1}, // dictionary with index uint32
+	};
+	size_t fields[2];
+	size_t table = builder_table(builder, 2, sizes, fields); // the endianness is Little (0)
+	size_t vector = builder_vector(builder, FIELDS_COUNT, sizeof(uint32_t), sizeof(uint32_t));
+	size_t i;
+
+	builder_offset(builder, fields[1], vector);
+	for(i = 0; i < FIELDS_COUNT; ++i)
+	{
+		size_t element = vector + sizeof(uint32_t) + i * sizeof(uint32_t);
+		builder_offset(builder, element, build_field(builder, columns[i].name, columns[i].type, columns[i].width, columns[i].dictionary));
+	}
+
+	return table;
+}
+
+// Message {version: MetadataVersion; header: MessageHeader; bodyLength: long;}
+// Returns the position of the offset of the header.
+static size_t build_message(struct builder *restrict builder, uint8_t type, uint64_t body)
+{
+	static const unsigned char sizes[] = {2, 1, 4, 8};
+	size_t fields[4];
+	int16_t version = ARROW_VERSION;
+
+	builder->size = 0;
+	builder_reserve(builder, sizeof(uint32_t), sizeof(uint32_t), 0);
+	builder_offset(builder, 0, builder_table(builder, 4, sizes, fields));
+	builder_set(builder, fields[0], &version, sizeof(version));
+	builder_set(builder, fields[1], &type, sizeof(type));
+	builder_set(builder, fields[3], &body, sizeof(body));
+
+	return fields[2];
+}
+
+// Buffer in the body of a record batch. It can consist of two parts that are not contiguous in memory.
+struct part
+{
+	const void *data[2];
+	size_t size[2];
+};
+
+// RecordBatch {length: long; nodes: [FieldNode]; buffers: [Buffer];}
+// Each column has a validity buffer (empty since there are no null values) and one or two buffers with data.
+static size_t build_batch(struct builder *restrict builder, uint64_t count, size_t columns, const struct part parts[], size_t parts_count)
+{
+	static const unsigned char sizes[] = {8, 4, 4};
+	size_t fields[3];
+	size_t table = builder_table(builder, 3, sizes, fields);
+	size_t nodes, buffers, i;
+	uint64_t offset = 0;
+
+	builder_set(builder, fields[0], &count, sizeof(count));
+
+	// FieldNode {length: long; null_count: long;}
+	nodes = builder_vector(builder, columns, 2 * sizeof(uint64_t), sizeof(uint64_t));
+	builder_offset(builder, fields[1], nodes);
+	for(i = 0; i < columns; ++i)
+		builder_set(builder, nodes + sizeof(uint32_t) + i * 2 * sizeof(uint64_t), &count, sizeof(count));
+
+	// Buffer {offset: long; length: long;}
+	buffers = builder_vector(builder, parts_count, 2 * sizeof(uint64_t), sizeof(uint64_t));
+	builder_offset(builder, fields[2], buffers);
+	for(i = 0; i < parts_count; ++i)
+	{
+		uint64_t buffer[2] = {offset, parts[i].size[0] + parts[i].size[1]};
+		builder_set(builder, buffers + sizeof(uint32_t) + i * sizeof(buffer), buffer, sizeof(buffer));
+		offset += buffer[1] + pad(buffer[1]);
+	}
+
+	return table;
+}
+
+static int export_write(struct export *restrict export, const void *restrict buffer, size_t size)
+{
+	if (!size)
+		return 0;
+	if (write(export->fd, buffer, size) != size)
+		return ERROR_WRITE;
+	export->offset += size;
+	return 0;
+}
+
+// Writes a message with the metadata in builder and the given buffers as body. Stores the position of the message in block.
+static int message_write(struct export *restrict export, const struct builder *restrict builder, const struct part parts[], size_t parts_count, uint64_t body, struct export_block *restrict block)
+{
+	uint32_t prefix[2] = {ARROW_CONTINUATION, builder->size + pad(builder->size)};
+	size_t i, j;
+	int status;
+
+	block->offset = export->offset;
+	block->metadata = sizeof(prefix) + prefix[1];
+	block->body = body;
+
+	if (status = export_write(export, prefix, sizeof(prefix)))
+		return status;
+	if (status = export_write(export, builder->data, builder->size))
+		return status;
+	if (status = export_write(export, padding, pad(builder->size)))
+		return status;
+
+	for(i = 0; i < parts_count; ++i)
+	{
+		for(j = 0; j < 2; ++j)
+			if (status = export_write(export, parts[i].data[j], parts[i].size[j]))
+				return status;
+		if (status = export_write(export, padding, pad(parts[i].size[0] + parts[i].size[1])))
+			return status;
+	}
+
+	return 0;
+}
+
+static uint64_t body_size(const struct part parts[], size_t parts_count)
+{
+	uint64_t size = 0;
+	size_t i;
+	for(i = 0; i < parts_count; ++i)
+		size += parts[i].size[0] + parts[i].size[1] + pad(parts[i].size[0] + parts[i].size[1]);
+	return size;
+}
+
+// Writes a record batch with count records. offsets are the offsets of the paths in paths and end is the end of the last path.
+static int batch_write(struct export *restrict export, size_t count, const uint64_t *restrict offsets, uint64_t end, const unsigned char *restrict paths, const uint64_t *restrict size, const uint64_t *restrict mtime, const uint16_t *restrict content, const uint32_t *restrict mime)
+{
+	const struct part parts[] = {
+		{{0}, {0}}, {{offsets, &end}, {count * sizeof(*offsets), sizeof(end)}}, {{paths}, {end}},
+		{{0}, {0}}, {{size}, {count * sizeof(*size)}},
+		{{0}, {0}}, {{mtime}, {count * sizeof(*mtime)}},
+		{{0}, {0}}, {{content}, {count * sizeof(*content)}},
+		{{0}, {0}}, {{mime}, {count * sizeof(*mime)}},
+	};
+	size_t parts_count = sizeof(parts) / sizeof(*parts);
+	uint64_t body = body_size(parts, parts_count);
+	struct builder builder = {0};
+	size_t header;
+	int status;
+
+	if (export->batches_count == export->batches_capacity)
+	{
+		export->batches_capacity = (export->batches_capacity ? export->batches_capacity * 2 : 256);
+		export->batches = realloc(export->batches, export->batches_capacity * sizeof(*export->batches));
+		if (!export->batches)
+			abort();
+	}
+
+	header = build_message(&builder, HEADER_BATCH, body);
+	builder_offset(&builder, header, build_batch(&builder, count, FIELDS_COUNT, parts, parts_count));
+	status = message_write(export, &builder, parts, parts_count, body, export->batches + export->batches_count);
+	free(builder.data);
+	if (status)
+		return status;
+
+	export->batches_count += 1;
+	return 0;
+}
+
+// Writes the records added by export_add().
+static int export_flush(struct export *restrict export)
+{
+	int status = batch_write(export, export->count, export->offsets, export->paths_size, export->paths, export->size, export->mtime, export->content, export->mime);
+	export->count = 0;
+	export->paths_size = 0;
+	return status;
+}
+
+// Writes the header of the file, the schema and the names of the mime types (the dictionary of the mime column).
+int export_init(struct export *restrict export, int fd)
+{
+	static const unsigned char magic[ARROW_ALIGNMENT] = ARROW_MAGIC;
+	int32_t offsets[TYPES_COUNT + 1];
+	unsigned char *names;
+	struct builder builder = {0};
+	struct export_block schema;
+	size_t type, header;
+	int status;
+
+	export->fd = fd;
+	export->offset = 0;
+	export->batches = 0;
+	export->batches_count = 0;
+	export->batches_capacity = 0;
+	export->count = 0;
+	export->paths = 0;
+	export->paths_size = 0;
+	export->paths_capacity = 0;
+	export->offsets = alloc(DB_BLOCK_RECORDS * sizeof(*export->offsets));
+	export->size = alloc(DB_BLOCK_RECORDS * sizeof(*export->size));
+	export->mtime = alloc(DB_BLOCK_RECORDS * sizeof(*export->mtime));
+	export->content = alloc(DB_BLOCK_RECORDS * sizeof(*export->content));
+	export->mime = alloc(DB_BLOCK_RECORDS * sizeof(*export->mime));
+
+	if (status = export_write(export, magic, sizeof(magic)))
+		return status;
+
+	header = build_message(&builder, HEADER_SCHEMA, 0);
+	builder_offset(&builder, header, build_schema(&builder));
+	status = message_write(export, &builder, 0, 0, 0, &schema);
+	if (status)
+		goto finally;
+
+	offsets[0] = 0;
+	for(type = 0; type < TYPES_COUNT; ++type)
+		offsets[type + 1] = offsets[type] + typeinfo[type].mime_type->size;
+	names = alloc(offsets[TYPES_COUNT] + 1);
+	for(type = 0; type < TYPES_COUNT; ++type)
+		memcpy(names + offsets[type], typeinfo[type].mime_type->data, typeinfo[type].mime_type->size);
+
+	{
+		// DictionaryBatch {id: long; data: RecordBatch;}
+		static const unsigned char sizes[] = {8, 4};
+		const struct part parts[] = {{{0}, {0}}, {{offsets}, {sizeof(offsets)}}, {{names}, {offsets[TYPES_COUNT]}}};
+		size_t parts_count = sizeof(parts) / sizeof(*parts);
+		uint64_t body = body_size(parts, parts_count);
+		size_t fields[2];
+		int64_t id = MIME_DICTIONARY;
+
+		header = build_message(&builder, HEADER_DICTIONARY, body);
+		builder_offset(&builder, header, builder_table(&builder, 2, sizes, fields));
+		builder_set(&builder, fields[0], &id, sizeof(id));
+		builder_offset(&builder, fields[1], build_batch(&builder, TYPES_COUNT, 1, parts, parts_count));
+		status = message_write(export, &builder, parts, parts_count, body, &export->dictionary);
+	}
+	free(names);
+
+finally:
+	free(builder.data);
+	return status;
+}
+
+// Adds a file. The files are written in batches of DB_BLOCK_RECORDS.
+int export_add(struct export *restrict export, const unsigned char *restrict path, const struct file *restrict file)
+{
+	if (export->paths_size + file->path_length > export->paths_capacity)
+	{
+		export->paths_capacity = (export->paths_size + file->path_length) * 2;
+		export->paths = realloc(export->paths, export->paths_capacity);
+		if (!export->paths)
+			abort();
+	}
+
+	export->offsets[export->count] = export->paths_size;
+	memcpy(export->paths + export->paths_size, path, file->path_length);
+	export->paths_size += file->path_length;
+	export->size[export->count] = file->size;
+	export->mtime[export->count] = file->mtime;
+	export->content[export->count] = file->content;
+	export->mime[export->count] = file->mime_type;
+
+	if (++export->count == DB_BLOCK_RECORDS)
+		return export_flush(export);
+	return 0;
+}
+
+// Adds the records in [first, last) that are not replaced by a delta segment.
+// The columns of each block are written as they are stored in the database; only the paths are decompressed.
+int export_records(struct export *restrict export, struct search *restrict search, size_t first, size_t last)
+{
+	const struct columns *columns = &search->columns;
+	size_t block, start, end, record;
+	int status;
+
+	for(block = first / DB_BLOCK_RECORDS; block * DB_BLOCK_RECORDS < last; ++block)
+	{
+		const struct block *header = db_block(search, block);
+		const unsigned char *paths;
+		uint64_t paths_end;
+
+		if (!header)
+			return ERROR_INPUT;
+		start = ((block * DB_BLOCK_RECORDS > first) ? block * DB_BLOCK_RECORDS : first);
+		end = (((block + 1) * DB_BLOCK_RECORDS < last) ? (block + 1) * DB_BLOCK_RECORDS : last);
+		paths_end = columns->offset[end - 1] + columns->path_length[end - 1];
+		if (paths_end > header->raw)
+			return ERROR_INPUT;
+		paths = db_paths(search, block, header->raw);
+		if (!paths)
+			return ERROR_INPUT;
+
+		for(record = start; record < end; ++record)
+			if (db_masked(search, record))
+				break;
+		if (record < end)
+		{
+			// The records replaced by delta segments must be skipped so the block is not written as it is.
+			for(record = start; record < end; ++record)
+			{
+				struct file file;
+
+				if (db_masked(search, record))
+					continue;
+				db_record(&file, search, record);
+				if (status = export_add(export, paths + columns->offset[record], &file))
+					return status;
+			}
+			continue;
+		}
+
+		if (export->count && (status = export_flush(export)))
+			return status;
+		status = batch_write(export, end - start, columns->offset + start, paths_end, paths, columns->size + start, columns->mtime + start, columns->content + start, columns->mime_type + start);
+		if (status)
+			return status;
+	}
+
+	return 0;
+}
+
+// Writes the remaining files and the footer of the file.
+int export_finish(struct export *restrict export)
+{
+	static const uint32_t end[2] = {ARROW_CONTINUATION, 0};
+	static const unsigned char sizes[] = {2, 4, 4, 4};
+	struct builder builder = {0};
+	size_t fields[4], blocks, i;
+	int16_t version = ARROW_VERSION;
+	int32_t footer;
+	int status = 0;
+
+	if (export->count)
+		status = export_flush(export);
+	if (!status)
+		status = export_write(export, end, sizeof(end));
+
+	if (!status)
+	{
+		// Footer {version: MetadataVersion; schema: Schema; dictionaries: [Block]; recordBatches: [Block];}
+		// Block {offset: long; metaDataLength: int; bodyLength: long;}
+		builder_reserve(&builder, sizeof(uint32_t), sizeof(uint32_t), 0);
+		builder_offset(&builder, 0, builder_table(&builder, 4, sizes, fields));
+		builder_set(&builder, fields[0], &version, sizeof(version));
+		builder_offset(&builder, fields[1], build_schema(&builder));
+
+		blocks = builder_vector(&builder, 1, 3 * sizeof(uint64_t), sizeof(uint64_t));
+		builder_offset(&builder, fields[2], blocks);
+		builder_set(&builder, blocks + sizeof(uint32_t), &export->dictionary.offset, sizeof(uint64_t));
+		builder_set(&builder, blocks + sizeof(uint32_t) + sizeof(uint64_t), &export->dictionary.metadata, sizeof(uint32_t));
+		builder_set(&builder, blocks + sizeof(uint32_t) + 2 * sizeof(uint64_t), &export->dictionary.body, sizeof(uint64_t));
+
+		blocks = builder_vector(&builder, export->batches_count, 3 * sizeof(uint64_t), sizeof(uint64_t));
+		builder_offset(&builder, fields[3], blocks);
+		for(i = 0; i < export->batches_count; ++i)
+		{
+			size_t position = blocks + sizeof(uint32_t) + i * 3 * sizeof(uint64_t);
+			builder_set(&builder, position, &export->batches[i].offset, sizeof(uint64_t));
+			builder_set(&builder, position + sizeof(uint64_t), &export->batches[i].metadata, sizeof(uint32_t));
+			builder_set(&builder, position + 2 * sizeof(uint64_t), &export->batches[i].body, sizeof(uint64_t));
+		}
+
+		footer = builder.size;
+		if (!(status = export_write(export, builder.data, builder.size)) && !(status = export_write(export, &footer, sizeof(footer))))
+			status = export_write(export, ARROW_MAGIC, sizeof(ARROW_MAGIC) - 1);
+		free(builder.data);
+	}
+
+	free(export->batches);
+	free(export->paths);
+	free(export->offsets);
+	free(export->size);
+	free(export->mtime);
+	free(export->content);
+	free(export->mime);
+	return status;
+}
@@ -0,0 +1,54 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Writes files to an Apache Arrow IPC file (https://arrow.apache.org/docs/format/Columnar.html) with the columns:
+// path (large_utf8), size (uint64), mtime (timestamp[s, UTC]), content (uint16 bitmask of CONTENT_*), mime (dictionary<uint32, utf8>).
+// The records are written in batches of at most DB_BLOCK_RECORDS records.
+struct export
+{
+	int fd;
+	uint64_t offset; // bytes written to fd
+
+	// Position of each message, needed by the footer of the file.
+	struct export_block
+	{
+		uint64_t offset;
+		uint32_t metadata;
+		uint64_t body;
+	} *batches;
+	size_t batches_count, batches_capacity;
+	struct export_block dictionary;
+
+	// Records added by export_add() that are not written yet.
+	size_t count;
+	unsigned char *paths;
+	size_t paths_size, paths_capacity;
+	uint64_t *offsets;
+	uint64_t *size, *mtime;
+	uint16_t *content;
+	uint32_t *mime;
+};
+
+struct search;
+struct file;
+
+int export_init(struct export *restrict export, int fd);
+int export_add(struct export *restrict export, const unsigned char *restrict path, const struct file *restrict file);
+int export_records(struct export *restrict export, struct search *restrict search, size_t first, size_t last);
+int export_finish(struct export *restrict export);
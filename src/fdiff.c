@@ -0,0 +1,85 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "base.h"
+#include "path.h"
+#include "db.h"
+
+#define STRING(s) (s), sizeof(s) - 1
+
+static int usage(int code)
+{
+	write(1, STRING(
+"Usage: fdiff <old database directory> <new database directory>\n"
+"Prints each added (A), removed (D) and changed (M) file.\n"
+	));
+	return code;
+}
+
+static int report(unsigned change, const unsigned char *restrict path, const struct file *restrict file, void *argument)
+{
+	static const char prefix[] = {[DB_DIFF_ADDED] = 'A', [DB_DIFF_REMOVED] = 'D', [DB_DIFF_CHANGED] = 'M'};
+	char buffer[2 + PATH_SIZE_LIMIT + 1];
+
+	buffer[0] = prefix[change];
+	buffer[1] = ' ';
+	memcpy(buffer + 2, path, file->path_length);
+	buffer[2 + file->path_length] = '\n';
+	write(1, buffer, 2 + file->path_length + 1);
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct search old, new;
+	int status;
+
+	if ((argc != 3) || !strcmp(argv[1], "--help"))
+		return usage(argc != 3);
+
+	status = db_open_directory(&old, argv[1]);
+	if (status < 0)
+	{
+		fprintf(stderr, "Unable to open database in %s\n", argv[1]);
+		return -status;
+	}
+	status = db_open_directory(&new, argv[2]);
+	if (status < 0)
+	{
+		fprintf(stderr, "Unable to open database in %s\n", argv[2]);
+		db_close(&old);
+		return -status;
+	}
+
+	db_advise(&old, DB_USE_SCAN);
+	db_advise(&new, DB_USE_SCAN);
+	status = db_diff(&old, &new, report, 0);
+
+	db_close(&new);
+	db_close(&old);
+
+	return -status;
+}
@@ -15,6 +15,36 @@
 
 #define STRING(s) (s), sizeof(s) - 1
 
+// Takes the details of the first path of a file found by its inode.
+static int inode_found(const unsigned char *restrict path, const struct file *restrict file, void *argument)
+{
+	*(struct file *)argument = *file;
+	return 1;
+}
+
+// Tells whether path is in the directory indexed by the shard.
+static int shard_contains(const struct shard *restrict shard, const char *restrict path, size_t length)
+{
+	if ((length < shard->root_length) || memcmp(path, shard->root, shard->root_length))
+		return 0;
+	return ((length == shard->root_length) || (path[shard->root_length] == '/') || (shard->root[shard->root_length - 1] == '/'));
+}
+
+// Opens the database of the shard with the given index when it is first needed.
+// opened[index] is 1 until the database is opened and then holds the status of db_open().
+static int shard_open(const struct shards *restrict shards, struct search *restrict searches, int *restrict opened, size_t index)
+{
+	if (opened[index] == 1)
+	{
+		path_directory(shards->shard[index].directory, shards->shard[index].directory_length);
+		opened[index] = db_open(searches + index);
+		path_directory(0, 0);
+		if (!opened[index])
+			db_advise(searches + index, DB_USE_LOOKUP);
+	}
+	return opened[index];
+}
+
 static int usage(int code)
 {
 	write(1, STRING(
@@ -28,16 +58,34 @@ int main(int argc, char *argv[])
 	int i;
 	int status;
 
-	struct search search;
+	struct search database;
+	struct shards shards;
+	struct search *searches; // databases of the shards
+	int *opened;
+	size_t index;
 
 	// TODO better error handling
 
 	if ((argc < 2) || !strcmp(argv[1], "--help"))
 		return usage(0);
 
-	status = db_open(&search);
+	status = db_open(&database);
 	if (status < 0)
 		return -status;
+	db_advise(&database, DB_USE_LOOKUP);
+
+	// Each file is looked up in the shard containing it or in the database.
+	status = db_shards_open(&shards);
+	if (status && (status != ERROR_MISSING))
+	{
+		db_close(&database);
+		return -status;
+	}
+	searches = alloc(shards.count * sizeof(*searches) + 1);
+	opened = alloc(shards.count * sizeof(*opened) + 1);
+	for(index = 0; index < shards.count; ++index)
+		opened[index] = 1;
+	status = 0;
 
 	for(i = 1; i < argc; i += 1)
 	{
@@ -45,6 +93,8 @@ int main(int argc, char *argv[])
 		//struct stat info;
 		size_t length;
 		struct file file;
+		struct media media;
+		struct search *search = &database;
 
 		char path[PATH_SIZE_LIMIT + 1];
 
@@ -54,6 +104,16 @@ int main(int argc, char *argv[])
 		if (status < 0)
 			break;
 
+		for(index = 0; index < shards.count; ++index)
+			if (shard_contains(shards.shard + index, path, length))
+			{
+				status = shard_open(&shards, searches, opened, index);
+				search = searches + index;
+				break;
+			}
+		if (status < 0)
+			break;
+
 		/*if (stat(argv[i], &info) < 0)
 		{
 			status = ERROR;
@@ -61,16 +121,36 @@ int main(int argc, char *argv[])
 		}*/
 
 		//status = db_set_fileinfo(&file, path, length, &info);
-		status = db_find_fileinfo(&file, path, length, &search);
+		status = db_find_fileinfo(&file, path, length, search);
+		if ((status == ERROR_MISSING) && search->inode_buffer)
+		{
+			// The file may be indexed under another path (e.g. through a symbolic link or a hard link).
+			struct stat info;
+			if (!lstat(path, &info))
+			{
+				struct inode inode = {info.st_dev, info.st_ino};
+				status = db_find_inode(search, &inode, &inode_found, &file);
+				if (status == 1)
+					status = 0;
+			}
+		}
 		if (status < 0)
 			break;
 
 		if (i > 1)
 			putc('\n', stdout); // separate output by new lines
 		details(argv[i], length, &file);
+		if (!db_find_media(&media, path, length, search))
+			details_media(&media);
 	}
 
-	db_close(&search);
+	for(index = 0; index < shards.count; ++index)
+		if (!opened[index])
+			db_close(searches + index);
+	free(opened);
+	free(searches);
+	db_shards_close(&shards);
+	db_close(&database);
 
 	return -status;
 }
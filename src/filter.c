@@ -0,0 +1,207 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+# include <immintrin.h>
+# define FILTER_X86
+#endif
+
+#include "filter.h"
+
+// Each kernel computes the bits for a whole word of the selection (64 records) at a time.
+// Words that are already cleared are skipped so that filters applied later touch less memory.
+// The last (incomplete) word is always handled by the scalar code.
+
+void filter_init(uint64_t *restrict selection, size_t count)
+{
+	size_t words = count / 64;
+	memset(selection, 0xff, words * sizeof(*selection));
+	if (count % 64)
+		selection[words] = ((uint64_t)1 << (count % 64)) - 1;
+}
+
+void filter_skip(uint64_t *restrict selection, size_t count)
+{
+	size_t words = count / 64;
+	memset(selection, 0, words * sizeof(*selection));
+	if (count % 64)
+		selection[words] &= ~(((uint64_t)1 << (count % 64)) - 1);
+}
+
+static uint64_t range_scalar(const uint64_t *restrict values, size_t count, uint64_t min, uint64_t max)
+{
+	uint64_t bits = 0;
+	size_t i;
+	for(i = 0; i < count; ++i)
+		bits |= (uint64_t)((min <= values[i]) & (values[i] <= max)) << i;
+	return bits;
+}
+
+static uint64_t any_scalar(const uint16_t *restrict values, size_t count, uint16_t mask)
+{
+	uint64_t bits = 0;
+	size_t i;
+	for(i = 0; i < count; ++i)
+		bits |= (uint64_t)!!(values[i] & mask) << i;
+	return bits;
+}
+
+#if defined(FILTER_X86)
+
+// There is no unsigned 64-bit comparison so the values are compared as signed after flipping their sign bit.
+
+__attribute__((target("avx2")))
+static uint64_t range_avx2(const uint64_t *restrict values, uint64_t min, uint64_t max)
+{
+	const __m256i sign = _mm256_set1_epi64x(INT64_MIN);
+	const __m256i low = _mm256_set1_epi64x((int64_t)(min ^ (uint64_t)INT64_MIN));
+	const __m256i high = _mm256_set1_epi64x((int64_t)(max ^ (uint64_t)INT64_MIN));
+	uint64_t outside = 0;
+	size_t i;
+
+	for(i = 0; i < 64; i += 4)
+	{
+		__m256i value = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(values + i)), sign);
+		__m256i out = _mm256_or_si256(_mm256_cmpgt_epi64(low, value), _mm256_cmpgt_epi64(value, high));
+		outside |= (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(out)) << i;
+	}
+
+	return ~outside;
+}
+
+__attribute__((target("sse4.2")))
+static uint64_t range_sse(const uint64_t *restrict values, uint64_t min, uint64_t max)
+{
+	const __m128i sign = _mm_set1_epi64x(INT64_MIN);
+	const __m128i low = _mm_set1_epi64x((int64_t)(min ^ (uint64_t)INT64_MIN));
+	const __m128i high = _mm_set1_epi64x((int64_t)(max ^ (uint64_t)INT64_MIN));
+	uint64_t outside = 0;
+	size_t i;
+
+	for(i = 0; i < 64; i += 2)
+	{
+		__m128i value = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(values + i)), sign);
+		__m128i out = _mm_or_si128(_mm_cmpgt_epi64(low, value), _mm_cmpgt_epi64(value, high));
+		outside |= (uint64_t)_mm_movemask_pd(_mm_castsi128_pd(out)) << i;
+	}
+
+	return ~outside;
+}
+
+// Pack the 16-bit comparison results to bytes so that one movemask yields one bit per record.
+
+__attribute__((target("avx2")))
+static uint64_t any_avx2(const uint16_t *restrict values, uint16_t mask)
+{
+	const __m256i bits = _mm256_set1_epi16((short)mask);
+	const __m256i zero = _mm256_setzero_si256();
+	uint64_t none = 0;
+	size_t i;
+
+	for(i = 0; i < 64; i += 32)
+	{
+		__m256i a = _mm256_cmpeq_epi16(_mm256_and_si256(_mm256_loadu_si256((const __m256i *)(values + i)), bits), zero);
+		__m256i b = _mm256_cmpeq_epi16(_mm256_and_si256(_mm256_loadu_si256((const __m256i *)(values + i + 16)), bits), zero);
+		__m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(a, b), 0xd8); // restore record order across lanes
+		none |= (uint64_t)(uint32_t)_mm256_movemask_epi8(packed) << i;
+	}
+
+	return ~none;
+}
+
+static uint64_t any_sse(const uint16_t *restrict values, uint16_t mask)
+{
+	const __m128i bits = _mm_set1_epi16((short)mask);
+	const __m128i zero = _mm_setzero_si128();
+	uint64_t none = 0;
+	size_t i;
+
+	for(i = 0; i < 64; i += 16)
+	{
+		__m128i a = _mm_cmpeq_epi16(_mm_and_si128(_mm_loadu_si128((const __m128i *)(values + i)), bits), zero);
+		__m128i b = _mm_cmpeq_epi16(_mm_and_si128(_mm_loadu_si128((const __m128i *)(values + i + 8)), bits), zero);
+		none |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_packs_epi16(a, b)) << i;
+	}
+
+	return ~none;
+}
+
+#endif /* defined(FILTER_X86) */
+
+void filter_range(uint64_t *restrict selection, const uint64_t *restrict values, size_t count, uint64_t min, uint64_t max)
+{
+	size_t words = count / 64;
+	size_t word;
+
+#if defined(FILTER_X86)
+	if (__builtin_cpu_supports("avx2"))
+	{
+		for(word = 0; word < words; ++word)
+			if (selection[word])
+				selection[word] &= range_avx2(values + word * 64, min, max);
+	}
+	else if (__builtin_cpu_supports("sse4.2"))
+	{
+		for(word = 0; word < words; ++word)
+			if (selection[word])
+				selection[word] &= range_sse(values + word * 64, min, max);
+	}
+	else
+#endif
+	{
+		for(word = 0; word < words; ++word)
+			if (selection[word])
+				selection[word] &= range_scalar(values + word * 64, 64, min, max);
+	}
+
+	if (count % 64)
+		selection[words] &= range_scalar(values + words * 64, count % 64, min, max);
+}
+
+void filter_any(uint64_t *restrict selection, const uint16_t *restrict values, size_t count, uint16_t mask)
+{
+	size_t words = count / 64;
+	size_t word;
+
+#if defined(FILTER_X86)
+	if (__builtin_cpu_supports("avx2"))
+	{
+		for(word = 0; word < words; ++word)
+			if (selection[word])
+				selection[word] &= any_avx2(values + word * 64, mask);
+	}
+	else
+	{
+		for(word = 0; word < words; ++word)
+			if (selection[word])
+				selection[word] &= any_sse(values + word * 64, mask);
+	}
+#else
+	for(word = 0; word < words; ++word)
+		if (selection[word])
+			selection[word] &= any_scalar(values + word * 64, 64, mask);
+#endif
+
+	if (count % 64)
+		selection[words] &= any_scalar(values + words * 64, count % 64, mask);
+}
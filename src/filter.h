@@ -0,0 +1,34 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Records are filtered in blocks. Bit i of a selection bitmap corresponds to the i-th record in the block.
+#define FILTER_BLOCK 4096
+
+#define FILTER_WORDS(count) (((count) + 63) / 64)
+
+void filter_init(uint64_t *restrict selection, size_t count);
+
+// Clear the bits of the first count records.
+void filter_skip(uint64_t *restrict selection, size_t count);
+
+// Clear the bits of the records whose value is outside [min, max].
+void filter_range(uint64_t *restrict selection, const uint64_t *restrict values, size_t count, uint64_t min, uint64_t max);
+
+// Clear the bits of the records whose value has no bit in common with mask.
+void filter_any(uint64_t *restrict selection, const uint16_t *restrict values, size_t count, uint16_t mask);
@@ -19,6 +19,7 @@
 
 #include <dirent.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -32,22 +33,39 @@
 #include "base.h"
 #include "path.h"
 #include "db.h"
+#include "stream.h"
 
 #define STRING(s) (s), sizeof(s) - 1
 
-static int db_insert(struct db *restrict db, const char *restrict path, size_t path_length, const struct stat *restrict info)
+// Changes recorded by -update and the database they are compared to.
+struct update
 {
-	struct file file;
+	struct delta delta;
+	struct search search;
+};
+
+// Adds the file to the database or (if update is not NULL) to the delta segment.
+static int db_insert(struct db *restrict db, struct update *restrict update, const char *restrict path, size_t path_length, const struct stat *restrict info)
+{
+	struct file file, current;
+	struct inode inode = {info->st_dev, info->st_ino};
 
 	int status = db_set_fileinfo(&file, path, path_length, info);
 	if (status < 0)
 		return ((status == ERROR_CANCEL) ? 0 : status); // ERROR_CANCEL is non-fatal
 
-	return db_add(db, path, path_length, &file);
+	if (update)
+	{
+		// Files that did not change need no delta entry.
+		if (!db_find_fileinfo(&current, path, path_length, &update->search) && !memcmp(&current, &file, sizeof(file)))
+			return 0;
+		return db_delta_add(&update->delta, path, path_length, &file);
+	}
+	return db_add(db, path, path_length, &file, &inode);
 }
 
 // Writes indexing data in a database.
-static int db_index(struct db *restrict db, char *path, size_t path_length)
+static int db_index(struct db *restrict db, struct update *restrict update, char *path, size_t path_length)
 {
 	DIR *dir;
 	struct dirent *entry;
@@ -138,7 +156,7 @@ static int db_index(struct db *restrict db, char *path, size_t path_length)
 			goto finally;
 		}
 
-		if (status = db_insert(db, path, path_length, &info))
+		if (status = db_insert(db, update, path, path_length, &info))
 		{
 			fprintf(stderr, "Unable to insert entry %s\n", path);
 			goto finally;
@@ -146,7 +164,7 @@ static int db_index(struct db *restrict db, char *path, size_t path_length)
 
 		// Recursively index each subdirectory.
 		if (S_ISDIR(info.st_mode))
-			if (status = db_index(db, path, path_length))
+			if (status = db_index(db, update, path, path_length))
 				goto finally;
 
 		path_length -= name_length;
@@ -165,33 +183,408 @@ finally:
 	return status;
 }
 
+// Records the deletion of path if the file no longer exists.
+static int db_deleted(struct delta *restrict delta, const unsigned char *restrict path, size_t path_length)
+{
+	char buffer[PATH_SIZE_LIMIT];
+	struct stat info;
+
+	memcpy(buffer, path, path_length);
+	buffer[path_length] = 0;
+	if ((lstat(buffer, &info) < 0) && (errno == ENOENT))
+		return db_delta_remove(delta, buffer, path_length);
+	return 0;
+}
+
+static inline int in_directory(const unsigned char *restrict path, size_t path_length, const char *restrict directory, size_t directory_length)
+{
+	return ((path_length > directory_length) && (path[directory_length] == '/') && !memcmp(path, directory, directory_length));
+}
+
+// Records the changes in path since the database was created.
+static int db_refresh(struct update *restrict update, char *path, size_t path_length)
+{
+	struct search *search = &update->search;
+	struct stat info;
+	struct file file;
+	const unsigned char *change;
+	size_t start, end, record, index;
+	int root;
+	int status;
+
+	root = db_root_find(search, path, path_length);
+	if (root < 0)
+	{
+		if (root == ERROR_MISSING)
+			fprintf(stderr, "%s is not in an indexed directory\n", path);
+		return root;
+	}
+
+	if (lstat(path, &info) < 0)
+	{
+		if (errno != ENOENT)
+		{
+			fprintf(stderr, "Unable to lstat %s\n", path);
+			return ERROR;
+		}
+		if (root && (status = db_delta_remove(&update->delta, path, path_length)))
+			return status;
+	}
+	else
+	{
+		// The indexed directories are not stored as records.
+		if (root && (status = db_insert(0, update, path, path_length, &info)))
+			return status;
+		if (S_ISDIR(info.st_mode) && (status = db_index(0, update, path, path_length)))
+			return status;
+	}
+
+	// Record the deletion of files that are no longer in the directory.
+	if (status = db_range(search, path, path_length, &start, &end))
+		return status;
+	for(record = start; record < end; ++record)
+	{
+		const unsigned char *record_path;
+
+		if (db_masked(search, record))
+			continue;
+		record_path = db_path(search, record);
+		if (!record_path)
+			return ERROR_INPUT;
+		if (in_directory(record_path, search->columns.path_length[record], path, path_length) && (status = db_deleted(&update->delta, record_path, search->columns.path_length[record])))
+			return status;
+	}
+	for(index = 0; index < search->deltas_entries; ++index)
+	{
+		status = db_delta(search, index, &file, &change);
+		if (status == ERROR_MISSING)
+			continue;
+		if (status)
+			return status;
+		if (in_directory(change, file.path_length, path, path_length) && (status = db_deleted(&update->delta, change, file.path_length)))
+			return status;
+	}
+
+	return 0;
+}
+
+// Records the changes in the given paths in a new delta segment.
+static int db_update(char *paths[], size_t count)
+{
+	struct update update;
+	size_t i;
+	int status;
+
+	status = db_open(&update.search);
+	if (status)
+		return status;
+	db_advise(&update.search, DB_USE_LOOKUP);
+	db_delta_new(&update.delta);
+
+	for(i = 0; i < count; ++i)
+	{
+		char target[PATH_SIZE_LIMIT];
+		size_t target_length;
+
+		status = normalize(target, &target_length, paths[i], strlen(paths[i]));
+		if (status)
+			goto finally;
+
+		status = db_refresh(&update, target, target_length);
+		if (status)
+			goto finally;
+	}
+
+	status = db_delta_persist(&update.delta);
+
+finally:
+	db_delta_delete(&update.delta);
+	db_close(&update.search);
+	if (status)
+		return status;
+
+	// Merge the segments into the database in the background when there are too many of them.
+	if ((db_deltas_count() >= DELTA_COMPACT_LIMIT) && !fork())
+		_exit(-db_compact());
+
+	return 0;
+}
+
+// Writes to the standard output the changes that bring the database in directory (a copy of an earlier version) to the current database.
+static int db_stream(const char *restrict directory)
+{
+	struct search base, current;
+	int status;
+
+	status = db_open_directory(&base, directory);
+	if (status)
+		return status;
+	status = db_open(&current);
+	if (status)
+	{
+		db_close(&base);
+		return status;
+	}
+
+	db_advise(&base, DB_USE_SCAN);
+	db_advise(&current, DB_USE_SCAN);
+	status = stream_write(1, &base, &current);
+
+	db_close(&current);
+	db_close(&base);
+	return status;
+}
+
+// Changes read from a stream.
+struct apply
+{
+	struct search search;
+	struct delta delta;
+	size_t skipped;
+};
+
+static int db_apply_change(unsigned change, const unsigned char *restrict path, const struct file *restrict file, void *argument)
+{
+	struct apply *apply = argument;
+
+	// Only changes in the indexed directories are kept when the segments are compacted.
+	if (db_root_find(&apply->search, (const char *)path, file->path_length) != 1)
+	{
+		apply->skipped += 1;
+		return 0;
+	}
+
+	if (change == DB_DIFF_REMOVED)
+		return db_delta_remove(&apply->delta, (const char *)path, file->path_length);
+	else
+		return db_delta_add(&apply->delta, (const char *)path, file->path_length, file);
+}
+
+// Records the changes read from the standard input (written by findex -delta) in a new delta segment.
+static int db_apply(void)
+{
+	struct apply apply;
+	uint64_t base, current;
+	int status;
+
+	status = db_open(&apply.search);
+	if (status)
+		return status;
+	db_delta_new(&apply.delta);
+	apply.skipped = 0;
+
+	// The stream is verified before any of the changes is stored.
+	// The changes are applied only to the version of the database they were computed from.
+	status = db_replica(&apply.search, &base);
+	if (!status)
+		status = stream_read(0, base, &current, db_apply_change, &apply);
+	if (status == ERROR_INPUT)
+		fprintf(stderr, "ERROR: Invalid or corrupted stream of changes\n");
+	else if (status == ERROR_MISSING)
+		fprintf(stderr, "ERROR: The changes are not based on generation %" PRIu64 " of the database (see findex -delta)\n", base);
+	else if (!status)
+	{
+		if (apply.skipped)
+			fprintf(stderr, "WARNING: %zu changes outside the indexed directories ignored\n", apply.skipped);
+		if (!(status = db_delta_persist(&apply.delta)))
+			status = db_replica_set(current);
+	}
+
+	db_delta_delete(&apply.delta);
+	db_close(&apply.search);
+	if (status)
+		return status;
+
+	// Merge the segments into the database in the background when there are too many of them.
+	if ((db_deltas_count() >= DELTA_COMPACT_LIMIT) && !fork())
+		_exit(-db_compact());
+
+	return 0;
+}
+
+// Indexes root in its own shard. The other shards are not changed.
+static int db_index_shard(char *root, const char *restrict directory, unsigned flags, unsigned bloom)
+{
+	struct db db;
+	char target[PATH_SIZE_LIMIT], storage[PATH_SIZE_LIMIT], location[PATH_SIZE_LIMIT];
+	size_t target_length, storage_length = 0, location_length;
+	int lock;
+	int status;
+
+	status = normalize(target, &target_length, root, strlen(root));
+	if (status)
+		return status;
+	if (directory)
+	{
+		status = normalize(storage, &storage_length, directory, strlen(directory));
+		if (status)
+			return status;
+	}
+
+	lock = db_shard(target, target_length, (directory ? storage : 0), storage_length, location, &location_length);
+	if (lock == ERROR_EXIST)
+		fprintf(stderr, "ERROR: %s overlaps an indexed directory or its shard directory is used by another database\n", target);
+	if (lock < 0)
+		return lock;
+
+	path_directory(location, location_length);
+	status = db_new(&db);
+	if (status >= 0)
+	{
+		db.flags = flags;
+		db.bloom = bloom;
+		if (!(status = db_index(&db, 0, target, target_length)) && !(status = db_root(&db, target, target_length, 0)))
+			status = db_persist(&db);
+		else
+			db_delete(&db);
+	}
+	path_directory(0, 0);
+
+	// The shard is added to the manifest only once its database exists.
+	if (status)
+	{
+		close(lock);
+		return status;
+	}
+	return db_shard_add(lock, target, target_length, location, location_length);
+}
+
+// Saves a search. Its location is stored normalized in order to be compared with the paths in the database.
+static int db_save_search(const char *restrict name, char *arguments[], size_t count)
+{
+	char target[PATH_SIZE_LIMIT + 1];
+	size_t target_length;
+	int status;
+
+	if (!arguments[0][0] || (arguments[0][0] == '-'))
+		return ERROR_INPUT;
+	status = normalize(target, &target_length, arguments[0], strlen(arguments[0]));
+	if (status)
+		return status;
+	target[target_length] = 0;
+	arguments[0] = target;
+
+	return db_save(name, arguments, count);
+}
+
 int main(int argc, char *argv[])
 {
 	struct db db;
+	unsigned flags = 0;
+	unsigned bloom = BLOOM_RATE_DEFAULT;
+	int update = 0;
+	int shard = 0;
+	const char *directory = 0;
 
 	size_t i;
 	int status;
 
-	if ((argc < 2) || ((argc == 2) && !strcmp(argv[1], "--help")))
+	// Parse options.
+	for(i = 1; (i < argc) && (argv[i][0] == '-'); i += 1)
+	{
+		if (!strcmp(argv[i], "-perfect"))
+			flags |= DB_PERFECT;
+		else if (!strcmp(argv[i], "-trigram"))
+			flags |= DB_TRIGRAM;
+		else if (!strcmp(argv[i], "-names"))
+			flags |= DB_NAMES;
+		else if (!strcmp(argv[i], "-sorted"))
+			flags |= DB_SORTED;
+		else if (!strcmp(argv[i], "-bitmap"))
+			flags |= DB_BITMAP;
+		else if (!strcmp(argv[i], "-inode"))
+			flags |= DB_INODE;
+		else if (!strcmp(argv[i], "-digest"))
+			flags |= DB_DIGEST;
+		else if (!strcmp(argv[i], "-media"))
+			flags |= DB_MEDIA;
+		else if (!strcmp(argv[i], "-bloom") && (i + 1 < argc))
+		{
+			char *end;
+			unsigned long rate = strtoul(argv[++i], &end, 10);
+			if ((end == argv[i]) || *end || (rate > UINT32_MAX))
+				break;
+			bloom = rate;
+		}
+		else if (!strcmp(argv[i], "-system"))
+			db_system();
+		else if (!strcmp(argv[i], "-update"))
+			update = 1;
+		else if (!strcmp(argv[i], "-shard"))
+			shard = 1;
+		else if (!strcmp(argv[i], "-shard-directory") && (i + 1 < argc))
+		{
+			shard = 1;
+			directory = argv[++i];
+		}
+		else if (!strcmp(argv[i], "-compact") && (i + 1 == argc))
+			return -db_compact();
+		else if (!strcmp(argv[i], "-upgrade") && (i + 1 == argc))
+			return -db_upgrade();
+		else if (!strcmp(argv[i], "-save") && (i + 2 < argc))
+		{
+			status = db_save_search(argv[i + 1], argv + i + 2, argc - i - 2);
+			if (status == ERROR_INPUT)
+				write(2, STRING("Invalid saved search\n"));
+			return -status;
+		}
+		else if (!strcmp(argv[i], "-forget") && (i + 2 == argc))
+			return -db_forget(argv[i + 1]);
+		else if (!strcmp(argv[i], "-delta") && (i + 2 == argc))
+			return -db_stream(argv[i + 1]);
+		else if (!strcmp(argv[i], "-apply") && (i + 1 == argc))
+			return -db_apply();
+		else
+			break;
+	}
+
+	if ((i == argc) || !strcmp(argv[i], "--help") || (directory && (i + 1 != argc)))
 	{
-		write(2, STRING("Usage: findex <path> ...\n"));
+		write(2, STRING("Usage: findex [-system] [-perfect] [-trigram] [-names] [-sorted] [-bitmap] [-inode] [-digest] [-media] [-bloom <rate>] <path> ...\n       findex [-system] [-perfect] [-trigram] [-names] [-sorted] [-bitmap] [-inode] [-digest] [-media] [-bloom <rate>] -shard <path> ...\n       findex [-system] [-perfect] [-trigram] [-names] [-sorted] [-bitmap] [-inode] [-digest] [-media] [-bloom <rate>] -shard-directory <directory> <path>\n       findex [-system] -update <path> ...\n       findex [-system] -compact\n       findex [-system] -upgrade\n       findex [-system] -save <name> <path> [-name <pattern>] [-path <pattern>] [-prune <pattern>] [-size [+-]<size>] [-type <type>] [-content <content>] [-mime <type>] [-mindepth <n>] [-maxdepth <n>]\n       findex [-system] -forget <name>\n       findex [-system] -delta <base database directory> > <changes>\n       findex [-system] -apply < <changes>\n"));
 		return ERROR_INPUT;
 	}
 
+	if (update)
+		return -db_update(argv + i, argc - i);
+
+	if (shard)
+	{
+		for(; i < argc; i += 1)
+			if (status = db_index_shard(argv[i], directory, flags, bloom))
+				return -status;
+		return 0;
+	}
+
 	status = db_new(&db);
 	if (status < 0)
 		return status;
+	db.flags = flags;
+	db.bloom = bloom;
 
-	for(i = 1; i < argc; i += 1)
+	for(; i < argc; i += 1)
 	{
 		char target[PATH_SIZE_LIMIT];
 		size_t target_length;
+		size_t start = db.count;
 
 		status = normalize(target, &target_length, argv[i], strlen(argv[i]));
 		if (status)
 			goto error;
 
-		status = db_index(&db, target, target_length);
+		// The files of a directory must be in only one database.
+		status = db_shards_check(target, target_length);
+		if (status)
+		{
+			if (status == ERROR_EXIST)
+				fprintf(stderr, "ERROR: %s overlaps a directory indexed in a shard\n", target);
+			goto error;
+		}
+
+		status = db_index(&db, 0, target, target_length);
+		if (status)
+			goto error;
+
+		status = db_root(&db, target, target_length, start);
 		if (status)
 			goto error;
 	}
@@ -49,7 +49,11 @@ static int fs_mkdir_parent(char *path, size_t length)
 	if (status < 0)
 	{
 		if (errno == ENOENT)
+		{
 			status = fs_mkdir_parent(path, end - path);
+			if (!status && (mkdir(path, 0755) < 0))
+				status = ERROR;
+		}
 		else
 			status = ERROR;
 	}
@@ -27,6 +27,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "hash.h"
 
@@ -95,3 +96,46 @@ uint32_t hash(const uint8_t *restrict data, uint32_t size)
   return h;
 }
 
+
+// MurmurHash64A
+uint64_t hash64(const uint8_t *restrict data, size_t size)
+{
+  static const uint64_t seed = 0;
+
+  const uint64_t m = 0xc6a4a7935bd1e995ULL;
+  const int r = 47;
+  uint64_t h = seed ^ (size * m);
+  uint64_t k;
+  const uint8_t *end = data + (size / 8) * 8;
+
+  // for each 8 byte chunk of `data'
+  for (; data != end; data += 8) {
+    memcpy(&k, data, sizeof(k));
+
+    k *= m;
+    k ^= k >> r;
+    k *= m;
+
+    h ^= k;
+    h *= m;
+  }
+
+  // remainder
+  switch (size & 7) {
+    case 7: h ^= (uint64_t)data[6] << 48;
+    case 6: h ^= (uint64_t)data[5] << 40;
+    case 5: h ^= (uint64_t)data[4] << 32;
+    case 4: h ^= (uint64_t)data[3] << 24;
+    case 3: h ^= (uint64_t)data[2] << 16;
+    case 2: h ^= (uint64_t)data[1] << 8;
+    case 1:
+      h ^= (uint64_t)data[0];
+      h *= m;
+  }
+
+  h ^= h >> r;
+  h *= m;
+  h ^= h >> r;
+
+  return h;
+}
@@ -1 +1,2 @@
 uint32_t hash(const uint8_t *restrict data, uint32_t size);
+uint64_t hash64(const uint8_t *restrict data, size_t size);
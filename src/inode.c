@@ -0,0 +1,100 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "base.h"
+#include "hash.h"
+#include "perfect.h"
+#include "sorted.h"
+#include "inode.h"
+
+uint64_t inode_hash(const struct inode *restrict inode)
+{
+	uint8_t buffer[sizeof(inode->device) + sizeof(inode->number)];
+	memcpy(buffer, &inode->device, sizeof(inode->device));
+	memcpy(buffer + sizeof(inode->device), &inode->number, sizeof(inode->number));
+	return hash64(buffer, sizeof(buffer));
+}
+
+static inline int inode_same(const struct inode *restrict a, const struct inode *restrict b)
+{
+	return ((a->device == b->device) && (a->number == b->number));
+}
+
+// Links the records of each file and generates a key for the first record of each file.
+// keys must have space for count items. Returns the number of keys.
+size_t inodes_link(const struct inode *restrict inodes, size_t count, uint64_t *restrict links, struct perfect_key *restrict keys)
+{
+	struct sorted_entry *order = alloc(count * sizeof(*order) + 1);
+	uint64_t *hashes = alloc(count * sizeof(*hashes) + 1);
+	size_t keys_count = 0;
+	size_t start, end, i, j;
+
+	// Sort the records by hash so that the records of each file are next to each other.
+	for(i = 0; i < count; ++i)
+	{
+		hashes[i] = inode_hash(inodes + i);
+		links[i] = UINT64_MAX; // not linked yet
+	}
+	sorted_init(order, hashes, count);
+	free(hashes);
+
+	// Different files can have the same hash so the records with the same hash are compared.
+	for(start = 0; start < count; start = end)
+	{
+		for(end = start + 1; (end < count) && (order[end].key == order[start].key); ++end)
+			;
+
+		for(i = start; i < end; ++i)
+		{
+			uint64_t last = order[i].record;
+
+			if (links[last] != UINT64_MAX)
+				continue; // linked to a previous record of the file
+			keys[keys_count].hash = order[i].key;
+			keys[keys_count].record = order[i].record;
+			keys_count += 1;
+
+			for(j = i + 1; j < end; ++j)
+				if ((links[order[j].record] == UINT64_MAX) && inode_same(inodes + order[i].record, inodes + order[j].record))
+				{
+					links[last] = order[j].record;
+					last = order[j].record;
+				}
+			links[last] = count;
+		}
+	}
+
+	free(order);
+	return keys_count;
+}
+
+// Finds the first record of the file. Returns the number of records if the file is not in the index.
+size_t inodes_find(const struct inodes *restrict inodes, const struct inode *restrict inode)
+{
+	const struct perfect_slot *slot = perfect_find(&inodes->perfect, inode_hash(inode));
+	if (!slot || (slot->record >= inodes->count))
+		return inodes->count;
+	if ((inodes->device[slot->record] != inode->device) || (inodes->number[slot->record] != inode->number))
+		return inodes->count;
+	return slot->record;
+}
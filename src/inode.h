@@ -0,0 +1,47 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Index of the records by device and inode number. The hard links of a file are linked in ascending order of the record.
+// The perfect hash function maps each file to the first of its records.
+
+struct inode
+{
+	uint64_t device;
+	uint64_t number;
+};
+
+struct inodes
+{
+	uint64_t count; // number of records
+	const uint64_t *device;
+	const uint64_t *number;
+	const uint64_t *link; // next record of the same file (count for the last one)
+	struct perfect perfect;
+};
+
+uint64_t inode_hash(const struct inode *restrict inode);
+
+// Returns the next record of the same file (count if there is none).
+static inline size_t inodes_next(const struct inodes *restrict inodes, size_t record)
+{
+	return ((inodes->link[record] > record) ? inodes->link[record] : inodes->count);
+}
+
+size_t inodes_link(const struct inode *restrict inodes, size_t count, uint64_t *restrict links, struct perfect_key *restrict keys);
+size_t inodes_find(const struct inodes *restrict inodes, const struct inode *restrict inode);
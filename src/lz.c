@@ -0,0 +1,209 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "base.h"
+#include "lz.h"
+
+// LZ77 compression producing the LZ4 block format.
+// The data is a sequence of:
+// - token (high 4 bits: literals length; low 4 bits: match length - 4)
+// - additional bytes for literals length (if it is at least 15)
+// - literals
+// - match offset (16-bit little endian)
+// - additional bytes for match length (if it is at least 19)
+// The last sequence consists only of literals.
+
+#define MATCH_MIN 4
+#define LAST_LITERALS 5 // the last bytes are always literals
+#define MATCH_START_LIMIT 12 // no match can start in the last bytes
+#define DISTANCE_MAX 65535
+
+#define HASH_BITS 14
+
+static inline uint32_t read32(const unsigned char *data)
+{
+	uint32_t value;
+	memcpy(&value, data, sizeof(value));
+	return value;
+}
+
+static inline uint32_t hash_sequence(uint32_t sequence)
+{
+	return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static unsigned char *length_write(unsigned char *restrict dest, size_t length)
+{
+	for(; length >= 255; length -= 255)
+		*dest++ = 255;
+	*dest++ = length;
+	return dest;
+}
+
+static unsigned char *sequence_write(unsigned char *restrict dest, const unsigned char *restrict literals, size_t literals_length, size_t offset, size_t match_length)
+{
+	unsigned char *token = dest++;
+
+	*token = ((literals_length < 15) ? literals_length : 15) << 4;
+	if (literals_length >= 15)
+		dest = length_write(dest, literals_length - 15);
+	memcpy(dest, literals, literals_length);
+	dest += literals_length;
+
+	if (!offset)
+		return dest; // last sequence
+
+	*dest++ = offset & 0xff;
+	*dest++ = offset >> 8;
+
+	match_length -= MATCH_MIN;
+	*token |= (match_length < 15) ? match_length : 15;
+	if (match_length >= 15)
+		dest = length_write(dest, match_length - 15);
+
+	return dest;
+}
+
+// Compresses size bytes from src into dest. dest must have space for LZ_BOUND(size) bytes.
+// Returns the size of the compressed data.
+size_t lz_compress(unsigned char *restrict dest, const unsigned char *restrict src, size_t size)
+{
+	uint32_t table[1 << HASH_BITS] = {0}; // last position of each hashed sequence
+	const unsigned char *position = src, *anchor = src;
+	const unsigned char *end = src + size;
+	unsigned char *out = dest;
+
+	if (size > MATCH_START_LIMIT)
+	{
+		const unsigned char *start_limit = end - MATCH_START_LIMIT;
+		const unsigned char *match_limit = end - LAST_LITERALS;
+
+		while (position < start_limit)
+		{
+			uint32_t sequence = read32(position);
+			uint32_t index = hash_sequence(sequence);
+			const unsigned char *reference = src + table[index];
+			const unsigned char *match_end;
+
+			table[index] = position - src;
+			if ((reference >= position) || ((position - reference) > DISTANCE_MAX) || (read32(reference) != sequence))
+			{
+				position += 1;
+				continue;
+			}
+
+			for(match_end = position + MATCH_MIN; match_end < match_limit; ++match_end)
+				if (*match_end != reference[match_end - position])
+					break;
+
+			out = sequence_write(out, anchor, position - anchor, position - reference, match_end - position);
+			anchor = position = match_end;
+
+			if (position - 2 > src)
+				table[hash_sequence(read32(position - 2))] = position - 2 - src;
+		}
+	}
+
+	out = sequence_write(out, anchor, end - anchor, 0, 0);
+
+	return out - dest;
+}
+
+static int length_read(size_t *restrict length, const unsigned char **restrict position, const unsigned char *restrict end)
+{
+	unsigned char byte;
+	do
+	{
+		if (*position == end)
+			return ERROR_INPUT;
+		byte = *(*position)++;
+		*length += byte;
+	} while (byte == 255);
+	return 0;
+}
+
+// Decompresses the data in src until limit bytes are written to dest or until the end of src.
+// Returns the number of bytes written or error code if the data is invalid.
+ssize_t lz_decompress(unsigned char *restrict dest, size_t limit, const unsigned char *restrict src, size_t size)
+{
+	const unsigned char *position = src, *end = src + size;
+	unsigned char *out = dest, *out_end = dest + limit;
+
+	while (position < end)
+	{
+		unsigned token = *position++;
+		size_t length, offset;
+
+		length = token >> 4;
+		if ((length == 15) && length_read(&length, &position, end))
+			return ERROR_INPUT;
+		if (length > (size_t)(end - position))
+			return ERROR_INPUT;
+		if (length >= (size_t)(out_end - out))
+		{
+			memcpy(out, position, out_end - out);
+			return limit;
+		}
+		memcpy(out, position, length);
+		position += length;
+		out += length;
+
+		if (position == end)
+			break; // last sequence
+
+		if ((end - position) < 2)
+			return ERROR_INPUT;
+		offset = position[0] | (position[1] << 8);
+		position += 2;
+		if (!offset || (offset > (size_t)(out - dest)))
+			return ERROR_INPUT;
+
+		length = token & 0xf;
+		if ((length == 15) && length_read(&length, &position, end))
+			return ERROR_INPUT;
+		length += MATCH_MIN;
+		if (length > (size_t)(out_end - out))
+			length = out_end - out;
+
+		// The match can overlap with the bytes it produces.
+		if (offset >= length)
+		{
+			memcpy(out, out - offset, length);
+			out += length;
+		}
+		else
+		{
+			const unsigned char *from = out - offset;
+			size_t i;
+			for(i = 0; i < length; ++i)
+				out[i] = from[i];
+			out += length;
+		}
+
+		if (out == out_end)
+			return limit;
+	}
+
+	return out - dest;
+}
@@ -0,0 +1,24 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Maximum size of the compressed data for input with the given size.
+#define LZ_BOUND(size) ((size) + (size) / 255 + 16)
+
+size_t lz_compress(unsigned char *restrict dest, const unsigned char *restrict src, size_t size);
+ssize_t lz_decompress(unsigned char *restrict dest, size_t limit, const unsigned char *restrict src, size_t size);
@@ -43,5 +43,6 @@ struct filetype
 extern const struct filetype typeinfo[];
 
 enum type {TYPE_UNKNOWN, TYPE_TAR, TYPE_ZIP, TYPE_RAR, TYPE_7ZIP, TYPE_GZIP, TYPE_BZIP2, TYPE_XZ, TYPE_ELF, TYPE_MACHO, TYPE_DJVU, TYPE_PDF, TYPE_MSWORD, TYPE_PNG, TYPE_JPEG, TYPE_GIF, TYPE_BMP, TYPE_MPEGAUDIO, TYPE_MPEGVIDEO, TYPE_OGG, TYPE_MATROSKA, TYPE_WAVE, TYPE_AVI, TYPE_ASF, TYPE_QUICKTIME, TYPE_MPEG4, TYPE_M4AUDIO, TYPE_M4VIDEO, TYPE_3GPP, TYPE_TEXT, TYPE_TEXT_SCRIPT, TYPE_TEXT_XML};
+#define TYPES_COUNT (TYPE_TEXT_XML + 1)
 
 enum type content(const unsigned char *magic, size_t size);
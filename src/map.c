@@ -0,0 +1,73 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "map.h"
+
+// The hints are only an optimization so errors are ignored.
+
+void map_advise(void *buffer, size_t size, enum access access)
+{
+	if (!buffer || !size)
+		return;
+
+	switch (access)
+	{
+	case ACCESS_DEFAULT:
+		madvise(buffer, size, MADV_NORMAL);
+		break;
+
+	case ACCESS_SEQUENTIAL:
+		madvise(buffer, size, MADV_SEQUENTIAL);
+		break;
+
+	case ACCESS_RANDOM:
+		madvise(buffer, size, MADV_RANDOM);
+		break;
+
+	case ACCESS_RESIDENT:
+		// The mappings are created before the use is known so the pages are populated here instead of with MAP_POPULATE.
+		madvise(buffer, size, MADV_NORMAL);
+#if defined(MADV_HUGEPAGE)
+		madvise(buffer, size, MADV_HUGEPAGE); // only effective where the kernel supports huge pages for the page cache
+#endif
+#if defined(MADV_POPULATE_READ)
+		if (madvise(buffer, size, MADV_POPULATE_READ) < 0)
+#endif
+			madvise(buffer, size, MADV_WILLNEED);
+		mlock(buffer, size); // fails when RLIMIT_MEMLOCK is too low; the pages are still populated
+		break;
+	}
+}
+
+// Starts reading the pages of the given section in the background.
+void map_prefetch(void *buffer, size_t size, size_t offset, size_t length)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t start = offset & ~(page - 1);
+
+	if (!buffer || (offset >= size))
+		return;
+	if (length > size - offset)
+		length = size - offset;
+	madvise((char *)buffer + start, length + (offset - start), MADV_WILLNEED);
+}
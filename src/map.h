@@ -0,0 +1,30 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Expected access pattern of a memory-mapped file (or a section of it). Selects the paging hints given to the kernel.
+enum access
+{
+	ACCESS_DEFAULT,
+	ACCESS_SEQUENTIAL, // read in order: read ahead aggressively, the pages behind can be dropped
+	ACCESS_RANDOM, // probed at unpredictable positions: read only the pages touched
+	ACCESS_RESIDENT, // used repeatedly by a long-lived process: load everything and keep it in memory
+};
+
+void map_advise(void *buffer, size_t size, enum access access);
+void map_prefetch(void *buffer, size_t size, size_t offset, size_t length);
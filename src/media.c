@@ -0,0 +1,686 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "base.h"
+#include "magic.h"
+#include "media.h"
+
+// Only the headers of the files are read. Each format is parsed from the position where content() recognized it.
+
+#define ITEMS_LIMIT 4096 /* stop looking for an atom, a chunk or a segment after this many siblings */
+#define EBML_READ 65536 /* Matroska headers are expected in this many bytes at the start of the file */
+#define EBML_DEPTH 8
+#define OGG_READ 65536 /* the last Ogg page is expected in this many bytes at the end of the file */
+#define OGG_PAGE_HEADER 27
+
+static inline uint32_t be16(const unsigned char *data)
+{
+	return (data[0] << 8) | data[1];
+}
+
+static inline uint32_t be24(const unsigned char *data)
+{
+	return ((uint32_t)data[0] << 16) | (data[1] << 8) | data[2];
+}
+
+static inline uint32_t be32(const unsigned char *data)
+{
+	return ((uint32_t)data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+}
+
+static inline uint64_t be64(const unsigned char *data)
+{
+	return ((uint64_t)be32(data) << 32) | be32(data + 4);
+}
+
+static inline uint32_t le16(const unsigned char *data)
+{
+	return data[0] | (data[1] << 8);
+}
+
+static inline uint32_t le32(const unsigned char *data)
+{
+	return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static inline uint64_t le64(const unsigned char *data)
+{
+	return le32(data) | ((uint64_t)le32(data + 4) << 32);
+}
+
+static int read_at(int fd, void *buffer, size_t size, uint64_t offset)
+{
+	return ((pread(fd, buffer, size, offset) == (ssize_t)size) ? 0 : ERROR_INPUT);
+}
+
+static void codec_set(struct media *restrict media, const char *restrict codec, size_t length)
+{
+	if (length >= sizeof(media->codec))
+		length = sizeof(media->codec) - 1;
+	memset(media->codec, 0, sizeof(media->codec));
+	memcpy(media->codec, codec, length);
+}
+
+#define CODEC(media, name) codec_set((media), (name), sizeof(name) - 1)
+
+// Converts duration in units of 1/scale seconds to milliseconds.
+static uint32_t milliseconds(uint64_t duration, uint64_t scale)
+{
+	uint64_t result;
+
+	if (!scale)
+		return 0;
+	result = (duration / scale) * 1000 + (duration % scale) * 1000 / scale;
+	return ((result > UINT32_MAX) ? UINT32_MAX : result);
+}
+
+static int png_parse(struct media *restrict media, int fd)
+{
+	unsigned char header[24]; // signature followed by the IHDR chunk
+
+	if (read_at(fd, header, sizeof(header), 0) || memcmp(header + 12, "IHDR", 4))
+		return ERROR_INPUT;
+	media->width = be32(header + 16);
+	media->height = be32(header + 20);
+	CODEC(media, "png");
+	return 0;
+}
+
+// The dimensions are in the Start Of Frame segment which precedes the image data.
+static int jpeg_parse(struct media *restrict media, int fd)
+{
+	unsigned char marker[4], frame[5];
+	uint64_t offset = 2;
+	size_t i;
+
+	for(i = 0; i < ITEMS_LIMIT; ++i)
+	{
+		if (read_at(fd, marker, sizeof(marker), offset) || (marker[0] != 0xff))
+			return ERROR_INPUT;
+
+		if (marker[1] == 0xff) // fill byte
+			offset += 1;
+		else if ((marker[1] == 0x01) || ((marker[1] >= 0xd0) && (marker[1] <= 0xd7))) // marker without segment
+			offset += 2;
+		else if ((marker[1] == 0xd9) || (marker[1] == 0xda)) // end of image or start of scan
+			return ERROR_MISSING;
+		else if ((marker[1] >= 0xc0) && (marker[1] <= 0xcf) && (marker[1] != 0xc4) && (marker[1] != 0xc8) && (marker[1] != 0xcc))
+		{
+			if (read_at(fd, frame, sizeof(frame), offset + 4))
+				return ERROR_INPUT;
+			media->height = be16(frame + 1);
+			media->width = be16(frame + 3);
+			CODEC(media, "jpeg");
+			return 0;
+		}
+		else offset += 2 + be16(marker + 2);
+	}
+
+	return ERROR_MISSING;
+}
+
+static int gif_parse(struct media *restrict media, int fd)
+{
+	unsigned char header[10];
+
+	if (read_at(fd, header, sizeof(header), 0))
+		return ERROR_INPUT;
+	media->width = le16(header + 6);
+	media->height = le16(header + 8);
+	CODEC(media, "gif");
+	return 0;
+}
+
+static int bmp_parse(struct media *restrict media, int fd)
+{
+	unsigned char header[26];
+	int32_t height;
+
+	if (read_at(fd, header, sizeof(header), 0))
+		return ERROR_INPUT;
+	if (le32(header + 14) == 12) // OS/2 header with 16-bit dimensions
+	{
+		media->width = le16(header + 18);
+		media->height = le16(header + 20);
+	}
+	else
+	{
+		media->width = le32(header + 18);
+		height = (int32_t)le32(header + 22);
+		media->height = ((height < 0) ? -(uint32_t)height : (uint32_t)height); // negative height means top-down rows
+	}
+	CODEC(media, "bmp");
+	return 0;
+}
+
+// The format chunk is followed by the data chunk. The duration is the size of the data divided by the byte rate.
+static int wave_parse(struct media *restrict media, int fd)
+{
+	unsigned char chunk[8], format[16];
+	uint64_t offset = 12;
+	uint32_t byte_rate = 0;
+	size_t i;
+
+	for(i = 0; i < ITEMS_LIMIT; ++i)
+	{
+		uint32_t size;
+
+		if (read_at(fd, chunk, sizeof(chunk), offset))
+			return ERROR_INPUT;
+		size = le32(chunk + 4);
+
+		if (!memcmp(chunk, "fmt ", 4))
+		{
+			if ((size < sizeof(format)) || read_at(fd, format, sizeof(format), offset + sizeof(chunk)))
+				return ERROR_INPUT;
+			media->rate = le32(format + 4);
+			byte_rate = le32(format + 8);
+			switch (le16(format))
+			{
+			case 1:
+				CODEC(media, "pcm");
+				break;
+			case 3:
+				CODEC(media, "float");
+				break;
+			default:
+				CODEC(media, "wave");
+				break;
+			}
+		}
+		else if (!memcmp(chunk, "data", 4))
+		{
+			media->duration = milliseconds(size, byte_rate);
+			return 0;
+		}
+
+		offset += sizeof(chunk) + size + (size & 1); // chunks are padded to even size
+	}
+
+	return ERROR_MISSING;
+}
+
+// The first page of the logical stream starts with the identification header of the codec.
+// The duration is the granule position of the last page of the stream.
+static int ogg_parse(struct media *restrict media, int fd)
+{
+	unsigned char page[OGG_PAGE_HEADER + 255 + 64];
+	const unsigned char *packet;
+	unsigned char *tail;
+	struct stat info;
+	uint64_t granule_rate = 0, skip = 0;
+	ssize_t size, available, i;
+
+	size = pread(fd, page, sizeof(page), 0);
+	if ((size < OGG_PAGE_HEADER) || (size < OGG_PAGE_HEADER + page[26]))
+		return ERROR_INPUT;
+	packet = page + OGG_PAGE_HEADER + page[26];
+	available = size - OGG_PAGE_HEADER - page[26];
+
+	if ((available >= 16) && !memcmp(packet, "\x01vorbis", 7))
+	{
+		media->rate = le32(packet + 12);
+		granule_rate = media->rate;
+		CODEC(media, "vorbis");
+	}
+	else if ((available >= 16) && !memcmp(packet, "OpusHead", 8))
+	{
+		media->rate = le32(packet + 12);
+		skip = le16(packet + 10);
+		granule_rate = 48000; // opus granule position is always in 48kHz samples
+		CODEC(media, "opus");
+	}
+	else if ((available >= 30) && !memcmp(packet, "\x7f" "FLAC", 5))
+	{
+		// Mapping header (9B), signature (4B) and metadata block header (4B) precede the stream information.
+		media->rate = (packet[27] << 12) | (packet[28] << 4) | (packet[29] >> 4);
+		granule_rate = media->rate;
+		CODEC(media, "flac");
+	}
+	else if ((available >= 20) && !memcmp(packet, "\x80theora", 7))
+	{
+		media->width = be24(packet + 14);
+		media->height = be24(packet + 17);
+		CODEC(media, "theora");
+		return 0; // the granule position of theora doesn't give the time directly
+	}
+	else return ERROR_UNSUPPORTED;
+
+	if (fstat(fd, &info) < 0)
+		return 0;
+	size = ((info.st_size > OGG_READ) ? OGG_READ : info.st_size);
+	tail = alloc(size);
+	if (pread(fd, tail, size, info.st_size - size) == size)
+		for(i = size - OGG_PAGE_HEADER; i >= 0; --i)
+			if (!memcmp(tail + i, "OggS", 4) && !tail[i + 4] && !memcmp(tail + i + 14, page + 14, 4)) // same stream serial number
+			{
+				uint64_t granule = le64(tail + i + 6);
+				if ((granule != UINT64_MAX) && (granule >= skip))
+				{
+					media->duration = milliseconds(granule - skip, granule_rate);
+					break;
+				}
+			}
+	free(tail);
+
+	return 0;
+}
+
+// Matroska is stored as EBML elements. Each element is an ID and a size (both variable length integers) followed by the data.
+// The segment information and the tracks precede the clusters with the media data.
+
+#define EBML_SEGMENT 0x18538067
+#define EBML_INFO 0x1549a966
+#define EBML_TIMECODE_SCALE 0x2ad7b1
+#define EBML_DURATION 0x4489
+#define EBML_TRACKS 0x1654ae6b
+#define EBML_TRACK_ENTRY 0xae
+#define EBML_TRACK_TYPE 0x83
+#define EBML_CODEC_ID 0x86
+#define EBML_VIDEO 0xe0
+#define EBML_PIXEL_WIDTH 0xb0
+#define EBML_PIXEL_HEIGHT 0xba
+#define EBML_AUDIO 0xe1
+#define EBML_SAMPLING_FREQUENCY 0xb5
+#define EBML_CLUSTER 0x1f43b675
+
+#define TRACK_VIDEO 1
+#define TRACK_AUDIO 2
+
+struct track
+{
+	uint64_t type;
+	const unsigned char *codec;
+	size_t codec_length;
+	uint64_t width, height;
+	double rate;
+};
+
+struct matroska
+{
+	uint64_t scale; // nanoseconds per duration unit
+	double duration;
+	int video; // whether a video track was found
+};
+
+// Reads a variable length integer. The length marker is kept for IDs and removed for sizes.
+// Returns the length of the integer or 0 if it doesn't fit in the data.
+static size_t ebml_number(const unsigned char *restrict data, const unsigned char *restrict end, uint64_t *restrict value, int marker)
+{
+	unsigned mask = 0x80;
+	size_t length = 1, i;
+
+	if (data >= end)
+		return 0;
+	for(; !(data[0] & mask); mask >>= 1, length += 1)
+		if (mask == 1)
+			return 0;
+	if ((size_t)(end - data) < length)
+		return 0;
+
+	*value = (marker ? data[0] : (data[0] & (mask - 1)));
+	for(i = 1; i < length; ++i)
+		*value = (*value << 8) | data[i];
+	return length;
+}
+
+static uint64_t ebml_uint(const unsigned char *data, size_t size)
+{
+	uint64_t value = 0;
+	if (size > sizeof(value))
+		return 0;
+	while (size--)
+		value = (value << 8) | *data++;
+	return value;
+}
+
+static double ebml_float(const unsigned char *data, size_t size)
+{
+	if (size == 4)
+	{
+		uint32_t bits = be32(data);
+		float value;
+		memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+	else if (size == 8)
+	{
+		uint64_t bits = be64(data);
+		double value;
+		memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+	return 0;
+}
+
+// Takes the dimensions and the codec of the first video track and the sample rate of the first audio track.
+static void track_add(struct media *restrict media, struct matroska *restrict state, const struct track *restrict track)
+{
+	if ((track->type == TRACK_VIDEO) && !state->video)
+	{
+		media->width = track->width;
+		media->height = track->height;
+		codec_set(media, (const char *)track->codec, track->codec_length);
+		state->video = 1;
+	}
+	else if (track->type == TRACK_AUDIO)
+	{
+		if (!media->rate && (track->rate > 0) && (track->rate < UINT32_MAX))
+			media->rate = track->rate;
+		if (!state->video && !media->codec[0])
+			codec_set(media, (const char *)track->codec, track->codec_length);
+	}
+}
+
+// Parses the elements in the data. Returns 1 when the first cluster is reached.
+static int ebml_parse(struct media *restrict media, struct matroska *restrict state, struct track *restrict track, const unsigned char *position, const unsigned char *end, unsigned depth)
+{
+	int status;
+
+	while (position < end)
+	{
+		uint64_t id, size;
+		size_t length, data_size;
+
+		if (!(length = ebml_number(position, end, &id, 1)))
+			return 0; // the data ends in the middle of the element
+		position += length;
+		if (!(length = ebml_number(position, end, &size, 0)))
+			return 0; // the data ends in the middle of the element
+		position += length;
+
+		// Master elements can have unknown size. Elements can continue past the data that was read.
+		if ((size == ((uint64_t)1 << (7 * length)) - 1) || (size > (uint64_t)(end - position)))
+			data_size = end - position;
+		else
+			data_size = size;
+
+		switch (id)
+		{
+		case EBML_CLUSTER:
+			return 1;
+
+		case EBML_SEGMENT:
+		case EBML_INFO:
+		case EBML_TRACKS:
+		case EBML_VIDEO:
+		case EBML_AUDIO:
+			if (depth == EBML_DEPTH)
+				return ERROR_INPUT;
+			if (status = ebml_parse(media, state, track, position, position + data_size, depth + 1))
+				return status;
+			break;
+
+		case EBML_TRACK_ENTRY:
+			{
+				struct track entry = {0};
+				if (depth == EBML_DEPTH)
+					return ERROR_INPUT;
+				status = ebml_parse(media, state, &entry, position, position + data_size, depth + 1);
+				if (status < 0)
+					return status;
+				track_add(media, state, &entry);
+				if (status)
+					return status;
+			}
+			break;
+
+		case EBML_TIMECODE_SCALE:
+			state->scale = ebml_uint(position, data_size);
+			break;
+
+		case EBML_DURATION:
+			state->duration = ebml_float(position, data_size);
+			break;
+
+		case EBML_TRACK_TYPE:
+			if (track)
+				track->type = ebml_uint(position, data_size);
+			break;
+
+		case EBML_CODEC_ID:
+			if (track)
+			{
+				track->codec = position;
+				track->codec_length = data_size;
+			}
+			break;
+
+		case EBML_PIXEL_WIDTH:
+			if (track)
+				track->width = ebml_uint(position, data_size);
+			break;
+
+		case EBML_PIXEL_HEIGHT:
+			if (track)
+				track->height = ebml_uint(position, data_size);
+			break;
+
+		case EBML_SAMPLING_FREQUENCY:
+			if (track)
+				track->rate = ebml_float(position, data_size);
+			break;
+		}
+
+		position += data_size;
+	}
+
+	return 0;
+}
+
+static int matroska_parse(struct media *restrict media, int fd)
+{
+	struct matroska state = {1000000, 0, 0};
+	unsigned char *buffer = alloc(EBML_READ);
+	ssize_t size;
+	int status;
+
+	size = pread(fd, buffer, EBML_READ, 0);
+	if (size < 0)
+	{
+		free(buffer);
+		return ERROR_INPUT;
+	}
+	status = ebml_parse(media, &state, 0, buffer, buffer + size, 0);
+	free(buffer);
+	if (status < 0)
+		return status;
+
+	if ((state.duration > 0) && (state.duration * state.scale / 1000000 < UINT32_MAX))
+		media->duration = state.duration * state.scale / 1000000;
+	return 0;
+}
+
+// QuickTime and MPEG-4 files consist of atoms. Each atom is a size and a type followed by the data (which can contain other atoms).
+
+// Finds the first atom of the given type in [start, end). Sets start and end to the data of the atom.
+static int atom_find(int fd, uint64_t *restrict start, uint64_t *restrict end, const char type[static 4])
+{
+	uint64_t offset = *start;
+	size_t i;
+
+	for(i = 0; (i < ITEMS_LIMIT) && (*end - offset >= 8); ++i)
+	{
+		unsigned char header[16];
+		uint64_t size, header_size = 8;
+
+		if (read_at(fd, header, 8, offset))
+			return ERROR_INPUT;
+		size = be32(header);
+		if (size == 1) // 64-bit size
+		{
+			if (read_at(fd, header + 8, 8, offset + 8))
+				return ERROR_INPUT;
+			size = be64(header + 8);
+			header_size = 16;
+		}
+		else if (!size) // the atom extends to the end
+			size = *end - offset;
+		if ((size < header_size) || (size > *end - offset))
+			return ERROR_INPUT;
+
+		if (!memcmp(header + 4, type, 4))
+		{
+			*start = offset + header_size;
+			*end = offset + size;
+			return 0;
+		}
+		offset += size;
+	}
+
+	return ERROR_MISSING;
+}
+
+// Takes the dimensions and the codec of the first video track and the sample rate of the first audio track.
+// The handler tells the type of the track. The first sample description tells the codec, the dimensions and the sample rate.
+static void qtff_track(struct media *restrict media, int fd, uint64_t start, uint64_t end, int *restrict video)
+{
+	unsigned char handler[12], description[44];
+	uint64_t media_start, media_end;
+	size_t length;
+
+	if (atom_find(fd, &start, &end, "mdia"))
+		return;
+	media_start = start;
+	media_end = end;
+	if (atom_find(fd, &start, &end, "hdlr") || read_at(fd, handler, sizeof(handler), start))
+		return;
+	if (memcmp(handler + 8, "vide", 4) && memcmp(handler + 8, "soun", 4))
+		return;
+
+	start = media_start;
+	end = media_end;
+	if (atom_find(fd, &start, &end, "minf") || atom_find(fd, &start, &end, "stbl") || atom_find(fd, &start, &end, "stsd"))
+		return;
+	if ((end - start < sizeof(description)) || read_at(fd, description, sizeof(description), start))
+		return;
+
+	// The format of the first entry is after the version, the entries count and the entry size.
+	for(length = 4; length && ((description[12 + length - 1] == ' ') || !description[12 + length - 1]); --length)
+		;
+
+	if (!memcmp(handler + 8, "vide", 4))
+	{
+		if (*video)
+			return;
+		media->width = be16(description + 40);
+		media->height = be16(description + 42);
+		codec_set(media, (const char *)description + 12, length);
+		*video = 1;
+	}
+	else
+	{
+		if (!media->rate)
+			media->rate = be32(description + 40) >> 16; // 16.16 fixed point
+		if (!*video && !media->codec[0])
+			codec_set(media, (const char *)description + 12, length);
+	}
+}
+
+static int qtff_parse(struct media *restrict media, int fd)
+{
+	unsigned char header[32];
+	struct stat info;
+	uint64_t start = 0, end, movie_start, movie_end;
+	int video = 0;
+	int status;
+
+	if (fstat(fd, &info) < 0)
+		return ERROR_INPUT;
+	end = info.st_size;
+
+	// The movie atom can be before or after the media data.
+	if (status = atom_find(fd, &start, &end, "moov"))
+		return status;
+	movie_start = start;
+	movie_end = end;
+
+	// The movie header stores the duration in units of 1/timescale seconds.
+	if (!atom_find(fd, &start, &end, "mvhd") && (end - start >= sizeof(header)) && !read_at(fd, header, sizeof(header), start))
+	{
+		if (header[0] == 1) // version 1 with 64-bit times
+			media->duration = milliseconds(be64(header + 24), be32(header + 20));
+		else
+			media->duration = milliseconds(be32(header + 16), be32(header + 12));
+	}
+
+	for(start = movie_start; 1; start = end)
+	{
+		end = movie_end;
+		if (atom_find(fd, &start, &end, "trak"))
+			break;
+		qtff_track(media, fd, start, end, &video);
+	}
+
+	return 0;
+}
+
+int media_parse(struct media *restrict media, int fd, uint32_t type)
+{
+	memset(media, 0, sizeof(*media));
+
+	switch (type)
+	{
+	case TYPE_PNG:
+		return png_parse(media, fd);
+	case TYPE_JPEG:
+		return jpeg_parse(media, fd);
+	case TYPE_GIF:
+		return gif_parse(media, fd);
+	case TYPE_BMP:
+		return bmp_parse(media, fd);
+	case TYPE_WAVE:
+		return wave_parse(media, fd);
+	case TYPE_OGG:
+		return ogg_parse(media, fd);
+	case TYPE_MATROSKA:
+		return matroska_parse(media, fd);
+	case TYPE_QUICKTIME:
+	case TYPE_MPEG4:
+	case TYPE_M4AUDIO:
+	case TYPE_M4VIDEO:
+	case TYPE_3GPP:
+		return qtff_parse(media, fd);
+	default:
+		return ERROR_UNSUPPORTED;
+	}
+}
+
+// Finds the media properties of a record with binary search.
+const struct media *media_find(const struct media_index *restrict index, uint64_t record)
+{
+	size_t left = 0, right = index->count;
+
+	while (left < right)
+	{
+		size_t middle = left + (right - left) / 2;
+		if (index->records[middle] < record)
+			left = middle + 1;
+		else
+			right = middle;
+	}
+
+	return (((left < index->count) && (index->records[left] == record)) ? index->media + left : 0);
+}
@@ -0,0 +1,38 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Properties of an image, audio or video file read from its headers. Unknown properties are 0.
+struct media
+{
+	uint32_t width, height; // pixels
+	uint32_t duration; // milliseconds
+	uint32_t rate; // audio samples per second
+	char codec[16]; // codec or image format (NUL-padded)
+};
+
+// Media properties of some of the records, sorted by record.
+struct media_index
+{
+	uint64_t count;
+	const uint64_t *records;
+	const struct media *media;
+};
+
+int media_parse(struct media *restrict media, int fd, uint32_t type);
+const struct media *media_find(const struct media_index *restrict index, uint64_t record);
@@ -0,0 +1,317 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "base.h"
+#include "names.h"
+#include "sorted.h"
+
+static const unsigned char *names_buffer; // used for comparing names while sorting
+
+static int name_equal(const unsigned char *restrict buffer, const struct name_entry *restrict a, const struct name_entry *restrict b)
+{
+	return ((a->length == b->length) && !memcmp(buffer + a->offset, buffer + b->offset, a->length));
+}
+
+static int name_compare(const struct name_entry *restrict a, const struct name_entry *restrict b)
+{
+	size_t length = ((a->length < b->length) ? a->length : b->length);
+	int difference = memcmp(names_buffer + a->offset, names_buffer + b->offset, length);
+	if (difference)
+		return difference;
+	if (a->length != b->length)
+		return ((a->length < b->length) ? -1 : 1);
+	return ((a->record < b->record) ? -1 : (a->record > b->record));
+}
+
+static int name_order(const void *a, const void *b)
+{
+	return name_compare(a, b);
+}
+
+void names_add(struct names *restrict names, const unsigned char *restrict name, size_t length, uint64_t record)
+{
+	if (names->count == names->capacity)
+	{
+		names->capacity = (names->capacity ? names->capacity * 2 : 4096);
+		names->entries = realloc(names->entries, names->capacity * sizeof(*names->entries));
+		if (!names->entries)
+			abort();
+	}
+	if (names->buffer_size + length > names->buffer_capacity)
+	{
+		size_t capacity = (names->buffer_capacity ? names->buffer_capacity * 2 : 65536);
+		while (capacity < names->buffer_size + length)
+			capacity *= 2;
+		names->buffer = realloc(names->buffer, capacity);
+		if (!names->buffer)
+			abort();
+		names->buffer_capacity = capacity;
+	}
+
+	memcpy(names->buffer + names->buffer_size, name, length);
+	names->entries[names->count].offset = names->buffer_size;
+	names->entries[names->count].record = record;
+	names->entries[names->count].length = length;
+	names->count += 1;
+	names->buffer_size += length;
+}
+
+static unsigned char *varint_write(unsigned char *restrict dest, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		*dest++ = (value & 0x7f) | 0x80;
+		value >>= 7;
+	}
+	*dest++ = value;
+	return dest;
+}
+
+// Reads a varint. Returns the position after it or NULL if the data is invalid.
+static const unsigned char *varint_read(const unsigned char *restrict position, const unsigned char *restrict end, uint64_t *restrict value)
+{
+	unsigned shift = 0;
+
+	*value = 0;
+	do
+	{
+		if ((position == end) || (shift > 63))
+			return 0;
+		*value |= (uint64_t)(*position & 0x7f) << shift;
+		shift += 7;
+	} while (*position++ & 0x80);
+
+	return position;
+}
+
+// Sorts the added names and generates the blocks. The returned buffers must be freed by the caller.
+int names_build(struct names *restrict names, uint64_t *restrict count, uint64_t **restrict offsets, size_t *restrict blocks, unsigned char **restrict data, size_t *restrict size)
+{
+	unsigned char *position;
+	size_t i, j;
+	size_t distinct = 0;
+	const unsigned char *previous = 0;
+	size_t previous_length = 0;
+
+	names_buffer = names->buffer;
+	qsort(names->entries, names->count, sizeof(*names->entries), name_order);
+
+	for(i = 0; i < names->count; ++i)
+		if (!i || !name_equal(names->buffer, names->entries + i - 1, names->entries + i))
+			distinct += 1;
+
+	*offsets = alloc((distinct / NAMES_BLOCK + 2) * sizeof(**offsets));
+	*data = position = alloc(names->buffer_size + names->count * 20 + 1); // each number takes at most 10 bytes
+
+	*blocks = 0;
+	*count = 0;
+	for(i = 0; i < names->count; i = j)
+	{
+		const unsigned char *name = names->buffer + names->entries[i].offset;
+		size_t length = names->entries[i].length;
+		uint64_t record = 0;
+
+		// Find the entries with the same name.
+		for(j = i + 1; j < names->count; ++j)
+			if (!name_equal(names->buffer, names->entries + i, names->entries + j))
+				break;
+
+		if (*count % NAMES_BLOCK == 0)
+		{
+			(*offsets)[(*blocks)++] = position - *data;
+			position = varint_write(position, length);
+			memcpy(position, name, length);
+			position += length;
+		}
+		else
+		{
+			size_t shared = 0;
+			while ((shared < length) && (shared < previous_length) && (name[shared] == previous[shared]))
+				shared += 1;
+			position = varint_write(position, shared);
+			position = varint_write(position, length - shared);
+			memcpy(position, name + shared, length - shared);
+			position += length - shared;
+		}
+		*count += 1;
+		previous = name;
+		previous_length = length;
+
+		position = varint_write(position, j - i);
+		for(; i < j; ++i)
+		{
+			position = varint_write(position, names->entries[i].record - record);
+			record = names->entries[i].record;
+		}
+	}
+	(*offsets)[*blocks] = position - *data;
+
+	*size = position - *data;
+	return 0;
+}
+
+void names_term(struct names *restrict names)
+{
+	free(names->buffer);
+	free(names->entries);
+}
+
+// Compares the name with the prefix. Returns 0 if the name starts with the prefix.
+static int prefix_compare(const unsigned char *restrict name, size_t name_length, const unsigned char *restrict prefix, size_t length)
+{
+	int difference = memcmp(name, prefix, ((name_length < length) ? name_length : length));
+	if (difference)
+		return difference;
+	return ((name_length < length) ? -1 : 0);
+}
+
+// Calls callback for each name that starts with prefix (in ascending order) until callback returns non-zero.
+// The callback receives the name and the position and the end of the list of records for it.
+// Returns the last value returned by callback or error code.
+int names_walk(const struct names_index *restrict index, const unsigned char *restrict prefix, size_t length, int (*callback)(const unsigned char *restrict, size_t, const unsigned char *restrict, const unsigned char *restrict, void *), void *argument)
+{
+	unsigned char name[NAME_SIZE_LIMIT];
+	uint64_t name_length = 0;
+	const unsigned char *position, *end = index->data + index->offsets[index->blocks];
+	size_t low = 0, high = index->blocks;
+	size_t block;
+	uint64_t i;
+
+	// Find the last block starting with a name before the prefix.
+	while (low < high)
+	{
+		size_t middle = (high - low) / 2 + low;
+		uint64_t first_length;
+
+		position = varint_read(index->data + index->offsets[middle], end, &first_length);
+		if (!position || (first_length > (uint64_t)(end - position)))
+			return ERROR_INPUT;
+		if (prefix_compare(position, first_length, prefix, length) < 0)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	block = (low ? low - 1 : 0);
+
+	for(; block < index->blocks; ++block)
+	{
+		position = index->data + index->offsets[block];
+		for(i = 0; (i < NAMES_BLOCK) && (position < index->data + index->offsets[block + 1]); ++i)
+		{
+			uint64_t shared = 0, rest, count, record;
+			const unsigned char *records;
+			int status;
+
+			if (i && !(position = varint_read(position, end, &shared)))
+				return ERROR_INPUT;
+			if (!(position = varint_read(position, end, &rest)))
+				return ERROR_INPUT;
+			if ((shared > name_length) || (rest > (uint64_t)(end - position)) || (shared + rest > sizeof(name)))
+				return ERROR_INPUT;
+			memcpy(name + shared, position, rest);
+			name_length = shared + rest;
+			position += rest;
+
+			// Skip the records.
+			if (!(position = varint_read(position, end, &count)))
+				return ERROR_INPUT;
+			records = position;
+			while (count--)
+				if (!(position = varint_read(position, end, &record)))
+					return ERROR_INPUT;
+
+			status = prefix_compare(name, name_length, prefix, length);
+			if (status > 0)
+				return 0; // no more names with the prefix
+			if (status < 0)
+				continue;
+
+			if (status = (*callback)(name, name_length, records, position, argument))
+				return status;
+		}
+	}
+
+	return 0;
+}
+
+struct gather
+{
+	int exact; // whether only the name equal to the prefix is wanted
+	size_t length;
+	size_t count, capacity;
+	uint64_t *records;
+};
+
+static int records_gather(const unsigned char *restrict name, size_t name_length, const unsigned char *restrict position, const unsigned char *restrict end, void *argument)
+{
+	struct gather *gather = argument;
+	uint64_t record = 0, delta;
+
+	if (gather->exact && (name_length != gather->length))
+		return 1; // names longer than the prefix don't match exactly
+
+	// Each record takes at least one byte.
+	if (gather->count + (end - position) > gather->capacity)
+	{
+		size_t capacity = (gather->capacity ? gather->capacity * 2 : 256);
+		while (capacity < gather->count + (end - position))
+			capacity *= 2;
+		gather->records = realloc(gather->records, capacity * sizeof(*gather->records));
+		if (!gather->records)
+			return ERROR_MEMORY;
+		gather->capacity = capacity;
+	}
+
+	while (position < end)
+	{
+		if (!(position = varint_read(position, end, &delta)))
+			return ERROR_INPUT;
+		record += delta;
+		gather->records[gather->count++] = record;
+	}
+
+	return (gather->exact ? 1 : 0);
+}
+
+// Finds the records whose name is equal to prefix (if exact is set) or starts with prefix.
+// On success, stores the records in ascending order in an allocated array and returns their number.
+ssize_t names_search(const struct names_index *restrict index, const unsigned char *restrict prefix, size_t length, int exact, uint64_t **restrict records)
+{
+	struct gather gather = {exact, length, 0, 0, 0};
+	int status;
+
+	status = names_walk(index, prefix, length, &records_gather, &gather);
+	if (status < 0)
+	{
+		free(gather.records);
+		return status;
+	}
+
+	// Records of different names are interleaved.
+	if (!exact)
+		sorted_records(gather.records, gather.count);
+
+	*records = gather.records;
+	return gather.count;
+}
@@ -0,0 +1,56 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Sorted index of the distinct file names. Each name is followed by the records with that name (in ascending order).
+// Names are stored in blocks of NAMES_BLOCK. The first name of each block is stored whole; each following name stores
+// only how many bytes it shares with the previous name and the rest of its bytes. All numbers are varint-encoded.
+
+#define NAMES_BLOCK 16
+
+#define NAME_SIZE_LIMIT 65536
+
+struct name_entry
+{
+	uint64_t offset; // offset of the name in the buffer
+	uint64_t record;
+	uint16_t length;
+};
+
+struct names
+{
+	size_t count, capacity;
+	struct name_entry *entries;
+	unsigned char *buffer;
+	size_t buffer_size, buffer_capacity;
+};
+
+struct names_index
+{
+	uint64_t count; // number of distinct names
+	uint64_t blocks;
+	const uint64_t *offsets; // offset of each block in data; followed by the size of data
+	const unsigned char *data;
+};
+
+void names_add(struct names *restrict names, const unsigned char *restrict name, size_t length, uint64_t record);
+int names_build(struct names *restrict names, uint64_t *restrict count, uint64_t **restrict offsets, size_t *restrict blocks, unsigned char **restrict data, size_t *restrict size);
+void names_term(struct names *restrict names);
+
+int names_walk(const struct names_index *restrict index, const unsigned char *restrict prefix, size_t length, int (*callback)(const unsigned char *restrict, size_t, const unsigned char *restrict, const unsigned char *restrict, void *), void *argument);
+ssize_t names_search(const struct names_index *restrict index, const unsigned char *restrict prefix, size_t length, int exact, uint64_t **restrict records);
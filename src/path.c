@@ -26,9 +26,30 @@
 #include "path.h"
 
 #define PATH_PREFIX "/.cache/filement/" /* relative path to directory storing database */
+#if !defined(PATH_SYSTEM)
+# define PATH_SYSTEM "/var/cache/filement/" /* directory storing the system-wide database */
+#endif
 
 enum {FILENAME_SIZE_LIMIT = 255};
 
+static int system_wide = 0;
+
+// Makes path_init use the system-wide database instead of the database of the user.
+void path_system(void)
+{
+	system_wide = 1;
+}
+
+static const char *directory_shard = 0;
+static size_t directory_shard_length;
+
+// Makes path_init use the database in the given directory (the database of a shard). NULL restores the default.
+void path_directory(const char *restrict directory, size_t directory_length)
+{
+	directory_shard = directory;
+	directory_shard_length = directory_length;
+}
+
 // Total path length with NUL is limited to PATH_SIZE_LIMIT.
 // Path component length is limited to FILENAME_SIZE_LIMIT.
 int path_init(struct path_buffer *restrict path)
@@ -36,6 +57,16 @@ int path_init(struct path_buffer *restrict path)
 	const char *home;
 	size_t home_length;
 
+	if (directory_shard)
+		return path_init_directory(path, directory_shard, directory_shard_length);
+
+	if (system_wide)
+	{
+		memcpy(path->data, PATH_SYSTEM, sizeof(PATH_SYSTEM) - 1);
+		path->prefix_length = sizeof(PATH_SYSTEM) - 1;
+		return 0;
+	}
+
 	home = getenv("HOME");
 	if (!home)
 		return ERROR; // TODO error code
@@ -52,6 +83,20 @@ int path_init(struct path_buffer *restrict path)
 	return 0;
 }
 
+// Initializes path for a database stored in the given directory.
+int path_init_directory(struct path_buffer *restrict path, const char *restrict directory, size_t directory_length)
+{
+	if ((directory_length + 1 + FILENAME_SIZE_LIMIT + 1) > PATH_SIZE_LIMIT)
+		return ERROR_UNSUPPORTED;
+
+	memcpy(path->data, directory, directory_length);
+	path->data[directory_length] = '/';
+
+	path->prefix_length = directory_length + 1;
+
+	return 0;
+}
+
 size_t path_set(struct path_buffer *restrict path, const char *restrict name, size_t name_length)
 {
 	size_t length;
@@ -69,8 +114,7 @@ size_t path_set(struct path_buffer *restrict path, const char *restrict name, si
 int normalize(char path[static restrict PATH_SIZE_LIMIT], size_t *restrict path_length, const char *restrict raw, size_t raw_length)
 {
 	size_t length;
-	size_t start, index;
-	size_t offset;
+	size_t index;
 
 	assert(raw_length);
 
@@ -25,7 +25,10 @@ struct path_buffer
 	char data[PATH_SIZE_LIMIT];
 };
 
+void path_system(void);
+void path_directory(const char *restrict directory, size_t directory_length);
 int path_init(struct path_buffer *restrict path);
+int path_init_directory(struct path_buffer *restrict path, const char *restrict directory, size_t directory_length);
 size_t path_set(struct path_buffer *restrict path, const char *restrict name, size_t name_length);
 
 int normalize(char path[static restrict PATH_SIZE_LIMIT], size_t *restrict path_length, const char *restrict raw, size_t raw_length);
@@ -0,0 +1,133 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+
+#include "pattern.h"
+
+// Wildcards: ? matches any character, * matches any sequence of characters and \ escapes the next character.
+
+static int match_internal(const unsigned char *restrict pattern, size_t pattern_length, size_t chars, size_t asterisks, const unsigned char *restrict string, size_t string_length)
+{
+	size_t pattern_index = 0, string_index = 0;
+
+	// Discard strings that won't match because of their length.
+	// This also ensures that (string_length - string_index) >= chars.
+	if (string_length < chars) return 0;
+
+	for(pattern_index = 0; pattern_index < pattern_length; ++pattern_index)
+	{
+		switch (pattern[pattern_index])
+		{
+		case '?':
+			if (string_index == string_length) return 0; // no more string chars to consume
+			string_index += 1;
+			chars -= 1;
+			break;
+
+		case '*':
+			{
+				size_t asterisk_chars = (string_length - string_index) - chars;
+				if (asterisks > 1)
+				{
+					// The first asterisk can match [0, asterisk_chars] characters.
+					// Try each of these values in descending order until a match succeeds.
+					// Use recursive call to match_internal() to match the rest of the string with the rest of the pattern.
+					pattern += pattern_index + 1;
+					pattern_length -= pattern_index + 1;
+					string += string_index;
+					string_length -= string_index;
+					do
+					{
+						if (match_internal(pattern, pattern_length, chars, asterisks - 1, string + asterisk_chars, string_length - asterisk_chars))
+							return 1;
+					} while (asterisk_chars--);
+					return 0;
+				}
+				else
+				{
+					// The only possibility for the asterisk is to match asterisk_chars characters.
+					string_index += asterisk_chars;
+					// asterisks -= 1; // asterisks will never be used again
+				}
+			}
+			break;
+
+		// TODO support this
+		/*case '[':
+			pattern_index += 1;
+			break;*/
+
+		case '\\':
+			pattern_index += 1;
+			// pattern_init() ensures pattern_index is in the bounds of pattern
+		default:
+			if (string_index == string_length) return 0; // no more string chars to consume
+			if (pattern[pattern_index] != string[string_index]) return 0; // mismatch
+			string_index += 1;
+			chars -= 1;
+			break;
+		}
+	}
+
+	return (string_index == string_length);
+}
+
+int pattern_match(const struct pattern *restrict pattern, const unsigned char *restrict data, size_t length)
+{
+	return match_internal(pattern->data, pattern->length, pattern->chars, pattern->asterisks, data, length);
+}
+
+// Initializes struct pattern with data with the specified length.
+// Counts the * and the non-* characters in the pattern.
+// Returns whether the pattern is valid.
+int pattern_init(struct pattern *restrict pattern, const unsigned char *restrict data, size_t length)
+{
+	size_t index;
+
+	pattern->data = data;
+	pattern->length = length;
+	pattern->chars = 0;
+	pattern->asterisks = 0;
+
+	for(index = 0; index < pattern->length; ++index)
+	{
+		switch (pattern->data[index])
+		{
+		case '*':
+			pattern->asterisks += 1;
+			break;
+
+		// TODO support this
+		/*case '[':
+			do if (++index == pattern->length) return 0;
+			while ((pattern->data[index] != ']') || (pattern->data[index - 1] == '\\'));
+			pattern->chars += 1;
+			break;*/
+
+		case '\\':
+			if (++index == pattern->length) return 0;
+		default:
+			pattern->chars += 1;
+			break;
+		}
+	}
+
+	return 1;
+}
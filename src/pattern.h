@@ -0,0 +1,28 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+struct pattern
+{
+	const unsigned char *data;
+	size_t length;
+	size_t chars, asterisks;
+};
+
+int pattern_init(struct pattern *restrict pattern, const unsigned char *restrict data, size_t length);
+int pattern_match(const struct pattern *restrict pattern, const unsigned char *restrict data, size_t length);
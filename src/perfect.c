@@ -0,0 +1,253 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "base.h"
+#include "perfect.h"
+
+// Based on PTHash (Pibiri, Trani. PTHash: Revisiting FCH Minimal Perfect Hashing. 2021).
+
+#define ATTEMPTS 8 // seeds to try before giving up
+#define PILOT_LIMIT (1 << 20) // pilots to try for a bucket before changing the seed
+
+// 60% of the keys are mapped to 30% of the buckets so that large buckets are placed while most positions are free.
+#define DENSE_KEYS 2576980377u /* 0.6 * 2^32 */
+
+static inline uint64_t mix(uint64_t value)
+{
+	value ^= value >> 33;
+	value *= 0xff51afd7ed558ccdULL;
+	value ^= value >> 33;
+	value *= 0xc4ceb9fe1a85ec53ULL;
+	value ^= value >> 33;
+	return value;
+}
+
+static inline uint64_t bucket(const struct perfect *restrict perfect, uint64_t hash)
+{
+	uint64_t dense = perfect->buckets * 3 / 10;
+	uint64_t low = (uint32_t)hash;
+	if ((hash >> 32) < DENSE_KEYS)
+		return (low * dense) >> 32;
+	else
+		return dense + ((low * (perfect->buckets - dense)) >> 32);
+}
+
+static inline uint64_t position(const struct perfect *restrict perfect, uint64_t hash, uint32_t pilot)
+{
+	return (hash ^ mix(perfect->seed ^ pilot)) % perfect->size;
+}
+
+static inline uint32_t fingerprint(const struct perfect *restrict perfect, uint64_t hash)
+{
+	return mix(hash ^ perfect->seed) >> 32;
+}
+
+static inline int taken(const uint64_t *restrict bitmap, uint64_t index)
+{
+	return (bitmap[index / 64] >> (index % 64)) & 1;
+}
+
+// Finds a pilot for each bucket. Returns 0 on success or ERROR_AGAIN if the seed must be changed.
+static int pilots_find(struct perfect *restrict perfect, const struct perfect_key *restrict keys, const uint64_t *restrict members, const uint64_t *restrict starts, const uint64_t *restrict order, uint64_t *restrict bitmap, uint64_t *restrict positions)
+{
+	size_t i, j, k;
+
+	for(i = 0; i < perfect->buckets; ++i)
+	{
+		uint64_t b = order[i];
+		const uint64_t *bucket_keys = members + starts[b];
+		size_t size = starts[b + 1] - starts[b];
+		uint32_t pilot;
+
+		if (!size)
+			break; // the remaining buckets are empty
+
+		for(pilot = 0; pilot < PILOT_LIMIT; ++pilot)
+		{
+			for(j = 0; j < size; ++j)
+			{
+				positions[j] = position(perfect, keys[bucket_keys[j]].hash, pilot);
+				if (taken(bitmap, positions[j]))
+					break;
+				for(k = 0; k < j; ++k)
+					if (positions[k] == positions[j])
+						break;
+				if (k < j)
+					break;
+			}
+			if (j == size)
+				break;
+		}
+		if (pilot == PILOT_LIMIT)
+			return ERROR_AGAIN;
+
+		perfect->pilots[b] = pilot;
+		for(j = 0; j < size; ++j)
+			bitmap[positions[j] / 64] |= (uint64_t)1 << (positions[j] % 64);
+	}
+
+	return 0;
+}
+
+// Builds a perfect hash function for the keys. The hashes of the keys must be distinct.
+// Returns ERROR_EXIST if two keys have the same hash.
+int perfect_build(struct perfect *restrict perfect, const struct perfect_key *restrict keys, size_t count)
+{
+	uint64_t *members, *starts, *order, *bitmap, *positions;
+	size_t bits;
+	size_t size_max;
+	size_t i, j;
+	int status;
+
+	perfect->count = count;
+	perfect->size = count + (count + 48) / 49 + 1; // load factor 0.98
+	for(bits = 1; ((size_t)1 << bits) <= count; ++bits)
+		;
+	perfect->buckets = count * 5 / bits + 1;
+
+	perfect->pilots = alloc(perfect->buckets * sizeof(*perfect->pilots));
+	perfect->free = alloc((perfect->size - count) * sizeof(*perfect->free));
+	perfect->slots = alloc((count + 1) * sizeof(*perfect->slots));
+
+	members = alloc((count + 1) * sizeof(*members));
+	starts = alloc((perfect->buckets + 1) * sizeof(*starts));
+	order = alloc((perfect->buckets + 1) * sizeof(*order));
+	bitmap = alloc((perfect->size / 64 + 1) * sizeof(*bitmap));
+	positions = 0;
+
+	status = ERROR_AGAIN;
+	for(perfect->seed = 0; (status == ERROR_AGAIN) && (perfect->seed < ATTEMPTS); ++perfect->seed)
+	{
+		uint64_t *sizes;
+
+		// Group the keys by bucket.
+		memset(starts, 0, (perfect->buckets + 1) * sizeof(*starts));
+		for(i = 0; i < count; ++i)
+			starts[bucket(perfect, keys[i].hash) + 1] += 1;
+		size_max = 0;
+		for(i = 0; i < perfect->buckets; ++i)
+		{
+			if (starts[i + 1] > size_max)
+				size_max = starts[i + 1];
+			starts[i + 1] += starts[i];
+		}
+		for(i = 0; i < count; ++i)
+		{
+			uint64_t b = bucket(perfect, keys[i].hash);
+			members[starts[b]++] = i;
+		}
+		for(i = perfect->buckets; i; --i)
+			starts[i] = starts[i - 1];
+		starts[0] = 0;
+
+		// Keys with the same hash are always in the same bucket.
+		for(i = 0; i < perfect->buckets; ++i)
+			for(j = starts[i] + 1; j < starts[i + 1]; ++j)
+			{
+				size_t k;
+				for(k = starts[i]; k < j; ++k)
+					if (keys[members[k]].hash == keys[members[j]].hash)
+					{
+						status = ERROR_EXIST;
+						goto finally;
+					}
+			}
+
+		// Sort the buckets by size in descending order.
+		sizes = alloc((size_max + 2) * sizeof(*sizes));
+		memset(sizes, 0, (size_max + 2) * sizeof(*sizes));
+		for(i = 0; i < perfect->buckets; ++i)
+			sizes[size_max - (starts[i + 1] - starts[i]) + 1] += 1;
+		for(i = 0; i <= size_max; ++i)
+			sizes[i + 1] += sizes[i];
+		for(i = 0; i < perfect->buckets; ++i)
+			order[sizes[size_max - (starts[i + 1] - starts[i])]++] = i;
+		free(sizes);
+
+		free(positions);
+		positions = alloc((size_max + 1) * sizeof(*positions));
+		memset(bitmap, 0, (perfect->size / 64 + 1) * sizeof(*bitmap));
+		status = pilots_find(perfect, keys, members, starts, order, bitmap, positions);
+	}
+	if (status)
+		goto finally;
+	perfect->seed -= 1;
+
+	// Map each taken position past count to a free slot.
+	for(i = count, j = 0; i < perfect->size; ++i)
+	{
+		if (taken(bitmap, i))
+		{
+			while (taken(bitmap, j))
+				j += 1;
+			perfect->free[i - count] = j++;
+		}
+		else perfect->free[i - count] = 0;
+	}
+
+	for(i = 0; i < count; ++i)
+	{
+		uint64_t slot = position(perfect, keys[i].hash, perfect->pilots[bucket(perfect, keys[i].hash)]);
+		if (slot >= count)
+			slot = perfect->free[slot - count];
+		perfect->slots[slot].record = keys[i].record;
+		perfect->slots[slot].fingerprint = fingerprint(perfect, keys[i].hash);
+	}
+
+finally:
+	free(positions);
+	free(bitmap);
+	free(order);
+	free(starts);
+	free(members);
+	if (status)
+		perfect_term(perfect);
+	return status;
+}
+
+void perfect_term(struct perfect *restrict perfect)
+{
+	free(perfect->slots);
+	free(perfect->free);
+	free(perfect->pilots);
+}
+
+// Returns the slot for the key with the given hash or NULL if there is no such key.
+// Keys not in the set can be mapped to a slot of another key (with probability 2^-32).
+const struct perfect_slot *perfect_find(const struct perfect *restrict perfect, uint64_t hash)
+{
+	const struct perfect_slot *slot;
+	uint64_t index;
+
+	if (!perfect->count)
+		return 0;
+
+	index = position(perfect, hash, perfect->pilots[bucket(perfect, hash)]);
+	if (index >= perfect->count)
+		index = perfect->free[index - perfect->count];
+
+	slot = perfect->slots + index;
+	if (slot->fingerprint != fingerprint(perfect, hash))
+		return 0;
+	return slot;
+}
@@ -0,0 +1,50 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Minimal perfect hash function mapping each of a set of keys to a distinct slot.
+// The keys are split into buckets. Each bucket stores a pilot value chosen so that the keys of the bucket land in free positions.
+// Positions past the number of keys are remapped to the slots left free.
+
+struct perfect_key
+{
+	uint64_t hash;
+	uint64_t record;
+};
+
+struct perfect_slot
+{
+	uint64_t record;
+	uint32_t fingerprint;
+} __attribute__((packed));
+
+struct perfect
+{
+	uint64_t count; // number of keys and slots
+	uint64_t size; // number of positions
+	uint64_t buckets;
+	uint64_t seed;
+	uint32_t *pilots; // one for each bucket
+	uint64_t *free; // slot for each position not less than count
+	struct perfect_slot *slots;
+};
+
+int perfect_build(struct perfect *restrict perfect, const struct perfect_key *restrict keys, size_t count);
+void perfect_term(struct perfect *restrict perfect);
+
+const struct perfect_slot *perfect_find(const struct perfect *restrict perfect, uint64_t hash);
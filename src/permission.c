@@ -0,0 +1,153 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "base.h"
+#include "hash.h"
+#include "path.h"
+#include "permission.h"
+
+#define PERMISSION_CAPACITY 1024
+
+void permission_init(struct permission *restrict permission)
+{
+	permission->count = 0;
+	permission->capacity = PERMISSION_CAPACITY;
+	permission->entries = alloc(permission->capacity * sizeof(*permission->entries));
+	memset(permission->entries, 0, permission->capacity * sizeof(*permission->entries));
+	permission->paths = 0;
+	permission->paths_size = 0;
+	permission->paths_capacity = 0;
+}
+
+// Finds the slot of the directory in the hash table (empty slot if the directory is not cached).
+static struct permission_entry *permission_slot(const struct permission *restrict permission, uint64_t hashsum, const unsigned char *restrict directory, size_t length)
+{
+	size_t mask = permission->capacity - 1;
+	size_t index;
+
+	for(index = hashsum & mask; permission->entries[index].state != PERMISSION_EMPTY; index = (index + 1) & mask)
+	{
+		const struct permission_entry *entry = permission->entries + index;
+		if ((entry->hash == hashsum) && (entry->length == length) && !memcmp(permission->paths + entry->offset, directory, length))
+			break;
+	}
+
+	return permission->entries + index;
+}
+
+static void permission_grow(struct permission *restrict permission)
+{
+	struct permission_entry *entries = permission->entries;
+	size_t capacity = permission->capacity;
+	size_t i;
+
+	permission->capacity *= 2;
+	permission->entries = alloc(permission->capacity * sizeof(*permission->entries));
+	memset(permission->entries, 0, permission->capacity * sizeof(*permission->entries));
+
+	for(i = 0; i < capacity; ++i)
+		if (entries[i].state != PERMISSION_EMPTY)
+		{
+			size_t index;
+			for(index = entries[i].hash & (permission->capacity - 1); permission->entries[index].state != PERMISSION_EMPTY; index = (index + 1) & (permission->capacity - 1))
+				;
+			permission->entries[index] = entries[i];
+		}
+
+	free(entries);
+}
+
+// Checks whether the user can list the directory containing path. The result is cached for each directory.
+// access() checks the real user and group so the check is not affected by the privileges used to open the database.
+int permission_check(struct permission *restrict permission, const unsigned char *restrict path, size_t length)
+{
+	struct permission_entry *entry;
+	uint64_t hashsum;
+
+	// Find the directory containing path. The root directory is denoted by "/".
+	while (length && (path[length - 1] != '/'))
+		length -= 1;
+	if (length > 1)
+		length -= 1;
+	if (!length)
+		return 0;
+
+	hashsum = hash64(path, length);
+	entry = permission_slot(permission, hashsum, path, length);
+	if (entry->state == PERMISSION_EMPTY)
+	{
+		char directory[PATH_SIZE_LIMIT];
+
+		if (length >= PATH_SIZE_LIMIT)
+			return 0;
+		memcpy(directory, path, length);
+		directory[length] = 0;
+
+		if (permission->paths_size + length > permission->paths_capacity)
+		{
+			size_t capacity = (permission->paths_capacity ? permission->paths_capacity * 2 : 65536);
+			while (capacity < permission->paths_size + length)
+				capacity *= 2;
+			permission->paths = realloc(permission->paths, capacity);
+			if (!permission->paths)
+				abort();
+			permission->paths_capacity = capacity;
+		}
+		memcpy(permission->paths + permission->paths_size, path, length);
+
+		entry->hash = hashsum;
+		entry->offset = permission->paths_size;
+		entry->length = length;
+		entry->state = (access(directory, R_OK | X_OK) ? PERMISSION_DENIED : PERMISSION_ALLOWED);
+		permission->paths_size += length;
+
+		if (++permission->count * 2 > permission->capacity)
+		{
+			int allowed = (entry->state == PERMISSION_ALLOWED);
+			permission_grow(permission);
+			return allowed;
+		}
+	}
+
+	return (entry->state == PERMISSION_ALLOWED);
+}
+
+// Checks whether the user can read the file (the content type and the digest of a file are derived from its content).
+int permission_read(const unsigned char *restrict path, size_t length)
+{
+	char file[PATH_SIZE_LIMIT];
+
+	if (length >= PATH_SIZE_LIMIT)
+		return 0;
+	memcpy(file, path, length);
+	file[length] = 0;
+
+	return !access(file, R_OK);
+}
+
+void permission_term(struct permission *restrict permission)
+{
+	free(permission->entries);
+	free(permission->paths);
+}
@@ -0,0 +1,46 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Cache of the directories whose contents can be listed by the user running the process.
+// A file in the system-wide database is visible only if the user can list the directory containing it.
+
+struct permission_entry
+{
+	uint64_t hash;
+	size_t offset; // offset of the directory path in paths
+	uint16_t length;
+	uint16_t state; // PERMISSION_*
+};
+
+#define PERMISSION_EMPTY 0
+#define PERMISSION_DENIED 1
+#define PERMISSION_ALLOWED 2
+
+struct permission
+{
+	size_t count, capacity; // capacity is a power of 2
+	struct permission_entry *entries;
+	char *paths;
+	size_t paths_size, paths_capacity;
+};
+
+void permission_init(struct permission *restrict permission);
+int permission_check(struct permission *restrict permission, const unsigned char *restrict path, size_t length);
+int permission_read(const unsigned char *restrict path, size_t length);
+void permission_term(struct permission *restrict permission);
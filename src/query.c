@@ -0,0 +1,270 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "base.h"
+#include "magic.h"
+#include "db.h"
+#include "pattern.h"
+#include "query.h"
+
+// The parsers below are shared with ffind so that a saved search selects the same files as the ffind command with the same filters.
+
+// WARNING: -size does not behave the same way as in find(1).
+int query_size(const char *restrict argument, uint64_t *restrict min, uint64_t *restrict max)
+{
+	static const uint64_t units[256] = {
+		['T'] = 1024lu * 1024 * 1024 * 1024,
+		['G'] = 1024lu * 1024 * 1024,
+		['M'] = 1024lu * 1024,
+		['K'] = 1024lu,
+		['c'] = 1lu,
+		['\0'] = 1lu,
+	};
+	const char *position = argument;
+	char *end;
+	uint64_t size, unit;
+
+	if ((*position == '+') || (*position == '-')) position += 1;
+
+	size = strtol(position, &end, 10);
+	if (end == position) return ERROR_INPUT; // there must be size
+	if (end[0] && end[1]) return ERROR_INPUT; // there must be no characters after the unit
+
+	unit = units[(unsigned char)end[0]];
+	if (!unit) return ERROR_INPUT; // invalid unit
+
+	// TODO size can cause overflow below
+	if (argument[0] == '+')
+	{
+		*min = size * unit;
+	}
+	else if (argument[0] == '-')
+	{
+		*max = size * unit;
+	}
+	else
+	{
+		*min = size * unit;
+		*max = *min + unit - 1;
+	}
+
+	return 0;
+}
+
+int query_type(const char *restrict argument, uint32_t *restrict content)
+{
+	if (!strcmp(argument, "d"))
+		*content |= CONTENT_DIRECTORY;
+	else if (!strcmp(argument, "l"))
+		*content |= CONTENT_LINK;
+	else
+		return ERROR_INPUT;
+	return 0;
+}
+
+int query_content(const char *restrict argument, uint32_t *restrict content)
+{
+	if (!strcmp(argument, "text"))
+		*content |= CONTENT_TEXT;
+	else if (!strcmp(argument, "archive"))
+		*content |= CONTENT_ARCHIVE;
+	else if (!strcmp(argument, "document"))
+		*content |= CONTENT_DOCUMENT;
+	else if (!strcmp(argument, "image"))
+		*content |= CONTENT_IMAGE;
+	else if (!strcmp(argument, "audio"))
+		*content |= CONTENT_AUDIO;
+	else if (!strcmp(argument, "video"))
+		*content |= CONTENT_VIDEO;
+	else if (!strcmp(argument, "database"))
+		*content |= CONTENT_DATABASE;
+	else if (!strcmp(argument, "directory"))
+		*content |= CONTENT_DIRECTORY;
+	else if (!strcmp(argument, "link"))
+		*content |= CONTENT_LINK;
+	else if (!strcmp(argument, "executable"))
+		*content |= CONTENT_EXECUTABLE;
+	else if (!strcmp(argument, "special"))
+		*content |= CONTENT_SPECIAL;
+	else
+		return ERROR_INPUT;
+	return 0;
+}
+
+// Selects each mime type matching the pattern.
+int query_mime(const char *restrict argument, uint64_t *restrict mimetypes)
+{
+	struct pattern pattern;
+	size_t type;
+
+	if (!pattern_init(&pattern, (const unsigned char *)argument, strlen(argument)))
+		return ERROR_INPUT;
+	for(type = 0; type < TYPES_COUNT; ++type)
+	{
+		const struct bytes *mime_type = typeinfo[type].mime_type;
+		if (pattern_match(&pattern, mime_type->data, mime_type->size))
+			*mimetypes |= (uint64_t)1 << type;
+	}
+	return (*mimetypes ? 0 : ERROR_INPUT);
+}
+
+// Parses the location (normalized) and the filters of a search. The patterns point to the arguments.
+int query_parse(struct query *restrict query, char *const arguments[], size_t count)
+{
+	size_t index;
+
+	memset(query, 0, sizeof(*query));
+	query->size_max = UINT64_MAX;
+	query->depth_max = SIZE_MAX;
+
+	for(index = 0; index < count; ++index)
+	{
+		const char *option = arguments[index];
+		const char *argument;
+
+		if (*option != '-')
+		{
+			if (query->location) return ERROR_INPUT;
+			query->location = option;
+			query->location_length = strlen(option);
+			continue;
+		}
+
+		if (++index == count) return ERROR_INPUT;
+		argument = arguments[index];
+		option += 1;
+
+		if (!strcmp(option, "name"))
+		{
+			if (!pattern_init(&query->name, (const unsigned char *)argument, strlen(argument))) return ERROR_INPUT;
+		}
+		else if (!strcmp(option, "path"))
+		{
+			if (!pattern_init(&query->path, (const unsigned char *)argument, strlen(argument))) return ERROR_INPUT;
+		}
+		else if (!strcmp(option, "prune"))
+		{
+			if (!pattern_init(&query->prune, (const unsigned char *)argument, strlen(argument))) return ERROR_INPUT;
+		}
+		else if (!strcmp(option, "size"))
+		{
+			if (query_size(argument, &query->size_min, &query->size_max)) return ERROR_INPUT;
+		}
+		else if (!strcmp(option, "type"))
+		{
+			if (query_type(argument, &query->content)) return ERROR_INPUT;
+		}
+		else if (!strcmp(option, "content"))
+		{
+			if (query_content(argument, &query->content)) return ERROR_INPUT;
+		}
+		else if (!strcmp(option, "mime"))
+		{
+			if (query_mime(argument, &query->mimetypes)) return ERROR_INPUT;
+		}
+		else if (!strcmp(option, "maxdepth") || !strcmp(option, "mindepth"))
+		{
+			char *end;
+			long depth = strtol(argument, &end, 10);
+			if ((end == argument) || *end || (depth < 0)) return ERROR_INPUT;
+
+			if (option[1] == 'a')
+				query->depth_max = depth;
+			else
+				query->depth_min = depth;
+		}
+		else return ERROR_INPUT;
+	}
+	if (!query->location) return ERROR_INPUT;
+
+	for(index = 0; index < query->location_length; ++index)
+		query->location_depth += (query->location[index] == '/');
+
+	return 0;
+}
+
+// Parses the arguments of a search stored one after the other, each terminated by 0.
+int query_load(struct query *restrict query, const char *restrict arguments, size_t size)
+{
+	char **list;
+	size_t count = 0, i;
+	int status;
+
+	for(i = 0; i < size; i += strlen(arguments + i) + 1)
+		count += 1;
+	list = alloc((count + 1) * sizeof(*list));
+	for(i = 0, count = 0; i < size; i += strlen(arguments + i) + 1)
+		list[count++] = (char *)arguments + i; // query_parse() doesn't change the arguments
+	status = query_parse(query, list, count);
+	free(list);
+
+	return status;
+}
+
+// Checks whether the file matches the search in the same way as ffind.
+int query_match(const struct query *restrict query, const unsigned char *restrict path, const struct file *restrict file)
+{
+	size_t depth = 0;
+	size_t start, end;
+
+	if ((file->size < query->size_min) || (query->size_max < file->size))
+		return 0;
+	if (query->content && !(file->content & query->content))
+		return 0;
+	if (query->mimetypes && ((file->mime_type >= 64) || !((query->mimetypes >> file->mime_type) & 1)))
+		return 0;
+
+	// The file must be in location.
+	if (file->path_length < query->location_length)
+		return 0;
+	if ((file->path_length > query->location_length) && (path[query->location_length] != '/'))
+		return 0;
+	if (memcmp(path, query->location, query->location_length))
+		return 0;
+
+	for(start = 0; start < file->path_length; ++start)
+		depth += (path[start] == '/');
+	if ((depth < query->location_depth + query->depth_min) || (depth - query->location_depth > query->depth_max))
+		return 0;
+
+	if (query->prune.data)
+		for(start = query->location_length + 1; start <= file->path_length; start = end + 1)
+		{
+			for(end = start; (end < file->path_length) && (path[end] != '/'); ++end)
+				;
+			if (pattern_match(&query->prune, path + start, end - start))
+				return 0;
+		}
+	if (query->path.data && !pattern_match(&query->path, path, file->path_length))
+		return 0;
+	if (query->name.data)
+	{
+		for(start = file->path_length; start && (path[start - 1] != '/'); --start)
+			;
+		if (!pattern_match(&query->name, path + start, file->path_length - start))
+			return 0;
+	}
+
+	return 1;
+}
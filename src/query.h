@@ -0,0 +1,44 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Search that can be evaluated outside of ffind (e.g. the saved searches evaluated by findex).
+// It supports the filters of ffind that don't depend on the time of the search:
+// location, -name, -path, -prune, -size, -type, -content, -mime, -maxdepth and -mindepth.
+struct query
+{
+	const char *location;
+	size_t location_length;
+	size_t location_depth;
+	struct pattern name, path, prune;
+	uint64_t size_min, size_max;
+	size_t depth_min, depth_max;
+	uint32_t content; // any of these content bits
+	uint64_t mimetypes; // bit t is set for each mime type t selected
+};
+
+struct file;
+
+int query_size(const char *restrict argument, uint64_t *restrict min, uint64_t *restrict max);
+int query_type(const char *restrict argument, uint32_t *restrict content);
+int query_content(const char *restrict argument, uint32_t *restrict content);
+int query_mime(const char *restrict argument, uint64_t *restrict mimetypes);
+
+int query_parse(struct query *restrict query, char *const arguments[], size_t count);
+int query_load(struct query *restrict query, const char *restrict arguments, size_t size);
+int query_match(const struct query *restrict query, const unsigned char *restrict path, const struct file *restrict file);
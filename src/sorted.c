@@ -0,0 +1,152 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "base.h"
+#include "sorted.h"
+
+// Fills entries with the values of the records sorted with LSD radix sort (16 bits at a time).
+// The sort is stable so records with the same value stay in ascending order.
+void sorted_init(struct sorted_entry *restrict entries, const uint64_t *restrict values, size_t count)
+{
+	struct sorted_entry *buffer;
+	size_t *counts;
+	unsigned shift;
+	size_t i;
+
+	if (!count)
+		return;
+
+	buffer = alloc(count * sizeof(*buffer));
+	counts = alloc((1 << 16) * sizeof(*counts));
+	for(i = 0; i < count; ++i)
+	{
+		entries[i].key = values[i];
+		entries[i].record = i;
+	}
+
+	for(shift = 0; shift < 64; shift += 16)
+	{
+		size_t total = 0;
+
+		memset(counts, 0, (1 << 16) * sizeof(*counts));
+		for(i = 0; i < count; ++i)
+			counts[(entries[i].key >> shift) & 0xffff] += 1;
+		if (counts[(entries[0].key >> shift) & 0xffff] == count)
+			continue; // all keys have the same bits
+		for(i = 0; i < (1 << 16); ++i)
+		{
+			size_t items = counts[i];
+			counts[i] = total;
+			total += items;
+		}
+		for(i = 0; i < count; ++i)
+			buffer[counts[(entries[i].key >> shift) & 0xffff]++] = entries[i];
+
+		memcpy(entries, buffer, count * sizeof(*entries));
+	}
+
+	free(counts);
+	free(buffer);
+}
+
+// Sorts the records in ascending order with LSD radix sort (16 bits at a time).
+void sorted_records(uint64_t *restrict records, size_t count)
+{
+	uint64_t *buffer;
+	size_t *counts;
+	unsigned shift;
+	size_t i;
+
+	if (count < 2)
+		return;
+
+	buffer = alloc(count * sizeof(*buffer));
+	counts = alloc((1 << 16) * sizeof(*counts));
+	for(shift = 0; shift < 64; shift += 16)
+	{
+		size_t total = 0;
+
+		memset(counts, 0, (1 << 16) * sizeof(*counts));
+		for(i = 0; i < count; ++i)
+			counts[(records[i] >> shift) & 0xffff] += 1;
+		if (counts[(records[0] >> shift) & 0xffff] == count)
+			continue; // all records have the same bits
+		for(i = 0; i < (1 << 16); ++i)
+		{
+			size_t items = counts[i];
+			counts[i] = total;
+			total += items;
+		}
+		for(i = 0; i < count; ++i)
+			buffer[counts[(records[i] >> shift) & 0xffff]++] = records[i];
+
+		memcpy(records, buffer, count * sizeof(*records));
+	}
+
+	free(counts);
+	free(buffer);
+}
+
+// Returns the index of the first entry with key not less than the given key.
+static size_t sorted_lower(const struct sorted_entry *restrict entries, size_t count, uint64_t key)
+{
+	size_t low = 0, high = count;
+	while (low < high)
+	{
+		size_t middle = (high - low) / 2 + low;
+		if (entries[middle].key < key)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low;
+}
+
+// Returns the number of records with value in [min, max].
+size_t sorted_count(const struct sorted_entry *restrict entries, size_t count, uint64_t min, uint64_t max)
+{
+	size_t start = sorted_lower(entries, count, min);
+	size_t end = ((max < UINT64_MAX) ? sorted_lower(entries, count, max + 1) : count);
+	return ((start < end) ? end - start : 0);
+}
+
+// Finds the records with value in [min, max].
+// On success, stores the records in ascending order in an allocated array and returns their number.
+ssize_t sorted_search(const struct sorted_entry *restrict entries, size_t count, uint64_t min, uint64_t max, uint64_t **restrict records)
+{
+	size_t start = sorted_lower(entries, count, min);
+	size_t end = ((max < UINT64_MAX) ? sorted_lower(entries, count, max + 1) : count);
+	size_t i;
+
+	if (end < start)
+		end = start;
+
+	*records = alloc((end - start + 1) * sizeof(**records));
+	for(i = start; i < end; ++i)
+		(*records)[i - start] = entries[i].record;
+
+	sorted_records(*records, end - start);
+
+	return end - start;
+}
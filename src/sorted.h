@@ -0,0 +1,40 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Records sorted by the value of a column. Used to find the records with values in a given range without a full scan.
+// Entries with the same key are in ascending order of the record.
+
+struct sorted_entry
+{
+	uint64_t key;
+	uint64_t record;
+};
+
+struct sorted
+{
+	uint64_t count;
+	const struct sorted_entry *size;
+	const struct sorted_entry *mtime;
+};
+
+void sorted_init(struct sorted_entry *restrict entries, const uint64_t *restrict values, size_t count);
+void sorted_records(uint64_t *restrict records, size_t count);
+
+size_t sorted_count(const struct sorted_entry *restrict entries, size_t count, uint64_t min, uint64_t max);
+ssize_t sorted_search(const struct sorted_entry *restrict entries, size_t count, uint64_t min, uint64_t max, uint64_t **restrict records);
@@ -0,0 +1,261 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "base.h"
+#include "arch.h"
+#include "path.h"
+#include "digest.h"
+#include "db.h"
+#include "stream.h"
+
+#define STREAM_BUFFER 65536
+
+#define STREAM_END 0
+
+// Buffered stream with a digest of the data passed through it.
+struct stream
+{
+	int fd;
+	struct digest digest;
+	uint64_t count;
+	unsigned char buffer[STREAM_BUFFER];
+	size_t start, end;
+};
+
+static int stream_flush(struct stream *restrict stream)
+{
+	if (write(stream->fd, stream->buffer, stream->end) != stream->end)
+		return ERROR_WRITE;
+	stream->end = 0;
+	return 0;
+}
+
+static int stream_put(struct stream *restrict stream, const void *restrict data, size_t size)
+{
+	int status;
+
+	digest_update(&stream->digest, data, size);
+	if ((stream->end + size > STREAM_BUFFER) && (status = stream_flush(stream)))
+		return status;
+	memcpy(stream->buffer + stream->end, data, size); // size is smaller than the buffer
+	stream->end += size;
+	return 0;
+}
+
+static int stream_put64(struct stream *restrict stream, uint64_t value)
+{
+	unsigned char buffer[sizeof(value)];
+	endian_little64(buffer, &value);
+	return stream_put(stream, buffer, sizeof(buffer));
+}
+
+// Converts the integers in file between host byte order and little-endian.
+static void file_little(struct file *to, const struct file *from)
+{
+	uint16_t path_length = from->path_length, content = from->content;
+	uint32_t mime_type = from->mime_type;
+	uint64_t mtime = from->mtime, size = from->size;
+
+	endian_little16(&path_length, &path_length);
+	endian_little16(&content, &content);
+	endian_little32(&mime_type, &mime_type);
+	endian_little64(&mtime, &mtime);
+	endian_little64(&size, &size);
+	to->path_length = path_length;
+	to->content = content;
+	to->mime_type = mime_type;
+	to->mtime = mtime;
+	to->size = size;
+}
+
+static int stream_change(unsigned change, const unsigned char *restrict path, const struct file *restrict file, void *argument)
+{
+	struct stream *stream = argument;
+	uint8_t type = change;
+	struct file encoded;
+	int status;
+
+	if (status = stream_put(stream, &type, sizeof(type)))
+		return status;
+	file_little(&encoded, file);
+	if (change == DB_DIFF_REMOVED)
+		status = stream_put(stream, &encoded.path_length, sizeof(encoded.path_length));
+	else
+		status = stream_put(stream, &encoded, sizeof(encoded));
+	if (status || (status = stream_put(stream, path, file->path_length)))
+		return status;
+
+	stream->count += 1;
+	return 0;
+}
+
+// Writes the changes that bring base to current.
+int stream_write(int fd, struct search *restrict base, struct search *restrict current)
+{
+	struct stream *stream = alloc(sizeof(*stream));
+	uint8_t end = STREAM_END;
+	int status;
+
+	stream->fd = fd;
+	digest_init(&stream->digest);
+	stream->count = 0;
+	stream->end = 0;
+
+	if (!(status = stream_put(stream, STREAM_MAGIC, sizeof(STREAM_MAGIC) - 1)) && !(status = stream_put64(stream, base->generation)) && !(status = stream_put64(stream, current->generation)))
+		status = db_diff(base, current, stream_change, stream);
+	if (!status && !(status = stream_put(stream, &end, sizeof(end))) && !(status = stream_put64(stream, stream->count)))
+	{
+		if (!(status = stream_put64(stream, digest_final(&stream->digest))))
+			status = stream_flush(stream);
+	}
+
+	free(stream);
+	return status;
+}
+
+// Reads size bytes from the stream. Unless verify is 0, they are included in the digest.
+static int stream_get(struct stream *restrict stream, void *restrict data, size_t size, int verify)
+{
+	unsigned char *position = data;
+
+	while (size)
+	{
+		size_t available;
+
+		if (stream->start == stream->end)
+		{
+			ssize_t count = read(stream->fd, stream->buffer, STREAM_BUFFER);
+			if (count < 0)
+				return ERROR_READ;
+			if (!count)
+				return ERROR_INPUT; // the stream is truncated
+			stream->start = 0;
+			stream->end = count;
+		}
+
+		available = stream->end - stream->start;
+		if (available > size)
+			available = size;
+		memcpy(position, stream->buffer + stream->start, available);
+		if (verify)
+			digest_update(&stream->digest, position, available);
+		stream->start += available;
+		position += available;
+		size -= available;
+	}
+
+	return 0;
+}
+
+static int stream_get64(struct stream *restrict stream, uint64_t *restrict value, int verify)
+{
+	unsigned char buffer[sizeof(*value)];
+	int status = stream_get(stream, buffer, sizeof(buffer), verify);
+	if (!status)
+		endian_little64(value, buffer);
+	return status;
+}
+
+// Reads a stream written by stream_write() and calls callback for each change until it returns non-zero.
+// The changes must not be used before this returns 0 because the stream is verified only at its end.
+// Returns ERROR_MISSING before reading any change if the changes don't start from the generation base.
+// The generation that the changes lead to is stored in current.
+int stream_read(int fd, uint64_t base, uint64_t *restrict current, int (*callback)(unsigned, const unsigned char *restrict, const struct file *restrict, void *), void *argument)
+{
+	struct stream *stream = alloc(sizeof(*stream));
+	unsigned char magic[sizeof(STREAM_MAGIC) - 1];
+	unsigned char path[PATH_SIZE_LIMIT];
+	uint64_t generation, count, digest;
+	int status;
+
+	stream->fd = fd;
+	digest_init(&stream->digest);
+	stream->count = 0;
+	stream->start = 0;
+	stream->end = 0;
+
+	if (status = stream_get(stream, magic, sizeof(magic), 1))
+		goto finally;
+	if (memcmp(magic, STREAM_MAGIC, sizeof(STREAM_MAGIC) - 1))
+	{
+		status = ERROR_INPUT;
+		goto finally;
+	}
+	if ((status = stream_get64(stream, &generation, 1)) || (status = stream_get64(stream, current, 1)))
+		goto finally;
+	if (generation != base)
+	{
+		status = ERROR_MISSING;
+		goto finally;
+	}
+
+	while (1)
+	{
+		struct file file = {0};
+		uint8_t type;
+
+		if (status = stream_get(stream, &type, sizeof(type), 1))
+			goto finally;
+		if (type == STREAM_END)
+			break;
+
+		if (type == DB_DIFF_REMOVED)
+			status = stream_get(stream, &file.path_length, sizeof(file.path_length), 1);
+		else if ((type == DB_DIFF_ADDED) || (type == DB_DIFF_CHANGED))
+			status = stream_get(stream, &file, sizeof(file), 1);
+		else
+			status = ERROR_INPUT;
+		if (status)
+			goto finally;
+		file_little(&file, &file);
+		if (!file.path_length || (file.path_length > PATH_SIZE_LIMIT))
+		{
+			status = ERROR_INPUT;
+			goto finally;
+		}
+		if (status = stream_get(stream, path, file.path_length, 1))
+			goto finally;
+		if (path[0] != '/')
+		{
+			status = ERROR_INPUT;
+			goto finally;
+		}
+
+		if (status = (*callback)(type, path, &file, argument))
+			goto finally;
+		stream->count += 1;
+	}
+
+	if (status = stream_get64(stream, &count, 1))
+		goto finally;
+	if (status = stream_get64(stream, &digest, 0))
+		goto finally;
+	if ((count != stream->count) || (digest != digest_final(&stream->digest)))
+		status = ERROR_INPUT;
+
+finally:
+	free(stream);
+	return status;
+}
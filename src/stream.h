@@ -0,0 +1,33 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Changes between two versions of a database, for replicating a database to another instance (findex -delta and findex -apply).
+// The stream starts with STREAM_MAGIC, the generation of the base database and the generation of the changed database.
+// Each change is a byte with its type (DB_DIFF_ADDED, DB_DIFF_REMOVED or DB_DIFF_CHANGED), followed by:
+// - for added and changed files, struct file followed by the path
+// - for removed files, the length of the path (16 bits) followed by the path
+// The stream ends with a 0 byte, the number of changes and XXH64 of everything before it.
+// All integers (including those in struct file) are little-endian so that the stream can be applied on a host with another byte order.
+#define STREAM_MAGIC "\x00" "fdelta\x01"
+
+struct search;
+struct file;
+
+int stream_write(int fd, struct search *restrict base, struct search *restrict current);
+int stream_read(int fd, uint64_t base, uint64_t *restrict current, int (*callback)(unsigned, const unsigned char *restrict, const struct file *restrict, void *), void *argument);
@@ -0,0 +1,347 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "base.h"
+#include "trigram.h"
+
+#define RECORD_BITS 40
+#define RECORD_MASK (((uint64_t)1 << RECORD_BITS) - 1)
+
+void trigrams_add(struct trigrams *restrict trigrams, const unsigned char *restrict path, size_t length, uint64_t record)
+{
+	size_t i;
+
+	if (length < 3)
+		return;
+
+	if (trigrams->count + length - 2 > trigrams->capacity)
+	{
+		size_t capacity = (trigrams->capacity ? trigrams->capacity * 2 : 4096);
+		while (capacity < trigrams->count + length - 2)
+			capacity *= 2;
+		trigrams->data = realloc(trigrams->data, capacity * sizeof(*trigrams->data));
+		if (!trigrams->data)
+			abort();
+		trigrams->capacity = capacity;
+	}
+
+	for(i = 0; i + 2 < length; ++i)
+		trigrams->data[trigrams->count++] = ((uint64_t)TRIGRAM(path[i], path[i + 1], path[i + 2]) << RECORD_BITS) | record;
+}
+
+// Sorts the values with LSD radix sort (16 bits at a time).
+static void radix_sort(uint64_t *restrict data, size_t count)
+{
+	uint64_t *buffer = alloc(count * sizeof(*buffer));
+	size_t *counts = alloc((1 << 16) * sizeof(*counts));
+	unsigned shift;
+	size_t i;
+
+	for(shift = 0; shift < 64; shift += 16)
+	{
+		size_t total = 0;
+
+		memset(counts, 0, (1 << 16) * sizeof(*counts));
+		for(i = 0; i < count; ++i)
+			counts[(data[i] >> shift) & 0xffff] += 1;
+		for(i = 0; i < (1 << 16); ++i)
+		{
+			size_t items = counts[i];
+			counts[i] = total;
+			total += items;
+		}
+		for(i = 0; i < count; ++i)
+			buffer[counts[(data[i] >> shift) & 0xffff]++] = data[i];
+
+		memcpy(data, buffer, count * sizeof(*data));
+	}
+
+	free(counts);
+	free(buffer);
+}
+
+static unsigned char *varint_write(unsigned char *restrict dest, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		*dest++ = (value & 0x7f) | 0x80;
+		value >>= 7;
+	}
+	*dest++ = value;
+	return dest;
+}
+
+// Generates the entries and the postings from the added trigrams.
+// The returned buffers must be freed by the caller.
+int trigrams_build(struct trigrams *restrict trigrams, struct trigram_entry **restrict entries, size_t *restrict entries_count, unsigned char **restrict postings, size_t *restrict postings_size)
+{
+	size_t i;
+	size_t count = 0;
+	unsigned char *position;
+	uint64_t previous = 0;
+
+	radix_sort(trigrams->data, trigrams->count);
+
+	// Count the distinct trigrams. Each varint takes at most 10 bytes.
+	for(i = 0; i < trigrams->count; ++i)
+		if (!i || ((trigrams->data[i] >> RECORD_BITS) != (trigrams->data[i - 1] >> RECORD_BITS)))
+			count += 1;
+
+	*entries = alloc((count + 1) * sizeof(**entries));
+	*postings = position = alloc(trigrams->count * 10 + 1);
+
+	count = 0;
+	for(i = 0; i < trigrams->count; ++i)
+	{
+		uint64_t trigram = trigrams->data[i] >> RECORD_BITS;
+		uint64_t record = trigrams->data[i] & RECORD_MASK;
+
+		if (!i || (trigram != (trigrams->data[i - 1] >> RECORD_BITS)))
+		{
+			(*entries)[count].trigram = trigram;
+			(*entries)[count].offset = position - *postings;
+			count += 1;
+			previous = 0;
+		}
+		else if (trigrams->data[i] == trigrams->data[i - 1])
+			continue; // the trigram occurs more than once in the path
+
+		position = varint_write(position, record - previous);
+		previous = record;
+	}
+	(*entries)[count].trigram = 0;
+	(*entries)[count].offset = position - *postings;
+
+	*entries_count = count;
+	*postings_size = position - *postings;
+	return 0;
+}
+
+void trigrams_term(struct trigrams *restrict trigrams)
+{
+	free(trigrams->data);
+}
+
+// Reads a varint. Returns the position after it or NULL if the data is invalid.
+static const unsigned char *varint_read(const unsigned char *restrict position, const unsigned char *restrict end, uint64_t *restrict value)
+{
+	unsigned shift = 0;
+
+	*value = 0;
+	do
+	{
+		if ((position == end) || (shift > 63))
+			return 0;
+		*value |= (uint64_t)(*position & 0x7f) << shift;
+		shift += 7;
+	} while (*position++ & 0x80);
+
+	return position;
+}
+
+static const struct trigram_entry *trigram_find(const struct trigram_index *restrict index, uint32_t trigram)
+{
+	size_t low = 0, high = index->count;
+
+	while (low < high)
+	{
+		size_t i = (high - low) / 2 + low;
+		if (index->entries[i].trigram < trigram)
+			low = i + 1;
+		else if (index->entries[i].trigram > trigram)
+			high = i;
+		else
+			return index->entries + i;
+	}
+
+	return 0;
+}
+
+// Keeps only the records which are in the list of the entry. Returns the number of records kept or error code.
+static ssize_t intersect(const struct trigram_index *restrict index, const struct trigram_entry *restrict entry, uint64_t *restrict records, size_t count)
+{
+	const unsigned char *position = index->postings + entry[0].offset, *end = index->postings + entry[1].offset;
+	uint64_t record = 0;
+	size_t i = 0, kept = 0;
+
+	while ((position < end) && (i < count))
+	{
+		uint64_t delta;
+
+		position = varint_read(position, end, &delta);
+		if (!position)
+			return ERROR_INPUT;
+		record += delta;
+
+		while ((i < count) && (records[i] < record))
+			i += 1;
+		if ((i < count) && (records[i] == record))
+			records[kept++] = records[i++];
+	}
+
+	return kept;
+}
+
+// Finds the records whose path contains all the trigrams.
+// On success, stores the records in ascending order in an allocated array and returns their number.
+ssize_t trigram_search(const struct trigram_index *restrict index, const uint32_t *restrict trigrams, size_t count, uint64_t **restrict records)
+{
+	const struct trigram_entry **entries;
+	const struct trigram_entry *shortest;
+	const unsigned char *position, *end;
+	uint64_t record = 0;
+	ssize_t size = 0;
+	size_t i;
+
+	if (!count)
+		return ERROR_INPUT;
+
+	entries = alloc(count * sizeof(*entries));
+	for(i = 0; i < count; ++i)
+	{
+		entries[i] = trigram_find(index, trigrams[i]);
+		if (!entries[i])
+		{
+			free(entries);
+			*records = 0;
+			return 0; // no path contains the trigram
+		}
+		if (entries[i][1].offset < entries[i][0].offset)
+		{
+			free(entries);
+			return ERROR_INPUT;
+		}
+	}
+
+	// Start with the shortest list so that there are fewer records to intersect.
+	shortest = entries[0];
+	for(i = 1; i < count; ++i)
+		if (entries[i][1].offset - entries[i][0].offset < shortest[1].offset - shortest[0].offset)
+			shortest = entries[i];
+
+	position = index->postings + shortest[0].offset;
+	end = index->postings + shortest[1].offset;
+	*records = alloc((end - position + 1) * sizeof(**records)); // each record takes at least one byte
+	while (position < end)
+	{
+		uint64_t delta;
+
+		position = varint_read(position, end, &delta);
+		if (!position)
+		{
+			free(entries);
+			free(*records);
+			return ERROR_INPUT;
+		}
+		record += delta;
+		(*records)[size++] = record;
+	}
+
+	for(i = 0; (i < count) && size; ++i)
+	{
+		if (entries[i] == shortest)
+			continue;
+		size = intersect(index, entries[i], *records, size);
+		if (size < 0)
+		{
+			free(entries);
+			free(*records);
+			return size;
+		}
+	}
+
+	free(entries);
+	return size;
+}
+
+// Finds the records whose path contains at least threshold of the trigrams.
+// On success, stores the records in ascending order in an allocated array and returns their number.
+ssize_t trigram_count(const struct trigram_index *restrict index, const uint32_t *restrict trigrams, size_t count, size_t threshold, uint64_t **restrict records)
+{
+	const struct trigram_entry **entries;
+	uint64_t *all;
+	size_t size = 0, total = 0;
+	ssize_t found = 0;
+	size_t i, j;
+
+	if (!threshold)
+		return ERROR_INPUT;
+
+	entries = alloc((count + 1) * sizeof(*entries));
+	for(i = 0; i < count; ++i)
+	{
+		entries[i] = trigram_find(index, trigrams[i]);
+		if (entries[i])
+		{
+			if (entries[i][1].offset < entries[i][0].offset)
+			{
+				free(entries);
+				return ERROR_INPUT;
+			}
+			total += entries[i][1].offset - entries[i][0].offset; // each record takes at least one byte
+		}
+	}
+
+	// Collect the records from all the lists. The records with enough trigrams occur at least threshold times.
+	all = alloc((total + 1) * sizeof(*all));
+	for(i = 0; i < count; ++i)
+	{
+		const unsigned char *position, *end;
+		uint64_t record = 0;
+
+		if (!entries[i])
+			continue;
+
+		position = index->postings + entries[i][0].offset;
+		end = index->postings + entries[i][1].offset;
+		while (position < end)
+		{
+			uint64_t delta;
+
+			position = varint_read(position, end, &delta);
+			if (!position)
+			{
+				free(all);
+				free(entries);
+				return ERROR_INPUT;
+			}
+			record += delta;
+			all[size++] = record;
+		}
+	}
+	free(entries);
+
+	radix_sort(all, size);
+
+	for(i = 0; i < size; i = j)
+	{
+		for(j = i + 1; (j < size) && (all[j] == all[i]); ++j)
+			;
+		if (j - i >= threshold)
+			all[found++] = all[i];
+	}
+
+	*records = all;
+	return found;
+}
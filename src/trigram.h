@@ -0,0 +1,49 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Index of the records containing each sequence of 3 bytes in their path.
+// The records of each trigram are stored in ascending order as varint-encoded differences.
+
+#define TRIGRAM(a, b, c) (((uint32_t)(a) << 16) | ((uint32_t)(b) << 8) | (uint32_t)(c))
+
+struct trigrams
+{
+	size_t count, capacity;
+	uint64_t *data; // trigram in the high 24 bits, record in the low 40 bits
+};
+
+struct trigram_entry
+{
+	uint64_t trigram;
+	uint64_t offset; // offset of the list of records in the postings
+};
+
+struct trigram_index
+{
+	uint64_t count;
+	const struct trigram_entry *entries; // followed by an entry marking the end of the postings
+	const unsigned char *postings;
+};
+
+void trigrams_add(struct trigrams *restrict trigrams, const unsigned char *restrict path, size_t length, uint64_t record);
+int trigrams_build(struct trigrams *restrict trigrams, struct trigram_entry **restrict entries, size_t *restrict entries_count, unsigned char **restrict postings, size_t *restrict postings_size);
+void trigrams_term(struct trigrams *restrict trigrams);
+
+ssize_t trigram_search(const struct trigram_index *restrict index, const uint32_t *restrict trigrams, size_t count, uint64_t **restrict records);
+ssize_t trigram_count(const struct trigram_index *restrict index, const uint32_t *restrict trigrams, size_t count, size_t threshold, uint64_t **restrict records);
@@ -0,0 +1,190 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// File of the tree indexed by the test.
+struct aggregate_file
+{
+	const char *path; // relative to the root of the tree
+	char type; // 'f' for regular file, 'd' for directory, 'h' for hard link, 's' for symbolic link
+	size_t size; // size of a regular file
+	const char *target; // path of the target of a hard link (relative to the root) or content of a symbolic link
+};
+
+static const struct aggregate_file aggregate_tree[] = {
+	{"a", 'f', 100, 0},
+	{"d", 'd', 0, 0},
+	{"d/b", 'f', 50, 0},
+	{"d/h", 'h', 0, "d/b"},
+	{"d/s", 's', 0, "../a"},
+	{"d/e", 'd', 0, 0},
+	{"d/e/f", 'f', 7, 0},
+	{"l", 's', 0, "d"}, // symbolic link to a directory
+};
+
+// Adds the files in the directory to the database (the same way as findex).
+static void aggregate_index(struct db *restrict db, char *restrict path, size_t length)
+{
+	DIR *dir = opendir(path);
+	struct dirent *entry;
+
+	assert_non_null(dir);
+	while (entry = readdir(dir))
+	{
+		size_t name_length = strlen(entry->d_name);
+		struct stat info;
+		struct inode inode;
+		struct file file;
+
+		if (entry->d_name[0] == '.')
+			continue;
+		path[length] = '/';
+		memcpy(path + length + 1, entry->d_name, name_length + 1);
+
+		assert_int_equal(lstat(path, &info), 0);
+		inode.device = info.st_dev;
+		inode.number = info.st_ino;
+		assert_int_equal(db_set_fileinfo(&file, path, length + 1 + name_length, &info), 0);
+		assert_int_equal(db_add(db, path, length + 1 + name_length, &file, &inode), 0);
+		if (S_ISDIR(info.st_mode))
+			aggregate_index(db, path, length + 1 + name_length);
+	}
+	closedir(dir);
+	path[length] = 0;
+}
+
+// Finds the totals of the record with the given path. Sets file to the record.
+static const struct aggregate *aggregate_find(struct search *restrict search, const char *restrict path, struct file *restrict file)
+{
+	size_t length = strlen(path);
+	size_t record, index;
+
+	for(record = 0; record < search->columns.count; ++record)
+	{
+		const unsigned char *found = db_path(search, record);
+
+		assert_non_null(found);
+		db_record(file, search, record);
+		if ((file->path_length == length) && !memcmp(found, path, length))
+		{
+			index = db_aggregate_first(search, record);
+			assert_true(index < search->aggregates_count);
+			assert_int_equal(search->aggregate_records[index], record);
+			return search->aggregates + index;
+		}
+	}
+
+	fail();
+	return 0;
+}
+
+static void test_aggregate_totals(void **state)
+{
+	static const unsigned char content[100] = {0};
+	char directory[] = "/tmp/check.XXXXXX";
+	char root[sizeof(directory) + 8], database[sizeof(directory) + 8];
+	char path[PATH_SIZE_LIMIT], target[PATH_SIZE_LIMIT];
+	const struct aggregate *aggregate;
+	struct file file, subdirectory;
+	struct db db;
+	struct search search;
+	size_t i;
+	int fd;
+
+	assert_non_null(mkdtemp(directory));
+	sprintf(root, "%s/files", directory);
+	sprintf(database, "%s/db", directory);
+	assert_int_equal(mkdir(root, 0700), 0);
+	assert_int_equal(mkdir(database, 0700), 0);
+
+	for(i = 0; i < sizeof(aggregate_tree) / sizeof(*aggregate_tree); ++i)
+	{
+		const struct aggregate_file *entry = aggregate_tree + i;
+
+		sprintf(path, "%s/%s", root, entry->path);
+		switch (entry->type)
+		{
+		case 'f':
+			fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0600);
+			assert_true(fd >= 0);
+			assert_int_equal(write(fd, content, entry->size), entry->size);
+			close(fd);
+			break;
+		case 'd':
+			assert_int_equal(mkdir(path, 0700), 0);
+			break;
+		case 'h':
+			sprintf(target, "%s/%s", root, entry->target);
+			assert_int_equal(link(target, path), 0);
+			break;
+		default:
+			assert_int_equal(symlink(entry->target, path), 0);
+			break;
+		}
+	}
+
+	path_directory(database, strlen(database));
+	assert_int_equal(db_new(&db), 0);
+	db.flags |= DB_INODE;
+	strcpy(path, root);
+	aggregate_index(&db, path, strlen(path));
+	assert_int_equal(db_root(&db, root, strlen(root), 0), 0);
+	assert_int_equal(db_persist(&db), 0);
+	path_directory(0, 0);
+
+	assert_int_equal(db_open_directory(&search, database), 0);
+
+	sprintf(path, "%s/d/e", root);
+	aggregate = aggregate_find(&search, path, &subdirectory);
+	assert_int_equal(aggregate->size, subdirectory.size + 7);
+	assert_int_equal(aggregate->files, 1);
+	subdirectory.size = aggregate->size;
+
+	// The hard links are counted once. The symbolic link is counted with its own size, not with the size of its target.
+	sprintf(path, "%s/d", root);
+	aggregate = aggregate_find(&search, path, &file);
+	assert_int_equal(aggregate->size, file.size + subdirectory.size + 50 + strlen("../a"));
+	assert_int_equal(aggregate->files, 3);
+	assert_int_equal(aggregate->content[__builtin_ctz(CONTENT_LINK)], 1);
+	assert_int_equal(aggregate->content[__builtin_ctz(CONTENT_DIRECTORY)], 1);
+
+	// A symbolic link to a directory has totals of its own instead of a subtree.
+	sprintf(path, "%s/l", root);
+	aggregate = aggregate_find(&search, path, &file);
+	assert_true(file.content & CONTENT_LINK);
+	assert_int_equal(aggregate->size, strlen("d"));
+	assert_int_equal(aggregate->files, 0);
+
+	db_close(&search);
+
+	for(i = sizeof(aggregate_tree) / sizeof(*aggregate_tree); i--;)
+	{
+		sprintf(path, "%s/%s", root, aggregate_tree[i].path);
+		assert_int_equal(remove(path), 0);
+	}
+	assert_int_equal(rmdir(root), 0);
+	stream_remove(directory, (const char *const []){"db"}, 1);
+}
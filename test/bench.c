@@ -0,0 +1,203 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Compares the time and the page faults of scans and path lookups on the database of the user,
+// with and without paging hints, when the database is in the page cache and when it is not.
+// The database files are dropped from the page cache with posix_fadvise() which doesn't require privileges
+// but has no effect on pages still mapped by another process.
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <base.h>
+#include <path.h>
+#include <db.h>
+
+#define LOOKUPS 1000
+
+struct sample
+{
+	size_t count;
+	size_t *offsets;
+	char *paths;
+};
+
+static int evict(void)
+{
+	struct path_buffer buffer;
+	DIR *dir;
+	struct dirent *entry;
+
+	if (path_init(&buffer))
+		return ERROR;
+	buffer.data[buffer.prefix_length] = 0;
+	dir = opendir(buffer.data);
+	if (!dir)
+		return ERROR_MISSING;
+	while (entry = readdir(dir))
+	{
+		int fd;
+		if (entry->d_name[0] == '.')
+			continue;
+		path_set(&buffer, entry->d_name, strlen(entry->d_name));
+		fd = open(buffer.data, O_RDONLY);
+		if (fd < 0)
+			continue;
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		close(fd);
+	}
+	closedir(dir);
+	return 0;
+}
+
+static volatile uint64_t result; // keeps the loops from being optimized away
+
+// Reads every path and every size in the database.
+static int scan(struct search *restrict search, const struct sample *restrict sample)
+{
+	uint64_t total = 0;
+	size_t record;
+
+	db_prefetch(search, 0, search->columns.count);
+	for(record = 0; record < search->columns.count; ++record)
+	{
+		const unsigned char *path = db_path(search, record);
+		if (!path)
+			return ERROR_INPUT;
+		total += path[0] + search->columns.size[record];
+	}
+	result = total;
+	return 0;
+}
+
+// Finds the paths of the sample through the index.
+static int lookup(struct search *restrict search, const struct sample *restrict sample)
+{
+	size_t i;
+	for(i = 0; i < sample->count; ++i)
+	{
+		struct file file;
+		const char *path = sample->paths + sample->offsets[i];
+		if (db_find_fileinfo(&file, path, sample->offsets[i + 1] - sample->offsets[i], search))
+			return ERROR_INPUT;
+	}
+	return 0;
+}
+
+// Selects paths spread evenly across the database.
+static int sample_init(struct sample *restrict sample)
+{
+	struct search search;
+	size_t size = 0, i;
+	int status;
+
+	status = db_open(&search);
+	if (status)
+		return status;
+
+	sample->count = ((search.columns.count < LOOKUPS) ? search.columns.count : LOOKUPS);
+	sample->offsets = malloc((sample->count + 1) * sizeof(*sample->offsets));
+	sample->paths = malloc(sample->count * PATH_SIZE_LIMIT);
+	if (!sample->offsets || !sample->paths)
+		abort();
+	for(i = 0; i < sample->count; ++i)
+	{
+		size_t record = i * (search.columns.count / sample->count);
+		const unsigned char *path = db_path(&search, record);
+		if (!path)
+		{
+			db_close(&search);
+			return ERROR_INPUT;
+		}
+		sample->offsets[i] = size;
+		memcpy(sample->paths + size, path, search.columns.path_length[record]);
+		size += search.columns.path_length[record];
+	}
+	sample->offsets[sample->count] = size;
+
+	db_close(&search);
+	return 0;
+}
+
+static int measure(const char *restrict name, int (*workload)(struct search *restrict, const struct sample *restrict), const struct sample *restrict sample, unsigned use, int cold)
+{
+	struct search search;
+	struct timespec start, end;
+	struct rusage before, after;
+	int status;
+
+	if (cold && (status = evict()))
+		return status;
+
+	getrusage(RUSAGE_SELF, &before);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	status = db_open(&search);
+	if (status)
+		return status;
+	if (use)
+		db_advise(&search, use);
+	status = (*workload)(&search, sample);
+	db_close(&search);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	getrusage(RUSAGE_SELF, &after);
+	if (status)
+		return status;
+
+	printf("%-8s %-9s %-5s %10.3f %8ld %8ld\n", name, (use == DB_USE_SCAN) ? "scan" : ((use == DB_USE_LOOKUP) ? "lookup" : ((use == DB_USE_RESIDENT) ? "resident" : "none")), cold ? "cold" : "warm",
+		(end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1000000.0, after.ru_majflt - before.ru_majflt, after.ru_minflt - before.ru_minflt);
+	return 0;
+}
+
+int main(void)
+{
+	static const unsigned uses[] = {0, DB_USE_SCAN, DB_USE_LOOKUP, DB_USE_RESIDENT};
+	struct sample sample;
+	size_t i;
+	int cold;
+	int status;
+
+	if (status = sample_init(&sample))
+	{
+		fprintf(stderr, "Unable to open the database\n");
+		return -status;
+	}
+
+	printf("%-8s %-9s %-5s %10s %8s %8s\n", "workload", "hints", "cache", "ms", "major", "minor");
+	for(cold = 1; cold >= 0; --cold)
+		for(i = 0; i < sizeof(uses) / sizeof(*uses); ++i)
+		{
+			if ((status = measure("scan", &scan, &sample, uses[i], cold)) || (status = measure("lookup", &lookup, &sample, uses[i], cold)))
+			{
+				fprintf(stderr, "Benchmark failed\n");
+				return -status;
+			}
+		}
+
+	free(sample.offsets);
+	free(sample.paths);
+	return 0;
+}
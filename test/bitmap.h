@@ -0,0 +1,153 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BITMAP_RECORDS (2 * BITMAP_CHUNK + 5000)
+#define BITMAP_COUNT 5
+
+// Whether the record is in the bitmap. Bitmap 0 is dense (bitmap containers), bitmaps 1 and 2 are sparse (array containers),
+// bitmap 3 has records only in the last chunk and bitmap 4 is empty.
+static int bitmap_member(uint64_t hash, size_t record, size_t bitmap)
+{
+	switch (bitmap)
+	{
+	case 0:
+		return (hash % 3 != 0);
+	case 1:
+		return (hash % 64 == 1);
+	case 2:
+		return ((hash >> 8) % 32 == 2);
+	case 3:
+		return ((record >= 2 * BITMAP_CHUNK) && (hash % 2));
+	default:
+		return 0;
+	}
+}
+
+static void test_bitmap_search(void **state)
+{
+	uint64_t *hashes = malloc(BITMAP_RECORDS * sizeof(*hashes));
+	uint64_t *words = malloc(BITMAP_WORDS * sizeof(*words));
+	struct bitmaps bitmaps[BITMAP_COUNT] = {0};
+	uint64_t starts[BITMAP_COUNT + 1];
+	struct bitmap_container *containers;
+	unsigned char *data;
+	struct bitmap_index index;
+	uint64_t random = 0x3c6ef372fe94f82bULL;
+	size_t chunk, bitmap, i, j;
+	size_t query;
+
+	for(i = 0; i < BITMAP_RECORDS; ++i)
+		hashes[i] = random64(&random);
+
+	for(bitmap = 0; bitmap < BITMAP_COUNT; ++bitmap)
+		for(chunk = 0; chunk * BITMAP_CHUNK < BITMAP_RECORDS; ++chunk)
+		{
+			memset(words, 0, BITMAP_WORDS * sizeof(*words));
+			for(i = chunk * BITMAP_CHUNK; (i < BITMAP_RECORDS) && (i < (chunk + 1) * BITMAP_CHUNK); ++i)
+				if (bitmap_member(hashes[i], i, bitmap))
+					words[(i % BITMAP_CHUNK) / 64] |= (uint64_t)1 << (i % 64);
+			bitmaps_add(bitmaps + bitmap, chunk, words);
+		}
+	assert_true(bitmaps[0].containers[0].cardinality > BITMAP_ARRAY_LIMIT);
+	assert_true(bitmaps[1].containers[0].cardinality <= BITMAP_ARRAY_LIMIT);
+	assert_int_equal(bitmaps[3].count, 1);
+	assert_int_equal(bitmaps[4].count, 0);
+
+	// Put the containers and the data of all the bitmaps together (as the database does).
+	starts[0] = 0;
+	for(bitmap = 0; bitmap < BITMAP_COUNT; ++bitmap)
+		starts[bitmap + 1] = starts[bitmap] + bitmaps[bitmap].count;
+	containers = malloc(starts[BITMAP_COUNT] * sizeof(*containers));
+	data = malloc(BITMAP_COUNT * 3 * BITMAP_WORDS * sizeof(uint64_t));
+	index.data_size = 0;
+	for(bitmap = 0; bitmap < BITMAP_COUNT; ++bitmap)
+	{
+		for(j = 0; j < bitmaps[bitmap].count; ++j)
+		{
+			containers[starts[bitmap] + j] = bitmaps[bitmap].containers[j];
+			containers[starts[bitmap] + j].offset += index.data_size;
+		}
+		memcpy(data + index.data_size, bitmaps[bitmap].data, bitmaps[bitmap].size);
+		index.data_size += bitmaps[bitmap].size;
+	}
+	index.count = BITMAP_COUNT;
+	index.starts = starts;
+	index.containers = containers;
+	index.data = data;
+
+	for(query = 0; query < 64; ++query)
+	{
+		uint32_t search[2 * (BITMAP_COUNT + 1)];
+		size_t groups[2] = {0, 0};
+		size_t groups_count = 1 + query % 2;
+		uint64_t cardinality = 0;
+		uint64_t *records;
+		ssize_t found;
+		size_t expected = 0;
+
+		// Each group is a subset of the bitmaps (a group may also have a bitmap that does not exist).
+		for(i = 0; i < groups_count; ++i)
+		{
+			uint64_t subset = random64(&random) % ((1 << (BITMAP_COUNT + 1)) - 1) + 1;
+			for(bitmap = 0; bitmap < BITMAP_COUNT + 1; ++bitmap)
+				if ((subset >> bitmap) & 1)
+					search[groups[0] + groups[i]++] = bitmap;
+		}
+
+		for(i = 0; i < groups[0]; ++i)
+			for(j = 0; j < BITMAP_RECORDS; ++j)
+				cardinality += ((search[i] < BITMAP_COUNT) && bitmap_member(hashes[j], j, search[i]));
+		assert_int_equal(bitmap_cardinality(&index, search, groups[0]), cardinality);
+
+		found = bitmap_search(&index, search, groups, groups_count, &records);
+		assert_true(found >= 0);
+		for(j = 0; j < BITMAP_RECORDS; ++j)
+		{
+			size_t g, offset;
+
+			for(g = 0, offset = 0; g < groups_count; offset += groups[g++])
+			{
+				for(i = offset; i < offset + groups[g]; ++i)
+					if ((search[i] < BITMAP_COUNT) && bitmap_member(hashes[j], j, search[i]))
+						break;
+				if (i == offset + groups[g])
+					break;
+			}
+			if (g < groups_count)
+				continue;
+
+			assert_true(expected < (size_t)found);
+			assert_int_equal(records[expected], j);
+			expected += 1;
+		}
+		assert_int_equal(found, expected);
+		free(records);
+	}
+
+	free(data);
+	free(containers);
+	for(bitmap = 0; bitmap < BITMAP_COUNT; ++bitmap)
+		bitmaps_term(bitmaps + bitmap);
+	free(words);
+	free(hashes);
+}
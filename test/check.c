@@ -4,15 +4,73 @@
 #include <cmocka.h>
 
 #include "path.h"
+#include "permission.h"
+#include "lz.h"
+#include "stream.h"
+#include "perfect.h" // uses the declarations included by db.h
+#include "filter.h"
+#include "trigram.h" // uses the declarations included by db.h
+#include "names.h" // uses the declarations included by db.h
+#include "sorted.h" // uses the declarations included by db.h
+#include "bitmap.h" // uses the declarations included by db.h
+#include "inode.h" // uses the declarations included by db.h
+#include "delta.h" // uses the helpers from stream.h
+#include "generation.h" // uses the helpers from stream.h
+#include "digest.h" // uses the helpers from stream.h
+#include "media.h"
+#include "aggregate.h" // uses the helpers from stream.h and the declarations included by media.h
+#include "map.h" // uses the helpers from stream.h
+#include "saved.h" // uses the helpers from stream.h and generation.h
+#include "export.h" // uses the helpers from stream.h and delta.h
+#include "container.h" // uses the helpers from stream.h
+#include "shard.h" // uses the helpers from stream.h
 
 int main(void)
 {
 	const struct CMUnitTest tests[] =
 	{
-		cmocka_unit_test(test_normalize_root),
-		cmocka_unit_test(test_normalize_simple),
-		cmocka_unit_test(test_normalize_current),
-		cmocka_unit_test(test_normalize_parent),
+		cmocka_unit_test_setup_teardown(test_normalize_root, free_mock, free_unmock),
+		cmocka_unit_test_setup_teardown(test_normalize_simple, free_mock, free_unmock),
+		cmocka_unit_test_setup_teardown(test_normalize_current, free_mock, free_unmock),
+		cmocka_unit_test_setup_teardown(test_normalize_parent, free_mock, free_unmock),
+		cmocka_unit_test(test_permission_root),
+		cmocka_unit_test(test_permission_allowed),
+		cmocka_unit_test(test_permission_denied),
+		cmocka_unit_test(test_permission_grow),
+		cmocka_unit_test(test_permission_read),
+		cmocka_unit_test(test_lz_empty),
+		cmocka_unit_test(test_lz_incompressible),
+		cmocka_unit_test(test_lz_runs),
+		cmocka_unit_test(test_lz_limit),
+		cmocka_unit_test(test_lz_invalid),
+		cmocka_unit_test(test_perfect_small),
+		cmocka_unit_test(test_perfect_large),
+		cmocka_unit_test(test_perfect_empty),
+		cmocka_unit_test(test_perfect_duplicate),
+		cmocka_unit_test(test_stream_apply),
+		cmocka_unit_test(test_stream_invalid),
+		cmocka_unit_test(test_filter_range),
+		cmocka_unit_test(test_filter_any),
+		cmocka_unit_test(test_trigram_search),
+		cmocka_unit_test(test_names_search),
+		cmocka_unit_test(test_sorted_search),
+		cmocka_unit_test(test_sorted_records),
+		cmocka_unit_test(test_bitmap_search),
+		cmocka_unit_test(test_inode_link),
+		cmocka_unit_test(test_delta_compact),
+		cmocka_unit_test(test_generation_changed),
+		cmocka_unit_test(test_digest_duplicates),
+		cmocka_unit_test(test_media_image),
+		cmocka_unit_test(test_media_audio),
+		cmocka_unit_test(test_media_invalid),
+		cmocka_unit_test(test_media_find),
+		cmocka_unit_test(test_aggregate_totals),
+		cmocka_unit_test(test_map_advise),
+		cmocka_unit_test(test_map_sections),
+		cmocka_unit_test(test_saved_update),
+		cmocka_unit_test(test_export_arrow),
+		cmocka_unit_test(test_container_invalid),
+		cmocka_unit_test(test_shard_overlap),
 	};
 	return cmocka_run_group_tests(tests, 0, 0);
 }
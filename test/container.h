@@ -0,0 +1,136 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Layout of the end of the container: table of sections {name[16], offset, size}, then {table offset, sections count, magic}.
+#define CONTAINER_ENTRY 32
+#define CONTAINER_TRAILER 24
+
+// Writes the container with the given content and returns the status of opening the database.
+static int container_open(const char *restrict directory, const char *restrict path, const unsigned char *restrict data, size_t size)
+{
+	struct search search;
+	int fd;
+	int status;
+
+	fd = open(path, O_WRONLY | O_TRUNC);
+	assert_true(fd >= 0);
+	assert_int_equal(write(fd, data, size), size);
+	close(fd);
+
+	status = db_open_directory(&search, directory);
+	if (!status)
+		db_close(&search);
+	return status;
+}
+
+static void test_container_invalid(void **state)
+{
+	static const struct stream_file files[] = {{"/data/a", 1}, {"/data/b", 2}};
+	char directory[] = "/tmp/check.XXXXXX";
+	char database[sizeof(directory) + 8], path[sizeof(directory) + 32];
+	unsigned char *original, *data;
+	uint64_t table, count, value;
+	struct search search;
+	struct stat info;
+	size_t size, i;
+	FILE *file;
+
+	assert_non_null(mkdtemp(directory));
+	sprintf(database, "%s/db", directory);
+	sprintf(path, "%s/database", database);
+	stream_database(database, files, sizeof(files) / sizeof(*files));
+
+	assert_int_equal(stat(path, &info), 0);
+	size = info.st_size;
+	original = malloc(size);
+	data = malloc(size);
+	file = fopen(path, "rb");
+	assert_non_null(file);
+	assert_int_equal(fread(original, 1, size, file), size);
+	fclose(file);
+
+	// The table of sections lists data first, at the beginning of the container.
+	assert_memory_equal(original + size - 8, "fsection", 8);
+	memcpy(&table, original + size - CONTAINER_TRAILER, sizeof(table));
+	memcpy(&count, original + size - CONTAINER_TRAILER + 8, sizeof(count));
+	assert_int_equal(table + count * CONTAINER_ENTRY + CONTAINER_TRAILER, size);
+	assert_true(count > 1);
+	assert_string_equal((const char *)original + table, "data");
+	memcpy(&value, original + table + 16, sizeof(value));
+	assert_int_equal(value, 0);
+
+	assert_int_equal(db_open_directory(&search, database), 0);
+	assert_int_equal(search.container_count, count);
+	db_close(&search);
+
+	// A container without a valid trailer may be truncated.
+	assert_int_equal(container_open(database, path, original, size - 1), ERROR_READ);
+	assert_int_equal(container_open(database, path, original, 10), ERROR_READ);
+	assert_int_equal(container_open(database, path, original, table), ERROR_READ);
+
+	memcpy(data, original, size);
+	value = size;
+	memcpy(data + size - CONTAINER_TRAILER, &value, sizeof(value)); // table after the end
+	assert_int_equal(container_open(database, path, data, size), ERROR_READ);
+
+	memcpy(data, original, size);
+	value = count + 1;
+	memcpy(data + size - CONTAINER_TRAILER + 8, &value, sizeof(value)); // more sections than the table has
+	assert_int_equal(container_open(database, path, data, size), ERROR_READ);
+
+	// An invalid entry in the table means the container is corrupted.
+	for(i = 0; i < 4; ++i)
+	{
+		const unsigned char *entry = original + table + CONTAINER_ENTRY; // the second section
+		memcpy(data, original, size);
+		switch (i)
+		{
+		case 0: // not page-aligned
+			memcpy(&value, entry + 16, sizeof(value));
+			value += 8;
+			memcpy(data + table + CONTAINER_ENTRY + 16, &value, sizeof(value));
+			break;
+		case 1: // past the table of sections
+			value = table;
+			memcpy(data + table + CONTAINER_ENTRY + 24, &value, sizeof(value));
+			break;
+		case 2: // name not terminated
+			memset(data + table + CONTAINER_ENTRY, 'x', 16);
+			break;
+		case 3: // no data section
+			data[table] = 'D';
+			break;
+		}
+		assert_int_equal(container_open(database, path, data, size), ERROR_INPUT);
+	}
+
+	assert_int_equal(container_open(database, path, original, size), 0);
+
+	free(data);
+	free(original);
+	stream_remove(directory, (const char *const []){"db"}, 1);
+}
@@ -0,0 +1,99 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Writes a delta segment with the given changes (files with size 0 are removed).
+static void delta_segment(const struct stream_file *restrict files, size_t count)
+{
+	struct delta delta;
+	size_t i;
+
+	db_delta_new(&delta);
+	for(i = 0; i < count; ++i)
+	{
+		size_t length = strlen(files[i].path);
+		if (files[i].size)
+		{
+			struct file file = {0};
+			file.path_length = length;
+			file.size = files[i].size;
+			file.mtime = 1000;
+			assert_int_equal(db_delta_add(&delta, files[i].path, length, &file), 0);
+		}
+		else
+			assert_int_equal(db_delta_remove(&delta, files[i].path, length), 0);
+	}
+	assert_int_equal(db_delta_persist(&delta), 0);
+	db_delta_delete(&delta);
+}
+
+static void test_delta_compact(void **state)
+{
+	static const struct stream_file files_base[] = {{"/data/a", 1}, {"/data/b", 2}, {"/data/c", 3}};
+	static const struct stream_file files_first[] = {{"/data/a", 10}, {"/data/d", 4}};
+	static const struct stream_file files_second[] = {{"/data/b", 0}, {"/data/d", 40}, {"/data/aa", 7}};
+	static const struct stream_file files_expected[] = {{"/data/a", 10}, {"/data/aa", 7}, {"/data/c", 3}, {"/data/d", 40}};
+	char directory[] = "/tmp/check.XXXXXX";
+	char base[sizeof(directory) + 8], expected[sizeof(directory) + 8];
+	struct search old, new;
+	struct file file;
+	size_t changes = 0;
+
+	assert_non_null(mkdtemp(directory));
+	sprintf(base, "%s/base", directory);
+	sprintf(expected, "%s/expected", directory);
+
+	stream_database(base, files_base, sizeof(files_base) / sizeof(*files_base));
+	stream_database(expected, files_expected, sizeof(files_expected) / sizeof(*files_expected));
+
+	path_directory(base, strlen(base));
+	delta_segment(files_first, sizeof(files_first) / sizeof(*files_first));
+	delta_segment(files_second, sizeof(files_second) / sizeof(*files_second));
+	assert_int_equal(db_deltas_count(), 2);
+
+	// The newest change of each path is used.
+	assert_int_equal(db_open(&old), 0);
+	assert_int_equal(old.deltas_count, 2);
+	assert_int_equal(db_find_fileinfo(&file, "/data/a", 7, &old), 0);
+	assert_int_equal(file.size, 10);
+	assert_int_equal(db_find_fileinfo(&file, "/data/d", 7, &old), 0);
+	assert_int_equal(file.size, 40);
+	assert_int_equal(db_find_fileinfo(&file, "/data/b", 7, &old), ERROR_MISSING);
+	assert_int_equal(db_find_fileinfo(&file, "/data/c", 7, &old), 0);
+	assert_int_equal(file.size, 3);
+	db_close(&old);
+
+	// Compaction merges the segments into the database.
+	assert_int_equal(db_compact(), 0);
+	assert_int_equal(db_deltas_count(), 0);
+	path_directory(0, 0);
+
+	assert_int_equal(db_open_directory(&old, base), 0);
+	assert_int_equal(old.deltas_count, 0);
+	assert_int_equal(db_open_directory(&new, expected), 0);
+	assert_int_equal(db_diff(&old, &new, stream_count, &changes), 0);
+	assert_int_equal(changes, 0);
+	db_close(&new);
+	db_close(&old);
+
+	stream_remove(directory, (const char *const []){"base", "expected"}, 2);
+}
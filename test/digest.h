@@ -0,0 +1,143 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DIGEST_SIZE_LARGE 10000 /* more than the two blocks at the ends of a file */
+
+struct digest_file
+{
+	const char *name;
+	size_t size;
+	unsigned char fill; // byte filling the file
+	unsigned char middle; // byte in the middle of the file
+};
+
+// Returns the digest of the record with the given path.
+static uint64_t digest_find(struct search *restrict search, const char *restrict path)
+{
+	size_t length = strlen(path);
+	size_t record;
+
+	for(record = 0; record < search->columns.count; ++record)
+	{
+		struct file file;
+		const unsigned char *found = db_path(search, record);
+
+		assert_non_null(found);
+		db_record(&file, search, record);
+		if ((file.path_length == length) && !memcmp(found, path, length))
+			return search->digests[record];
+	}
+
+	fail();
+	return 0;
+}
+
+static void test_digest_duplicates(void **state)
+{
+	// Sorted by name (the order of the records in the database).
+	static const struct digest_file files[] = {
+		{"empty0", 0, 0, 0},
+		{"empty1", 0, 0, 0},
+		{"large0", DIGEST_SIZE_LARGE, 'a', 'a'},
+		{"large1", DIGEST_SIZE_LARGE, 'a', 'a'},
+		{"large2", DIGEST_SIZE_LARGE, 'a', 'b'}, // same ends as large0
+		{"single", 777, 'a', 'a'},
+		{"small0", 100, 'x', 'x'},
+		{"small1", 100, 'x', 'x'},
+		{"small2", 100, 'y', 'y'},
+	};
+	static unsigned char content[DIGEST_SIZE_LARGE];
+	char directory[] = "/tmp/check.XXXXXX";
+	char root[sizeof(directory) + 8], database[sizeof(directory) + 8];
+	char path[sizeof(root) + 8];
+	struct db db;
+	struct search search;
+	uint64_t large, small;
+	size_t i;
+
+	assert_non_null(mkdtemp(directory));
+	sprintf(root, "%s/files", directory);
+	sprintf(database, "%s/db", directory);
+	assert_int_equal(mkdir(root, 0700), 0);
+	assert_int_equal(mkdir(database, 0700), 0);
+
+	path_directory(database, strlen(database));
+	assert_int_equal(db_new(&db), 0);
+	db.flags |= DB_DIGEST;
+	for(i = 0; i < sizeof(files) / sizeof(*files); ++i)
+	{
+		struct file file = {0};
+		int fd;
+
+		memset(content, files[i].fill, files[i].size);
+		if (files[i].size)
+			content[files[i].size / 2] = files[i].middle;
+		sprintf(path, "%s/%s", root, files[i].name);
+		fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0600);
+		assert_true(fd >= 0);
+		assert_int_equal(write(fd, content, files[i].size), files[i].size);
+		close(fd);
+
+		file.path_length = strlen(path);
+		file.size = files[i].size;
+		file.mtime = 1000;
+		assert_int_equal(db_add(&db, path, file.path_length, &file, 0), 0);
+	}
+	assert_int_equal(db_root(&db, root, strlen(root), 0), 0);
+	assert_int_equal(db_persist(&db), 0);
+	path_directory(0, 0);
+
+	assert_int_equal(db_open_directory(&search, database), 0);
+	assert_non_null(search.digests);
+
+	// Only files with the same size as another file have a digest. Empty files are not duplicates.
+	sprintf(path, "%s/empty0", root);
+	assert_int_equal(digest_find(&search, path), 0);
+	sprintf(path, "%s/single", root);
+	assert_int_equal(digest_find(&search, path), 0);
+
+	// Files are told apart by the whole content, not only by their ends.
+	sprintf(path, "%s/large0", root);
+	large = digest_find(&search, path);
+	assert_int_not_equal(large, 0);
+	sprintf(path, "%s/large1", root);
+	assert_int_equal(digest_find(&search, path), large);
+	sprintf(path, "%s/large2", root);
+	assert_int_not_equal(digest_find(&search, path), 0);
+	assert_int_not_equal(digest_find(&search, path), large);
+
+	sprintf(path, "%s/small0", root);
+	small = digest_find(&search, path);
+	assert_int_not_equal(small, 0);
+	sprintf(path, "%s/small1", root);
+	assert_int_equal(digest_find(&search, path), small);
+	sprintf(path, "%s/small2", root);
+	assert_int_not_equal(digest_find(&search, path), 0);
+	assert_int_not_equal(digest_find(&search, path), small);
+
+	db_close(&search);
+
+	stream_remove(directory, (const char *const []){"db", "files"}, 2);
+}
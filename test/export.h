@@ -0,0 +1,176 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <export.h>
+
+#define EXPORT_RECORDS (DB_BLOCK_RECORDS + 10)
+
+// Minimal reader of the flatbuffers in the file (enough to find the record batches and their columns).
+
+// Follows the offset at position.
+static const unsigned char *export_table(const unsigned char *position)
+{
+	uint32_t offset;
+	memcpy(&offset, position, sizeof(offset));
+	return position + offset;
+}
+
+// Returns the position of the field of the table or NULL if the field is not set.
+static const unsigned char *export_field(const unsigned char *table, size_t field)
+{
+	const unsigned char *vtable;
+	int32_t vtable_offset;
+	uint16_t vtable_size, offset;
+
+	memcpy(&vtable_offset, table, sizeof(vtable_offset));
+	vtable = table - vtable_offset;
+	memcpy(&vtable_size, vtable, sizeof(vtable_size));
+	if (2 * sizeof(uint16_t) + field * sizeof(uint16_t) >= vtable_size)
+		return 0;
+	memcpy(&offset, vtable + 2 * sizeof(uint16_t) + field * sizeof(uint16_t), sizeof(offset));
+	return (offset ? table + offset : 0);
+}
+
+static uint64_t export_u64(const unsigned char *position)
+{
+	uint64_t value;
+	memcpy(&value, position, sizeof(value));
+	return value;
+}
+
+static void test_export_arrow(void **state)
+{
+	static struct stream_file files[EXPORT_RECORDS];
+	static char paths[EXPORT_RECORDS][16];
+	static uint64_t expected[EXPORT_RECORDS];
+	char directory[] = "/tmp/check.XXXXXX";
+	char path[sizeof(directory) + 8];
+	const unsigned char *buffer, *footer, *batches;
+	struct search search;
+	struct export export;
+	struct stat info;
+	uint32_t batches_count;
+	int32_t footer_size;
+	size_t i, batch, exported = 0, count = 0;
+	FILE *file;
+	int fd;
+
+	assert_non_null(mkdtemp(directory));
+	sprintf(path, "%s/db", directory);
+	for(i = 0; i < EXPORT_RECORDS; ++i)
+	{
+		sprintf(paths[i], "/data/%05zu", i);
+		files[i].path = paths[i];
+		files[i].size = 1000000 + i;
+	}
+	stream_database(path, files, EXPORT_RECORDS);
+
+	// The last block has records replaced by delta segments so its records are exported one by one.
+	// The changed files are exported after the records.
+	path_directory(path, strlen(path));
+	delta_segment((const struct stream_file []){{paths[DB_BLOCK_RECORDS + 2], 0}, {paths[DB_BLOCK_RECORDS + 3], 7}}, 2);
+	path_directory(0, 0);
+	for(i = 0; i < EXPORT_RECORDS; ++i)
+		if ((i != DB_BLOCK_RECORDS + 2) && (i != DB_BLOCK_RECORDS + 3))
+			expected[count++] = files[i].size;
+	expected[count++] = 7; // the changed file is added after the records
+
+	file = tmpfile();
+	assert_non_null(file);
+	fd = dup(fileno(file));
+	fclose(file);
+
+	assert_int_equal(db_open_directory(&search, path), 0);
+	assert_int_equal(export_init(&export, fd), 0);
+	assert_int_equal(export_records(&export, &search, 0, search.columns.count), 0);
+	for(i = 0; i < search.deltas_entries; ++i)
+	{
+		struct file change;
+		const unsigned char *changed;
+		int status = db_delta(&search, i, &change, &changed);
+		if (status == ERROR_MISSING)
+			continue;
+		assert_int_equal(status, 0);
+		assert_int_equal(export_add(&export, changed, &change), 0);
+	}
+	assert_int_equal(export_finish(&export), 0);
+	db_close(&search);
+
+	assert_int_equal(fstat(fd, &info), 0);
+	buffer = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	assert_true(buffer != MAP_FAILED);
+
+	// The file starts and ends with the magic. The footer precedes its size at the end.
+	assert_memory_equal(buffer, "ARROW1\0\0", 8);
+	assert_memory_equal(buffer + info.st_size - 6, "ARROW1", 6);
+	memcpy(&footer_size, buffer + info.st_size - 6 - sizeof(footer_size), sizeof(footer_size));
+	assert_true((footer_size > 0) && (footer_size < info.st_size));
+	footer = export_table(buffer + info.st_size - 6 - sizeof(footer_size) - footer_size);
+
+	// Footer {version, schema, dictionaries, recordBatches}
+	batches = export_field(footer, 3);
+	assert_non_null(batches);
+	batches = export_table(batches);
+	memcpy(&batches_count, batches, sizeof(batches_count));
+	assert_int_equal(batches_count, 2);
+	batches += sizeof(uint32_t);
+
+	for(batch = 0; batch < batches_count; ++batch)
+	{
+		// Block {offset: long; metaDataLength: int; bodyLength: long;}
+		uint64_t offset = export_u64(batches + batch * 24), body = export_u64(batches + batch * 24 + 16);
+		int32_t metadata;
+		uint32_t prefix[2];
+		const unsigned char *message, *header, *buffers;
+		uint64_t length;
+
+		memcpy(&metadata, batches + batch * 24 + 8, sizeof(metadata));
+		assert_true(offset + metadata + body <= (uint64_t)info.st_size);
+		memcpy(prefix, buffer + offset, sizeof(prefix));
+		assert_int_equal(prefix[0], 0xffffffff);
+		assert_int_equal(prefix[1] + sizeof(prefix), metadata);
+
+		// Message {version, header_type, header, bodyLength}; RecordBatch {length, nodes, buffers}
+		message = export_table(buffer + offset + sizeof(prefix));
+		assert_int_equal(*export_field(message, 1), 3);
+		assert_int_equal(export_u64(export_field(message, 3)), body);
+		header = export_table(export_field(message, 2));
+		length = export_u64(export_field(header, 0));
+
+		// Buffer {offset: long; length: long;}: the size column is after the 3 buffers of the path column and its own validity buffer.
+		buffers = export_table(export_field(header, 2)) + sizeof(uint32_t);
+		assert_int_equal(export_u64(buffers + 4 * 16 + 8), length * sizeof(uint64_t));
+		assert_true(exported + length <= count);
+		assert_memory_equal(buffer + offset + metadata + export_u64(buffers + 4 * 16), expected + exported, length * sizeof(uint64_t));
+		exported += length;
+	}
+	assert_int_equal(exported, count);
+
+	munmap((void *)buffer, info.st_size);
+	close(fd);
+	stream_remove(directory, (const char *const []){"db"}, 1);
+}
@@ -0,0 +1,126 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <filter.h>
+
+// The kernels handle whole words and the scalar code handles the rest, so the counts cover both.
+static const size_t filter_counts[] = {1, 63, 64, 65, 200, FILTER_BLOCK};
+
+// Checks that the selection has exactly the records that were selected before and match.
+static void filter_compare(const uint64_t *restrict selection, const uint64_t *restrict before, const unsigned char *restrict match, size_t count)
+{
+	size_t i;
+
+	for(i = 0; i < count; ++i)
+		assert_int_equal((selection[i / 64] >> (i % 64)) & 1, ((before[i / 64] >> (i % 64)) & 1) & match[i]);
+	if (count % 64)
+		assert_int_equal(selection[count / 64] >> (count % 64), 0);
+}
+
+static void test_filter_range(void **state)
+{
+	static const uint64_t bounds[][2] = {{0, UINT64_MAX}, {100, 1000}, {(uint64_t)1 << 63, UINT64_MAX}, {5, 5}, {1000, 100}, {0, ((uint64_t)1 << 63) - 1}};
+	uint64_t *values = malloc(FILTER_BLOCK * sizeof(*values));
+	uint64_t selection[FILTER_WORDS(FILTER_BLOCK)], before[FILTER_WORDS(FILTER_BLOCK)];
+	unsigned char *match = malloc(FILTER_BLOCK);
+	uint64_t random = 0x2545f4914f6cdd1dULL;
+	size_t c, b, i;
+
+	// Small values, values around the bounds and values with the highest bit set (compared as signed by the kernels).
+	for(i = 0; i < FILTER_BLOCK; ++i)
+	{
+		uint64_t value = random64(&random);
+		switch (i % 4)
+		{
+		case 0:
+			values[i] = value % 2000;
+			break;
+		case 1:
+			values[i] = bounds[value % 6][value % 2] + (value >> 62) - 1;
+			break;
+		case 2:
+			values[i] = value | ((uint64_t)1 << 63);
+			break;
+		default:
+			values[i] = value;
+		}
+	}
+
+	for(c = 0; c < sizeof(filter_counts) / sizeof(*filter_counts); ++c)
+	{
+		size_t count = filter_counts[c];
+
+		for(b = 0; b < sizeof(bounds) / sizeof(*bounds); ++b)
+		{
+			uint64_t min = bounds[b][0], max = bounds[b][1];
+
+			filter_init(selection, count);
+			filter_skip(selection, count / 3); // records already rejected stay rejected
+			memcpy(before, selection, FILTER_WORDS(count) * sizeof(*selection));
+			for(i = 0; i < count; ++i)
+				match[i] = ((min <= values[i]) && (values[i] <= max));
+
+			filter_range(selection, values, count, min, max);
+			filter_compare(selection, before, match, count);
+		}
+	}
+
+	free(match);
+	free(values);
+}
+
+static void test_filter_any(void **state)
+{
+	static const uint16_t masks[] = {0x1, 0x10, 0x8000, 0xffff, 0x0, 0x0f0f};
+	uint16_t *values = malloc(FILTER_BLOCK * sizeof(*values));
+	uint64_t selection[FILTER_WORDS(FILTER_BLOCK)], before[FILTER_WORDS(FILTER_BLOCK)];
+	unsigned char *match = malloc(FILTER_BLOCK);
+	uint64_t random = 0x9e3779b97f4a7c15ULL;
+	size_t c, m, i;
+
+	for(i = 0; i < FILTER_BLOCK; ++i)
+	{
+		uint64_t value = random64(&random);
+		values[i] = ((i % 3) ? (uint16_t)1 << (value % 16) : (uint16_t)value);
+	}
+
+	for(c = 0; c < sizeof(filter_counts) / sizeof(*filter_counts); ++c)
+	{
+		size_t count = filter_counts[c];
+
+		for(m = 0; m < sizeof(masks) / sizeof(*masks); ++m)
+		{
+			filter_init(selection, count);
+			filter_skip(selection, count / 5);
+			memcpy(before, selection, FILTER_WORDS(count) * sizeof(*selection));
+			for(i = 0; i < count; ++i)
+				match[i] = !!(values[i] & masks[m]);
+
+			filter_any(selection, values, count, masks[m]);
+			filter_compare(selection, before, match, count);
+		}
+	}
+
+	free(match);
+	free(values);
+}
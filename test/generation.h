@@ -0,0 +1,105 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Creates the database in directory again with the given files.
+static void generation_update(const char *restrict directory, const struct stream_file *restrict files, size_t count)
+{
+	struct db db;
+	size_t i;
+
+	path_directory(directory, strlen(directory));
+	assert_int_equal(db_new(&db), 0);
+	for(i = 0; i < count; ++i)
+	{
+		struct file file = {0};
+		file.path_length = strlen(files[i].path);
+		file.size = files[i].size;
+		file.mtime = 1000;
+		assert_int_equal(db_add(&db, files[i].path, file.path_length, &file, 0), 0);
+	}
+	assert_int_equal(db_root(&db, "/data", 5, 0), 0);
+	assert_int_equal(db_persist(&db), 0);
+	path_directory(0, 0);
+}
+
+// Returns the generation of the record with the given path.
+static uint64_t generation_find(struct search *restrict search, const char *restrict path)
+{
+	size_t length = strlen(path);
+	size_t record;
+
+	for(record = 0; record < search->columns.count; ++record)
+	{
+		struct file file;
+		const unsigned char *found = db_path(search, record);
+
+		assert_non_null(found);
+		db_record(&file, search, record);
+		if ((file.path_length == length) && !memcmp(found, path, length))
+			return db_generation(search, record);
+	}
+
+	fail();
+	return 0;
+}
+
+static void test_generation_changed(void **state)
+{
+	static const struct stream_file files_first[] = {{"/data/a", 1}, {"/data/b", 2}, {"/data/c", 3}};
+	static const struct stream_file files_second[] = {{"/data/a", 1}, {"/data/b", 20}, {"/data/d", 4}};
+	static const struct stream_file files_third[] = {{"/data/a", 1}, {"/data/b", 20}, {"/data/c", 3}, {"/data/d", 4}};
+	char directory[] = "/tmp/check.XXXXXX";
+	char path[sizeof(directory) + 8];
+	struct search search;
+
+	assert_non_null(mkdtemp(directory));
+	sprintf(path, "%s/db", directory);
+
+	stream_database(path, files_first, sizeof(files_first) / sizeof(*files_first));
+	assert_int_equal(db_open_directory(&search, path), 0);
+	assert_int_equal(search.generation, 1);
+	assert_int_equal(generation_find(&search, "/data/a"), 1);
+	assert_int_equal(generation_find(&search, "/data/c"), 1);
+	db_close(&search);
+
+	// Unchanged files keep their generation. Changed and new files get the generation of the database.
+	generation_update(path, files_second, sizeof(files_second) / sizeof(*files_second));
+	assert_int_equal(db_open_directory(&search, path), 0);
+	assert_int_equal(search.generation, 2);
+	assert_int_equal(generation_find(&search, "/data/a"), 1);
+	assert_int_equal(generation_find(&search, "/data/b"), 2);
+	assert_int_equal(generation_find(&search, "/data/d"), 2);
+	db_close(&search);
+
+	// A file that was removed and added again is new.
+	generation_update(path, files_third, sizeof(files_third) / sizeof(*files_third));
+	assert_int_equal(db_open_directory(&search, path), 0);
+	assert_int_equal(search.generation, 3);
+	assert_int_equal(generation_find(&search, "/data/a"), 1);
+	assert_int_equal(generation_find(&search, "/data/b"), 2);
+	assert_int_equal(generation_find(&search, "/data/c"), 3);
+	assert_int_equal(generation_find(&search, "/data/d"), 2);
+	db_close(&search);
+
+	stream_remove(directory, (const char *const []){"db"}, 1);
+}
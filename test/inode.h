@@ -0,0 +1,82 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define INODE_RECORDS 3000
+
+static void test_inode_link(void **state)
+{
+	static struct inode files[INODE_RECORDS];
+	static uint64_t device[INODE_RECORDS], number[INODE_RECORDS], links[INODE_RECORDS];
+	static struct perfect_key keys[INODE_RECORDS];
+	struct inodes inodes;
+	uint64_t random = 0xa54ff53a5f1d36f1ULL;
+	size_t keys_count, distinct = 0;
+	size_t i, j, next;
+
+	// Few distinct inode numbers so that many records are hard links of the same file. The same number on another device is another file.
+	for(i = 0; i < INODE_RECORDS; ++i)
+	{
+		files[i].device = device[i] = 1 + random64(&random) % 2;
+		files[i].number = number[i] = random64(&random) % 1000;
+	}
+
+	keys_count = inodes_link(files, INODE_RECORDS, links, keys);
+	inodes.count = INODE_RECORDS;
+	inodes.device = device;
+	inodes.number = number;
+	inodes.link = links;
+	assert_int_equal(perfect_build(&inodes.perfect, keys, keys_count), 0);
+
+	for(i = 0; i < INODE_RECORDS; ++i)
+	{
+		size_t first = INODE_RECORDS;
+
+		for(j = 0; j < INODE_RECORDS; ++j)
+			if ((files[j].device == files[i].device) && (files[j].number == files[i].number))
+			{
+				first = j;
+				break;
+			}
+		distinct += (first == i);
+
+		// The records of the file are linked in ascending order starting from the first one.
+		assert_int_equal(inodes_find(&inodes, files + i), first);
+		next = first;
+		for(j = first; j < INODE_RECORDS; ++j)
+			if ((files[j].device == files[i].device) && (files[j].number == files[i].number))
+			{
+				assert_int_equal(next, j);
+				next = inodes_next(&inodes, next);
+			}
+		assert_int_equal(next, INODE_RECORDS);
+	}
+	assert_int_equal(keys_count, distinct);
+
+	// Files that are not in the index.
+	for(i = 0; i < 100; ++i)
+	{
+		struct inode missing = {3 + i, random64(&random)};
+		assert_int_equal(inodes_find(&inodes, &missing), INODE_RECORDS);
+	}
+
+	perfect_term(&inodes.perfect);
+}
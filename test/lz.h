@@ -0,0 +1,159 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <lz.h>
+
+// Compresses the data and checks that decompressing it gives the data back.
+static size_t roundtrip(const unsigned char *restrict data, size_t size, unsigned char *restrict compressed)
+{
+	unsigned char *restored = malloc(size + 1);
+	size_t compressed_size;
+	ssize_t restored_size;
+
+	compressed_size = lz_compress(compressed, data, size);
+	assert_true(compressed_size <= LZ_BOUND(size));
+
+	restored_size = lz_decompress(restored, size, compressed, compressed_size);
+	assert_int_equal(restored_size, size);
+	assert_memory_equal(restored, data, size);
+
+	free(restored);
+	return compressed_size;
+}
+
+static void test_lz_empty(void **state)
+{
+	unsigned char compressed[LZ_BOUND(0)];
+	unsigned char restored[1];
+
+	assert_int_equal(roundtrip((const unsigned char *)"", 0, compressed), 1);
+	assert_int_equal(lz_decompress(restored, sizeof(restored), compressed, 1), 0);
+}
+
+static void test_lz_incompressible(void **state)
+{
+	size_t size = 65536 * 3;
+	unsigned char *data = malloc(size);
+	unsigned char *compressed = malloc(LZ_BOUND(size));
+	uint64_t value = 0x9e3779b97f4a7c15ULL;
+	size_t i;
+
+	// Pseudo-random bytes (xorshift) have no matches.
+	for(i = 0; i < size; ++i)
+	{
+		value ^= value << 13;
+		value ^= value >> 7;
+		value ^= value << 17;
+		data[i] = value >> 56;
+	}
+	assert_true(roundtrip(data, size, compressed) > size);
+
+	free(compressed);
+	free(data);
+}
+
+static void test_lz_runs(void **state)
+{
+	size_t size = 100000;
+	unsigned char *data = malloc(size);
+	unsigned char *compressed = malloc(LZ_BOUND(size));
+	size_t i;
+
+	// A run of one byte is encoded as a match overlapping the bytes it produces (offset 1).
+	memset(data, 'a', size);
+	assert_true(roundtrip(data, size, compressed) < size / 100);
+
+	// Short repeated patterns overlap with offsets smaller than the match.
+	for(i = 0; i < size; ++i)
+		data[i] = "abc"[i % 3];
+	assert_true(roundtrip(data, size, compressed) < size / 100);
+
+	// Paths with long common prefixes, as stored in the database.
+	for(i = 0; i + 32 <= size; i += 32)
+		memcpy(data + i, "/home/user/projects/source/0123/", 32);
+	assert_true(roundtrip(data, i, compressed) < i / 10);
+
+	free(compressed);
+	free(data);
+}
+
+static void test_lz_limit(void **state)
+{
+	size_t size = 4096;
+	unsigned char data[4096];
+	unsigned char compressed[LZ_BOUND(4096)];
+	unsigned char restored[4096];
+	size_t compressed_size;
+	size_t i;
+
+	for(i = 0; i < size; ++i)
+		data[i] = "/usr/include/"[i % 13];
+	compressed_size = lz_compress(compressed, data, size);
+
+	// Decompression stops when the limit is reached.
+	assert_int_equal(lz_decompress(restored, 100, compressed, compressed_size), 100);
+	assert_memory_equal(restored, data, 100);
+}
+
+// Finds the position of the match offset of the first sequence.
+static size_t offset_position(const unsigned char *compressed)
+{
+	size_t position = 1;
+	size_t length = compressed[0] >> 4;
+
+	if (length == 15)
+		do length += compressed[position];
+		while (compressed[position++] == 255);
+	return position + length;
+}
+
+static void test_lz_invalid(void **state)
+{
+	size_t size = 4096;
+	unsigned char data[4096];
+	unsigned char compressed[LZ_BOUND(4096)];
+	unsigned char restored[4096];
+	size_t compressed_size, offset;
+	size_t i;
+
+	for(i = 0; i < size; ++i)
+		data[i] = "/usr/include/linux/"[i % 19];
+	compressed_size = lz_compress(compressed, data, size);
+	offset = offset_position(compressed);
+	assert_true(offset + 2 < compressed_size);
+
+	// The first sequence is cut in its literals or in its match offset.
+	assert_int_equal(lz_decompress(restored, size, compressed, offset - 1), ERROR_INPUT);
+	assert_int_equal(lz_decompress(restored, size, compressed, offset + 1), ERROR_INPUT);
+
+	// The length of the literals continues past the end.
+	assert_int_equal(lz_decompress(restored, size, (const unsigned char *)"\xf0\xff", 2), ERROR_INPUT);
+
+	// The match offset is 0 or points before the beginning of the output.
+	assert_int_equal(lz_decompress(restored, size, (const unsigned char *)"\x10" "a" "\x00\x00", 4), ERROR_INPUT);
+	assert_int_equal(lz_decompress(restored, size, (const unsigned char *)"\x10" "a" "\x02\x00", 4), ERROR_INPUT);
+	compressed[offset] = 0xff;
+	compressed[offset + 1] = 0xff;
+	assert_int_equal(lz_decompress(restored, size, compressed, compressed_size), ERROR_INPUT);
+}
@@ -0,0 +1,111 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <map.h>
+
+static void test_map_advise(void **state)
+{
+	static const enum access accesses[] = {ACCESS_SEQUENTIAL, ACCESS_RANDOM, ACCESS_RESIDENT, ACCESS_DEFAULT};
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t size = 5 * page + 100, pages = 6;
+	unsigned char *content = malloc(size);
+	unsigned char *residency = malloc(pages);
+	unsigned char *buffer;
+	FILE *file = tmpfile();
+	size_t i;
+
+	assert_non_null(file);
+	for(i = 0; i < size; ++i)
+		content[i] = i * 7;
+	assert_int_equal(fwrite(content, 1, size, file), size);
+	assert_int_equal(fflush(file), 0);
+	buffer = mmap(0, size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+	assert_true(buffer != MAP_FAILED);
+
+	// The hints don't change the content.
+	for(i = 0; i < sizeof(accesses) / sizeof(*accesses); ++i)
+	{
+		map_advise(buffer, size, accesses[i]);
+		assert_memory_equal(buffer, content, size);
+#if defined(MADV_POPULATE_READ)
+		if (accesses[i] == ACCESS_RESIDENT)
+		{
+			size_t j;
+			assert_int_equal(mincore(buffer, size, residency), 0);
+			for(j = 0; j < pages; ++j)
+				assert_true(residency[j] & 1);
+		}
+#endif
+	}
+
+	// Sections that don't start at a page boundary or go past the end of the mapping.
+	map_prefetch(buffer, size, page + 10, 2 * page);
+	map_prefetch(buffer, size, 4 * page + 50, 10 * page);
+	map_prefetch(buffer, size, size, page);
+	map_prefetch(buffer, size, 0, 0);
+	map_prefetch(0, 0, 0, page);
+	map_advise(0, 0, ACCESS_RESIDENT);
+	assert_memory_equal(buffer, content, size);
+
+	munmap(buffer, size);
+	fclose(file);
+	free(residency);
+	free(content);
+}
+
+static void test_map_sections(void **state)
+{
+	static const struct stream_file files[] = {{"/data/a", 1}, {"/data/b", 2}, {"/data/c", 3}};
+	static const unsigned use[] = {DB_USE_SCAN, DB_USE_LOOKUP, DB_USE_RESIDENT};
+	char directory[] = "/tmp/check.XXXXXX";
+	char path[sizeof(directory) + 8];
+	struct search search;
+	struct file file;
+	size_t i;
+
+	assert_non_null(mkdtemp(directory));
+	sprintf(path, "%s/db", directory);
+	stream_database(path, files, sizeof(files) / sizeof(*files));
+
+	// Each section starts at a page boundary (of 4096 bytes) so that it can be given its own hints.
+	assert_int_equal(db_open_directory(&search, path), 0);
+	assert_non_null(search.container_buffer);
+	assert_int_equal(((uintptr_t)search.container_buffer) % 4096, 0);
+	assert_int_equal(((uintptr_t)search.columns_buffer) % 4096, 0);
+	assert_int_equal(((uintptr_t)search.index_buffer) % 4096, 0);
+	assert_int_equal(((uintptr_t)search.roots_buffer) % 4096, 0);
+	assert_int_equal(((uintptr_t)search.aggregate_buffer) % 4096, 0);
+
+	for(i = 0; i < sizeof(use) / sizeof(*use); ++i)
+	{
+		db_advise(&search, use[i]);
+		db_prefetch(&search, 0, search.columns.count);
+		assert_int_equal(db_find_fileinfo(&file, "/data/b", 7, &search), 0);
+		assert_int_equal(file.size, 2);
+	}
+	db_close(&search);
+
+	stream_remove(directory, (const char *const []){"db"}, 1);
+}
@@ -0,0 +1,124 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <magic.h>
+
+// Returns a temporary file with the given content.
+static int media_file(const unsigned char *restrict data, size_t size)
+{
+	FILE *file = tmpfile();
+	int fd;
+
+	assert_non_null(file);
+	fd = dup(fileno(file));
+	fclose(file);
+	assert_int_equal(write(fd, data, size), size);
+	return fd;
+}
+
+static void test_media_image(void **state)
+{
+	static const unsigned char png[] = "\x89PNG\r\n\x1a\n" "\0\0\0\x0d" "IHDR" "\0\0\x02\x80" "\0\0\x01\xe0" "\x08\x02\0\0\0";
+	static const unsigned char gif[] = "GIF89a" "\x40\x01" "\xc8\x00" "\0\0\0";
+	static const unsigned char bmp[] = "BM" "\0\0\0\0" "\0\0\0\0" "\0\0\0\0" "\x28\0\0\0" "\x20\0\0\0" "\xf0\xff\xff\xff"; // top-down rows
+	static const unsigned char jpeg[] = "\xff\xd8" "\xff\xe0\x00\x04\0\0" "\xff\xff" "\xff\xc0\x00\x0b\x08\x00\x78\x00\xa0\x01\x01\x11\x00";
+	struct media media;
+	int fd;
+
+	fd = media_file(png, sizeof(png) - 1);
+	assert_int_equal(media_parse(&media, fd, TYPE_PNG), 0);
+	assert_int_equal(media.width, 640);
+	assert_int_equal(media.height, 480);
+	assert_string_equal(media.codec, "png");
+	close(fd);
+
+	fd = media_file(gif, sizeof(gif) - 1);
+	assert_int_equal(media_parse(&media, fd, TYPE_GIF), 0);
+	assert_int_equal(media.width, 320);
+	assert_int_equal(media.height, 200);
+	close(fd);
+
+	fd = media_file(bmp, sizeof(bmp) - 1);
+	assert_int_equal(media_parse(&media, fd, TYPE_BMP), 0);
+	assert_int_equal(media.width, 32);
+	assert_int_equal(media.height, 16);
+	close(fd);
+
+	// The frame follows another segment and a fill byte.
+	fd = media_file(jpeg, sizeof(jpeg) - 1);
+	assert_int_equal(media_parse(&media, fd, TYPE_JPEG), 0);
+	assert_int_equal(media.width, 160);
+	assert_int_equal(media.height, 120);
+	assert_string_equal(media.codec, "jpeg");
+	close(fd);
+}
+
+static void test_media_audio(void **state)
+{
+	// 44100 samples per second, 2 channels, 16 bits; 2 seconds of data.
+	static const unsigned char wave[] = "RIFF" "\0\0\0\0" "WAVE"
+		"LIST" "\x03\0\0\0" "abc\0" // odd-sized chunk with padding
+		"fmt " "\x10\0\0\0" "\x01\0" "\x02\0" "\x44\xac\0\0" "\x10\xb1\x02\0" "\x04\0" "\x10\0"
+		"data" "\x20\x62\x05\0";
+	struct media media;
+	int fd;
+
+	fd = media_file(wave, sizeof(wave) - 1);
+	assert_int_equal(media_parse(&media, fd, TYPE_WAVE), 0);
+	assert_int_equal(media.rate, 44100);
+	assert_int_equal(media.duration, 2000);
+	assert_string_equal(media.codec, "pcm");
+	assert_int_equal(media.width, 0);
+	close(fd);
+}
+
+static void test_media_invalid(void **state)
+{
+	static const unsigned char png[] = "\x89PNG\r\n\x1a\n" "\0\0\0\x0d" "IHDR" "\0\0"; // truncated
+	static const unsigned char jpeg[] = "\xff\xd8" "\xff\xda\x00\x02"; // no frame before the scan
+	struct media media;
+	int fd;
+
+	fd = media_file(png, sizeof(png) - 1);
+	assert_int_equal(media_parse(&media, fd, TYPE_PNG), ERROR_INPUT);
+	assert_int_equal(media_parse(&media, fd, TYPE_ZIP), ERROR_UNSUPPORTED);
+	close(fd);
+
+	fd = media_file(jpeg, sizeof(jpeg) - 1);
+	assert_int_equal(media_parse(&media, fd, TYPE_JPEG), ERROR_MISSING);
+	close(fd);
+}
+
+static void test_media_find(void **state)
+{
+	static const uint64_t records[] = {2, 5, 9};
+	static const struct media media[] = {{1, 1}, {2, 2}, {3, 3}};
+	struct media_index index = {3, records, media};
+
+	assert_ptr_equal(media_find(&index, 5), media + 1);
+	assert_ptr_equal(media_find(&index, 9), media + 2);
+	assert_null(media_find(&index, 0));
+	assert_null(media_find(&index, 6));
+	assert_null(media_find(&index, 10));
+}
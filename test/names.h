@@ -0,0 +1,86 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NAMES_RECORDS 3000
+#define NAMES_LENGTH 8
+
+static void test_names_search(void **state)
+{
+	static unsigned char names[NAMES_RECORDS][NAMES_LENGTH];
+	size_t lengths[NAMES_RECORDS];
+	struct names builder = {0};
+	struct names_index index;
+	uint64_t *offsets;
+	unsigned char *data;
+	size_t blocks, size;
+	uint64_t random = 0xda3e39cb94b95bdbULL;
+	size_t query, i, j;
+
+	// Names from a small alphabet so that many of them are repeated or share a prefix (across several blocks).
+	for(i = 0; i < NAMES_RECORDS; ++i)
+	{
+		lengths[i] = 1 + random64(&random) % NAMES_LENGTH;
+		for(j = 0; j < lengths[i]; ++j)
+			names[i][j] = "ab."[random64(&random) % 3];
+		names_add(&builder, names[i], lengths[i], i);
+	}
+	assert_int_equal(names_build(&builder, &index.count, &offsets, &blocks, &data, &size), 0);
+	assert_int_equal(blocks, (index.count + NAMES_BLOCK - 1) / NAMES_BLOCK);
+	index.blocks = blocks;
+	index.offsets = offsets;
+	index.data = data;
+
+	for(query = 0; query < 400; ++query)
+	{
+		int exact = query % 2;
+		unsigned char prefix[NAMES_LENGTH + 1];
+		size_t length;
+		uint64_t *records;
+		ssize_t found;
+		size_t expected = 0;
+
+		// Use (a prefix of) an existing name or a name that does not exist.
+		i = random64(&random) % NAMES_RECORDS;
+		length = random64(&random) % (lengths[i] + 1);
+		memcpy(prefix, names[i], length);
+		if (query % 7 == 0)
+			prefix[length++] = 'z';
+
+		found = names_search(&index, prefix, length, exact, &records);
+		assert_true(found >= 0);
+		for(i = 0; i < NAMES_RECORDS; ++i)
+		{
+			if ((lengths[i] < length) || (exact && (lengths[i] != length)) || memcmp(names[i], prefix, length))
+				continue;
+			assert_true(expected < (size_t)found);
+			assert_int_equal(records[expected], i);
+			expected += 1;
+		}
+		assert_int_equal(found, expected);
+		free(records);
+	}
+
+	free(data);
+	free(offsets);
+	names_term(&builder);
+}
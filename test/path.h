@@ -30,11 +30,33 @@ char *__wrap_getcwd(char *buf, size_t size)
 	return (char *)mock();
 }
 
+// free() is checked only in the tests of normalize(). The other tests use the real one.
+static int free_mocked = 0;
+
+void __real_free(void *ptr);
+
 void __wrap_free(void *ptr)
 {
+	if (!free_mocked)
+	{
+		__real_free(ptr);
+		return;
+	}
 	check_expected(ptr);
 }
 
+static int free_mock(void **state)
+{
+	free_mocked = 1;
+	return 0;
+}
+
+static int free_unmock(void **state)
+{
+	free_mocked = 0;
+	return 0;
+}
+
 static void check(const struct bytes *restrict relative, const struct bytes *restrict answer)
 {
 	char path[3][PATH_SIZE_LIMIT];
@@ -0,0 +1,101 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+static uint64_t random64(uint64_t *restrict state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state;
+}
+
+// Builds the table for count keys with random hashes and checks that each key is found in its own slot.
+static void perfect_check(size_t count)
+{
+	struct perfect perfect;
+	struct perfect_key *keys = malloc((count + 1) * sizeof(*keys));
+	unsigned char *used = calloc(count + 1, 1);
+	uint64_t state = 0x9e3779b97f4a7c15ULL + count;
+	size_t i;
+
+	for(i = 0; i < count; ++i)
+	{
+		keys[i].hash = random64(&state);
+		keys[i].record = i;
+	}
+	assert_int_equal(perfect_build(&perfect, keys, count), 0);
+	assert_int_equal(perfect.count, count);
+
+	for(i = 0; i < count; ++i)
+	{
+		const struct perfect_slot *slot = perfect_find(&perfect, keys[i].hash);
+		assert_non_null(slot);
+		assert_int_equal(slot->record, i);
+		assert_true(slot >= perfect.slots);
+		assert_true(slot < perfect.slots + count);
+		assert_false(used[slot - perfect.slots]);
+		used[slot - perfect.slots] = 1;
+	}
+
+	// A missing key is rejected by the fingerprint or by comparing with the key of the record in its slot.
+	for(i = 0; i < count; ++i)
+	{
+		uint64_t hash = random64(&state);
+		const struct perfect_slot *slot = perfect_find(&perfect, hash);
+		if (slot)
+			assert_int_not_equal(keys[slot->record].hash, hash);
+	}
+
+	perfect_term(&perfect);
+	free(used);
+	free(keys);
+}
+
+static void test_perfect_small(void **state)
+{
+	perfect_check(1);
+	perfect_check(2);
+	perfect_check(49);
+}
+
+static void test_perfect_large(void **state)
+{
+	perfect_check(100000);
+}
+
+static void test_perfect_empty(void **state)
+{
+	struct perfect perfect;
+
+	assert_int_equal(perfect_build(&perfect, 0, 0), 0);
+	assert_null(perfect_find(&perfect, 0x1234));
+	perfect_term(&perfect);
+}
+
+static void test_perfect_duplicate(void **state)
+{
+	struct perfect perfect;
+	struct perfect_key keys[] = {{0x1111, 0}, {0x2222, 1}, {0x1111, 2}};
+
+	// Two keys with the same hash can't be told apart.
+	assert_int_equal(perfect_build(&perfect, keys, 3), ERROR_EXIST);
+}
@@ -0,0 +1,137 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <permission.h>
+
+static int permission_path(struct permission *restrict permission, const char *restrict path)
+{
+	return permission_check(permission, (const unsigned char *)path, strlen(path));
+}
+
+static void test_permission_root(void **state)
+{
+	struct permission permission;
+
+	permission_init(&permission);
+	assert_true(permission_path(&permission, "/file"));
+	assert_false(permission_path(&permission, "file")); // not an absolute path
+	permission_term(&permission);
+}
+
+static void test_permission_allowed(void **state)
+{
+	struct permission permission;
+	char directory[] = "/tmp/permission.XXXXXX";
+	char path[sizeof(directory) + 5];
+
+	assert_non_null(mkdtemp(directory));
+	sprintf(path, "%s/file", directory);
+
+	permission_init(&permission);
+	assert_true(permission_path(&permission, path));
+	assert_true(permission_path(&permission, path)); // cached
+	permission_term(&permission);
+
+	rmdir(directory);
+}
+
+static void test_permission_denied(void **state)
+{
+	struct permission permission;
+	char directory[] = "/tmp/permission.XXXXXX";
+	char path[sizeof(directory) + 5];
+
+	assert_non_null(mkdtemp(directory));
+	sprintf(path, "%s/file", directory);
+
+	permission_init(&permission);
+
+	// The user can't list a directory that doesn't exist.
+	assert_false(permission_path(&permission, "/nonexistent/directory/file"));
+
+	// The superuser can list any directory.
+	if (geteuid())
+	{
+		assert_int_equal(chmod(directory, 0), 0);
+		assert_false(permission_path(&permission, path));
+	}
+
+	permission_term(&permission);
+	rmdir(directory);
+}
+
+static void test_permission_grow(void **state)
+{
+	struct permission permission;
+	char directory[] = "/tmp/permission.XXXXXX";
+	char path[PATH_SIZE_LIMIT];
+	size_t capacity, count, i;
+
+	assert_non_null(mkdtemp(directory));
+	sprintf(path, "%s/file", directory);
+
+	permission_init(&permission);
+	capacity = permission.capacity;
+	assert_true(permission_path(&permission, path));
+
+	// The result is cached so removing the directory doesn't change it.
+	rmdir(directory);
+	for(i = 0; i < capacity; ++i)
+	{
+		sprintf(path, "/nonexistent/%zu/file", i);
+		assert_false(permission_path(&permission, path));
+	}
+	assert_true(permission.capacity > capacity);
+	assert_int_equal(permission.count, capacity + 1);
+
+	count = permission.count;
+	sprintf(path, "%s/file", directory);
+	assert_true(permission_path(&permission, path));
+	assert_int_equal(permission.count, count);
+
+	permission_term(&permission);
+}
+
+static void test_permission_read(void **state)
+{
+	char path[] = "/tmp/permission.XXXXXX";
+	int fd;
+
+	fd = mkstemp(path);
+	assert_true(fd >= 0);
+	close(fd);
+
+	assert_true(permission_read((const unsigned char *)path, strlen(path)));
+
+	// The superuser can read any file.
+	if (geteuid())
+	{
+		assert_int_equal(chmod(path, 0), 0);
+		assert_false(permission_read((const unsigned char *)path, strlen(path)));
+	}
+
+	unlink(path);
+	assert_false(permission_read((const unsigned char *)path, strlen(path)));
+}
@@ -0,0 +1,99 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <pattern.h>
+#include <query.h>
+
+// Checks that the saved search has the records matching its arguments.
+static void saved_check(struct search *restrict search, const char *restrict name, char *const arguments[], size_t count, size_t expected)
+{
+	struct query query;
+	struct saved saved;
+	size_t record, found = 0;
+
+	assert_int_equal(query_parse(&query, arguments, count), 0);
+	assert_int_equal(db_saved(search, name, &saved), 0);
+	assert_string_equal(saved.definition, name);
+
+	for(record = 0; record < search->columns.count; ++record)
+	{
+		struct file file;
+		const unsigned char *path = db_path(search, record);
+
+		assert_non_null(path);
+		db_record(&file, search, record);
+		if (!query_match(&query, path, &file))
+			continue;
+		assert_true(found < saved.count);
+		assert_int_equal(saved.records[found], record);
+		found += 1;
+	}
+	assert_int_equal(saved.count, found);
+	assert_int_equal(found, expected);
+}
+
+static void test_saved_update(void **state)
+{
+	static const struct stream_file files_first[] = {{"/data/a.txt", 1}, {"/data/b.log", 2}, {"/data/c.txt", 300}, {"/data/d.txt", 5}};
+	static const struct stream_file files_second[] = {{"/data/a.txt", 150}, {"/data/b.log", 2}, {"/data/c.txt", 3}, {"/data/e.txt", 4}, {"/data/f.txt", 6}};
+	static char *const small[] = {"/data", "-size", "-100c", "-name", "*.txt"};
+	static char *const logs[] = {"/data", "-name", "*.log"};
+	char directory[] = "/tmp/check.XXXXXX";
+	char path[sizeof(directory) + 8];
+	struct search search;
+	struct saved saved;
+
+	assert_non_null(mkdtemp(directory));
+	sprintf(path, "%s/db", directory);
+	stream_database(path, files_first, sizeof(files_first) / sizeof(*files_first));
+
+	// The results are computed when the search is saved.
+	path_directory(path, strlen(path));
+	assert_int_equal(db_save("small", small, sizeof(small) / sizeof(*small)), 0);
+	assert_int_equal(db_save("logs", logs, sizeof(logs) / sizeof(*logs)), 0);
+	assert_int_equal(db_save("invalid", (char *const []){"/data", "-size"}, 2), ERROR_INPUT);
+	path_directory(0, 0);
+
+	assert_int_equal(db_open_directory(&search, path), 0);
+	saved_check(&search, "small", small, sizeof(small) / sizeof(*small), 2);
+	saved_check(&search, "logs", logs, sizeof(logs) / sizeof(*logs), 1);
+	assert_int_equal(db_saved(&search, "invalid", &saved), ERROR_MISSING);
+	db_close(&search);
+
+	// The results are updated when the database is created again.
+	generation_update(path, files_second, sizeof(files_second) / sizeof(*files_second));
+	assert_int_equal(db_open_directory(&search, path), 0);
+	saved_check(&search, "small", small, sizeof(small) / sizeof(*small), 3);
+	saved_check(&search, "logs", logs, sizeof(logs) / sizeof(*logs), 1);
+	db_close(&search);
+
+	path_directory(path, strlen(path));
+	assert_int_equal(db_forget("small"), 0);
+	path_directory(0, 0);
+	assert_int_equal(db_open_directory(&search, path), 0);
+	assert_int_equal(db_saved(&search, "small", &saved), ERROR_MISSING);
+	saved_check(&search, "logs", logs, sizeof(logs) / sizeof(*logs), 1);
+	db_close(&search);
+
+	stream_remove(directory, (const char *const []){"db"}, 1);
+}
@@ -0,0 +1,82 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// Adds a shard for root to the manifest. Returns the directory of its database in result.
+static int shard_new(const char *restrict root, const char *restrict directory, char *restrict result)
+{
+	size_t length;
+	int lock = db_shard(root, strlen(root), directory, (directory ? strlen(directory) : 0), result, &length);
+	if (lock < 0)
+		return lock;
+	result[length] = 0;
+	assert_int_equal(db_shard_add(lock, root, strlen(root), result, length), 0);
+	return 0;
+}
+
+static void test_shard_overlap(void **state)
+{
+	static const struct stream_file files[] = {{"/data/a", 1}};
+	char directory[] = "/tmp/check.XXXXXX";
+	char database[sizeof(directory) + 8];
+	char first[PATH_SIZE_LIMIT], second[PATH_SIZE_LIMIT], result[PATH_SIZE_LIMIT];
+	struct shards shards;
+
+	assert_non_null(mkdtemp(directory));
+	sprintf(database, "%s/db", directory);
+	stream_database(database, files, sizeof(files) / sizeof(*files));
+	path_directory(database, strlen(database));
+
+	// A shard can't overlap the root of the database.
+	assert_int_equal(shard_new("/data/sub", 0, result), ERROR_EXIST);
+	assert_int_equal(shard_new("/", 0, result), ERROR_EXIST);
+
+	// Each shard gets a directory of its own next to the manifest.
+	assert_int_equal(shard_new("/dat", 0, first), 0);
+	assert_int_equal(shard_new("/other", 0, second), 0);
+	assert_int_equal(strncmp(first, database, strlen(database)), 0);
+	assert_int_equal(strncmp(second, database, strlen(database)), 0);
+	assert_int_not_equal(strcmp(first, second), 0);
+
+	// A shard can't overlap another shard.
+	assert_int_equal(shard_new("/other/sub", 0, result), ERROR_EXIST);
+	assert_int_equal(shard_new("/dat/sub", 0, result), ERROR_EXIST);
+
+	// Indexing the root of a shard again uses the same directory. Another shard can't use a directory already used.
+	assert_int_equal(shard_new("/other", 0, result), 0);
+	assert_string_equal(result, second);
+	assert_int_equal(shard_new("/new", database, result), ERROR_EXIST);
+	assert_int_equal(shard_new("/new", first, result), ERROR_EXIST);
+
+	// The database can't be created for a root overlapping a shard.
+	assert_int_equal(db_shards_check("/other/sub", 10), ERROR_EXIST);
+	assert_int_equal(db_shards_check("/", 1), ERROR_EXIST);
+	assert_int_equal(db_shards_check("/data", 5), 0);
+	assert_int_equal(db_shards_check("/othe", 5), 0);
+
+	assert_int_equal(db_shards_open(&shards), 0);
+	assert_int_equal(shards.count, 2);
+	db_shards_close(&shards);
+
+	path_directory(0, 0);
+	stream_remove(directory, (const char *const []){"db"}, 1);
+}
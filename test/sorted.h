@@ -0,0 +1,112 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define SORTED_RECORDS 5000
+
+static void test_sorted_search(void **state)
+{
+	static uint64_t values[SORTED_RECORDS];
+	static struct sorted_entry entries[SORTED_RECORDS];
+	uint64_t random = 0x6a09e667f3bcc908ULL;
+	size_t query, i, expected;
+
+	// Repeated small values, values that differ only in the high bits and the extremes.
+	for(i = 0; i < SORTED_RECORDS; ++i)
+	{
+		uint64_t value = random64(&random);
+		switch (i % 4)
+		{
+		case 0:
+			values[i] = value % 100;
+			break;
+		case 1:
+			values[i] = (value % 8) << 48;
+			break;
+		case 2:
+			values[i] = ((value % 2) ? UINT64_MAX : 0);
+			break;
+		default:
+			values[i] = value;
+		}
+	}
+	sorted_init(entries, values, SORTED_RECORDS);
+
+	// The entries are sorted by value, then by record.
+	for(i = 0; i < SORTED_RECORDS; ++i)
+	{
+		assert_int_equal(entries[i].key, values[entries[i].record]);
+		if (i)
+			assert_true((entries[i - 1].key < entries[i].key) || ((entries[i - 1].key == entries[i].key) && (entries[i - 1].record < entries[i].record)));
+	}
+
+	for(query = 0; query < 300; ++query)
+	{
+		uint64_t min = values[random64(&random) % SORTED_RECORDS], max = values[random64(&random) % SORTED_RECORDS];
+		uint64_t *records;
+		ssize_t found;
+
+		if (query % 5 == 0)
+			min += 1; // bounds that are not values of any record
+		if (query % 7 == 0)
+			max = UINT64_MAX;
+
+		found = sorted_search(entries, SORTED_RECORDS, min, max, &records);
+		assert_true(found >= 0);
+		assert_int_equal(sorted_count(entries, SORTED_RECORDS, min, max), found);
+
+		expected = 0;
+		for(i = 0; i < SORTED_RECORDS; ++i)
+		{
+			if ((values[i] < min) || (max < values[i]))
+				continue;
+			assert_true(expected < (size_t)found);
+			assert_int_equal(records[expected], i);
+			expected += 1;
+		}
+		assert_int_equal(found, expected);
+		free(records);
+	}
+}
+
+static void test_sorted_records(void **state)
+{
+	static uint64_t records[SORTED_RECORDS];
+	uint64_t random = 0xbb67ae8584caa73bULL;
+	uint64_t sum = 0;
+	size_t i;
+
+	for(i = 0; i < SORTED_RECORDS; ++i)
+	{
+		records[i] = random64(&random) >> ((i % 3) * 20);
+		sum ^= records[i];
+	}
+	sorted_records(records, SORTED_RECORDS);
+	for(i = 0; i < SORTED_RECORDS; ++i)
+	{
+		if (i)
+			assert_true(records[i - 1] <= records[i]);
+		sum ^= records[i];
+	}
+	assert_int_equal(sum, 0);
+
+	sorted_records(records, 0);
+}
@@ -0,0 +1,225 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <db.h>
+#include <stream.h>
+
+struct stream_file
+{
+	const char *path;
+	uint64_t size;
+};
+
+// Removes the database directories created by the test.
+static void stream_remove(const char *restrict directory, const char *const names[], size_t count)
+{
+	char path[PATH_SIZE_LIMIT];
+	size_t i;
+
+	for(i = 0; i < count; ++i)
+	{
+		DIR *dir;
+		struct dirent *entry;
+
+		sprintf(path, "%s/%s", directory, names[i]);
+		dir = opendir(path);
+		assert_non_null(dir);
+		while (entry = readdir(dir))
+		{
+			if (entry->d_name[0] == '.')
+				continue;
+			sprintf(path, "%s/%s/%s", directory, names[i], entry->d_name);
+			assert_int_equal(unlink(path), 0);
+		}
+		closedir(dir);
+		sprintf(path, "%s/%s", directory, names[i]);
+		assert_int_equal(rmdir(path), 0);
+	}
+	assert_int_equal(rmdir(directory), 0);
+}
+
+// Creates a database in directory with the given files under /data.
+static void stream_database(const char *restrict directory, const struct stream_file *restrict files, size_t count)
+{
+	struct db db;
+	size_t i;
+
+	assert_int_equal(mkdir(directory, 0700), 0);
+	path_directory(directory, strlen(directory));
+	assert_int_equal(db_new(&db), 0);
+	for(i = 0; i < count; ++i)
+	{
+		struct file file = {0};
+		file.path_length = strlen(files[i].path);
+		file.size = files[i].size;
+		file.mtime = 1000;
+		assert_int_equal(db_add(&db, files[i].path, file.path_length, &file, 0), 0);
+	}
+	assert_int_equal(db_root(&db, "/data", 5, 0), 0);
+	assert_int_equal(db_persist(&db), 0);
+	path_directory(0, 0);
+}
+
+static int stream_apply(unsigned change, const unsigned char *restrict path, const struct file *restrict file, void *argument)
+{
+	if (change == DB_DIFF_REMOVED)
+		return db_delta_remove(argument, (const char *)path, file->path_length);
+	else
+		return db_delta_add(argument, (const char *)path, file->path_length, file);
+}
+
+static int stream_count(unsigned change, const unsigned char *restrict path, const struct file *restrict file, void *argument)
+{
+	*(size_t *)argument += 1;
+	return 0;
+}
+
+// Writes to a temporary file the changes from the database in base to the database in current.
+static int stream_changes(const char *restrict base, const char *restrict current)
+{
+	struct search old, new;
+	FILE *stream = tmpfile();
+	int fd;
+
+	assert_non_null(stream);
+	fd = dup(fileno(stream));
+	fclose(stream);
+
+	assert_int_equal(db_open_directory(&old, base), 0);
+	assert_int_equal(db_open_directory(&new, current), 0);
+	assert_int_equal(stream_write(fd, &old, &new), 0);
+	db_close(&new);
+	db_close(&old);
+
+	return fd;
+}
+
+static void test_stream_apply(void **state)
+{
+	static const struct stream_file files_base[] = {{"/data/a", 1}, {"/data/b", 2}, {"/data/c", 3}};
+	static const struct stream_file files_current[] = {{"/data/a", 10}, {"/data/c", 3}, {"/data/d", 4}};
+	char directory[] = "/tmp/check.XXXXXX";
+	char base[sizeof(directory) + 8], current[sizeof(directory) + 8], copy[sizeof(directory) + 8];
+	struct search old, new;
+	struct delta delta;
+	uint64_t generation;
+	size_t changes = 0;
+	int fd;
+
+	assert_non_null(mkdtemp(directory));
+	sprintf(base, "%s/base", directory);
+	sprintf(current, "%s/current", directory);
+	sprintf(copy, "%s/copy", directory);
+
+	stream_database(base, files_base, sizeof(files_base) / sizeof(*files_base));
+	stream_database(current, files_current, sizeof(files_current) / sizeof(*files_current));
+	stream_database(copy, files_base, sizeof(files_base) / sizeof(*files_base));
+
+	fd = stream_changes(base, current);
+
+	// Apply the changes to the copy of the base database.
+	assert_int_equal(lseek(fd, 0, SEEK_SET), 0);
+	path_directory(copy, strlen(copy));
+	db_delta_new(&delta);
+	assert_int_equal(stream_read(fd, 1, &generation, stream_apply, &delta), 0);
+	assert_int_equal(generation, 1);
+	assert_int_equal(db_delta_persist(&delta), 0);
+	db_delta_delete(&delta);
+	path_directory(0, 0);
+	close(fd);
+
+	assert_int_equal(db_open_directory(&old, copy), 0);
+	assert_int_equal(db_open_directory(&new, current), 0);
+	assert_int_equal(db_diff(&old, &new, stream_count, &changes), 0);
+	assert_int_equal(changes, 0);
+	db_close(&new);
+	db_close(&old);
+
+	stream_remove(directory, (const char *const []){"base", "current", "copy"}, 3);
+}
+
+static void test_stream_invalid(void **state)
+{
+	static const struct stream_file files_base[] = {{"/data/a", 1}};
+	static const struct stream_file files_current[] = {{"/data/a", 1}, {"/data/b", 2}};
+	char directory[] = "/tmp/check.XXXXXX";
+	char base[sizeof(directory) + 8], current[sizeof(directory) + 8];
+	size_t changes = 0;
+	uint64_t generation;
+	struct stat info;
+	unsigned char byte, header[8];
+	int fd;
+
+	assert_non_null(mkdtemp(directory));
+	sprintf(base, "%s/base", directory);
+	sprintf(current, "%s/current", directory);
+
+	stream_database(base, files_base, sizeof(files_base) / sizeof(*files_base));
+	stream_database(current, files_current, sizeof(files_current) / sizeof(*files_current));
+
+	fd = stream_changes(base, current);
+	assert_int_equal(fstat(fd, &info), 0);
+
+	assert_int_equal(lseek(fd, 0, SEEK_SET), 0);
+	assert_int_equal(stream_read(fd, 1, &generation, stream_count, &changes), 0);
+	assert_int_equal(changes, 1);
+
+	// The generations are little-endian.
+	assert_int_equal(pread(fd, header, sizeof(header), sizeof(STREAM_MAGIC) - 1), sizeof(header));
+	assert_memory_equal(header, "\x01\x00\x00\x00\x00\x00\x00\x00", sizeof(header));
+
+	// Changes computed from another generation are rejected before any of them is read.
+	changes = 0;
+	assert_int_equal(lseek(fd, 0, SEEK_SET), 0);
+	assert_int_equal(stream_read(fd, 2, &generation, stream_count, &changes), ERROR_MISSING);
+	assert_int_equal(changes, 0);
+
+	// Change the digest at the end of the stream.
+	assert_int_equal(pread(fd, &byte, 1, info.st_size - 1), 1);
+	byte ^= 0x1;
+	assert_int_equal(pwrite(fd, &byte, 1, info.st_size - 1), 1);
+	assert_int_equal(lseek(fd, 0, SEEK_SET), 0);
+	assert_int_equal(stream_read(fd, 1, &generation, stream_count, &changes), ERROR_INPUT);
+
+	// Change a byte of the path.
+	byte ^= 0x1;
+	assert_int_equal(pwrite(fd, &byte, 1, info.st_size - 1), 1);
+	assert_int_equal(pread(fd, &byte, 1, info.st_size - 1 - 8 - 8 - 1 - 1), 1);
+	byte ^= 0x1;
+	assert_int_equal(pwrite(fd, &byte, 1, info.st_size - 1 - 8 - 8 - 1 - 1), 1);
+	assert_int_equal(lseek(fd, 0, SEEK_SET), 0);
+	assert_int_equal(stream_read(fd, 1, &generation, stream_count, &changes), ERROR_INPUT);
+
+	// Remove the end of the stream.
+	assert_int_equal(ftruncate(fd, info.st_size - 4), 0);
+	assert_int_equal(lseek(fd, 0, SEEK_SET), 0);
+	assert_int_equal(stream_read(fd, 1, &generation, stream_count, &changes), ERROR_INPUT);
+
+	close(fd);
+	stream_remove(directory, (const char *const []){"base", "current"}, 2);
+}
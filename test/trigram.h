@@ -0,0 +1,132 @@
+/*
+ * Filement Index
+ * Copyright (C) 2018  Martin Kunev <martinkunev@gmail.com>
+ *
+ * This file is part of Filement Index.
+ *
+ * Filement Index is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ *
+ * Filement Index is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Filement Index.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRIGRAM_PATHS 2000
+#define TRIGRAM_LENGTH 24
+
+// Generates paths from a small alphabet so that the trigrams are shared by many paths.
+static void trigram_paths(unsigned char paths[][TRIGRAM_LENGTH], size_t *restrict lengths, size_t count, uint64_t *restrict random)
+{
+	static const unsigned char alphabet[] = "abcde/.";
+	size_t i, j;
+
+	for(i = 0; i < count; ++i)
+	{
+		lengths[i] = random64(random) % TRIGRAM_LENGTH; // some paths are too short to have trigrams
+		for(j = 0; j < lengths[i]; ++j)
+			paths[i][j] = alphabet[random64(random) % (sizeof(alphabet) - 1)];
+	}
+}
+
+static int trigram_contains(const unsigned char *restrict path, size_t length, uint32_t trigram)
+{
+	size_t i;
+	for(i = 0; i + 2 < length; ++i)
+		if (TRIGRAM(path[i], path[i + 1], path[i + 2]) == trigram)
+			return 1;
+	return 0;
+}
+
+static void test_trigram_search(void **state)
+{
+	static unsigned char paths[TRIGRAM_PATHS][TRIGRAM_LENGTH];
+	size_t lengths[TRIGRAM_PATHS];
+	struct trigrams trigrams = {0};
+	struct trigram_entry *entries;
+	unsigned char *postings;
+	size_t entries_count, postings_size;
+	struct trigram_index index;
+	uint64_t random = 0x853c49e6748fea9bULL;
+	size_t query, i, j;
+
+	trigram_paths(paths, lengths, TRIGRAM_PATHS, &random);
+	for(i = 0; i < TRIGRAM_PATHS; ++i)
+		trigrams_add(&trigrams, paths[i], lengths[i], i);
+	assert_int_equal(trigrams_build(&trigrams, &entries, &entries_count, &postings, &postings_size), 0);
+	index.count = entries_count;
+	index.entries = entries;
+	index.postings = postings;
+
+	for(query = 0; query < 200; ++query)
+	{
+		uint32_t search[4];
+		size_t count = 0;
+		uint64_t *records;
+		ssize_t found;
+		size_t expected = 0;
+
+		// Take the trigrams from a substring of one of the paths or make them up (the latter usually match nothing).
+		while (count < 1 + query % 4)
+		{
+			uint32_t trigram;
+			i = random64(&random) % TRIGRAM_PATHS;
+			if (lengths[i] < 3)
+				continue;
+			j = random64(&random) % (lengths[i] - 2);
+			trigram = ((query % 8) ? TRIGRAM(paths[i][j], paths[i][j + 1], paths[i][j + 2]) : TRIGRAM('a', 'x', paths[i][j]));
+			for(j = 0; j < count; ++j)
+				if (search[j] == trigram)
+					break;
+			if (j == count)
+				search[count++] = trigram;
+		}
+
+		found = trigram_search(&index, search, count, &records);
+		assert_true(found >= 0);
+		for(i = 0; i < TRIGRAM_PATHS; ++i)
+		{
+			for(j = 0; j < count; ++j)
+				if (!trigram_contains(paths[i], lengths[i], search[j]))
+					break;
+			if (j < count)
+				continue;
+			assert_true(expected < (size_t)found);
+			assert_int_equal(records[expected], i);
+			expected += 1;
+		}
+		assert_int_equal(found, expected);
+		free(records);
+
+		// Records with at least two of the trigrams.
+		found = trigram_count(&index, search, count, 2, &records);
+		assert_true(found >= 0);
+		expected = 0;
+		for(i = 0; i < TRIGRAM_PATHS; ++i)
+		{
+			size_t matches = 0;
+			for(j = 0; j < count; ++j)
+				matches += trigram_contains(paths[i], lengths[i], search[j]);
+			if (matches < 2)
+				continue;
+			assert_true(expected < (size_t)found);
+			assert_int_equal(records[expected], i);
+			expected += 1;
+		}
+		assert_int_equal(found, expected);
+		free(records);
+	}
+
+	free(postings);
+	free(entries);
+	trigrams_term(&trigrams);
+}